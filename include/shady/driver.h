@@ -13,9 +13,12 @@ typedef enum {
     InputFileIOError,
     MissingDumpCfgArg,
     MissingDumpIrArg,
+    MissingProfileArg,
+    MissingCacheArg,
     IncorrectLogLevel = 16,
     InvalidTarget,
     ClangInvocationFailed,
+    InvalidBinaryModule,
 } ShadyErrorCodes;
 
 typedef enum {
@@ -23,6 +26,8 @@ typedef enum {
     SrcSlim,
     SrcSPIRV,
     SrcLLVM,
+    /// Modules written by serialize_module
+    SrcShadyBinary,
 } SourceLanguage;
 
 SourceLanguage guess_source_language(const char* filename);
@@ -35,10 +40,36 @@ typedef enum {
     TgtSPV,
     TgtGLSL,
     TgtISPC,
+    /// Writes out the module as it was loaded, without running any passes, so it can stand in for its sources later
+    TgtShadyBinary,
 } CodegenTarget;
 
 CodegenTarget guess_target(const char* filename);
 
+/// Everything that goes into a compilation, hashed to name its results in a CompileCache
+typedef struct CompileCacheKey_ CompileCacheKey;
+
+CompileCacheKey* new_compile_cache_key();
+void destroy_compile_cache_key(CompileCacheKey*);
+/// Source files and other inputs, a key without any is never looked up
+void compile_cache_key_add_input(CompileCacheKey*, size_t, const char*);
+void compile_cache_key_add_compiler_config(CompileCacheKey*, const CompilerConfig*);
+void compile_cache_key_add_arena_config(CompileCacheKey*, const ArenaConfig*);
+void compile_cache_key_add_c_emitter_config(CompileCacheKey*, const CEmitterConfig*);
+/// Whether both keys were built from the same things, and would name the same results
+bool compile_cache_keys_equal(const CompileCacheKey*, const CompileCacheKey*);
+
+/// A directory holding compilation results, named after their key: results are written atomically so several compilers
+/// can share a directory, and the least recently used ones are deleted once it grows bigger than 'max_size' bytes.
+typedef struct CompileCache_ CompileCache;
+
+CompileCache* open_compile_cache(const char* directory, size_t max_size);
+/// Logs how many lookups were hits and misses
+void close_compile_cache(CompileCache*);
+/// 'kind' tells apart the different results of a compilation (for instance "spv" and "shd"), the data is to be freed by the caller
+bool compile_cache_lookup(CompileCache*, const CompileCacheKey*, const char* kind, size_t* size, char** data);
+void compile_cache_store(CompileCache*, const CompileCacheKey*, const char* kind, size_t size, const char* data);
+
 void cli_pack_remaining_args(int* pargc, char** argv);
 
 // parses 'common' arguments such as log level etc
@@ -57,6 +88,12 @@ typedef struct {
     const char* shd_output_filename;
     const char* cfg_output_filename;
     const char* loop_tree_output_filename;
+    const char* profile_output_filename;
+    /// Where to cache compilation results, defaults to $SHADY_CACHE_DIR, caching is off when that isn't set either
+    const char* cache_dir;
+    size_t cache_max_size;
+    /// Hashes the source files as they get loaded
+    CompileCacheKey* cache_key;
 } DriverConfig;
 
 DriverConfig default_driver_config();
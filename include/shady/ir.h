@@ -38,6 +38,29 @@ Nodes prepend_nodes(IrArena*, Nodes, const Node*);
 Nodes concat_nodes(IrArena*, Nodes, Nodes);
 Nodes change_node_at_index(IrArena*, Nodes, size_t, const Node*);
 
+#define NODES_BUILDER_INLINE_CAPACITY 16
+
+/// Builds a list one element at a time: only the final list gets interned, not every intermediate prefix.
+/// Small lists stay in the builder itself (so keep it on the stack), larger ones spill to the heap.
+typedef struct {
+    IrArena* arena;
+    size_t count;
+    size_t capacity;
+    const Node** heap;
+    const Node* inline_storage[NODES_BUILDER_INLINE_CAPACITY];
+} NodesBuilder;
+
+NodesBuilder begin_nodes(IrArena*);
+void reserve_nodes(NodesBuilder*, size_t additional);
+void push_node(NodesBuilder*, const Node*);
+void extend_nodes(NodesBuilder*, Nodes);
+/// Interns the contents and releases the builder
+Nodes finish_nodes(NodesBuilder*);
+/// Non-interned view of the contents, for lists that never end up in a node. Only valid until the builder is modified or released
+Nodes peek_nodes(const NodesBuilder*);
+/// Releases the builder without interning anything
+void discard_nodes(NodesBuilder*);
+
 String string_sized(IrArena*, size_t size, const char* start);
 String string(IrArena*, const char*);
 // see also: format_string in util.h
@@ -53,7 +76,10 @@ Module* new_module(IrArena*, String name);
 
 IrArena* get_module_arena(const Module*);
 String get_module_name(const Module*);
+/// Interns a snapshot of the declarations, prefer module_decls_iter when you only need to go over them
 Nodes get_module_declarations(const Module*);
+/// Walks the declarations in place, declarations added during the iteration are visited as well
+bool module_decls_iter(const Module*, size_t* i, const Node** decl);
 const Node* get_declaration(const Module*, String);
 
 //////////////////////////////// Grammar ////////////////////////////////
@@ -102,6 +128,7 @@ typedef struct {
 } ArenaConfig;
 
 typedef struct CompilerConfig_ CompilerConfig;
+typedef struct AnalysisManager_ AnalysisManager;
 ArenaConfig default_arena_config();
 
 IrArena* new_ir_arena(ArenaConfig);
@@ -253,6 +280,14 @@ const Node* bind_last_instruction_and_wrap_in_block(BodyBuilder*, const Node*);
 
 //////////////////////////////// Compilation ////////////////////////////////
 
+/// Records how long each pass takes, and how many nodes, strings and bytes it costs, see CompilerConfig.profiling
+typedef struct PassProfiler_ PassProfiler;
+
+PassProfiler* new_pass_profiler();
+void destroy_pass_profiler(PassProfiler*);
+/// Writes a JSON summary of every pass run so far, which also loads as a trace in chrome://tracing or ui.perfetto.dev
+void dump_pass_profile(FILE* output, const PassProfiler*);
+
 struct CompilerConfig_ {
     bool dynamic_scheduling;
     uint32_t per_thread_stack_size;
@@ -281,6 +316,12 @@ struct CompilerConfig_ {
             bool after_every_pass;
             bool delete_unused_instructions;
         } cleanup;
+        struct {
+            /// Folds duplicate types and constants, removes unused ones and renumbers ids in the final module
+            bool compact;
+            /// Removes OpName, OpLine and friends
+            bool strip_debug_info;
+        } spirv;
     } optimisations;
 
     struct {
@@ -303,20 +344,49 @@ struct CompilerConfig_ {
         String entry_point;
         ExecutionModel execution_model;
         uint32_t subgroup_size;
+        /// Leaves the subgroup and workgroup sizes to specialization constants (see ShdSpecId) instead of baking them in.
+        /// subgroup_size is then only an upper bound, arrays are sized for any subgroup size in [min_subgroup_size; subgroup_size]
+        bool spec_constants;
+        uint32_t min_subgroup_size;
     } specialization;
 
     struct {
         struct { void* uptr; void (*fn)(void*, String, Module*); } after_pass;
     } hooks;
+
+    struct {
+        /// Optional, not owned
+        PassProfiler* profiler;
+    } profiling;
+
+    struct {
+        /// Caches analyses between passes, run_compiler_passes and emit_spirv set one up for as long as they run
+        AnalysisManager* manager;
+    } analyses;
 };
 
 CompilerConfig default_compiler_config();
 
+/// The SpecIds of the specialization constants emitted when CompilerConfig.specialization.spec_constants is set
+typedef enum {
+    /// The default value is the one from @WorkgroupSize, code that reads the workgroup size assumes that one
+    ShdSpecIdWorkgroupSizeX,
+    ShdSpecIdWorkgroupSizeY,
+    ShdSpecIdWorkgroupSizeZ,
+    ShdSpecIdSubgroupSize,
+} ShdSpecId;
+
 typedef enum CompilationResult_ {
     CompilationNoError
 } CompilationResult;
 
+/// Runs the whole pipeline, this is run_generic_compiler_passes followed by run_specialized_compiler_passes
 CompilationResult run_compiler_passes(CompilerConfig* config, Module** mod);
+/// The passes that don't depend on the target or the entry point: their output can be kept as a checkpoint and shared by several specializations
+/// The checkpoint lives in a new arena owned by the caller, the input module only gets the scheduler and the internal constants added to it
+CompilationResult run_generic_compiler_passes(CompilerConfig* config, Module** mod);
+/// Lowers a checkpoint from run_generic_compiler_passes for config.specialization and the target, the checkpoint stays valid and can be specialized again
+CompilationResult run_specialized_compiler_passes(CompilerConfig* config, Module** mod);
 
 //////////////////////////////// Emission ////////////////////////////////
 
@@ -340,6 +410,12 @@ void dump_cfg(FILE* file, Module*);
 void dump_loop_trees(FILE* output, Module* mod);
 void dump_module(Module*);
 void print_module_into_str(Module*, char** str_ptr, size_t*);
+
+/// Compact binary form of a module (the '.shdb' files), that loads without any parsing. The output is to be freed by the caller.
+void serialize_module(Module*, size_t* size, char** output);
+/// Adds the declarations of a serialized module to 'mod'. 'data' needs to be aligned on 4 bytes, and does not need to
+/// outlive the call. Fails if the data is corrupted, or was written by an incompatible version of shady.
+bool deserialize_module(Module* mod, size_t size, const char* data);
 void dump_node(const Node* node);
 
 #endif
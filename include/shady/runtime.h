@@ -9,13 +9,17 @@ typedef struct {
     bool use_validation;
     bool dump_spv;
     bool allow_no_devices;
+    /// Threads used by prepare_program, 0 picks one less than the number of processors
+    size_t compiler_threads;
 } RuntimeConfig;
 
 typedef struct Runtime_  Runtime;
 typedef struct Device_   Device;
 typedef struct Program_  Program;
 typedef struct Command_ Command;
+typedef struct CommandStream_ CommandStream;
 typedef struct Buffer_   Buffer;
+typedef struct ProgramFuture_ ProgramFuture;
 
 Runtime* initialize_runtime(RuntimeConfig config);
 void shutdown_runtime(Runtime*);
@@ -32,18 +36,59 @@ Program* new_program_from_module(Runtime*, const CompilerConfig*, Module*);
 Program* load_program(Runtime*, const CompilerConfig*, const char* program_src);
 Program* load_program_from_disk(Runtime*, const CompilerConfig*, const char* path);
 
+/// Compiles the given entry points for a device in the background, so that their first launch does not have to.
+/// A launch of an entry point that is still being compiled waits for that compilation rather than starting another.
+ProgramFuture* prepare_program(Program*, Device*, size_t entry_points_count, const char** entry_points);
+/// Never blocks
+bool is_program_ready(Program*, Device*, const char* entry_point);
+/// Blocks until every entry point of the future is compiled and frees it, returns false if any of them failed to compile
+bool wait_program_future(ProgramFuture*);
+
 Command* launch_kernel(Program*, Device*, const char* entry_point, int dimx, int dimy, int dimz, int args_count, void** args);
+/// Frees the command
 bool wait_completion(Command*);
+/// Never blocks, the command still has to be waited on to be freed
+bool is_command_complete(Command*);
+
+/// Commands appended to a stream are submitted together, with barriers only where a command depends on an earlier one.
+/// Kernels can access any buffer through device pointers, so dispatches are ordered after everything that came before them.
+CommandStream* begin_command_stream(Device*);
+bool command_stream_dispatch(CommandStream*, Program*, const char* entry_point, int dimx, int dimy, int dimz, int args_count, void** args);
+bool command_stream_copy(CommandStream*, Buffer* src, size_t src_offset, Buffer* dst, size_t dst_offset, size_t size);
+/// 'offset' and 'size' must be multiples of 4
+bool command_stream_fill(CommandStream*, Buffer* dst, size_t offset, size_t size, uint32_t value);
+/// Orders everything appended so far before everything appended afterwards, on top of the automatic barriers
+void command_stream_barrier(CommandStream*);
+/// Frees the stream, returns NULL if any of its commands failed to be appended
+Command* submit_command_stream(CommandStream*);
 
 Buffer* allocate_buffer_device(Device*, size_t);
 bool can_import_host_memory(Device*);
 Buffer* import_buffer_host(Device*, void*, size_t);
 void destroy_buffer(Buffer*);
 
+typedef struct {
+    /// Bytes in live device buffers, alignment included
+    size_t live_bytes;
+    /// Bytes obtained from the driver
+    size_t reserved_bytes;
+    size_t blocks_count;
+    /// 0 when the free space in the blocks is in one piece, close to 1 when it is scattered in small holes
+    double fragmentation;
+} DeviceMemoryStats;
+
+DeviceMemoryStats get_device_memory_stats(Device*);
+
 void* get_buffer_host_pointer(Buffer* buf);
 uint64_t get_buffer_device_pointer(Buffer* buf);
 
 bool copy_to_buffer(Buffer* dst, size_t buffer_offset, void* src, size_t size);
 bool copy_from_buffer(Buffer* src, size_t buffer_offset, void* dst, size_t size);
 
+/// Transfers are batched: they are submitted together with the next launch, or when one of them is waited on.
+/// 'src' is staged before this returns, so it can be reused right away.
+Command* copy_to_buffer_async(Buffer* dst, size_t buffer_offset, void* src, size_t size);
+/// 'dst' is written by the time the command is waited on, it must stay valid until then
+Command* copy_from_buffer_async(Buffer* src, size_t buffer_offset, void* dst, size_t size);
+
 #endif
@@ -69,7 +69,7 @@ int main(int argc, char **argv)
 
     IrArena* a = new_ir_arena(default_arena_config());
     Module* m = new_module(a, "checkerboard");
-    driver_load_source_file(SrcSlim, sizeof(checkerboard_kernel_src), checkerboard_kernel_src, m);
+    driver_load_source_file(SrcSlim, sizeof(checkerboard_kernel_src) - 1, checkerboard_kernel_src, m);
     Program* program = new_program_from_module(runtime, &compiler_config, m);
 
     wait_completion(launch_kernel(program, device, "main", 16, 16, 1, 1, (void*[]) { &buf_addr }));
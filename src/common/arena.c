@@ -2,16 +2,40 @@
 #include "portability.h"
 
 #include <stdlib.h>
+#include <stdbool.h>
 #include <assert.h>
 #include <string.h>
 
-#define alloc_size 1024 * 1024
+#define KiB * 1024
+#define MiB * 1024 KiB
+
+/// Blocks start small since lots of arenas are short-lived (scopes, uses maps...) and double up to a cap
+#define initial_block_size (16 KiB)
+#define max_block_size (16 MiB)
+/// Anything larger gets its own allocation rather than forcing a block switch that would waste the tail of the current one
+#define oversized_threshold (max_block_size / 4)
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t used;
+} Block;
+
+typedef struct {
+    void* data;
+    size_t size;
+} OversizedAlloc;
 
 typedef struct Arena_ {
-    int nblocks;
-    int maxblocks;
-    void** blocks;
-    size_t available;
+    size_t nblocks;
+    size_t maxblocks;
+    Block* blocks;
+    /// Blocks past the current one are spare: they are kept around after a rewind for reuse
+    size_t current;
+
+    size_t noversized;
+    size_t maxoversized;
+    OversizedAlloc* oversized;
 } Arena;
 
 inline static size_t round_up(size_t a, size_t b) {
@@ -19,49 +43,158 @@ inline static size_t round_up(size_t a, size_t b) {
     return divided * b;
 }
 
+/// Allocations are assumed to be a multiple of their alignment, as sizeof(T) is of alignof(T): the lowest set bit of the size is then enough alignment for it.
+/// Callers allocating truncated structs must round the size up themselves.
+inline static size_t natural_alignment(size_t size) {
+    size_t alignment = size & (~size + 1);
+    if (alignment > _Alignof(max_align_t))
+        return _Alignof(max_align_t);
+    return alignment;
+}
+
 Arena* new_arena() {
     Arena* arena = malloc(sizeof(Arena));
     *arena = (Arena) {
         .nblocks = 0,
-        .maxblocks = 256,
-        .blocks = malloc(256 * sizeof(size_t)),
-        .available = 0,
+        .maxblocks = 16,
+        .blocks = malloc(16 * sizeof(Block)),
+        .current = 0,
+        .noversized = 0,
+        .maxoversized = 0,
+        .oversized = NULL,
     };
-    for (int i = 0; i < arena->maxblocks; i++)
-        arena->blocks[i] = NULL;
     return arena;
 }
 
 void destroy_arena(Arena* arena) {
-    for (int i = 0; i < arena->nblocks; i++) {
-        free(arena->blocks[i]);
+    for (size_t i = 0; i < arena->nblocks; i++) {
+        free(arena->blocks[i].data);
+    }
+    for (size_t i = 0; i < arena->noversized; i++) {
+        free(arena->oversized[i].data);
     }
     free(arena->blocks);
+    free(arena->oversized);
     free(arena);
 }
 
-void* arena_alloc(Arena* arena, size_t size) {
-    size = round_up(size, (size_t) sizeof(max_align_t));
-    if (size == 0)
-        return NULL;
-    // arena is full
-    if (size > arena->available) {
-        assert(arena->nblocks <= arena->maxblocks);
-        // we need more storage for the block pointers themselves !
-        if (arena->nblocks == arena->maxblocks) {
-            arena->maxblocks *= 2;
-            arena->blocks = realloc(arena->blocks, arena->maxblocks);
+static void* alloc_oversized(Arena* arena, size_t size) {
+    if (arena->noversized == arena->maxoversized) {
+        arena->maxoversized = arena->maxoversized ? arena->maxoversized * 2 : 8;
+        arena->oversized = realloc(arena->oversized, arena->maxoversized * sizeof(OversizedAlloc));
+    }
+    void* data = malloc(size);
+    arena->oversized[arena->noversized++] = (OversizedAlloc) { .data = data, .size = size };
+    return data;
+}
+
+/// Moves on to a block that can hold at least 'size' bytes, reusing spare blocks when they are big enough
+static Block* next_block(Arena* arena, size_t size) {
+    size_t block_size = initial_block_size;
+    if (arena->nblocks > 0) {
+        Block* spare = arena->current + 1 < arena->nblocks ? &arena->blocks[arena->current + 1] : NULL;
+        if (spare && spare->size >= size) {
+            arena->current++;
+            assert(spare->used == 0);
+            return spare;
         }
+        // spare blocks too small for this: drop them all, they would get in the way
+        for (size_t i = arena->current + 1; i < arena->nblocks; i++)
+            free(arena->blocks[i].data);
+        arena->nblocks = arena->current + 1;
+        block_size = arena->blocks[arena->current].size * 2;
+        if (block_size > max_block_size)
+            block_size = max_block_size;
+    }
+    while (block_size < size)
+        block_size *= 2;
 
-        arena->blocks[arena->nblocks++] = malloc(alloc_size);
-        arena->available = alloc_size;
+    if (arena->nblocks == arena->maxblocks) {
+        arena->maxblocks *= 2;
+        arena->blocks = realloc(arena->blocks, arena->maxblocks * sizeof(Block));
     }
+    Block* block = &arena->blocks[arena->nblocks];
+    *block = (Block) {
+        .data = malloc(block_size),
+        .size = block_size,
+        .used = 0,
+    };
+    arena->current = arena->nblocks++;
+    return block;
+}
+
+static void* arena_alloc_impl(Arena* arena, size_t size, bool zero) {
+    if (size == 0)
+        return NULL;
 
-    assert(size <= arena->available);
+    void* allocated;
+    if (size > oversized_threshold) {
+        allocated = alloc_oversized(arena, size);
+    } else {
+        size_t alignment = natural_alignment(size);
+        Block* block = arena->nblocks > 0 ? &arena->blocks[arena->current] : NULL;
+        size_t offset = block ? round_up(block->used, alignment) : 0;
+        // arena is full
+        if (!block || offset + size > block->size) {
+            block = next_block(arena, size);
+            offset = 0;
+        }
+        assert(offset + size <= block->size);
+        allocated = block->data + offset;
+        block->used = offset + size;
+    }
 
-    size_t in_block = alloc_size - arena->available;
-    void* allocated = (void*) ((size_t) arena->blocks[arena->nblocks - 1] + in_block);
-    memset(allocated, 0, size);
-    arena->available -= size;
+    if (zero)
+        memset(allocated, 0, size);
     return allocated;
 }
+
+void* arena_alloc(Arena* arena, size_t size) {
+    return arena_alloc_impl(arena, size, true);
+}
+
+void* arena_alloc_uninitialized(Arena* arena, size_t size) {
+    return arena_alloc_impl(arena, size, false);
+}
+
+ArenaMark arena_mark(Arena* arena) {
+    return (ArenaMark) {
+        .block = arena->current,
+        .used = arena->nblocks > 0 ? arena->blocks[arena->current].used : 0,
+        .oversized = arena->noversized,
+    };
+}
+
+void arena_rewind(Arena* arena, ArenaMark mark) {
+    assert(mark.oversized <= arena->noversized);
+    for (size_t i = mark.oversized; i < arena->noversized; i++)
+        free(arena->oversized[i].data);
+    arena->noversized = mark.oversized;
+
+    if (arena->nblocks == 0)
+        return;
+    assert(mark.block <= arena->current);
+    for (size_t i = mark.block + 1; i <= arena->current; i++)
+        arena->blocks[i].used = 0;
+    arena->current = mark.block;
+    assert(mark.used <= arena->blocks[mark.block].used);
+    arena->blocks[mark.block].used = mark.used;
+}
+
+ArenaStats get_arena_stats(Arena* arena) {
+    ArenaStats stats = { 0 };
+    for (size_t i = 0; i < arena->nblocks; i++) {
+        Block* block = &arena->blocks[i];
+        stats.used += block->used;
+        stats.reserved += block->size;
+        if (i < arena->current)
+            stats.wasted += block->size - block->used;
+    }
+    stats.blocks = arena->nblocks;
+    for (size_t i = 0; i < arena->noversized; i++) {
+        stats.used += arena->oversized[i].size;
+        stats.reserved += arena->oversized[i].size;
+    }
+    stats.oversized_allocations = arena->noversized;
+    return stats;
+}
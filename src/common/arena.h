@@ -7,6 +7,34 @@ typedef struct Arena_ Arena;
 
 Arena* new_arena();
 void destroy_arena(Arena* arena);
+
+/// Returns zeroed memory, aligned for anything that fits in 'size' bytes
 void* arena_alloc(Arena* arena, size_t size);
+/// Same as arena_alloc but leaves the memory as-is, for callers that overwrite it immediately
+void* arena_alloc_uninitialized(Arena* arena, size_t size);
+
+/// Opaque checkpoint, everything allocated after it can be released at once with arena_rewind
+typedef struct {
+    size_t block;
+    size_t used;
+    size_t oversized;
+} ArenaMark;
+
+ArenaMark arena_mark(Arena* arena);
+/// Releases all allocations made since 'mark' was taken, marks must be rewound in LIFO order
+void arena_rewind(Arena* arena, ArenaMark mark);
+
+typedef struct {
+    /// Bytes handed out, alignment padding included
+    size_t used;
+    /// Bytes left over at the end of blocks we moved past
+    size_t wasted;
+    /// Bytes obtained from malloc
+    size_t reserved;
+    size_t blocks;
+    size_t oversized_allocations;
+} ArenaStats;
+
+ArenaStats get_arena_stats(Arena* arena);
 
 #endif
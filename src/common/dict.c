@@ -1,10 +1,23 @@
 #include "dict.h"
+#include "portability.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DICT_USE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define DICT_USE_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 inline static size_t div_roundup(size_t a, size_t b) {
     //return (a + b - 1) / b;
     if (a % b == 0)
@@ -22,128 +35,196 @@ inline static size_t maxof(size_t a, size_t b) {
     return a > b ? a : b;
 }
 
+/// Must be a power of two, and at least as big as a group
 static size_t init_size = 32;
 
-struct BucketTag {
-    bool is_present;
-    bool is_thombstone;
-};
+/// The control bytes are probed this many at a time
+#define GROUP_WIDTH 16
+
+/// A slot is either empty (high bit set) or holds the top 7 bits of the hash of the key in it (high bit clear)
+typedef uint8_t CtrlByte;
+static const CtrlByte ctrl_empty = 0x80;
+
+/// One bit per slot in a group, bit i set means slot i matched
+typedef uint32_t GroupMask;
 
 struct Dict {
     size_t entries_count;
-    size_t thombstones_count;
+    /// Always a power of two
     size_t size;
 
     size_t key_size;
     size_t value_size;
 
     size_t value_offset;
-    size_t tag_offset;
     size_t bucket_entry_size;
 
     KeyHash (*hash_fn) (void*);
     bool (*cmp_fn) (void*, void*);
+    /// size + GROUP_WIDTH control bytes, the first GROUP_WIDTH ones are mirrored at the end so groups can wrap around
+    CtrlByte* ctrl;
     void* alloc;
 };
 
+/// Spreads the user-provided hash so both the slot index (low bits) and the control byte (high bits) are well-distributed.
+/// Some hash functions (ie pointers) have poor entropy in the low bits.
+inline static uint32_t mix_hash(KeyHash hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+inline static CtrlByte hash_to_ctrl(uint32_t mixed) {
+    return (CtrlByte) (mixed >> 25);
+}
+
+inline static unsigned lowest_bit(GroupMask mask) {
+    assert(mask != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned) index;
+#else
+    return (unsigned) __builtin_ctz(mask);
+#endif
+}
+
+#if defined(DICT_USE_SSE2)
+inline static GroupMask group_match(const CtrlByte* group, CtrlByte c) {
+    __m128i g = _mm_loadu_si128((const __m128i*) group);
+    return (GroupMask) _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char) c)));
+}
+#elif defined(DICT_USE_NEON)
+inline static GroupMask group_match(const CtrlByte* group, CtrlByte c) {
+    static const uint8_t bit_weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t eq = vceqq_u8(vld1q_u8(group), vdupq_n_u8(c));
+    uint8x16_t bits = vandq_u8(eq, vld1q_u8(bit_weights));
+    return (GroupMask) vaddv_u8(vget_low_u8(bits)) | ((GroupMask) vaddv_u8(vget_high_u8(bits)) << 8);
+}
+#else
+inline static GroupMask group_match(const CtrlByte* group, CtrlByte c) {
+    GroupMask mask = 0;
+    for (unsigned i = 0; i < GROUP_WIDTH; i++)
+        mask |= (GroupMask) (group[i] == c) << i;
+    return mask;
+}
+#endif
+
+inline static void* get_bucket(const struct Dict* dict, size_t pos) {
+    return (void*) ((size_t) dict->alloc + pos * dict->bucket_entry_size);
+}
+
+inline static void set_ctrl(struct Dict* dict, size_t pos, CtrlByte c) {
+    dict->ctrl[pos] = c;
+    // keep the mirrored bytes in sync
+    if (pos < GROUP_WIDTH)
+        dict->ctrl[dict->size + pos] = c;
+}
+
+static void alloc_storage(struct Dict* dict) {
+    assert(dict->size >= GROUP_WIDTH && (dict->size & (dict->size - 1)) == 0);
+    dict->alloc = malloc(dict->bucket_entry_size * dict->size);
+    dict->ctrl = malloc(dict->size + GROUP_WIDTH);
+    memset(dict->ctrl, ctrl_empty, dict->size + GROUP_WIDTH);
+}
+
 struct Dict* new_dict_impl(size_t key_size, size_t value_size, size_t key_align, size_t value_align, KeyHash (*hash_fn)(void*), bool (*cmp_fn) (void*, void*)) {
     // offset of key is obviously zero
     size_t value_offset = align_offset(key_size, value_align);
-    size_t tag_offset = align_offset(value_offset + value_size, alignof(struct BucketTag));
-
-    size_t bucket_entry_size = tag_offset + sizeof(struct BucketTag);
+    size_t bucket_entry_size = value_offset + value_size;
 
     // Add extra padding at the end of each entry if required...
-    size_t max_align = maxof(maxof(key_align, value_align), alignof(struct BucketTag));
+    size_t max_align = maxof(key_align, value_align);
     bucket_entry_size = align_offset(bucket_entry_size, max_align);
 
     struct Dict* dict = (struct Dict*) malloc(sizeof(struct Dict));
     *dict = (struct Dict) {
         .entries_count = 0,
-        .thombstones_count = 0,
         .size = init_size,
 
         .key_size = key_size,
         .value_size = value_size,
 
         .value_offset = value_offset,
-        .tag_offset = tag_offset,
         .bucket_entry_size = bucket_entry_size,
 
         .hash_fn = hash_fn,
         .cmp_fn = cmp_fn,
-
-        .alloc = malloc(bucket_entry_size * init_size)
     };
-    // zero-init
-    memset(dict->alloc, 0, bucket_entry_size * init_size);
+    alloc_storage(dict);
     return dict;
 }
 
 struct Dict* clone_dict(struct Dict* source) {
     struct Dict* dict = (struct Dict*) malloc(sizeof(struct Dict));
-    *dict = (struct Dict) {
-        .entries_count = source->entries_count,
-        .thombstones_count = source->thombstones_count,
-        .size = source->size,
-
-        .key_size = source->key_size,
-        .value_size = source->value_size,
-
-        .value_offset = source->value_offset,
-        .tag_offset = source->tag_offset,
-        .bucket_entry_size = source->bucket_entry_size,
-
-        .hash_fn = source->hash_fn,
-        .cmp_fn = source->cmp_fn,
-
-        .alloc = malloc(source->bucket_entry_size * source->size)
-    };
+    *dict = *source;
+    alloc_storage(dict);
     memcpy(dict->alloc, source->alloc, source->bucket_entry_size * source->size);
+    memcpy(dict->ctrl, source->ctrl, source->size + GROUP_WIDTH);
     return dict;
 }
 
 void destroy_dict(struct Dict* dict) {
+    free(dict->ctrl);
     free(dict->alloc);
     free(dict);
 }
 
 void clear_dict(struct Dict* dict) {
     dict->entries_count = 0;
-    dict->thombstones_count = 0;
-    memset(dict->alloc, 0, dict->bucket_entry_size * dict->size);
+    memset(dict->ctrl, ctrl_empty, dict->size + GROUP_WIDTH);
+}
+
+static SHADY_THREAD_LOCAL DictStats stats = { 0 };
+
+DictStats get_dict_stats(void) {
+    return stats;
 }
 
 size_t entries_count_dict(struct Dict* dict) {
     return dict->entries_count;
 }
 
-void* find_key_dict_impl(struct Dict* dict, void* key) {
-    KeyHash hash = dict->hash_fn(key);
-    size_t pos = hash % dict->size;
-    const size_t init_pos = pos;
-    const size_t alloc_base = (size_t) dict->alloc;
+/// Linear probing, accelerated by looking at GROUP_WIDTH control bytes at once.
+/// Since there are no tombstones, a key can never be found past the first empty slot of its probe sequence.
+/// Returns the slot holding the key, or SIZE_MAX. If not found, the first empty slot is written to 'empty_pos'.
+static size_t find_slot(struct Dict* dict, void* key, uint32_t mixed, size_t* empty_pos) {
+    const size_t mask = dict->size - 1;
+    CtrlByte c = hash_to_ctrl(mixed);
+    size_t pos = mixed & mask;
+    stats.lookups++;
     while (true) {
-        size_t bucket = alloc_base + pos * dict->bucket_entry_size;
-
-        void* in_dict_key = (void*) bucket;
-        struct BucketTag* tag = (struct BucketTag*) (void*) (bucket + dict->tag_offset);
-        if (tag->is_present || tag->is_thombstone) {
-            // If the key is identical, we found our guy !
-            if (tag->is_present && dict->cmp_fn(in_dict_key, key))
-                return in_dict_key;
-
-            // Otherwise, do a crappy linear scan...
-            pos++;
-            if (pos == dict->size)
-                pos = 0;
-
-            // Make sure to die if we go full circle
-            if (pos == init_pos)
-                break;
-        } else break;
+        stats.probes++;
+        const CtrlByte* group = &dict->ctrl[pos];
+        GroupMask empties = group_match(group, ctrl_empty);
+        GroupMask matches = group_match(group, c);
+        // only consider matches before the first empty slot
+        if (empties)
+            matches &= ((GroupMask) 1 << lowest_bit(empties)) - 1;
+        while (matches) {
+            unsigned i = lowest_bit(matches);
+            size_t slot = (pos + i) & mask;
+            if (dict->cmp_fn(get_bucket(dict, slot), key))
+                return slot;
+            matches &= matches - 1;
+        }
+        if (empties) {
+            if (empty_pos)
+                *empty_pos = (pos + lowest_bit(empties)) & mask;
+            return SIZE_MAX;
+        }
+        pos = (pos + GROUP_WIDTH) & mask;
     }
-    return NULL;
+}
+
+void* find_key_dict_impl(struct Dict* dict, void* key) {
+    size_t slot = find_slot(dict, key, mix_hash(dict->hash_fn(key)), NULL);
+    if (slot == SIZE_MAX)
+        return NULL;
+    return get_bucket(dict, slot);
 }
 
 void* find_value_dict_impl(struct Dict* dict, void* key) {
@@ -154,17 +235,26 @@ void* find_value_dict_impl(struct Dict* dict, void* key) {
 }
 
 bool remove_dict_impl(struct Dict* dict, void* key) {
-    void* found = find_key_dict_impl(dict, key);
-    if (found) {
-        struct BucketTag* tag = (void *) (((size_t) found) + dict->tag_offset);
-        assert(tag->is_present && !tag->is_thombstone);
-        tag->is_present = false;
-        tag->is_thombstone = true;
-        dict->thombstones_count++;
-        dict->entries_count--;
-        return true;
+    size_t hole = find_slot(dict, key, mix_hash(dict->hash_fn(key)), NULL);
+    if (hole == SIZE_MAX)
+        return false;
+
+    // Backward-shift deletion: pull later entries of the same cluster into the hole when that doesn't move them before their home slot
+    const size_t mask = dict->size - 1;
+    for (size_t pos = (hole + 1) & mask; dict->ctrl[pos] != ctrl_empty; pos = (pos + 1) & mask) {
+        void* bucket = get_bucket(dict, pos);
+        size_t home = mix_hash(dict->hash_fn(bucket)) & mask;
+        size_t displacement = (pos - home) & mask;
+        size_t distance_to_hole = (pos - hole) & mask;
+        if (distance_to_hole <= displacement) {
+            memcpy(get_bucket(dict, hole), bucket, dict->bucket_entry_size);
+            set_ctrl(dict, hole, dict->ctrl[pos]);
+            hole = pos;
+        }
     }
-    return false;
+    set_ctrl(dict, hole, ctrl_empty);
+    dict->entries_count--;
+    return true;
 }
 
 bool insert_dict_impl(struct Dict* dict, void* key, void* value, void** out_ptr);
@@ -185,140 +275,92 @@ void* insert_dict_and_get_value_impl(struct Dict* dict, void* key, void* value)
     return (void*) ((size_t)do_care + dict->value_offset);
 }
 
-static void rehash(struct Dict* dict, void* old_alloc, size_t old_size) {
-    const size_t alloc_base = (size_t) old_alloc;
-    // Go over all the old entries and add them back
-    for(size_t pos = 0; pos < old_size; pos++) {
-        size_t bucket = alloc_base + pos * dict->bucket_entry_size;
-
-        struct BucketTag* tag = (struct BucketTag*) (void*) (bucket + dict->tag_offset);
-        if (tag->is_present) {
-            void* key = (void*) bucket;
-            void* value = (void*) (bucket + dict->value_offset);
-            insert_dict_and_get_result_impl(dict, key, value);
-        }
-    }
-}
-
-static void grow_and_rehash(struct Dict* dict) {
-    //printf("grow_rehash\n");
+static void rehash(struct Dict* dict, size_t new_size) {
+    stats.resizes++;
     size_t old_entries_count = entries_count_dict(dict);
 
     void* old_alloc = dict->alloc;
+    CtrlByte* old_ctrl = dict->ctrl;
     size_t old_size = dict->size;
 
-    dict->entries_count = 0;
-    dict->thombstones_count = 0;
-    dict->size *= 2;
-    dict->alloc = malloc(dict->size * dict->bucket_entry_size);
-    // zero-allocated so all the bucket flags are false
-    memset(dict->alloc, 0, dict->size * dict->bucket_entry_size);
-
-    rehash(dict, old_alloc, old_size);
+    dict->size = new_size;
+    alloc_storage(dict);
+
+    // Go over all the old entries and add them back, we know they're all distinct so no need to compare keys
+    const size_t mask = dict->size - 1;
+    for (size_t old_pos = 0; old_pos < old_size; old_pos++) {
+        if (old_ctrl[old_pos] == ctrl_empty)
+            continue;
+        void* bucket = (void*) ((size_t) old_alloc + old_pos * dict->bucket_entry_size);
+        size_t pos = mix_hash(dict->hash_fn(bucket)) & mask;
+        while (true) {
+            GroupMask empties = group_match(&dict->ctrl[pos], ctrl_empty);
+            if (empties) {
+                pos = (pos + lowest_bit(empties)) & mask;
+                break;
+            }
+            pos = (pos + GROUP_WIDTH) & mask;
+        }
+        memcpy(get_bucket(dict, pos), bucket, dict->bucket_entry_size);
+        set_ctrl(dict, pos, old_ctrl[old_pos]);
+    }
     assert(old_entries_count == entries_count_dict(dict));
 
+    free(old_ctrl);
     free(old_alloc);
 }
 
-bool insert_dict_impl(struct Dict* dict, void* key, void* value, void** out_ptr) {
-    float load_factor = (float) (dict->entries_count + dict->thombstones_count) / (float) dict->size;
-    if (load_factor > 0.6)
-        grow_and_rehash(dict);
-
-    KeyHash hash = dict->hash_fn(key);
-    size_t pos = hash % dict->size;
-    const size_t init_pos = pos;
-    const size_t alloc_base = (size_t) dict->alloc;
-
-    enum { Inserting, Overwriting, Moving } mode;
+static void grow_and_rehash(struct Dict* dict) {
+    rehash(dict, dict->size * 2);
+}
 
-    size_t first_available_pos = SIZE_MAX;
+void reserve_dict(struct Dict* dict, size_t entries) {
+    size_t size = dict->size;
+    while (entries * 4 > size * 3)
+        size *= 2;
+    if (size != dict->size)
+        rehash(dict, size);
+}
 
-    // Find an empty spot...
-    while (true) {
-        size_t bucket = alloc_base + pos * dict->bucket_entry_size;
-
-        struct BucketTag tag = *(struct BucketTag*) (void*) (bucket + dict->tag_offset);
-        if (!tag.is_present) {
-            if (first_available_pos == SIZE_MAX)
-                first_available_pos = pos;
-            if (!tag.is_thombstone) {
-                mode = Inserting;
-                break;
-            }
-        } else {
-            void* in_dict_key = (void*) bucket;
-            if (dict->cmp_fn(in_dict_key, key)) {
-                if (first_available_pos == SIZE_MAX)
-                    first_available_pos = pos;
-                mode = (first_available_pos == pos) ? Overwriting : Moving;
-                break;
-            }
-        }
+bool insert_dict_impl(struct Dict* dict, void* key, void* value, void** out_ptr) {
+    // max load factor of 3/4
+    if ((dict->entries_count + 1) * 4 > dict->size * 3)
+        grow_and_rehash(dict);
 
-        pos++;
-        if (pos == dict->size)
-            pos = 0;
-        if (pos == init_pos) {
-            assert(first_available_pos != SIZE_MAX);
-            mode = Inserting;
-            break;
-        }
-    }
-    assert(first_available_pos < dict->size);
-    assert(pos < dict->size);
-
-    size_t dst_bucket = alloc_base + first_available_pos * dict->bucket_entry_size;
-    struct BucketTag* dst_tag = (struct BucketTag*) (void*) (dst_bucket + dict->tag_offset);
-    void* in_dict_key = (void*) dst_bucket;
-    void* in_dict_value = (void*) (dst_bucket + dict->value_offset);
-
-    if (dst_tag->is_thombstone)
-        dict->thombstones_count--;
-
-    if (mode == Moving) {
-        size_t src_bucket = alloc_base + pos * dict->bucket_entry_size;
-        struct BucketTag* src_tag = (struct BucketTag*) (void*) (src_bucket + dict->tag_offset);
-        assert(src_tag->is_present && dst_tag->is_thombstone);
-        src_tag->is_thombstone = true;
-        src_tag->is_present = false;
-    } else if (mode == Overwriting) {
-        assert(dst_tag->is_present);
-    } else {
+    uint32_t mixed = mix_hash(dict->hash_fn(key));
+    size_t empty_pos;
+    size_t pos = find_slot(dict, key, mixed, &empty_pos);
+    bool inserting = pos == SIZE_MAX;
+    if (inserting) {
+        pos = empty_pos;
+        set_ctrl(dict, pos, hash_to_ctrl(mixed));
         dict->entries_count++;
     }
 
-    dst_tag->is_present = true;
-    dst_tag->is_thombstone = false;
+    void* in_dict_key = get_bucket(dict, pos);
+    void* in_dict_value = (void*) ((size_t) in_dict_key + dict->value_offset);
     memcpy(in_dict_key, key, dict->key_size);
     if (dict->value_size)
         memcpy(in_dict_value, value, dict->value_size);
     *out_ptr = in_dict_key;
 
-    return mode == Inserting;
+    return inserting;
 }
 
 bool dict_iter(struct Dict* dict, size_t* iterator_state, void* key, void* value) {
-    bool found_something = false;
-    while (!found_something) {
-        if (*iterator_state >= dict->size) {
-            return false;
-        }
-        const size_t alloc_base = (size_t) dict->alloc;
-        size_t bucket = alloc_base + (*iterator_state) * dict->bucket_entry_size;
-        struct BucketTag* tag = (struct BucketTag*) (void*) (bucket + dict->tag_offset);
-        if (tag->is_present) {
-            found_something = true;
-            void* in_dict_key = (void*) bucket;
-            if (key)
-                memcpy(key, in_dict_key, dict->key_size);
-            void* in_dict_value = (void*) (bucket + dict->value_offset);
-            if (value && dict->value_size > 0)
-                memcpy(value, in_dict_value, dict->value_size);
-        }
-        (*iterator_state)++;
+    while (*iterator_state < dict->size) {
+        size_t pos = (*iterator_state)++;
+        if (dict->ctrl[pos] == ctrl_empty)
+            continue;
+        void* in_dict_key = get_bucket(dict, pos);
+        if (key)
+            memcpy(key, in_dict_key, dict->key_size);
+        void* in_dict_value = (void*) ((size_t) in_dict_key + dict->value_offset);
+        if (value && dict->value_size > 0)
+            memcpy(value, in_dict_value, dict->value_size);
+        return true;
     }
-    return true;
+    return false;
 }
 
 #include "murmur3.h"
@@ -334,3 +376,7 @@ KeyHash hash_murmur(const void* data, size_t size) {
     final ^= out[3];
     return final;
 }
+
+void hash_murmur_128(const void* data, size_t size, uint64_t out[2]) {
+    MurmurHash3_x64_128(data, (int) size, 0x1234567, out);
+}
@@ -19,6 +19,8 @@ struct Dict* new_dict_impl(size_t key_size, size_t value_size, size_t key_align,
 struct Dict* clone_dict(struct Dict*);
 void destroy_dict(struct Dict*);
 void clear_dict(struct Dict*);
+/// Makes room for that many entries in total, so they can be inserted without growing the dict along the way
+void reserve_dict(struct Dict*, size_t entries);
 
 bool dict_iter(struct Dict*, size_t* iterator_state, void* key, void* value);
 
@@ -44,6 +46,25 @@ void* insert_dict_and_get_key_impl(struct Dict*, void* key, void* value);
 #define      insert_set_get_result(K, dict, key)           insert_dict_and_get_result_impl(dict, (void*) (&(key)), NULL)
 bool insert_dict_and_get_result_impl(struct Dict*, void* key, void* value);
 
+typedef struct {
+    size_t lookups;
+    /// Groups of control bytes looked at, a lookup that hits its home group costs one
+    size_t probes;
+    size_t resizes;
+} DictStats;
+
+/// Running totals over every dict used by the calling thread, meant to be diffed around a piece of work.
+DictStats get_dict_stats(void);
+
 KeyHash hash_murmur(const void* data, size_t size);
+/// The full 128 bits, for when the hash names the data and collisions can't be told apart from matches
+void hash_murmur_128(const void* data, size_t size, uint64_t out[2]);
+
+/// Cheap multiply-xorshift step, good enough to combine words that are already unique (interned pointers, enums, literals)
+static inline uint64_t hash_combine_word(uint64_t hash, uint64_t word) {
+    hash ^= word;
+    hash *= 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 29);
+}
 
 #endif
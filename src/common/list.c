@@ -68,7 +68,7 @@ void delete_list_impl(struct List* list, size_t index) {
 
     void* hole_at = (void*) ((size_t) list->alloc + element_size * index);
     void* fill_with = (void*) ((size_t) list->alloc + element_size * (index + 1));
-    size_t amount = old_elements_count - index;
+    size_t amount = old_elements_count - index - 1;
     memmove(hole_at, fill_with, element_size * amount);
 
     list->elements_count--;
@@ -82,14 +82,14 @@ void* remove_list_impl(struct List* list, size_t index) {
 
     void* hole_at = (void*) ((size_t) list->alloc + element_size * index);
     void* fill_with = (void*) ((size_t) list->alloc + element_size * (index + 1));
-    size_t amount = old_elements_count - index;
-    memcpy(&temp, hole_at, element_size);
+    size_t amount = old_elements_count - index - 1;
+    memcpy(temp, hole_at, element_size);
     memmove(hole_at, fill_with, element_size * amount);
 
     list->elements_count--;
 
     void* end = (void*) ((size_t) list->alloc + element_size * list->elements_count);
-    memcpy(end, &temp, element_size);
+    memcpy(end, temp, element_size);
     return end;
 }
 
@@ -1,3 +1,5 @@
+#include "portability.h"
+
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
@@ -50,4 +52,288 @@ const char* get_executable_location(void) {
 #endif
     assert(final_len <= len);
     return buf;
-}
\ No newline at end of file
+}
+
+#ifdef WIN32
+uint64_t get_time_nano(void) {
+    static LARGE_INTEGER frequency = { 0 };
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (uint64_t) ((double) now.QuadPart * 1000000000.0 / (double) frequency.QuadPart);
+}
+
+uint64_t get_cpu_time_nano(void) {
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    // FILETIMEs count 100ns intervals
+    uint64_t k = ((uint64_t) kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t u = ((uint64_t) user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (k + u) * 100;
+}
+#else
+#include <time.h>
+uint64_t get_time_nano(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ull + (uint64_t) t.tv_nsec;
+}
+
+uint64_t get_cpu_time_nano(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+    return (uint64_t) t.tv_sec * 1000000000ull + (uint64_t) t.tv_nsec;
+}
+#endif
+
+#ifdef WIN32
+size_t get_processors_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+#else
+#include <unistd.h>
+size_t get_processors_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+}
+#endif
+
+#ifdef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
+#include <string.h>
+#include <stdio.h>
+
+bool make_directory(const char* path) {
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+bool replace_file(const char* src, const char* dst) {
+    return MoveFileExA(src, dst, MOVEFILE_REPLACE_EXISTING);
+}
+
+bool get_file_info(const char* path, size_t* size, uint64_t* mtime) {
+    struct _stat64 s;
+    if (_stat64(path, &s) != 0)
+        return false;
+    *size = (size_t) s.st_size;
+    *mtime = (uint64_t) s.st_mtime;
+    return true;
+}
+
+bool touch_file(const char* path) {
+    return _utime(path, NULL) == 0;
+}
+
+bool list_directory(const char* path, void* uptr, void (*fn)(void* uptr, const char* name)) {
+    size_t len = strlen(path);
+    LARRAY(char, pattern, len + 3);
+    snprintf(pattern, len + 3, "%s\\*", path);
+    WIN32_FIND_DATAA entry;
+    HANDLE handle = FindFirstFileA(pattern, &entry);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    do {
+        if (strcmp(entry.cFileName, ".") != 0 && strcmp(entry.cFileName, "..") != 0)
+            fn(uptr, entry.cFileName);
+    } while (FindNextFileA(handle, &entry));
+    FindClose(handle);
+    return true;
+}
+
+bool map_file(const char* path, size_t* size, const char** data, void** handle) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return false;
+    }
+    *size = (size_t) file_size.QuadPart;
+    *data = NULL;
+    *handle = NULL;
+    // empty files can't be mapped
+    if (*size == 0) {
+        CloseHandle(file);
+        return true;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return false;
+    *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!*data) {
+        CloseHandle(mapping);
+        return false;
+    }
+    *handle = mapping;
+    return true;
+}
+
+void unmap_file(void* handle, size_t size, const char* data) {
+    if (!data)
+        return;
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE) handle);
+}
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+
+bool make_directory(const char* path) {
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+bool replace_file(const char* src, const char* dst) {
+    return rename(src, dst) == 0;
+}
+
+bool get_file_info(const char* path, size_t* size, uint64_t* mtime) {
+    struct stat s;
+    if (stat(path, &s) != 0)
+        return false;
+    *size = (size_t) s.st_size;
+    *mtime = (uint64_t) s.st_mtime;
+    return true;
+}
+
+bool touch_file(const char* path) {
+    return utime(path, NULL) == 0;
+}
+
+bool list_directory(const char* path, void* uptr, void (*fn)(void* uptr, const char* name)) {
+    DIR* dir = opendir(path);
+    if (!dir)
+        return false;
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+            fn(uptr, entry->d_name);
+    }
+    closedir(dir);
+    return true;
+}
+
+bool map_file(const char* path, size_t* size, const char** data, void** handle) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat s;
+    if (fstat(fd, &s) != 0) {
+        close(fd);
+        return false;
+    }
+    *size = (size_t) s.st_size;
+    *data = NULL;
+    *handle = NULL;
+    // empty files can't be mapped
+    if (*size > 0) {
+        void* mapped = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        *data = mapped;
+    }
+    // the mapping stays valid once the file is closed
+    close(fd);
+    return true;
+}
+
+void unmap_file(SHADY_UNUSED void* handle, size_t size, const char* data) {
+    if (data)
+        munmap((void*) data, size);
+}
+#endif
+
+// the header picks the types with _WIN32, so the implementation has to agree
+#ifdef _WIN32
+#include <windows.h>
+
+static_assert(sizeof(Mutex) == sizeof(SRWLOCK), "Mutex has to hold a SRWLOCK");
+static_assert(sizeof(CondVar) == sizeof(CONDITION_VARIABLE), "CondVar has to hold a CONDITION_VARIABLE");
+static_assert(sizeof(OnceFlag) == sizeof(INIT_ONCE), "OnceFlag has to hold an INIT_ONCE");
+
+void init_mutex(Mutex* mutex) { InitializeSRWLock((PSRWLOCK) mutex); }
+void destroy_mutex(SHADY_UNUSED Mutex* mutex) {}
+void lock_mutex(Mutex* mutex) { AcquireSRWLockExclusive((PSRWLOCK) mutex); }
+void unlock_mutex(Mutex* mutex) { ReleaseSRWLockExclusive((PSRWLOCK) mutex); }
+
+void init_cond_var(CondVar* cond_var) { InitializeConditionVariable((PCONDITION_VARIABLE) cond_var); }
+void destroy_cond_var(SHADY_UNUSED CondVar* cond_var) {}
+void wait_cond_var(CondVar* cond_var, Mutex* mutex) { SleepConditionVariableSRW((PCONDITION_VARIABLE) cond_var, (PSRWLOCK) mutex, INFINITE, 0); }
+void signal_cond_var(CondVar* cond_var) { WakeConditionVariable((PCONDITION_VARIABLE) cond_var); }
+void broadcast_cond_var(CondVar* cond_var) { WakeAllConditionVariable((PCONDITION_VARIABLE) cond_var); }
+
+typedef struct {
+    void* (*fn)(void*);
+    void* arg;
+} ThreadStart;
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+    ThreadStart start = *(ThreadStart*) param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+bool spawn_thread(Thread* thread, void* (*fn)(void*), void* arg) {
+    ThreadStart* start = malloc(sizeof(ThreadStart));
+    *start = (ThreadStart) { .fn = fn, .arg = arg };
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (!*thread) {
+        free(start);
+        return false;
+    }
+    return true;
+}
+
+void join_thread(Thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+typedef struct {
+    void (*fn)(void);
+} OnceCallback;
+
+static BOOL CALLBACK once_trampoline(SHADY_UNUSED PINIT_ONCE once, PVOID param, SHADY_UNUSED PVOID* context) {
+    ((OnceCallback*) param)->fn();
+    return TRUE;
+}
+
+void run_once(OnceFlag* flag, void (*fn)(void)) {
+    OnceCallback callback = { .fn = fn };
+    InitOnceExecuteOnce((PINIT_ONCE) flag, once_trampoline, &callback, NULL);
+}
+#else
+void init_mutex(Mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+void destroy_mutex(Mutex* mutex) { pthread_mutex_destroy(mutex); }
+void lock_mutex(Mutex* mutex) { pthread_mutex_lock(mutex); }
+void unlock_mutex(Mutex* mutex) { pthread_mutex_unlock(mutex); }
+
+void init_cond_var(CondVar* cond_var) { pthread_cond_init(cond_var, NULL); }
+void destroy_cond_var(CondVar* cond_var) { pthread_cond_destroy(cond_var); }
+void wait_cond_var(CondVar* cond_var, Mutex* mutex) { pthread_cond_wait(cond_var, mutex); }
+void signal_cond_var(CondVar* cond_var) { pthread_cond_signal(cond_var); }
+void broadcast_cond_var(CondVar* cond_var) { pthread_cond_broadcast(cond_var); }
+
+bool spawn_thread(Thread* thread, void* (*fn)(void*), void* arg) { return pthread_create(thread, NULL, fn, arg) == 0; }
+void join_thread(Thread thread) { pthread_join(thread, NULL); }
+
+void run_once(OnceFlag* flag, void (*fn)(void)) { pthread_once(flag, fn); }
+#endif
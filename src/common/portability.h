@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #ifdef _MSC_VER
 #include <malloc.h>
 #endif
@@ -19,6 +21,7 @@ static_assert(__STDC_VERSION__ >= 201112L, "C11 support is required to build sha
     // It's mid 2022, and this typedef is missing from <stdalign.h>
     // MSVC is not a real C11 compiler.
     typedef long long max_align_t;
+    #define SHADY_THREAD_LOCAL __declspec(thread)
 #else
     #ifdef USE_VLAS
         #define LARRAY(T, name, size) T name[size]
@@ -27,6 +30,7 @@ static_assert(__STDC_VERSION__ >= 201112L, "C11 support is required to build sha
     #endif
     #define SHADY_UNUSED __attribute__((unused))
     #define SHADY_FALLTHROUGH __attribute__((fallthrough));
+    #define SHADY_THREAD_LOCAL _Thread_local
 #endif
 
 static inline void* alloc_aligned(size_t size, size_t alignment) {
@@ -47,6 +51,64 @@ static inline void free_aligned(void* ptr) {
 
 const char* get_executable_location(void);
 
+/// Monotonic clock, for measuring how long things take
+uint64_t get_time_nano(void);
+/// CPU time consumed by the process so far, all threads included
+uint64_t get_cpu_time_nano(void);
+
+/// How many threads the machine can run at once, at least 1
+size_t get_processors_count(void);
+
+// pthreads, or the Win32 equivalents where there are none
+#ifdef _WIN32
+typedef struct { void* ptr; } Mutex;
+typedef struct { void* ptr; } CondVar;
+typedef void* Thread;
+typedef struct { void* ptr; } OnceFlag;
+#define SHADY_ONCE_INIT { NULL }
+#else
+#include <pthread.h>
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t CondVar;
+typedef pthread_t Thread;
+typedef pthread_once_t OnceFlag;
+#define SHADY_ONCE_INIT PTHREAD_ONCE_INIT
+#endif
+
+void init_mutex(Mutex*);
+void destroy_mutex(Mutex*);
+void lock_mutex(Mutex*);
+void unlock_mutex(Mutex*);
+
+void init_cond_var(CondVar*);
+void destroy_cond_var(CondVar*);
+/// Releases the mutex while waiting, holds it again on return. Wakeups can be spurious.
+void wait_cond_var(CondVar*, Mutex*);
+void signal_cond_var(CondVar*);
+void broadcast_cond_var(CondVar*);
+
+bool spawn_thread(Thread*, void* (*fn)(void*), void* arg);
+void join_thread(Thread);
+
+/// Runs fn the first time it's called with a given flag, later and concurrent callers wait for it to be done
+void run_once(OnceFlag*, void (*fn)(void));
+
 void platform_specific_terminal_init_extras();
 
+/// Succeeds if the directory exists afterwards, whether or not it had to be created
+bool make_directory(const char* path);
+/// Moves 'src' over 'dst' in a single step: other processes either see the old 'dst' or the new one, never a partial file
+bool replace_file(const char* src, const char* dst);
+/// Size and last modification time (in seconds) of a file
+bool get_file_info(const char* path, size_t* size, uint64_t* mtime);
+/// Bumps the modification time of a file to now
+bool touch_file(const char* path);
+/// Calls 'fn' with the name of every entry in a directory, except for '.' and '..'
+bool list_directory(const char* path, void* uptr, void (*fn)(void* uptr, const char* name));
+
+/// Maps a whole file in memory, read-only. The mapping starts on a page boundary.
+/// 'handle' identifies the mapping, it has to be passed back to unmap_file along with the same size and data.
+bool map_file(const char* path, size_t* size, const char** data, void** handle);
+void unmap_file(void* handle, size_t size, const char* data);
+
 #endif
@@ -0,0 +1,297 @@
+#include "tlsf.h"
+#include "portability.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// Each power of two gets split in that many linear classes
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_COUNT (64 - SL_LOG2 + 1)
+
+struct TlsfRange_ {
+    size_t offset;
+    size_t size;
+    bool free;
+    /// Neighbours in the managed range, ordered by offset
+    TlsfRange* prev_phys;
+    TlsfRange* next_phys;
+    /// Neighbours in the free list of the size class, or in the spares list
+    TlsfRange* prev_free;
+    TlsfRange* next_free;
+};
+
+struct Tlsf_ {
+    size_t size;
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmaps[FL_COUNT];
+    TlsfRange* free_lists[FL_COUNT][SL_COUNT];
+    /// The range at offset 0, everything else is reachable from there
+    TlsfRange* first;
+    /// Range records are recycled rather than given back to malloc
+    TlsfRange* spares;
+
+    size_t used;
+    size_t allocations;
+    size_t free_ranges;
+};
+
+inline static unsigned highest_bit(uint64_t x) {
+    assert(x != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return (unsigned) index;
+#else
+    return 63 - (unsigned) __builtin_clzll(x);
+#endif
+}
+
+inline static unsigned lowest_bit(uint64_t x) {
+    assert(x != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (unsigned) index;
+#else
+    return (unsigned) __builtin_ctzll(x);
+#endif
+}
+
+inline static size_t align_up(size_t x, size_t alignment) {
+    return (x + alignment - 1) & ~(alignment - 1);
+}
+
+/// Size classes count in granules: the first level is linear, the next ones cover a power of two each
+static void get_size_class(size_t size, unsigned* fl, unsigned* sl) {
+    size_t units = size / TLSF_GRANULARITY;
+    if (units < SL_COUNT) {
+        *fl = 0;
+        *sl = (unsigned) units;
+        return;
+    }
+    unsigned msb = highest_bit(units);
+    *fl = msb - SL_LOG2 + 1;
+    *sl = (unsigned) (units >> (msb - SL_LOG2)) - SL_COUNT;
+}
+
+/// Any range in the class we get back is large enough, unlike in the class 'size' itself falls in
+static void get_size_class_rounded_up(size_t size, unsigned* fl, unsigned* sl) {
+    size_t units = size / TLSF_GRANULARITY;
+    if (units >= SL_COUNT)
+        units += ((size_t) 1 << (highest_bit(units) - SL_LOG2)) - 1;
+    get_size_class(units * TLSF_GRANULARITY, fl, sl);
+}
+
+static TlsfRange* new_range(Tlsf* tlsf, size_t offset, size_t size) {
+    TlsfRange* range = tlsf->spares;
+    if (range)
+        tlsf->spares = range->next_free;
+    else
+        range = malloc(sizeof(TlsfRange));
+    *range = (TlsfRange) { .offset = offset, .size = size };
+    return range;
+}
+
+static void recycle_range(Tlsf* tlsf, TlsfRange* range) {
+    range->next_free = tlsf->spares;
+    tlsf->spares = range;
+}
+
+static void insert_free_range(Tlsf* tlsf, TlsfRange* range) {
+    unsigned fl, sl;
+    get_size_class(range->size, &fl, &sl);
+    range->free = true;
+    range->prev_free = NULL;
+    range->next_free = tlsf->free_lists[fl][sl];
+    if (range->next_free)
+        range->next_free->prev_free = range;
+    tlsf->free_lists[fl][sl] = range;
+    tlsf->sl_bitmaps[fl] |= 1u << sl;
+    tlsf->fl_bitmap |= (uint64_t) 1 << fl;
+    tlsf->free_ranges++;
+}
+
+static void remove_free_range(Tlsf* tlsf, TlsfRange* range) {
+    assert(range->free);
+    unsigned fl, sl;
+    get_size_class(range->size, &fl, &sl);
+    if (range->prev_free)
+        range->prev_free->next_free = range->next_free;
+    else
+        tlsf->free_lists[fl][sl] = range->next_free;
+    if (range->next_free)
+        range->next_free->prev_free = range->prev_free;
+    if (!tlsf->free_lists[fl][sl]) {
+        tlsf->sl_bitmaps[fl] &= ~(1u << sl);
+        if (!tlsf->sl_bitmaps[fl])
+            tlsf->fl_bitmap &= ~((uint64_t) 1 << fl);
+    }
+    range->free = false;
+    tlsf->free_ranges--;
+}
+
+/// Cuts 'size' bytes off the front of 'range' into a new range, which takes its place in the physical order
+static TlsfRange* split_front(Tlsf* tlsf, TlsfRange* range, size_t size) {
+    assert(size < range->size);
+    TlsfRange* front = new_range(tlsf, range->offset, size);
+    front->prev_phys = range->prev_phys;
+    front->next_phys = range;
+    if (front->prev_phys)
+        front->prev_phys->next_phys = front;
+    else
+        tlsf->first = front;
+    range->prev_phys = front;
+    range->offset += size;
+    range->size -= size;
+    return front;
+}
+
+/// 'next' is absorbed into 'range'
+static void merge_with_next(Tlsf* tlsf, TlsfRange* range, TlsfRange* next) {
+    assert(range->next_phys == next && range->offset + range->size == next->offset);
+    range->size += next->size;
+    range->next_phys = next->next_phys;
+    if (range->next_phys)
+        range->next_phys->prev_phys = range;
+    recycle_range(tlsf, next);
+}
+
+Tlsf* new_tlsf(size_t size) {
+    Tlsf* tlsf = calloc(1, sizeof(Tlsf));
+    tlsf->size = size - size % TLSF_GRANULARITY;
+    if (tlsf->size > 0) {
+        tlsf->first = new_range(tlsf, 0, tlsf->size);
+        insert_free_range(tlsf, tlsf->first);
+    }
+    return tlsf;
+}
+
+void destroy_tlsf(Tlsf* tlsf) {
+    TlsfRange* range = tlsf->first;
+    while (range) {
+        TlsfRange* next = range->next_phys;
+        free(range);
+        range = next;
+    }
+    while (tlsf->spares) {
+        TlsfRange* next = tlsf->spares->next_free;
+        free(tlsf->spares);
+        tlsf->spares = next;
+    }
+    free(tlsf);
+}
+
+static TlsfRange* find_free_range(Tlsf* tlsf, size_t size) {
+    unsigned fl, sl;
+    get_size_class_rounded_up(size, &fl, &sl);
+    if (fl >= FL_COUNT)
+        return NULL;
+    uint32_t sl_map = tlsf->sl_bitmaps[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint64_t fl_map = fl + 1 < 64 ? tlsf->fl_bitmap & (~(uint64_t) 0 << (fl + 1)) : 0;
+        if (!fl_map)
+            return NULL;
+        fl = lowest_bit(fl_map);
+        sl_map = tlsf->sl_bitmaps[fl];
+    }
+    sl = lowest_bit(sl_map);
+    return tlsf->free_lists[fl][sl];
+}
+
+/// Slow path for when padding the size for alignment pushed the search past ranges that would fit as they are
+static TlsfRange* find_fitting_range(Tlsf* tlsf, size_t size, size_t alignment) {
+    unsigned fl, sl, last_fl, last_sl;
+    get_size_class(size, &fl, &sl);
+    get_size_class_rounded_up(size + alignment - TLSF_GRANULARITY, &last_fl, &last_sl);
+    while (fl < FL_COUNT && (fl < last_fl || (fl == last_fl && sl <= last_sl))) {
+        for (TlsfRange* range = tlsf->free_lists[fl][sl]; range; range = range->next_free) {
+            if (align_up(range->offset, alignment) + size <= range->offset + range->size)
+                return range;
+        }
+        if (++sl == SL_COUNT) {
+            sl = 0;
+            fl++;
+        }
+    }
+    return NULL;
+}
+
+TlsfRange* tlsf_alloc(Tlsf* tlsf, size_t size, size_t alignment, size_t* offset) {
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment < TLSF_GRANULARITY)
+        alignment = TLSF_GRANULARITY;
+    size = align_up(size > 0 ? size : 1, TLSF_GRANULARITY);
+    // enough room to align the start of whatever range we find
+    size_t padded_size = size + alignment - TLSF_GRANULARITY;
+    if (size > tlsf->size || padded_size < size)
+        return NULL;
+
+    TlsfRange* range = find_free_range(tlsf, padded_size);
+    if (!range)
+        range = find_fitting_range(tlsf, size, alignment);
+    if (!range)
+        return NULL;
+    remove_free_range(tlsf, range);
+
+    // the neighbours of a free range are always taken, so the leftovers can go straight back in the free lists
+    size_t padding = align_up(range->offset, alignment) - range->offset;
+    assert(range->size >= padding + size);
+    if (padding > 0)
+        insert_free_range(tlsf, split_front(tlsf, range, padding));
+    if (range->size > size) {
+        TlsfRange* taken = split_front(tlsf, range, size);
+        insert_free_range(tlsf, range);
+        range = taken;
+    }
+
+    tlsf->used += range->size;
+    tlsf->allocations++;
+    *offset = range->offset;
+    return range;
+}
+
+void tlsf_free(Tlsf* tlsf, TlsfRange* range) {
+    assert(!range->free);
+    tlsf->used -= range->size;
+    tlsf->allocations--;
+
+    TlsfRange* prev = range->prev_phys;
+    if (prev && prev->free) {
+        remove_free_range(tlsf, prev);
+        merge_with_next(tlsf, prev, range);
+        range = prev;
+    }
+    TlsfRange* next = range->next_phys;
+    if (next && next->free) {
+        remove_free_range(tlsf, next);
+        merge_with_next(tlsf, range, next);
+    }
+    insert_free_range(tlsf, range);
+}
+
+bool tlsf_is_empty(Tlsf* tlsf) {
+    return tlsf->allocations == 0;
+}
+
+TlsfStats get_tlsf_stats(Tlsf* tlsf) {
+    TlsfStats stats = {
+        .size = tlsf->size,
+        .used = tlsf->used,
+        .allocations = tlsf->allocations,
+        .free_ranges = tlsf->free_ranges,
+    };
+    if (tlsf->fl_bitmap) {
+        // the largest range lives in the highest non-empty class, but not necessarily at the head of its list
+        unsigned fl = highest_bit(tlsf->fl_bitmap);
+        unsigned sl = highest_bit(tlsf->sl_bitmaps[fl]);
+        for (TlsfRange* range = tlsf->free_lists[fl][sl]; range; range = range->next_free)
+            stats.largest_free_range = range->size > stats.largest_free_range ? range->size : stats.largest_free_range;
+    }
+    return stats;
+}
@@ -0,0 +1,36 @@
+#ifndef SHADY_TLSF
+#define SHADY_TLSF
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/// Two-level segregated fit allocator over a range of offsets: it never touches the memory it manages,
+/// so it works for memory the host can't see (GPU heaps). Allocating and freeing are O(1).
+typedef struct Tlsf_ Tlsf;
+/// Handle to an allocation, only valid until it is freed
+typedef struct TlsfRange_ TlsfRange;
+
+/// All offsets and sizes get rounded up to that
+#define TLSF_GRANULARITY 16
+
+Tlsf* new_tlsf(size_t size);
+void destroy_tlsf(Tlsf*);
+
+/// 'alignment' must be a power of two. Returns NULL if there is no free range large enough.
+TlsfRange* tlsf_alloc(Tlsf*, size_t size, size_t alignment, size_t* offset);
+/// Merges the range with its free neighbours
+void tlsf_free(Tlsf*, TlsfRange*);
+bool tlsf_is_empty(Tlsf*);
+
+typedef struct {
+    size_t size;
+    /// Bytes in live allocations, rounding included
+    size_t used;
+    size_t allocations;
+    size_t free_ranges;
+    size_t largest_free_range;
+} TlsfStats;
+
+TlsfStats get_tlsf_stats(Tlsf*);
+
+#endif
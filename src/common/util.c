@@ -1,5 +1,6 @@
 #include "util.h"
 #include "arena.h"
+#include "portability.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -107,7 +108,7 @@ enum {
     ThreadLocalStaticBufferSize = 256
 };
 
-static char static_buffer[ThreadLocalStaticBufferSize];
+static SHADY_THREAD_LOCAL char static_buffer[ThreadLocalStaticBufferSize];
 
 void format_string_internal(const char* str, va_list args, void* uptr, void callback(void*, size_t, char*)) {
     size_t buffer_size = ThreadLocalStaticBufferSize;
@@ -19,6 +19,8 @@ CodegenTarget guess_target(const char* filename) {
         return TgtSPV;
     else if (string_ends_with(filename, "ispc"))
         return TgtISPC;
+    else if (string_ends_with(filename, ".shdb"))
+        return TgtShadyBinary;
     error_print("No target has been specified, and output filename '%s' did not allow guessing the right one\n");
     exit(InvalidTarget);
 }
@@ -104,6 +106,14 @@ void cli_parse_compiler_config_args(CompilerConfig* config, int* pargc, char** a
             if (i == argc)
                 error("Missing subgroup size name");
             config->specialization.subgroup_size = atoi(argv[i]);
+        } else if (strcmp(argv[i], "--spec-constants") == 0) {
+            config->specialization.spec_constants = true;
+        } else if (strcmp(argv[i], "--min-subgroup-size") == 0) {
+            argv[i] = NULL;
+            i++;
+            if (i == argc)
+                error("Missing subgroup size");
+            config->specialization.min_subgroup_size = atoi(argv[i]);
         } else if (strcmp(argv[i], "--execution-model") == 0) {
             argv[i] = NULL;
             i++;
@@ -124,6 +134,12 @@ void cli_parse_compiler_config_args(CompilerConfig* config, int* pargc, char** a
             config->logging.skip_generated = false;
         } else if (strcmp(argv[i], "--no-physical-global-ptrs") == 0) {
             config->hacks.no_physical_global_ptrs = true;
+        } else if (strcmp(argv[i], "--spirv-compaction") == 0) {
+            config->optimisations.spirv.compact = true;
+        } else if (strcmp(argv[i], "--strip-spirv-debug-info") == 0) {
+            // stripping is done by the compactor
+            config->optimisations.spirv.compact = true;
+            config->optimisations.spirv.strip_debug_info = true;
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             help = true;
             continue;
@@ -143,7 +159,11 @@ void cli_parse_compiler_config_args(CompilerConfig* config, int* pargc, char** a
         error_print("  --execution-model <em>                   Selects an entry point for the program to be specialized on.\nPossible values: " EXECUTION_MODELS(EM));
 #undef EM
         error_print("  --subgroup-size N                         Sets the subgroup size the program will be specialized for.\n");
+        error_print("  --spec-constants                          Leaves the subgroup and workgroup sizes to specialization constants, --subgroup-size is then the largest one supported.\n");
+        error_print("  --min-subgroup-size N                     Sets the smallest subgroup size supported with --spec-constants.\n");
         error_print("  --lift-join-points                        Forcefully lambda-lifts all join points. Can help with reconvergence issues.\n");
+        error_print("  --spirv-compaction                        Folds duplicate and removes unused types and constants in the SPIR-V output.\n");
+        error_print("  --strip-spirv-debug-info                  Removes names and line information from the SPIR-V output, implies --spirv-compaction.\n");
     }
 
     cli_pack_remaining_args(pargc, argv);
@@ -171,11 +191,16 @@ DriverConfig default_driver_config() {
         .output_filename = NULL,
         .cfg_output_filename = NULL,
         .shd_output_filename = NULL,
+        .profile_output_filename = NULL,
+        .cache_dir = getenv("SHADY_CACHE_DIR"),
+        .cache_max_size = 256 * 1024 * 1024,
+        .cache_key = new_compile_cache_key(),
     };
 }
 
 void destroy_driver_config(DriverConfig* config) {
     destroy_list(config->input_filenames);
+    destroy_compile_cache_key(config->cache_key);
 }
 
 void cli_parse_driver_arguments(DriverConfig* args, int* pargc, char** argv) {
@@ -215,6 +240,28 @@ void cli_parse_driver_arguments(DriverConfig* args, int* pargc, char** argv) {
                 exit(MissingDumpIrArg);
             }
             args->shd_output_filename = argv[i];
+        } else if (strncmp(argv[i], "--profile-passes=", strlen("--profile-passes=")) == 0) {
+            args->profile_output_filename = argv[i] + strlen("--profile-passes=");
+            if (strlen(args->profile_output_filename) == 0) {
+                error_print("--profile-passes= must be followed with a filename");
+                exit(MissingProfileArg);
+            }
+        } else if (strcmp(argv[i], "--cache-dir") == 0) {
+            argv[i] = NULL;
+            i++;
+            if (i == argc) {
+                error_print("--cache-dir must be followed with a directory");
+                exit(MissingCacheArg);
+            }
+            args->cache_dir = argv[i];
+        } else if (strcmp(argv[i], "--cache-max-size") == 0) {
+            argv[i] = NULL;
+            i++;
+            if (i == argc) {
+                error_print("--cache-max-size must be followed with a size in MiB");
+                exit(MissingCacheArg);
+            }
+            args->cache_max_size = (size_t) atoi(argv[i]) * 1024 * 1024;
         } else if (strcmp(argv[i], "--target") == 0) {
             argv[i] = NULL;
             i++;
@@ -228,6 +275,8 @@ void cli_parse_driver_arguments(DriverConfig* args, int* pargc, char** argv) {
                 args->target = TgtGLSL;
             else if (strcmp(argv[i], "ispc") == 0)
                 args->target = TgtISPC;
+            else if (strcmp(argv[i], "shdb") == 0)
+                args->target = TgtShadyBinary;
             else
                 goto invalid_target;
             argv[i] = NULL;
@@ -247,11 +296,14 @@ void cli_parse_driver_arguments(DriverConfig* args, int* pargc, char** argv) {
     if (help) {
         // error_print("Usage: slim source.slim\n");
         // error_print("Available arguments: \n");
-        error_print("  --target <c, glsl, ispc, spirv>           \n");
+        error_print("  --target <c, glsl, ispc, spirv, shdb>     shdb writes the loaded program as a binary module, without compiling it\n");
         error_print("  --output <filename>, -o <filename>        \n");
         error_print("  --dump-cfg <filename>                     Dumps the control flow graph of the final IR\n");
         error_print("  --dump-loop-tree <filename>\n");
         error_print("  --dump-ir <filename>                      Dumps the final IR\n");
+        error_print("  --profile-passes=<filename>               Writes per-pass timings and memory usage as JSON, loadable as a Chrome/Perfetto trace\n");
+        error_print("  --cache-dir <directory>                   Reuses the results of identical compilations, defaults to $SHADY_CACHE_DIR\n");
+        error_print("  --cache-max-size <MiB>                    Deletes the least recently used results past that size, 256 MiB by default\n");
     }
 
     cli_pack_remaining_args(pargc, argv);
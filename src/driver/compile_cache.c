@@ -0,0 +1,286 @@
+#include "shady/driver.h"
+
+#include "log.h"
+#include "list.h"
+#include "dict.h"
+#include "growy.h"
+#include "util.h"
+#include "portability.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/// Bump this whenever the way keys are built changes
+#define COMPILE_CACHE_FORMAT_VERSION 1
+
+struct CompileCacheKey_ {
+    Growy* bytes;
+    size_t inputs;
+    /// Some configurations have side effects beyond the produced code (the after_pass hook), those can't be skipped
+    bool uncacheable;
+};
+
+CompileCacheKey* new_compile_cache_key() {
+    CompileCacheKey* key = calloc(1, sizeof(CompileCacheKey));
+    key->bytes = new_growy();
+    return key;
+}
+
+void destroy_compile_cache_key(CompileCacheKey* key) {
+    destroy_growy(key->bytes);
+    free(key);
+}
+
+static void add_bytes(CompileCacheKey* key, size_t size, const void* bytes) {
+    growy_append_bytes(key->bytes, size, (const char*) bytes);
+}
+
+/// Fields are added one by one, so padding bytes never make it into the hash
+#define ADD_FIELD(key, field) add_bytes(key, sizeof(field), &(field))
+
+static void add_string(CompileCacheKey* key, String s) {
+    uint64_t len = s ? strlen(s) : UINT64_MAX;
+    ADD_FIELD(key, len);
+    if (s)
+        add_bytes(key, len, s);
+}
+
+void compile_cache_key_add_input(CompileCacheKey* key, size_t size, const char* bytes) {
+    uint64_t len = size;
+    ADD_FIELD(key, len);
+    add_bytes(key, size, bytes);
+    key->inputs++;
+}
+
+/// Keep this in sync with CompilerConfig: anything that changes the generated code has to be here.
+/// Logging options and the profiler only change what gets printed along the way, and are left out on purpose.
+void compile_cache_key_add_compiler_config(CompileCacheKey* key, const CompilerConfig* config) {
+    ADD_FIELD(key, config->dynamic_scheduling);
+    ADD_FIELD(key, config->per_thread_stack_size);
+    ADD_FIELD(key, config->target_spirv_version.major);
+    ADD_FIELD(key, config->target_spirv_version.minor);
+
+    ADD_FIELD(key, config->lower.emulate_subgroup_ops);
+    ADD_FIELD(key, config->lower.emulate_subgroup_ops_extended_types);
+    ADD_FIELD(key, config->lower.simt_to_explicit_simd);
+    ADD_FIELD(key, config->lower.int64);
+    ADD_FIELD(key, config->lower.decay_ptrs);
+
+    ADD_FIELD(key, config->hacks.spv_shuffle_instead_of_broadcast_first);
+    ADD_FIELD(key, config->hacks.force_join_point_lifting);
+    ADD_FIELD(key, config->hacks.no_physical_global_ptrs);
+
+    ADD_FIELD(key, config->optimisations.cleanup.after_every_pass);
+    ADD_FIELD(key, config->optimisations.cleanup.delete_unused_instructions);
+    ADD_FIELD(key, config->optimisations.spirv.compact);
+    ADD_FIELD(key, config->optimisations.spirv.strip_debug_info);
+
+    ADD_FIELD(key, config->printf_trace.memory_accesses);
+    ADD_FIELD(key, config->printf_trace.stack_accesses);
+    ADD_FIELD(key, config->printf_trace.god_function);
+    ADD_FIELD(key, config->printf_trace.stack_size);
+    ADD_FIELD(key, config->printf_trace.subgroup_ops);
+
+    ADD_FIELD(key, config->shader_diagnostics.max_top_iterations);
+
+    add_string(key, config->specialization.entry_point);
+    ADD_FIELD(key, config->specialization.execution_model);
+    ADD_FIELD(key, config->specialization.subgroup_size);
+    ADD_FIELD(key, config->specialization.spec_constants);
+    ADD_FIELD(key, config->specialization.min_subgroup_size);
+
+    if (config->hooks.after_pass.fn)
+        key->uncacheable = true;
+}
+
+void compile_cache_key_add_arena_config(CompileCacheKey* key, const ArenaConfig* config) {
+    ADD_FIELD(key, config->name_bound);
+    ADD_FIELD(key, config->check_op_classes);
+    ADD_FIELD(key, config->check_types);
+    ADD_FIELD(key, config->allow_fold);
+    ADD_FIELD(key, config->untyped_ptrs);
+    ADD_FIELD(key, config->validate_builtin_types);
+    ADD_FIELD(key, config->is_simt);
+    ADD_FIELD(key, config->allow_subgroup_memory);
+    ADD_FIELD(key, config->allow_shared_memory);
+
+    ADD_FIELD(key, config->specializations.subgroup_mask_representation);
+    ADD_FIELD(key, config->specializations.subgroup_size);
+    ADD_FIELD(key, config->specializations.workgroup_size);
+
+    ADD_FIELD(key, config->memory.ptr_size);
+    ADD_FIELD(key, config->memory.word_size);
+
+    ADD_FIELD(key, config->optimisations.delete_unreachable_structured_cases);
+}
+
+void compile_cache_key_add_c_emitter_config(CompileCacheKey* key, const CEmitterConfig* config) {
+    ADD_FIELD(key, config->dialect);
+    ADD_FIELD(key, config->explicitly_sized_types);
+    ADD_FIELD(key, config->allow_compound_literals);
+}
+
+bool compile_cache_keys_equal(const CompileCacheKey* a, const CompileCacheKey* b) {
+    if (a->inputs != b->inputs || a->uncacheable != b->uncacheable || growy_size(a->bytes) != growy_size(b->bytes))
+        return false;
+    return memcmp(growy_data(a->bytes), growy_data(b->bytes), growy_size(a->bytes)) == 0;
+}
+
+/// A new build of the compiler can produce different code for the same inputs: we tell builds apart by the size and
+/// modification time of the executable.
+static void get_build_id(uint64_t id[2]) {
+    static bool computed = false;
+    static uint64_t build_id[2];
+    if (!computed) {
+        const char* exe = get_executable_location();
+        size_t size = 0;
+        uint64_t mtime = 0;
+        if (!get_file_info(exe, &size, &mtime))
+            warn_print("Could not identify the compiler binary '%s', cached results might be stale\n", exe);
+        free((void*) exe);
+        uint64_t data[3] = { COMPILE_CACHE_FORMAT_VERSION, size, mtime };
+        hash_murmur_128(data, sizeof(data), build_id);
+        computed = true;
+    }
+    id[0] = build_id[0];
+    id[1] = build_id[1];
+}
+
+/// 32 hex digits, the key's name in the cache
+static void get_key_name(const CompileCacheKey* key, char name[33]) {
+    uint64_t hashes[4];
+    hash_murmur_128(growy_data(key->bytes), growy_size(key->bytes), hashes);
+    get_build_id(hashes + 2);
+    uint64_t final[2];
+    hash_murmur_128(hashes, sizeof(hashes), final);
+    snprintf(name, 33, "%016" PRIx64 "%016" PRIx64, final[0], final[1]);
+}
+
+struct CompileCache_ {
+    String directory;
+    size_t max_size;
+
+    size_t hits;
+    size_t misses;
+    size_t stores;
+    size_t evictions;
+};
+
+CompileCache* open_compile_cache(const char* directory, size_t max_size) {
+    if (!make_directory(directory)) {
+        warn_print("Could not create the compile cache directory '%s', caching is disabled\n", directory);
+        return NULL;
+    }
+    CompileCache* cache = calloc(1, sizeof(CompileCache));
+    cache->directory = format_string_new("%s", directory);
+    cache->max_size = max_size;
+    return cache;
+}
+
+void close_compile_cache(CompileCache* cache) {
+    info_print("Compile cache: %zu hits, %zu misses, %zu results stored, %zu evicted\n", cache->hits, cache->misses, cache->stores, cache->evictions);
+    free((void*) cache->directory);
+    free(cache);
+}
+
+static bool is_key_cacheable(const CompileCacheKey* key) {
+    return key->inputs > 0 && !key->uncacheable;
+}
+
+static String get_entry_path(CompileCache* cache, const CompileCacheKey* key, const char* kind) {
+    char name[33];
+    get_key_name(key, name);
+    return format_string_new("%s/%s.%s", cache->directory, name, kind);
+}
+
+bool compile_cache_lookup(CompileCache* cache, const CompileCacheKey* key, const char* kind, size_t* size, char** data) {
+    if (!is_key_cacheable(key))
+        return false;
+    String path = get_entry_path(cache, key, kind);
+    bool found = read_file(path, size, data);
+    if (found) {
+        // this keeps the entry at the back of the eviction queue
+        touch_file(path);
+        cache->hits++;
+        debug_print("Compile cache: found %s\n", path);
+    } else {
+        cache->misses++;
+    }
+    free((void*) path);
+    return found;
+}
+
+typedef struct {
+    String name;
+    size_t size;
+    uint64_t mtime;
+} CacheEntry;
+
+typedef struct {
+    CompileCache* cache;
+    struct List* entries;
+    size_t total_size;
+} EvictionContext;
+
+static void collect_entry(EvictionContext* ctx, const char* name) {
+    // leave the files other compilers are still writing alone
+    if (string_ends_with(name, ".tmp"))
+        return;
+    String path = format_string_new("%s/%s", ctx->cache->directory, name);
+    CacheEntry entry = { .name = path };
+    if (!get_file_info(path, &entry.size, &entry.mtime)) {
+        free((void*) path);
+        return;
+    }
+    append_list(CacheEntry, ctx->entries, entry);
+    ctx->total_size += entry.size;
+}
+
+static int compare_entries_by_age(const CacheEntry* a, const CacheEntry* b) {
+    if (a->mtime != b->mtime)
+        return a->mtime < b->mtime ? -1 : 1;
+    return strcmp(a->name, b->name);
+}
+
+/// Deletes the least recently used entries until the cache fits in its size budget again
+static void evict_entries(CompileCache* cache) {
+    EvictionContext ctx = {
+        .cache = cache,
+        .entries = new_list(CacheEntry),
+        .total_size = 0,
+    };
+    list_directory(cache->directory, &ctx, (void (*)(void*, const char*)) collect_entry);
+
+    size_t count = entries_count_list(ctx.entries);
+    CacheEntry* entries = read_list(CacheEntry, ctx.entries);
+    if (ctx.total_size > cache->max_size)
+        qsort(entries, count, sizeof(CacheEntry), (int (*)(const void*, const void*)) compare_entries_by_age);
+    for (size_t i = 0; i < count; i++) {
+        if (ctx.total_size > cache->max_size && remove(entries[i].name) == 0) {
+            ctx.total_size -= entries[i].size;
+            cache->evictions++;
+            debugv_print("Compile cache: evicted %s\n", entries[i].name);
+        }
+        free((void*) entries[i].name);
+    }
+    destroy_list(ctx.entries);
+}
+
+void compile_cache_store(CompileCache* cache, const CompileCacheKey* key, const char* kind, size_t size, const char* data) {
+    if (!is_key_cacheable(key))
+        return;
+    String path = get_entry_path(cache, key, kind);
+    // write next to the final location and move it in place in one go, concurrent readers never see a partial file
+    String tmp_path = format_string_new("%s.%" PRIx64 "%x.tmp", path, get_time_nano(), (unsigned) rand());
+    if (write_file(tmp_path, size, data) && replace_file(tmp_path, path)) {
+        cache->stores++;
+        evict_entries(cache);
+    } else {
+        warn_print("Compile cache: could not write %s\n", path);
+        remove(tmp_path);
+    }
+    free((void*) tmp_path);
+    free((void*) path);
+}
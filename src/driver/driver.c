@@ -5,6 +5,7 @@
 
 #include "list.h"
 #include "util.h"
+#include "portability.h"
 
 #include "log.h"
 
@@ -31,6 +32,8 @@ SourceLanguage guess_source_language(const char* filename) {
         return SrcSlim;
     else if (string_ends_with(filename, ".slim"))
         return SrcShadyIR;
+    else if (string_ends_with(filename, ".shdb"))
+        return SrcShadyBinary;
 
     warn_print("unknown filename extension '%s', interpreting as Slim sourcecode by default.");
     return SrcSlim;
@@ -59,20 +62,29 @@ ShadyErrorCodes driver_load_source_file(SourceLanguage lang, size_t len, const c
             ParserConfig pconfig = {
                     .front_end = lang == SrcSlim,
             };
-            debugv_print("Parsing: \n%s\n", file_contents);
-            parse_shady_ir(pconfig, (const char*) file_contents, mod);
+            debugv_print("Parsing: \n%.*s\n", (int) len, file_contents);
+            parse_shady_ir(pconfig, len, file_contents, mod);
+            break;
+        }
+        case SrcShadyBinary: {
+            if (!deserialize_module(mod, len, file_contents))
+                return InvalidBinaryModule;
+            break;
         }
     }
     return NoError;
 }
 
-ShadyErrorCodes driver_load_source_file_from_filename(const char* filename, Module* mod) {
+static ShadyErrorCodes load_source_file_from_filename(const char* filename, Module* mod, CompileCacheKey* key) {
     ShadyErrorCodes err;
     SourceLanguage lang = guess_source_language(filename);
     size_t len;
     char* contents;
     assert(filename);
-    bool ok = read_file(filename, &len, &contents);
+    // used in place: the slim parser hands out slices of the mapping, and the SPIR-V front-end reads words straight from it
+    void* mapping = NULL;
+    bool mapped = lang == SrcSlim || lang == SrcShadyIR || lang == SrcShadyBinary || lang == SrcSPIRV;
+    bool ok = mapped ? map_file(filename, &len, (const char**) &contents, &mapping) : read_file(filename, &len, &contents);
     if (!ok) {
         error_print("Failed to read file '%s'\n", filename);
         err = InputFileIOError;
@@ -83,12 +95,21 @@ ShadyErrorCodes driver_load_source_file_from_filename(const char* filename, Modu
         err = InputFileDoesNotExist;
         goto exit;
     }
+    if (key)
+        compile_cache_key_add_input(key, len, contents);
     err = driver_load_source_file(lang, len, contents, mod);
     exit:
-    free((void*) contents);
+    if (mapped)
+        unmap_file(mapping, len, contents);
+    else
+        free((void*) contents);
     return err;
 }
 
+ShadyErrorCodes driver_load_source_file_from_filename(const char* filename, Module* mod) {
+    return load_source_file_from_filename(filename, mod, NULL);
+}
+
 ShadyErrorCodes driver_load_source_files(DriverConfig* args, Module* mod) {
     if (entries_count_list(args->input_filenames) == 0) {
         error_print("Missing input file. See --help for proper usage");
@@ -97,7 +118,7 @@ ShadyErrorCodes driver_load_source_files(DriverConfig* args, Module* mod) {
 
     size_t num_source_files = entries_count_list(args->input_filenames);
     for (size_t i = 0; i < num_source_files; i++) {
-        int err = driver_load_source_file_from_filename(read_list(const char*, args->input_filenames)[i], mod);
+        int err = load_source_file_from_filename(read_list(const char*, args->input_filenames)[i], mod, args->cache_key);
         if (err)
             return err;
     }
@@ -105,10 +126,94 @@ ShadyErrorCodes driver_load_source_files(DriverConfig* args, Module* mod) {
     return NoError;
 }
 
+static String get_target_extension(CodegenTarget target) {
+    switch (target) {
+        case TgtAuto: SHADY_UNREACHABLE;
+        case TgtSPV: return "spv";
+        case TgtC: return "c";
+        case TgtGLSL: return "glsl";
+        case TgtISPC: return "ispc";
+        case TgtShadyBinary: return "shdb";
+    }
+    SHADY_UNREACHABLE;
+}
+
+/// Writes out the results of an earlier identical compilation, if they're all in the cache
+static bool load_cached_results(DriverConfig* args, CompileCache* cache) {
+    size_t output_size, shd_size = 0;
+    char* output_buffer;
+    char* shd_buffer = NULL;
+    if (!compile_cache_lookup(cache, args->cache_key, get_target_extension(args->target), &output_size, &output_buffer))
+        return false;
+    if (args->shd_output_filename && !compile_cache_lookup(cache, args->cache_key, "shd", &shd_size, &shd_buffer)) {
+        free(output_buffer);
+        return false;
+    }
+
+    write_file(args->output_filename, output_size, output_buffer);
+    debug_print("Wrote cached result to %s\n", args->output_filename);
+    free(output_buffer);
+    if (shd_buffer) {
+        write_file(args->shd_output_filename, shd_size, shd_buffer);
+        free(shd_buffer);
+    }
+    return true;
+}
+
+/// No passes are run: the module stays in the arena it was loaded in, which belongs to the caller
+static ShadyErrorCodes write_binary_module(DriverConfig* args, Module* mod) {
+    size_t output_size;
+    char* output_buffer;
+    serialize_module(mod, &output_size, &output_buffer);
+    bool ok = write_file(args->output_filename, output_size, output_buffer);
+    free(output_buffer);
+    if (!ok) {
+        error_print("Failed to write binary module to %s\n", args->output_filename);
+        return InputFileIOError;
+    }
+    debug_print("Wrote binary module to %s\n", args->output_filename);
+    return NoError;
+}
+
 ShadyErrorCodes driver_compile(DriverConfig* args, Module* mod) {
     debugv_print("Parsed program successfully: \n");
     log_module(DEBUGV, &args->config, mod);
 
+    if (args->output_filename) {
+        if (args->target == TgtAuto)
+            args->target = guess_target(args->output_filename);
+        switch (args->target) {
+            case TgtAuto: SHADY_UNREACHABLE;
+            case TgtSPV: break;
+            case TgtC: args->c_emitter_config.dialect = C; break;
+            case TgtGLSL: args->c_emitter_config.dialect = GLSL; break;
+            case TgtISPC: args->c_emitter_config.dialect = ISPC; break;
+            case TgtShadyBinary: return write_binary_module(args, mod);
+        }
+    }
+
+    // the CFG, loop tree and profile dumps are only available if we actually run the passes
+    CompileCache* cache = NULL;
+    if (args->cache_dir && args->output_filename && !args->cfg_output_filename && !args->loop_tree_output_filename && !args->profile_output_filename)
+        cache = open_compile_cache(args->cache_dir, args->cache_max_size);
+    if (cache) {
+        ArenaConfig aconfig = get_arena_config(get_module_arena(mod));
+        compile_cache_key_add_arena_config(args->cache_key, &aconfig);
+        compile_cache_key_add_compiler_config(args->cache_key, &args->config);
+        if (args->target != TgtSPV)
+            compile_cache_key_add_c_emitter_config(args->cache_key, &args->c_emitter_config);
+        if (load_cached_results(args, cache)) {
+            close_compile_cache(cache);
+            return NoError;
+        }
+    }
+
+    PassProfiler* profiler = NULL;
+    if (args->profile_output_filename) {
+        profiler = new_pass_profiler();
+        args->config.profiling.profiler = profiler;
+    }
+
     CompilationResult result = run_compiler_passes(&args->config, &mod);
     if (result != CompilationNoError) {
         error_print("Compilation pipeline failed, errcode=%d\n", (int) result);
@@ -140,38 +245,50 @@ ShadyErrorCodes driver_compile(DriverConfig* args, Module* mod) {
         char* output_buffer;
         print_module_into_str(mod, &output_buffer, &output_size);
         fwrite(output_buffer, output_size, 1, f);
+        if (cache)
+            compile_cache_store(cache, args->cache_key, "shd", output_size, output_buffer);
         free((void*) output_buffer);
         fclose(f);
         debug_print("IR dumped\n");
     }
 
     if (args->output_filename) {
-        if (args->target == TgtAuto)
-            args->target = guess_target(args->output_filename);
         FILE* f = fopen(args->output_filename, "wb");
         size_t output_size;
         char* output_buffer;
         switch (args->target) {
-            case TgtAuto: SHADY_UNREACHABLE;
+            case TgtAuto:
+            case TgtShadyBinary: SHADY_UNREACHABLE;
             case TgtSPV: emit_spirv(&args->config, mod, &output_size, &output_buffer, NULL); break;
             case TgtC:
-                args->c_emitter_config.dialect = C;
-                emit_c(args->config, args->c_emitter_config, mod, &output_size, &output_buffer, NULL);
-                break;
             case TgtGLSL:
-                args->c_emitter_config.dialect = GLSL;
-                emit_c(args->config, args->c_emitter_config, mod, &output_size, &output_buffer, NULL);
-                break;
             case TgtISPC:
-                args->c_emitter_config.dialect = ISPC;
                 emit_c(args->config, args->c_emitter_config, mod, &output_size, &output_buffer, NULL);
                 break;
         }
         debug_print("Wrote result to %s\n", args->output_filename);
         fwrite(output_buffer, output_size, 1, f);
+        if (cache)
+            compile_cache_store(cache, args->cache_key, get_target_extension(args->target), output_size, output_buffer);
         free((void*) output_buffer);
         fclose(f);
     }
+
+    if (cache)
+        close_compile_cache(cache);
+
+    if (profiler) {
+        FILE* f = fopen(args->profile_output_filename, "wb");
+        if (f) {
+            dump_pass_profile(f, profiler);
+            fclose(f);
+            debug_print("Pass profile written to %s\n", args->profile_output_filename);
+        } else
+            error_print("Failed to write the pass profile to %s\n", args->profile_output_filename);
+        args->config.profiling.profiler = NULL;
+        destroy_pass_profiler(profiler);
+    }
+
     destroy_ir_arena(get_module_arena(mod));
     return NoError;
 }
@@ -11,8 +11,8 @@
 #include <string.h>
 
 typedef struct {
-    char* tmp_filename;
-    bool delete_tmp_file;
+    /// Where to leave a copy of the bitcode clang produced, for debugging
+    const char* keep_bitcode_filename;
 } VccOptions;
 
 static void cli_parse_vcc_args(VccOptions* options, int* pargc, char** argv) {
@@ -23,8 +23,7 @@ static void cli_parse_vcc_args(VccOptions* options, int* pargc, char** argv) {
             continue;
         else if (strcmp(argv[i], "--vcc-keep-tmp-file") == 0) {
             argv[i] = NULL;
-            options->delete_tmp_file = false;
-            options->tmp_filename = "vcc_tmp.ll";
+            options->keep_bitcode_filename = "vcc_tmp.bc";
             continue;
         }
     }
@@ -32,15 +31,66 @@ static void cli_parse_vcc_args(VccOptions* options, int* pargc, char** argv) {
     cli_pack_remaining_args(pargc, argv);
 }
 
-uint32_t hash_murmur(const void* data, size_t size);
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPE_READ_MODE "rb"
+#else
+#define PIPE_READ_MODE "r"
+#endif
+
+static char* read_pipe(FILE* stream, size_t* size) {
+    Growy* g = new_growy();
+    while (true) {
+        char buf[4096];
+        size_t read = fread(buf, 1, sizeof(buf), stream);
+        if (read == 0)
+            break;
+        growy_append_bytes(g, read, buf);
+    }
+    *size = growy_size(g);
+    return growy_deconstruct(g);
+}
+
+/// Has clang write bitcode for one source file to its standard output, so nothing goes through the filesystem
+/// and we don't need to parse textual IR back. There's no separate check that clang is present: that would cost
+/// one more process on every run, and this fails just as well without it.
+static char* compile_to_bitcode(String filename, size_t* size) {
+    Growy* g = new_growy();
+    growy_append_string(g, "clang");
+    char* self_path = get_executable_location();
+    char* working_dir = strip_path(self_path);
+    growy_append_formatted(g, " -c -emit-llvm -g -O0 -ffreestanding -Wno-main-return-type -Xclang -fpreserve-vec3-type --target=spir64-unknown-unknown -isystem\"%s/../share/vcc/include/\" -D__SHADY__=1", working_dir);
+    free(working_dir);
+    free(self_path);
+    growy_append_formatted(g, " -o - \"%s\"", filename);
+    growy_append_bytes(g, 1, "\0");
+    char* arg_string = growy_deconstruct(g);
+
+    info_print("built command: %s\n", arg_string);
+
+    FILE* stream = popen(arg_string, PIPE_READ_MODE);
+    free(arg_string);
+    if (!stream)
+        exit(ClangInvocationFailed);
+
+    char* bitcode = read_pipe(stream, size);
+    int clang_returned = pclose(stream);
+    info_print("Clang returned %d and produced %zu bytes of bitcode\n", clang_returned, *size);
+    if (clang_returned) {
+        error_print("clang failed, or isn't present in path (retval=%d)\n", clang_returned);
+        free(bitcode);
+        exit(ClangInvocationFailed);
+    }
+    return bitcode;
+}
 
 int main(int argc, char** argv) {
     platform_specific_terminal_init_extras();
 
     DriverConfig args = default_driver_config();
     VccOptions vcc_options = {
-        .tmp_filename = NULL,
-        .delete_tmp_file = true
+        .keep_bitcode_filename = NULL,
     };
     cli_parse_driver_arguments(&args, &argc, argv);
     cli_parse_common_args(&argc, argv);
@@ -58,75 +108,17 @@ int main(int argc, char** argv) {
     IrArena* arena = new_ir_arena(aconfig);
     Module* mod = new_module(arena, "my_module"); // TODO name module after first filename, or perhaps the last one
 
-    int clang_retval = system("clang --version");
-    if (clang_retval != 0)
-    error("clang not present in path or otherwise broken (retval=%d)", clang_retval);
-
     size_t num_source_files = entries_count_list(args.input_filenames);
-    if (!vcc_options.tmp_filename) {
-        vcc_options.tmp_filename = alloca(33);
-        vcc_options.tmp_filename[32] = '\0';
-        uint32_t hash = 0;
-        for (size_t i = 0; i < num_source_files; i++) {
-            String filename = read_list(const char*, args.input_filenames)[i];
-            hash ^= hash_murmur(filename, strlen(filename));
-        }
-        srand(hash);
-        for (size_t i = 0; i < 32; i++) {
-            vcc_options.tmp_filename[i] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"[rand() % (10 + 26 * 2)];
-        }
-    }
-
-    Growy* g = new_growy();
-    growy_append_string(g, "clang");
-    char* self_path = get_executable_location();
-    char* working_dir = strip_path(self_path);
-    growy_append_formatted(g, " -c -emit-llvm -S -g -O0 -ffreestanding -Wno-main-return-type -Xclang -fpreserve-vec3-type --target=spir64-unknown-unknown -isystem\"%s/../share/vcc/include/\" -D__SHADY__=1", working_dir);
-    free(working_dir);
-    free(self_path);
-    growy_append_formatted(g, " -o %s", vcc_options.tmp_filename);
-
     for (size_t i = 0; i < num_source_files; i++) {
         String filename = read_list(const char*, args.input_filenames)[i];
-
-        growy_append_string(g, " \"");
-        growy_append_bytes(g, strlen(filename), filename);
-        growy_append_string(g, "\"");
-    }
-
-    growy_append_bytes(g, 1, "\0");
-    char* arg_string = growy_deconstruct(g);
-
-    info_print("built command: %s\n", arg_string);
-
-    FILE* stream = popen(arg_string, "r");
-    free(arg_string);
-
-    Growy* json_bytes = new_growy();
-    while (true) {
-        char buf[4096];
-        int read = fread(buf, 1, sizeof(buf), stream);
-        if (read == 0)
-            break;
-        growy_append_bytes(json_bytes, read, buf);
+        size_t len;
+        char* bitcode = compile_to_bitcode(filename, &len);
+        if (vcc_options.keep_bitcode_filename)
+            write_file(vcc_options.keep_bitcode_filename, len, bitcode);
+        compile_cache_key_add_input(args.cache_key, len, bitcode);
+        driver_load_source_file(SrcLLVM, len, bitcode, mod);
+        free(bitcode);
     }
-    growy_append_string(json_bytes, "\0");
-    char* llvm_result = growy_deconstruct(json_bytes);
-    int clang_returned = pclose(stream);
-    info_print("Clang returned %d and replied: \n%s", clang_returned, llvm_result);
-    free(llvm_result);
-    if (clang_returned)
-        exit(ClangInvocationFailed);
-
-    size_t len;
-    char* llvm_ir;
-    if (!read_file(vcc_options.tmp_filename, &len, &llvm_ir))
-        exit(InputFileIOError);
-    driver_load_source_file(SrcLLVM, len, llvm_ir, mod);
-    free(llvm_ir);
-
-    if (vcc_options.delete_tmp_file)
-        remove(vcc_options.tmp_filename);
 
     driver_compile(&args, mod);
     info_print("Done\n");
@@ -5,6 +5,7 @@
 #include "util.h"
 
 #include "llvm-c/IRReader.h"
+#include "llvm-c/BitReader.h"
 #include "portability.h"
 
 #include <assert.h>
@@ -99,14 +100,15 @@ const Node* convert_function(Parser* p, LLVMValueRef fn) {
     IrArena* a = get_module_arena(p->dst);
     debug_print("Converting function: %s\n", LLVMGetValueName(fn));
 
-    Nodes params = empty(a);
+    NodesBuilder params_builder = begin_nodes(a);
     for (LLVMValueRef oparam = LLVMGetFirstParam(fn); oparam && oparam <= LLVMGetLastParam(fn); oparam = LLVMGetNextParam(oparam)) {
         LLVMTypeRef ot = LLVMTypeOf(oparam);
         const Type* t = convert_type(p, ot);
         const Node* param = var(a, t, LLVMGetValueName(oparam));
         insert_dict(LLVMValueRef, const Node*, p->map, oparam, param);
-        params = append_nodes(a, params, param);
+        push_node(&params_builder, param);
     }
+    Nodes params = finish_nodes(&params_builder);
     const Type* fn_type = convert_type(p, LLVMGlobalGetValueType(fn));
     assert(fn_type->tag == FnType_TAG);
     assert(fn_type->payload.fn_type.param_types.count == params.count);
@@ -132,10 +134,9 @@ const Node* convert_global(Parser* p, LLVMValueRef global) {
     String name = LLVMGetValueName(global);
     String intrinsic = is_llvm_intrinsic(global);
     if (intrinsic) {
-        if (strcmp(intrinsic, "llvm.global.annotations") == 0) {
-            process_llvm_annotations(p, global);
+        // processed once everything else is converted
+        if (strcmp(intrinsic, "llvm.global.annotations") == 0)
             return NULL;
-        }
         warn_print("Skipping unknown LLVM intrinsic function: %s\n", name);
         return NULL;
     }
@@ -166,15 +167,35 @@ const Node* convert_global(Parser* p, LLVMValueRef global) {
     return r;
 }
 
+/// Either raw bitcode ('BC' 0xC0DE) or bitcode in a wrapper header (0x0B17C0DE)
+static bool is_llvm_bitcode(size_t len, const char* data) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    if (len >= 4 && bytes[0] == 'B' && bytes[1] == 'C' && bytes[2] == 0xC0 && bytes[3] == 0xDE)
+        return true;
+    if (len >= 4 && bytes[0] == 0xDE && bytes[1] == 0xC0 && bytes[2] == 0x17 && bytes[3] == 0x0B)
+        return true;
+    return false;
+}
+
 bool parse_llvm_into_shady(Module* dst, size_t len, const char* data) {
     LLVMContextRef context = LLVMContextCreate();
     LLVMModuleRef src;
     LLVMMemoryBufferRef mem = LLVMCreateMemoryBufferWithMemoryRange(data, len, "my_great_buffer", false);
-    char* parsing_diagnostic = "";
-    if (LLVMParseIRInContext(context, mem, &src, &parsing_diagnostic)) {
-        error_print("Failed to parse LLVM IR\n");
-        error_print(parsing_diagnostic);
-        error_die();
+    if (is_llvm_bitcode(len, data)) {
+        // unlike the textual parser, this one does not take ownership of the buffer
+        bool failed = LLVMParseBitcodeInContext2(context, mem, &src);
+        LLVMDisposeMemoryBuffer(mem);
+        if (failed) {
+            error_print("Failed to parse LLVM bitcode\n");
+            error_die();
+        }
+    } else {
+        char* parsing_diagnostic = "";
+        if (LLVMParseIRInContext(context, mem, &src, &parsing_diagnostic)) {
+            error_print("Failed to parse LLVM IR\n");
+            error_print(parsing_diagnostic);
+            error_die();
+        }
     }
     info_print("LLVM IR parsed successfully\n");
 
@@ -189,17 +210,29 @@ bool parse_llvm_into_shady(Module* dst, size_t len, const char* data) {
         .dst = dirty,
     };
 
-    for (LLVMValueRef fn = LLVMGetFirstFunction(src); fn && fn <= LLVMGetNextFunction(fn); fn = LLVMGetLastFunction(src)) {
-        convert_function(&p, fn);
+    // only what is reachable from the entry points gets converted, through calls, address-taken functions and
+    // initializers: headers bring in a lot of code that would otherwise go through every pass before getting dropped.
+    LLVMValueRef annotations = LLVMGetNamedGlobal(src, "llvm.global.annotations");
+    size_t entry_points = annotations ? convert_annotated_entry_points(&p, annotations) : 0;
+    // without entry points, we don't know what is going to be used
+    if (entry_points == 0) {
+        for (LLVMValueRef fn = LLVMGetFirstFunction(src); fn; fn = LLVMGetNextFunction(fn))
+            convert_function(&p, fn);
+        for (LLVMValueRef global = LLVMGetFirstGlobal(src); global; global = LLVMGetNextGlobal(global))
+            convert_global(&p, global);
     }
+    if (annotations)
+        process_llvm_annotations(&p, annotations);
 
-    LLVMValueRef global = LLVMGetFirstGlobal(src);
-    while (global) {
-        convert_global(&p, global);
-        if (global == LLVMGetLastGlobal(src))
-            break;
-        global = LLVMGetNextGlobal(global);
+    size_t functions = 0, skipped = 0;
+    for (LLVMValueRef fn = LLVMGetFirstFunction(src); fn; fn = LLVMGetNextFunction(fn)) {
+        if (LLVMCountBasicBlocks(fn) == 0)
+            continue;
+        functions++;
+        if (!find_value_dict(LLVMValueRef, const Node*, p.map, fn))
+            skipped++;
     }
+    info_print("Converted %zu LLVM functions reachable from %zu entry points, skipped %zu\n", functions - skipped, entry_points, skipped);
 
     postprocess(&p, dirty, dst);
 
@@ -29,16 +29,58 @@ static const Node* assert_and_strip_fn_addr(const Node* fn) {
     return fn;
 }
 
+/// Looks through the casts and GEPs clang wraps the operands of annotations in
+static LLVMValueRef strip_constant_exprs(LLVMValueRef v) {
+    while (v && LLVMIsAConstantExpr(v))
+        v = LLVMGetOperand(v, 0);
+    return v;
+}
+
+static LLVMValueRef get_annotation_target(LLVMValueRef entry) {
+    return strip_constant_exprs(LLVMGetOperand(entry, 0));
+}
+
+static const char* get_annotation_string(LLVMValueRef entry, size_t* len) {
+    LLVMValueRef str = strip_constant_exprs(LLVMGetOperand(entry, 1));
+    if (!str || !LLVMIsAGlobalVariable(str))
+        return NULL;
+    LLVMValueRef init = LLVMGetInitializer(str);
+    if (!init || !LLVMIsAConstantDataSequential(init))
+        return NULL;
+    return LLVMGetAsString(init, len);
+}
+
+size_t convert_annotated_entry_points(Parser* p, LLVMValueRef global) {
+    LLVMValueRef init = LLVMGetInitializer(global);
+    size_t count = 0;
+    for (int i = 0; init && i < LLVMGetNumOperands(init); i++) {
+        LLVMValueRef entry = LLVMGetOperand(init, i);
+        size_t len;
+        const char* str = get_annotation_string(entry, &len);
+        const char prefix[] = "shady::entry_point::";
+        if (!str || len < sizeof(prefix) - 1 || memcmp(str, prefix, sizeof(prefix) - 1) != 0)
+            continue;
+        LLVMValueRef target = get_annotation_target(entry);
+        assert(target && LLVMIsAFunction(target));
+        debug_print("Converting entry point %s and everything it uses\n", LLVMGetValueName(target));
+        convert_function(p, target);
+        count++;
+    }
+    return count;
+}
+
 void process_llvm_annotations(Parser* p, LLVMValueRef global) {
     IrArena* a = get_module_arena(p->dst);
-    const Type* t = convert_type(p, LLVMGlobalGetValueType(global));
-    assert(t->tag == ArrType_TAG);
-    size_t arr_size = get_int_literal_value(*resolve_to_int_literal(t->payload.arr_type.size), false);
+    LLVMValueRef init = LLVMGetInitializer(global);
+    size_t arr_size = LLVMGetNumOperands(init);
     assert(arr_size > 0);
-    const Node* value = convert_value(p, LLVMGetInitializer(global));
-    assert(value->tag == Composite_TAG && value->payload.composite.contents.count == arr_size);
     for (size_t i = 0; i < arr_size; i++) {
-        const Node* entry = value->payload.composite.contents.nodes[i];
+        LLVMValueRef oentry = LLVMGetOperand(init, i);
+        // annotations on things we did not convert are of no use, and processing them would drag their targets in
+        LLVMValueRef otarget = get_annotation_target(oentry);
+        if (!find_value_dict(LLVMValueRef, const Node*, p->map, otarget))
+            continue;
+        const Node* entry = convert_value(p, oentry);
         assert(entry->tag == Composite_TAG);
         const Node* annotation_payload = entry->payload.composite.contents.nodes[1];
         // eliminate dummy reinterpret cast
@@ -76,7 +76,8 @@ static const Node* process_op(Context* ctx, NodeClass op_class, String op_name,
             Controls controls;
             initialize_controls(ctx, &controls, node);
             Node* decl = (Node*) recreate_node_identity(&fn_ctx.rewriter, node);
-            Nodes annotations = decl->payload.fun.annotations;
+            NodesBuilder annotations = begin_nodes(a);
+            extend_nodes(&annotations, decl->payload.fun.annotations);
             ParsedAnnotation* an = find_annotation(ctx->p, node);
             while (an) {
                 if (strcmp(get_annotation_name(an->payload), "PrimOpIntrinsic") == 0) {
@@ -94,10 +95,10 @@ static const Node* process_op(Context* ctx, NodeClass op_class, String op_name,
                         .args = singleton(prim_op_helper(a, op, empty(a), get_abstraction_params(decl)))
                     });
                 }
-                annotations = append_nodes(a, annotations, an->payload);
+                push_node(&annotations, an->payload);
                 an = an->next;
             }
-            decl->payload.fun.annotations = annotations;
+            decl->payload.fun.annotations = finish_nodes(&annotations);
             // decl->payload.fun.body = wrap_in_controls(ctx, &controls, decl->payload.fun.body);
             destroy_scope(fn_ctx.curr_scope);
             return decl;
@@ -193,18 +194,19 @@ static const Node* process_op(Context* ctx, NodeClass op_class, String op_name,
         case GlobalVariable_TAG: {
             AddressSpace as = node->payload.global_variable.address_space;
             const Node* old_init = node->payload.global_variable.init;
-            Nodes annotations = rewrite_nodes(&ctx->rewriter, node->payload.global_variable.annotations);
+            NodesBuilder annotations = begin_nodes(a);
+            extend_nodes(&annotations, rewrite_nodes(&ctx->rewriter, node->payload.global_variable.annotations));
             const Type* type = rewrite_node(&ctx->rewriter, node->payload.global_variable.type);
             ParsedAnnotation* an = find_annotation(ctx->p, node);
             while (an) {
-                annotations = append_nodes(a, annotations, an->payload);
+                push_node(&annotations, an->payload);
                 if (strcmp(get_annotation_name(an->payload), "Builtin") == 0)
                     old_init = NULL;
                 if (strcmp(get_annotation_name(an->payload), "UniformConstant") == 0)
                     as = AsUniformConstant;
                 an = an->next;
             }
-            Node* decl = global_var(ctx->rewriter.dst_module, annotations, type, get_decl_name(node), as);
+            Node* decl = global_var(ctx->rewriter.dst_module, finish_nodes(&annotations), type, get_decl_name(node), as);
             register_processed(&ctx->rewriter, node, decl);
             if (old_init)
                 decl->payload.global_variable.init = rewrite_node(&ctx->rewriter, old_init);
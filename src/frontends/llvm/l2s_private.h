@@ -35,6 +35,8 @@ ParsedAnnotation* find_annotation(Parser*, const Node*);
 ParsedAnnotation* next_annotation(ParsedAnnotation*);
 void add_annotation(Parser*, const Node*, ParsedAnnotation);
 
+/// Converts the functions annotated as entry points (and, transitively, everything they use), returns how many there were
+size_t convert_annotated_entry_points(Parser* p, LLVMValueRef global);
 void process_llvm_annotations(Parser* p, LLVMValueRef global);
 
 AddressSpace convert_llvm_address_space(unsigned);
@@ -437,20 +437,21 @@ static const Node* accept_primary_expr(ctxparams) {
 
     const Node* expr = accept_value(ctx);
     while (expr) {
-        Nodes ty_args = nodes(arena, 0, NULL);
+        NodesBuilder ty_args_builder = begin_nodes(arena);
         bool parse_ty_args = false;
         if (accept_token(ctx, lsbracket_tok)) {
             parse_ty_args = true;
             while (true) {
                 const Type* t = accept_unqualified_type(ctx);
                 expect(t);
-                ty_args = append_nodes(arena, ty_args, t);
+                push_node(&ty_args_builder, t);
                 if (accept_token(ctx, comma_tok))
                     continue;
                 if (accept_token(ctx, rsbracket_tok))
                     break;
             }
         }
+        Nodes ty_args = finish_nodes(&ty_args_builder);
         switch (curr_token(tokenizer).tag) {
             case lpar_tok: {
                 Op op = PRIMOPS_COUNT;
@@ -754,8 +755,8 @@ static const Node* accept_terminator(ctxparams, Node* fn) {
             const Node* inspectee = accept_value(ctx);
             expect(inspectee);
             expect(accept_token(ctx, comma_tok));
-            Nodes values = empty(arena);
-            Nodes cases = empty(arena);
+            NodesBuilder values_builder = begin_nodes(arena);
+            NodesBuilder cases_builder = begin_nodes(arena);
             const Node* default_jump;
             while (true) {
                 if (accept_token(ctx, default_tok)) {
@@ -768,10 +769,12 @@ static const Node* accept_terminator(ctxparams, Node* fn) {
                 expect(accept_token(ctx, comma_tok) && 1);
                 const Node* j = expect_jump(ctx);
                 expect(accept_token(ctx, comma_tok) && true);
-                values = append_nodes(arena, values, value);
-                cases = append_nodes(arena, cases, j);
+                push_node(&values_builder, value);
+                push_node(&cases_builder, j);
             }
             expect(accept_token(ctx, rpar_tok));
+            Nodes values = finish_nodes(&values_builder);
+            Nodes cases = finish_nodes(&cases_builder);
 
             return br_switch(arena, (Switch) {
                 .switch_value = first(values),
@@ -1037,9 +1040,9 @@ static const Node* accept_nominal_type_decl(ctxparams, Nodes annotations) {
     return nom;
 }
 
-void parse_shady_ir(ParserConfig config, const char* contents, Module* mod) {
+void parse_shady_ir(ParserConfig config, size_t size, const char* contents, Module* mod) {
     IrArena* arena = get_module_arena(mod);
-    Tokenizer* tokenizer = new_tokenizer(contents);
+    Tokenizer* tokenizer = new_tokenizer(contents, size);
 
     while (true) {
         Token token = curr_token(tokenizer);
@@ -36,6 +36,6 @@ INFIX_OPERATORS()
     InfixOperatorsCount
 } InfixOperators;
 
-void parse_shady_ir(ParserConfig config, const char* contents, Module* mod);
+void parse_shady_ir(ParserConfig config, size_t size, const char* contents, Module* mod);
 
 #endif
@@ -1,13 +1,22 @@
 #include "token.h"
 
 #include "log.h"
+#include "portability.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
 
-#define PRIMOP(has_side_effects, name) TEXT_TOKEN(name)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TOKENIZER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 static const char* token_strings[] = {
 #define TOKEN(name, str) str,
@@ -21,35 +30,110 @@ const char* token_tags[] = {
 #undef TOKEN
 };
 
-#undef PRIMOP
+typedef enum {
+    CharWhitespace       = 1 << 0,
+    CharDigit            = 1 << 1,
+    CharIdentifierStart  = 1 << 2,
+    CharIdentifierPart   = 1 << 3,
+    /// Can start one of the symbolic tokens (operators, brackets...)
+    CharSymbol           = 1 << 4,
+} CharClass;
+
+static uint8_t char_classes[256];
 
+/// Keywords are looked up in a perfect hash table: the seed is picked so that no two keywords share a slot,
+/// an identifier then costs one hash and at most one comparison.
+#define KEYWORDS_TABLE_SIZE 256
+static TokenTag keywords_table[KEYWORDS_TABLE_SIZE];
 static size_t token_strings_size[LIST_END_tok];
-static bool constants_initialized = false;
+static uint32_t keywords_seed;
+
+/// Symbolic tokens that start with a given character, longest first
+#define MAX_SYMBOLS_PER_CHAR 4
+static TokenTag symbols_table[256][MAX_SYMBOLS_PER_CHAR];
+
+static OnceFlag constants_initialized = SHADY_ONCE_INIT;
+
+static inline uint8_t classify(char c) { return char_classes[(uint8_t) c]; }
+
+static inline uint32_t hash_keyword(uint32_t seed, const char* str, size_t len) {
+    uint32_t hash = seed ^ (uint32_t) len;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t) str[i];
+        hash *= 16777619u;
+    }
+    return hash >> 24;
+}
 
-static void init_tokenizer_constants() {
-    for (int i = 0; i < LIST_END_tok; i++) {
-        token_strings_size[i] = token_strings[i] == NULL ? 0 : strlen(token_strings[i]);
+static bool try_keywords_seed(uint32_t seed) {
+    for (size_t i = 0; i < KEYWORDS_TABLE_SIZE; i++)
+        keywords_table[i] = identifier_tok;
+    for (TokenTag t = 0; t < LIST_END_tok; t++) {
+        if (!token_strings[t] || !(classify(token_strings[t][0]) & CharIdentifierStart))
+            continue;
+        uint32_t slot = hash_keyword(seed, token_strings[t], token_strings_size[t]);
+        if (keywords_table[slot] != identifier_tok)
+            return false;
+        keywords_table[slot] = t;
+    }
+    return true;
+}
+
+static void init_tokenizer_constants(void) {
+    for (int c = 0; c < 256; c++) {
+        uint8_t class = 0;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            class |= CharWhitespace;
+        if (c >= '0' && c <= '9')
+            class |= CharDigit | CharIdentifierPart;
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_')
+            class |= CharIdentifierStart | CharIdentifierPart;
+        char_classes[c] = class;
+    }
+
+    for (TokenTag t = 0; t < LIST_END_tok; t++)
+        token_strings_size[t] = token_strings[t] == NULL ? 0 : strlen(token_strings[t]);
+
+    // sort symbols by their first character, longer ones first so we always get the longest match
+    for (int c = 0; c < 256; c++)
+        for (size_t i = 0; i < MAX_SYMBOLS_PER_CHAR; i++)
+            symbols_table[c][i] = LIST_END_tok;
+    for (TokenTag t = 0; t < LIST_END_tok; t++) {
+        if (!token_strings[t] || (classify(token_strings[t][0]) & CharIdentifierStart))
+            continue;
+        uint8_t first = (uint8_t) token_strings[t][0];
+        char_classes[first] |= CharSymbol;
+        TokenTag* candidates = symbols_table[first];
+        size_t i = 0;
+        while (candidates[i] != LIST_END_tok && token_strings_size[candidates[i]] >= token_strings_size[t])
+            i++;
+        if (candidates[MAX_SYMBOLS_PER_CHAR - 1] != LIST_END_tok)
+            error("Too many tokens start with '%c', bump MAX_SYMBOLS_PER_CHAR", first);
+        memmove(&candidates[i + 1], &candidates[i], (MAX_SYMBOLS_PER_CHAR - 1 - i) * sizeof(TokenTag));
+        candidates[i] = t;
+    }
+
+    for (keywords_seed = 0; !try_keywords_seed(keywords_seed); keywords_seed++) {
+        if (keywords_seed == 1 << 20)
+            error("Could not find a perfect hash for the keywords, bump KEYWORDS_TABLE_SIZE");
     }
 }
 
 typedef struct Tokenizer_ {
     const char* const source;
     const size_t source_size;
-    
+
     size_t pos;
     Token current;
 } Tokenizer;
 
-Tokenizer* new_tokenizer(const char* source) {
-    if (!constants_initialized) {
-        init_tokenizer_constants();
-        constants_initialized = true;
-    }
+Tokenizer* new_tokenizer(const char* source, size_t size) {
+    run_once(&constants_initialized, init_tokenizer_constants);
 
     Tokenizer* alloc = (Tokenizer*) malloc(sizeof(Tokenizer));
     Tokenizer tokenizer = (Tokenizer) {
         .source = source,
-        .source_size = strlen(source),
+        .source_size = size,
         .pos = 0
     };
     memcpy(alloc, &tokenizer, sizeof(Tokenizer));
@@ -61,148 +145,166 @@ void destroy_tokenizer(Tokenizer* tokenizer) {
     free(tokenizer);
 }
 
-static bool in_bounds(Tokenizer* tokenizer, size_t offset_to_slice) {
-    return (tokenizer->pos + offset_to_slice) <= tokenizer->source_size;
+#if defined(TOKENIZER_USE_SSE2)
+inline static unsigned lowest_bit(unsigned mask) {
+    assert(mask != 0);
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned) index;
+#else
+    return (unsigned) __builtin_ctz(mask);
+#endif
 }
+#endif
 
-const char whitespace[] = { ' ', '\t', '\n', '\r' };
-
-static inline bool is_alpha(char c) { return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'); }
-static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
-static inline bool is_whitespace(char c) { for (size_t i = 0; i < sizeof(whitespace); i++) { if(c == whitespace[i]) return true; } return false; }
-static inline bool can_start_identifier(char c) { return is_alpha(c) || c == '_'; }
-static inline bool can_make_up_identifier(char c) { return can_start_identifier(c) || is_digit(c); }
+static size_t skip_whitespace(const char* source, size_t size, size_t pos) {
+#if defined(TOKENIZER_USE_SSE2)
+    // check 16 characters at a time, indentation makes for long runs of whitespace
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    while (pos + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*) &source[pos]);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)), _mm_or_si128(_mm_cmpeq_epi8(chunk, lf), _mm_cmpeq_epi8(chunk, cr)));
+        unsigned not_ws = ~(unsigned) _mm_movemask_epi8(ws) & 0xFFFF;
+        if (not_ws)
+            return pos + lowest_bit(not_ws);
+        pos += 16;
+    }
+#endif
+    while (pos < size && (classify(source[pos]) & CharWhitespace))
+        pos++;
+    return pos;
+}
 
 static void eat_whitespace_and_comments(Tokenizer* tokenizer) {
-    while (tokenizer->pos < tokenizer->source_size) {
-        if (is_whitespace(tokenizer->source[tokenizer->pos])) {
-            tokenizer->pos++;
-        } else if (tokenizer->pos + 2 <= tokenizer->source_size && tokenizer->source[tokenizer->pos] == '/' && tokenizer->source[tokenizer->pos + 1] == '/') {
-            while (tokenizer->pos < tokenizer->source_size) {
-                if (tokenizer->source[tokenizer->pos] == '\n')
+    const char* source = tokenizer->source;
+    const size_t size = tokenizer->source_size;
+    size_t pos = tokenizer->pos;
+    while (true) {
+        pos = skip_whitespace(source, size, pos);
+        if (pos + 2 <= size && source[pos] == '/' && source[pos + 1] == '/') {
+            const char* eol = memchr(&source[pos], '\n', size - pos);
+            pos = eol ? (size_t) (eol - source) : size;
+        } else if (pos + 2 <= size && source[pos] == '/' && source[pos + 1] == '*') {
+            // look for the closing */, the opening one doesn't count
+            pos += 2;
+            while (true) {
+                const char* star = memchr(&source[pos], '*', size - pos);
+                if (!star) {
+                    pos = size;
                     break;
-                tokenizer->pos++;
-            }
-        } else if (tokenizer->pos + 4 <= tokenizer->source_size && tokenizer->source[tokenizer->pos] == '/' && tokenizer->source[tokenizer->pos + 1] == '*') {
-            tokenizer->pos += 3;
-            while (tokenizer->pos < tokenizer->source_size) {
-                if (tokenizer->source[tokenizer->pos] == '/' && tokenizer->source[tokenizer->pos - 1] == '*') {
-                    tokenizer->pos++;
+                }
+                pos = (size_t) (star - source) + 1;
+                if (pos < size && source[pos] == '/') {
+                    pos++;
                     break;
                 }
-                tokenizer->pos++;
             }
         } else
             break;
     }
+    tokenizer->pos = pos;
+}
+
+static size_t skip_digits(const char* source, size_t size, size_t pos) {
+    while (pos < size && (classify(source[pos]) & CharDigit))
+        pos++;
+    return pos;
 }
 
 Token next_token(Tokenizer* tokenizer) {
     eat_whitespace_and_comments(tokenizer);
-    if (tokenizer->pos == tokenizer->source_size) {
+    const char* source = tokenizer->source;
+    const size_t size = tokenizer->source_size;
+    size_t start = tokenizer->pos;
+    if (start == size) {
         debugvv_print("EOF\n");
         Token token = {
-            .tag = EOF_tok
+            .tag = EOF_tok,
+            .start = start,
+            .end = start,
         };
         tokenizer->current = token;
         return token;
     }
-    assert(in_bounds(tokenizer, 1));
-    const char* slice = &tokenizer->source[tokenizer->pos];
 
     Token token = {
-        .start = tokenizer->pos,
+        .start = start,
     };
-
-    size_t token_size = 0;
-    // First, try to do alphanumeric tokenization
-    bool can_be_identifier = false;
-    if (can_start_identifier(slice[0])) {
-        can_be_identifier = true;
-        while (in_bounds(tokenizer, token_size)) {
-            if (can_make_up_identifier(slice[token_size])) {
-                token_size++;
-            } else break;
-        }
-    } else if (is_digit(slice[0])) {
+    size_t end = start;
+    uint8_t class = classify(source[start]);
+    if (class & CharIdentifierStart) {
+        end++;
+        while (end < size && (classify(source[end]) & CharIdentifierPart))
+            end++;
+        size_t len = end - start;
+        TokenTag keyword = keywords_table[hash_keyword(keywords_seed, &source[start], len)];
+        if (keyword != identifier_tok && token_strings_size[keyword] == len && memcmp(token_strings[keyword], &source[start], len) == 0)
+            token.tag = keyword;
+        else
+            token.tag = identifier_tok;
+    } else if (class & CharDigit) {
         token.tag = dec_lit_tok;
-
-        if (slice[0] == '0' && slice[1] == 'x') {
+        if (source[start] == '0' && end + 1 < size && source[start + 1] == 'x') {
             token.tag = hex_lit_tok;
-            token_size += 2;
-        }
-
-        while (in_bounds(tokenizer, token_size) && is_digit(slice[token_size])) {
-            token_size++;
-        }
-        if (slice[token_size] == '.')
-            token_size++;
-        while (in_bounds(tokenizer, token_size) && is_digit(slice[token_size])) {
-            token_size++;
+            end += 2;
         }
-        if (slice[token_size] == 'e') {
-            token_size++;
-            if (slice[token_size] == '-' || slice[token_size] == '+')
-                token_size++;
-            while (in_bounds(tokenizer, token_size) && is_digit(slice[token_size])) {
-                token_size++;
-            }
+        end = skip_digits(source, size, end);
+        if (end < size && source[end] == '.')
+            end = skip_digits(source, size, end + 1);
+        if (end < size && source[end] == 'e') {
+            end++;
+            if (end < size && (source[end] == '-' || source[end] == '+'))
+                end++;
+            end = skip_digits(source, size, end);
         }
-        if (slice[token_size] == 'f')
-            token_size++;
-
-        goto parsed_successfully;
-    } else if(slice[0] == '"') {
+        if (end < size && source[end] == 'f')
+            end++;
+    } else if (source[start] == '"') {
         token.tag = string_lit_tok;
-        token.start += 1;
-
-        while (in_bounds(tokenizer, token_size + 1) && slice[token_size + 1] != '"') {
-            token_size++;
+        const char* closing = memchr(&source[start + 1], '"', size - start - 1);
+        if (!closing) {
+            error_print("Unterminated string literal: %.16s...\n", &source[start]);
+            exit(-2);
         }
-
-        if (slice[token_size + 1] == '"') {
-            tokenizer->pos += token_size + 2;
-            goto parsed_successfully_dont_update_pos;
-        }
-    }
-
-    for (int i = 0; i < LIST_END_tok; i++) {
-        size_t tok_size = token_strings_size[i];
-        // if there is a match ...
-        if (tok_size != 0 && in_bounds(tokenizer, tok_size) && strncmp(token_strings[i], slice, tok_size) == 0) {
-            // if this is an identifier, we need the size to match exactly
-            if (!can_be_identifier || tok_size == token_size) {
-                token.tag = i;
-                token_size = tok_size;
+        // the quotes are not part of the token
+        token.start = start + 1;
+        end = (size_t) (closing - source);
+        tokenizer->pos = end + 1;
+        goto parsed_successfully_dont_update_pos;
+    } else if (class & CharSymbol) {
+        const TokenTag* candidates = symbols_table[(uint8_t) source[start]];
+        for (size_t i = 0; i < MAX_SYMBOLS_PER_CHAR && candidates[i] != LIST_END_tok; i++) {
+            size_t len = token_strings_size[candidates[i]];
+            if (start + len <= size && memcmp(token_strings[candidates[i]], &source[start], len) == 0) {
+                token.tag = candidates[i];
+                end = start + len;
                 goto parsed_successfully;
             }
         }
-    }
-
-    // If it was like an identifier, but wasn't a token, then we consider it an identifier !
-    if (can_be_identifier) {
-        token.tag = identifier_tok;
-        goto parsed_successfully;
-    }
-
-    error_print("We don't know how to tokenize %.16s...\n", slice);
-    exit(-2);
+        goto failed;
+    } else
+        goto failed;
 
     parsed_successfully:
-    tokenizer->pos += token_size;
+    tokenizer->pos = end;
 
     parsed_successfully_dont_update_pos:
-    token.end = token.start + token_size;
+    token.end = end;
     tokenizer->current = token;
 
     debugvv_print("Token parsed: (tag = %s, pos = %zu", token_tags[token.tag], token.start);
-    if (token.tag == identifier_tok || token.tag == string_lit_tok) {
-        debugvv_print(", str=");
-        for (size_t i = token.start; i < token.end; i++)
-            debugvv_print("%c", tokenizer->source[i]);
-    }
+    if (token.tag == identifier_tok || token.tag == string_lit_tok)
+        debugvv_print(", str=%.*s", (int) (token.end - token.start), &source[token.start]);
     debugvv_print(")\n");
     return token;
+
+    failed:
+    error_print("We don't know how to tokenize %.*s...\n", (int) (size - start < 16 ? size - start : 16), &source[start]);
+    exit(-2);
 }
 
 Token curr_token(Tokenizer* tokenizer) {
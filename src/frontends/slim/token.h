@@ -103,7 +103,7 @@ TOKEN(equal, "=") \
 TOKEN(LIST_END, NULL)
 
 typedef struct Tokenizer_ Tokenizer;
-Tokenizer* new_tokenizer(const char* source);
+Tokenizer* new_tokenizer(const char* source, size_t size);
 void destroy_tokenizer(Tokenizer*);
 
 typedef enum {
@@ -27,6 +27,7 @@ typedef enum {
 #include "arena.h"
 #include "portability.h"
 #include "dict.h"
+#include "list.h"
 #include "util.h"
 
 #include "../shady/type.h"
@@ -47,25 +48,38 @@ typedef struct {
 
 typedef struct SpvDeco_ SpvDeco;
 
+/// There is one of those for every id up to the bound, keep it small
 typedef struct {
     enum { Nothing, Forward, Str, Typ, Decl, BB, Value, Literals } type;
+    uint32_t final_size;
     const Type* result_type;
     union {
         size_t instruction_offset;
         const Node* node;
         String str;
-        struct { size_t count; uint32_t* data; } literals;
+        struct { uint32_t count; uint32_t* data; } literals;
     };
-    SpvDeco* next_decoration;
-    size_t final_size;
 } SpvDef;
 
 struct SpvDeco_ {
     SpvDecoration decoration;
     int member;
     SpvDef payload;
+    /// Next decoration of the same kind on the same id
+    SpvDeco* next;
 };
 
+typedef struct {
+    SpvId id;
+    uint32_t decoration;
+} SpvDecoKey;
+
+/// Where a function's instructions start and end, so we can skip over them until they are needed
+typedef struct {
+    size_t begin;
+    size_t end;
+} SpvFunctionExtent;
+
 typedef struct SpvPhiArgs_ SpvPhiArgs;
 struct SpvPhiArgs_ {
     SpvId predecessor;
@@ -93,35 +107,46 @@ typedef struct {
 
     SpvHeader header;
     SpvDef* defs;
+    /// SpvDecoKey -> SpvDeco*
+    struct Dict* decorations;
+    struct List* functions;
     Arena* decorations_arena;
     struct Dict* phi_arguments;
 } SpvParser;
 
 SpvDef* get_definition_by_id(SpvParser* parser, size_t id);
 
-SpvDef* new_def(SpvParser* parser) {
-    SpvDef* interned = arena_alloc(parser->decorations_arena, sizeof(SpvDef));
-    SpvDef empty = {0};
-    memcpy(interned, &empty, sizeof(SpvDef));
-    return interned;
+static KeyHash hash_deco_key(SpvDecoKey* key) {
+    return hash_murmur(key, sizeof(SpvDecoKey));
+}
+
+static bool compare_deco_key(SpvDecoKey* a, SpvDecoKey* b) {
+    return a->id == b->id && a->decoration == b->decoration;
 }
 
 void add_decoration(SpvParser* parser, SpvId id, SpvDeco decoration) {
-    SpvDef* tgt_def = &parser->defs[id];
-    while (tgt_def->next_decoration) {
-        tgt_def = &tgt_def->next_decoration->payload;
-    }
     SpvDeco* interned = arena_alloc(parser->decorations_arena, sizeof(SpvDeco));
     memcpy(interned, &decoration, sizeof(SpvDeco));
-    tgt_def->next_decoration = interned;
+    interned->next = NULL;
+
+    SpvDecoKey key = { .id = id, .decoration = decoration.decoration };
+    SpvDeco** found = find_value_dict(SpvDecoKey, SpvDeco*, parser->decorations, key);
+    if (found) {
+        SpvDeco* last = *found;
+        while (last->next)
+            last = last->next;
+        last->next = interned;
+    } else {
+        insert_dict(SpvDecoKey, SpvDeco*, parser->decorations, key, interned);
+    }
 }
 
 SpvDeco* find_decoration(SpvParser* parser, SpvId id, int member, SpvDecoration tag) {
-    SpvDef* tgt_def = &parser->defs[id];
-    while (tgt_def->next_decoration) {
-        if (tgt_def->next_decoration->decoration == tag && (member < 0 || tgt_def->next_decoration->member == member))
-            return tgt_def->next_decoration;
-        tgt_def = &tgt_def->next_decoration->payload;
+    SpvDecoKey key = { .id = id, .decoration = tag };
+    SpvDeco** found = find_value_dict(SpvDecoKey, SpvDeco*, parser->decorations, key);
+    for (SpvDeco* deco = found ? *found : NULL; deco; deco = deco->next) {
+        if (member < 0 || deco->member == member)
+            return deco;
     }
     return NULL;
 }
@@ -357,6 +382,7 @@ SpvId get_result_defined_at(SpvParser* parser, size_t instruction_offset) {
 
 void scan_definitions(SpvParser* parser) {
     size_t old_cursor = parser->cursor;
+    SpvFunctionExtent function = { 0 };
     while (true) {
         size_t available = parser->len - parser->cursor;
         if (available == 0)
@@ -378,7 +404,13 @@ void scan_definitions(SpvParser* parser) {
             parser->defs[result].type = Forward;
             parser->defs[result].instruction_offset = parser->cursor;
         }
+        if (op == SpvOpFunction)
+            function.begin = parser->cursor;
         parser->cursor += size;
+        if (op == SpvOpFunctionEnd) {
+            function.end = parser->cursor;
+            append_list(SpvFunctionExtent, parser->functions, function);
+        }
     }
     parser->cursor = old_cursor;
 }
@@ -488,7 +520,7 @@ size_t parse_spv_instruction_at(SpvParser* parser, size_t instruction_offset) {
             ShdDecoration decoration = op == SpvOpName ? ShdDecorationName : ShdDecorationMemberName;
             int name_offset = op == SpvOpName ? 2 : 3;
             SpvDeco deco = {
-                .payload = { Str, .str = decode_spv_string_literal(parser, instruction + name_offset), .next_decoration = NULL },
+                .payload = { Str, .str = decode_spv_string_literal(parser, instruction + name_offset) },
                 .decoration = decoration,
                 .member = op == SpvOpName ? -1 : (int)instruction[3],
             };
@@ -868,7 +900,7 @@ size_t parse_spv_instruction_at(SpvParser* parser, size_t instruction_offset) {
             struct CurrBlock old = parser->current_block;
             parser->current_block.id = result;
 
-            Nodes params = empty(parser->arena);
+            NodesBuilder params_builder = begin_nodes(parser->arena);
             parser->fun_arg_i = 0;
             while (true) {
                 SpvOp param_op = (parser->words + instruction_offset)[0] & 0xFFFF;
@@ -888,13 +920,14 @@ size_t parse_spv_instruction_at(SpvParser* parser, size_t instruction_offset) {
                 if (is_param) {
                     const Node* param = get_definition_by_id(parser, get_result_defined_at(parser, instruction_offset))->node;
                     assert(param && param->tag == Variable_TAG);
-                    params = concat_nodes(parser->arena, params, singleton(param));
+                    push_node(&params_builder, param);
                 }
                 size += s;
                 instruction_offset += s;
             }
 
-            done_with_params:
+            done_with_params:;
+            Nodes params = finish_nodes(&params_builder);
 
             parser->defs[result].type = BB;
             String bb_name = get_name(parser, result);
@@ -1361,6 +1394,8 @@ S2SError parse_spirv_into_shady(Module* dst, size_t len, const char* data) {
         .mod = dst,
         .arena = get_module_arena(dst),
 
+        .decorations = new_dict(SpvDecoKey, SpvDeco*, (HashFn) hash_deco_key, (CmpFn) compare_deco_key),
+        .functions = new_list(SpvFunctionExtent),
         .decorations_arena = new_arena(),
         .phi_arguments = new_dict(SpvId, SpvPhiArgs*, (HashFn) hash_spvid, (CmpFn) compare_spvid),
     };
@@ -1372,10 +1407,39 @@ S2SError parse_spirv_into_shady(Module* dst, size_t len, const char* data) {
 
     scan_definitions(&parser);
 
+    // function bodies are skipped, they get converted when something refers to them
+    size_t functions_count = entries_count_list(parser.functions);
+    SpvFunctionExtent* functions = read_list(SpvFunctionExtent, parser.functions);
+    size_t next_function = 0;
     while (parser.cursor < parser.len) {
+        if (next_function < functions_count && parser.cursor == functions[next_function].begin) {
+            parser.cursor = functions[next_function++].end;
+            continue;
+        }
         parser.cursor += parse_spv_instruction_at(&parser, parser.cursor);
     }
 
+    // start from the entry points, or from everything if there are none
+    size_t entry_points = 0;
+    for (size_t i = 0; i < functions_count; i++) {
+        SpvId fn = get_result_defined_at(&parser, functions[i].begin);
+        if (find_decoration(&parser, fn, -1, ShdDecorationEntryPointType)) {
+            get_definition_by_id(&parser, fn);
+            entry_points++;
+        }
+    }
+    size_t skipped = 0;
+    for (size_t i = 0; i < functions_count; i++) {
+        SpvId fn = get_result_defined_at(&parser, functions[i].begin);
+        if (entry_points == 0)
+            get_definition_by_id(&parser, fn);
+        else if (parser.defs[fn].type == Forward)
+            skipped++;
+    }
+    info_print("Converted %zu SPIR-V functions reachable from %zu entry points, skipped %zu\n", functions_count - skipped, entry_points, skipped);
+
+    destroy_dict(parser.decorations);
+    destroy_list(parser.functions);
     destroy_dict(parser.phi_arguments);
     destroy_arena(parser.decorations_arena);
     free(parser.defs);
@@ -13,6 +13,7 @@ Runtime* initialize_runtime(RuntimeConfig config) {
     runtime->backends = new_list(Backend*);
     runtime->devices = new_list(Device*);
     runtime->programs = new_list(Program*);
+    CHECK(start_runtime_workers(runtime), goto init_fail_free);
 
 #if VK_BACKEND_PRESENT
     Backend* vk_backend = initialize_vk_backend(runtime);
@@ -31,6 +32,9 @@ Runtime* initialize_runtime(RuntimeConfig config) {
 void shutdown_runtime(Runtime* runtime) {
     if (!runtime) return;
 
+    // the workers might still be compiling for the devices
+    stop_runtime_workers(runtime);
+
     // TODO force wait outstanding dispatches ?
     for (size_t i = 0; i < entries_count_list(runtime->devices); i++) {
         Device* dev = read_list(Device*, runtime->devices)[i];
@@ -73,12 +77,32 @@ Command* launch_kernel(Program* p, Device* d, const char* entry_point, int dimx,
 }
 
 bool wait_completion(Command* cmd) { return cmd->wait_for_completion(cmd); }
+bool is_command_complete(Command* cmd) { return cmd->is_complete(cmd); }
+
+CommandStream* begin_command_stream(Device* device) { return device->begin_command_stream(device); }
+
+bool command_stream_dispatch(CommandStream* stream, Program* p, const char* entry_point, int dimx, int dimy, int dimz, int args_count, void** args) {
+    return stream->dispatch(stream, p, entry_point, dimx, dimy, dimz, args_count, args);
+}
+
+bool command_stream_copy(CommandStream* stream, Buffer* src, size_t src_offset, Buffer* dst, size_t dst_offset, size_t size) {
+    return stream->copy(stream, src, src_offset, dst, dst_offset, size);
+}
+
+bool command_stream_fill(CommandStream* stream, Buffer* dst, size_t offset, size_t size, uint32_t value) {
+    return stream->fill(stream, dst, offset, size, value);
+}
+
+void command_stream_barrier(CommandStream* stream) { stream->barrier(stream); }
+Command* submit_command_stream(CommandStream* stream) { return stream->submit(stream); }
 
 bool can_import_host_memory(Device* device) { return device->can_import_host_memory(device); }
 
 Buffer* allocate_buffer_device(Device* device, size_t bytes) { return device->allocate_buffer(device, bytes); }
 Buffer* import_buffer_host(Device* device, void* ptr, size_t bytes) { return device->import_host_memory_as_buffer(device, ptr, bytes); }
 
+DeviceMemoryStats get_device_memory_stats(Device* device) { return device->get_memory_stats(device); }
+
 void destroy_buffer(Buffer* buf) { buf->destroy(buf); };
 
 void* get_buffer_host_pointer(Buffer* buf) { return buf->get_host_ptr(buf); }
@@ -91,3 +115,11 @@ bool copy_to_buffer(Buffer* dst, size_t buffer_offset, void* src, size_t size) {
 bool copy_from_buffer(Buffer* src, size_t buffer_offset, void* dst, size_t size) {
     return src->copy_from(src, buffer_offset, dst, size);
 }
+
+Command* copy_to_buffer_async(Buffer* dst, size_t buffer_offset, void* src, size_t size) {
+    return dst->copy_into_async(dst, buffer_offset, src, size);
+}
+
+Command* copy_from_buffer_async(Buffer* src, size_t buffer_offset, void* dst, size_t size) {
+    return src->copy_from_async(src, buffer_offset, dst, size);
+}
@@ -2,6 +2,9 @@
 #define SHADY_RUNTIME_PRIVATE
 #include "shady/runtime.h"
 #include "shady/ir.h"
+#include "shady/driver.h"
+
+#include "portability.h"
 
 #define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
 
@@ -13,8 +16,29 @@ struct Runtime_ {
     struct List* backends;
     struct List* devices;
     struct List* programs;
+
+    /// Background threads compiling the programs queued with prepare_program
+    struct {
+        Mutex lock;
+        CondVar wakeup;
+        /// RuntimeJob, consumed from the front
+        struct List* queue;
+        size_t threads_count;
+        Thread* threads;
+        bool shutting_down;
+    } workers;
 };
 
+typedef struct {
+    void (*fn)(void*);
+    void* payload;
+} RuntimeJob;
+
+bool start_runtime_workers(Runtime*);
+/// Jobs still in the queue are run before the workers exit
+void stop_runtime_workers(Runtime*);
+void submit_runtime_job(Runtime*, RuntimeJob);
+
 typedef struct Backend_ Backend;
 struct Backend_ {
     Runtime* runtime;
@@ -26,21 +50,64 @@ struct Device_ {
     String (*get_name)(Device*);
 
     Command* (*launch_kernel)(Device*, Program*, const char* entry_point, int dimx, int dimy, int dimz, int args_count, void** args);
+    CommandStream* (*begin_command_stream)(Device*);
+    /// Queues the compilation of an entry point on the runtime workers, does nothing if it's already compiled or in flight
+    bool (*prepare_program)(Device*, Program*, const char* entry_point);
+    bool (*is_program_ready)(Device*, Program*, const char* entry_point);
+    /// Blocks until the entry point is compiled, returns false if that failed
+    bool (*wait_program_ready)(Device*, Program*, const char* entry_point);
     Buffer* (*allocate_buffer)(Device*, size_t bytes);
     Buffer* (*import_host_memory_as_buffer)(Device*, void* base, size_t bytes);
     bool (*can_import_host_memory)(Device*);
+    DeviceMemoryStats (*get_memory_stats)(Device*);
 };
 
+/// The specialized passes' output for one entry point, shared by all the devices that compile it with the same config
+typedef struct {
+    /// Built from that config, it includes the entry point
+    CompileCacheKey* key;
+    /// Held while compiling, devices that need the same thing wait on it. Take it to read the module too, that can intern new nodes.
+    Mutex lock;
+    bool done;
+    bool failed;
+    Module* module;
+    size_t spirv_size;
+    char* spirv_bytes;
+} CompiledEntryPoint;
+
 struct Program_ {
     Runtime* runtime;
     const CompilerConfig* base_config;
     /// owns the module, may be NULL if module is owned by someone else
     IrArena* arena;
     Module* module;
+    /// Output of run_generic_compiler_passes, every specialization of the program starts from there
+    Module* generic_module;
+    /// CompiledEntryPoint*
+    struct List* compiled_entry_points;
+    /// Guards generic_module and compiled_entry_points, the devices compile their specializations concurrently
+    Mutex lock;
+};
+
+struct ProgramFuture_ {
+    Program* program;
+    Device* device;
+    size_t entry_points_count;
+    String* entry_points;
+    bool failed;
 };
 
 struct Command_ {
     bool (*wait_for_completion)(Command*);
+    bool (*is_complete)(Command*);
+};
+
+struct CommandStream_ {
+    bool (*dispatch)(CommandStream*, Program*, const char* entry_point, int dimx, int dimy, int dimz, int args_count, void** args);
+    bool (*copy)(CommandStream*, Buffer* src, size_t src_offset, Buffer* dst, size_t dst_offset, size_t size);
+    bool (*fill)(CommandStream*, Buffer* dst, size_t offset, size_t size, uint32_t value);
+    void (*barrier)(CommandStream*);
+    Command* (*submit)(CommandStream*);
 };
 
 struct Buffer_ {
@@ -50,9 +117,15 @@ struct Buffer_ {
 
     bool (*copy_into)(Buffer* dst, size_t buffer_offset, void* src, size_t bytes);
     bool (*copy_from)(Buffer* src, size_t buffer_offset, void* dst, size_t bytes);
+    Command* (*copy_into_async)(Buffer* dst, size_t buffer_offset, void* src, size_t bytes);
+    Command* (*copy_from_async)(Buffer* src, size_t buffer_offset, void* dst, size_t bytes);
 };
 
 void unload_program(Program*);
+/// Runs the generic part of the pipeline the first time it's needed
+Module* get_program_generic_module(Program*);
+/// Runs the specialized part of the pipeline and emits SPIR-V, unless another device did so with the same config already. Returns NULL if that fails.
+CompiledEntryPoint* get_compiled_entry_point(Program*, const CompilerConfig*);
 
 Backend* initialize_vk_backend(Runtime*);
 #endif
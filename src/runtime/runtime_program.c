@@ -15,8 +15,10 @@ Program* new_program_from_module(Runtime* runtime, const CompilerConfig* base_co
     program->base_config = base_config;
     program->arena = NULL;
     program->module = mod;
+    program->generic_module = NULL;
+    program->compiled_entry_points = new_list(CompiledEntryPoint*);
+    init_mutex(&program->lock);
 
-    // TODO split the compilation pipeline into generic and non-generic parts
     append_list(Program*, runtime->programs, program);
     return program;
 }
@@ -49,9 +51,115 @@ Program* load_program_from_disk(Runtime* runtime, const CompilerConfig* base_con
     return program;
 }
 
+Module* get_program_generic_module(Program* program) {
+    lock_mutex(&program->lock);
+    if (!program->generic_module) {
+        CompilerConfig config = *program->base_config;
+        Module* mod = program->module;
+        CHECK(run_generic_compiler_passes(&config, &mod) == CompilationNoError, unlock_mutex(&program->lock); return NULL);
+        program->generic_module = mod;
+    }
+    unlock_mutex(&program->lock);
+    return program->generic_module;
+}
+
+static bool compile_entry_point(Program* program, const CompilerConfig* config, CompiledEntryPoint* compiled) {
+    Module* mod = get_program_generic_module(program);
+    CHECK(mod, return false);
+
+    CompilerConfig specialized_config = *config;
+    CHECK(run_specialized_compiler_passes(&specialized_config, &mod) == CompilationNoError, return false);
+
+    Module* emitted;
+    emit_spirv(&specialized_config, mod, &compiled->spirv_size, &compiled->spirv_bytes, &emitted);
+    if (get_module_arena(emitted) != get_module_arena(mod) && get_module_arena(mod) != get_module_arena(program->generic_module))
+        destroy_ir_arena(get_module_arena(mod));
+    compiled->module = emitted;
+
+    if (program->runtime->config.dump_spv) {
+        String file_name = format_string_new("%s.spv", get_module_name(compiled->module));
+        write_file(file_name, compiled->spirv_size, (const char*) compiled->spirv_bytes);
+        free((void*) file_name);
+    }
+    return true;
+}
+
+CompiledEntryPoint* get_compiled_entry_point(Program* program, const CompilerConfig* config) {
+    CompileCacheKey* key = new_compile_cache_key();
+    compile_cache_key_add_compiler_config(key, config);
+
+    lock_mutex(&program->lock);
+    CompiledEntryPoint* compiled = NULL;
+    for (size_t i = 0; i < entries_count_list(program->compiled_entry_points) && !compiled; i++) {
+        CompiledEntryPoint* candidate = read_list(CompiledEntryPoint*, program->compiled_entry_points)[i];
+        if (compile_cache_keys_equal(candidate->key, key))
+            compiled = candidate;
+    }
+    if (!compiled) {
+        compiled = calloc(1, sizeof(CompiledEntryPoint));
+        compiled->key = key;
+        key = NULL;
+        init_mutex(&compiled->lock);
+        append_list(CompiledEntryPoint*, program->compiled_entry_points, compiled);
+    }
+    unlock_mutex(&program->lock);
+    if (key)
+        destroy_compile_cache_key(key);
+
+    // the first device to get there compiles it, the others wait for it to be done
+    lock_mutex(&compiled->lock);
+    if (!compiled->done) {
+        compiled->failed = !compile_entry_point(program, config, compiled);
+        compiled->done = true;
+    }
+    unlock_mutex(&compiled->lock);
+    return compiled->failed ? NULL : compiled;
+}
+
+ProgramFuture* prepare_program(Program* program, Device* device, size_t entry_points_count, const char** entry_points) {
+    ProgramFuture* future = calloc(1, sizeof(ProgramFuture));
+    future->program = program;
+    future->device = device;
+    future->entry_points = calloc(entry_points_count, sizeof(String));
+    for (size_t i = 0; i < entry_points_count; i++) {
+        // the entry points are waited on later, by then the caller's strings might be gone
+        future->entry_points[future->entry_points_count++] = format_string_new("%s", entry_points[i]);
+        CHECK(device->prepare_program(device, program, entry_points[i]), future->failed = true);
+    }
+    return future;
+}
+
+bool is_program_ready(Program* program, Device* device, const char* entry_point) {
+    return device->is_program_ready(device, program, entry_point);
+}
+
+bool wait_program_future(ProgramFuture* future) {
+    bool ok = !future->failed;
+    for (size_t i = 0; i < future->entry_points_count; i++) {
+        ok &= future->device->wait_program_ready(future->device, future->program, future->entry_points[i]);
+        free((void*) future->entry_points[i]);
+    }
+    free(future->entry_points);
+    free(future);
+    return ok;
+}
+
 void unload_program(Program* program) {
-    // TODO iterate over the specialized stuff
+    // the specialized programs are gone by now, they are cleaned up with the devices
+    for (size_t i = 0; i < entries_count_list(program->compiled_entry_points); i++) {
+        CompiledEntryPoint* compiled = read_list(CompiledEntryPoint*, program->compiled_entry_points)[i];
+        if (compiled->module && get_module_arena(compiled->module) != get_module_arena(program->generic_module))
+            destroy_ir_arena(get_module_arena(compiled->module));
+        free(compiled->spirv_bytes);
+        destroy_compile_cache_key(compiled->key);
+        destroy_mutex(&compiled->lock);
+        free(compiled);
+    }
+    destroy_list(program->compiled_entry_points);
+    if (program->generic_module && get_module_arena(program->generic_module) != get_module_arena(program->module))
+        destroy_ir_arena(get_module_arena(program->generic_module));
     if (program->arena) // if the program owns an arena
         destroy_ir_arena(program->arena);
+    destroy_mutex(&program->lock);
     free(program);
 }
@@ -23,6 +23,8 @@ typedef struct {
     DriverConfig driver_config;
     RuntimeConfig runtime_config;
     size_t device;
+    bool bench_copies;
+    bool bench_dispatches;
 } Args;
 
 static void parse_runtime_arguments(int* pargc, char** argv, Args* args) {
@@ -39,6 +41,10 @@ static void parse_runtime_arguments(int* pargc, char** argv, Args* args) {
             argv[i] = NULL;
             i++;
             args->device = strtol(argv[i], NULL, 10);
+        } else if (strcmp(argv[i], "--bench-copies") == 0) {
+            args->bench_copies = true;
+        } else if (strcmp(argv[i], "--bench-dispatches") == 0) {
+            args->bench_dispatches = true;
         } else {
             continue;
         }
@@ -52,10 +58,69 @@ static void parse_runtime_arguments(int* pargc, char** argv, Args* args) {
         error_print("  --print-builtin\n");
         error_print("  --print-generated\n");
         error_print("  --device n\n");
+        error_print("  --bench-copies\n");
+        error_print("  --bench-dispatches\n");
         exit(0);
     }
 }
 
+#define BENCH_SMALL_COPIES 1000
+#define BENCH_SMALL_COPY_SIZE 256
+#define BENCH_LARGE_COPY_SIZE (64 * 1024 * 1024)
+
+/// Latency of small copies, one at a time and batched, then bandwidth of large ones
+static void bench_copies(Device* device) {
+    Buffer* buffer = allocate_buffer_device(device, BENCH_LARGE_COPY_SIZE);
+    char* host = calloc(1, BENCH_LARGE_COPY_SIZE);
+
+    uint64_t start = get_time_nano();
+    for (size_t i = 0; i < BENCH_SMALL_COPIES; i++)
+        copy_to_buffer(buffer, i * BENCH_SMALL_COPY_SIZE, host, BENCH_SMALL_COPY_SIZE);
+    double sync_us = (double) (get_time_nano() - start) / 1000.0 / BENCH_SMALL_COPIES;
+
+    Command** commands = calloc(BENCH_SMALL_COPIES, sizeof(Command*));
+    start = get_time_nano();
+    for (size_t i = 0; i < BENCH_SMALL_COPIES; i++)
+        commands[i] = copy_to_buffer_async(buffer, i * BENCH_SMALL_COPY_SIZE, host, BENCH_SMALL_COPY_SIZE);
+    for (size_t i = 0; i < BENCH_SMALL_COPIES; i++)
+        wait_completion(commands[i]);
+    double async_us = (double) (get_time_nano() - start) / 1000.0 / BENCH_SMALL_COPIES;
+    free(commands);
+    info_print("%d bytes uploads: %.1f us each when waited on one by one, %.1f us each when batched\n", BENCH_SMALL_COPY_SIZE, sync_us, async_us);
+
+    start = get_time_nano();
+    copy_to_buffer(buffer, 0, host, BENCH_LARGE_COPY_SIZE);
+    double upload_s = (double) (get_time_nano() - start) / 1000000000.0;
+    start = get_time_nano();
+    copy_from_buffer(buffer, 0, host, BENCH_LARGE_COPY_SIZE);
+    double download_s = (double) (get_time_nano() - start) / 1000000000.0;
+    double mib = (double) BENCH_LARGE_COPY_SIZE / (1024.0 * 1024.0);
+    info_print("Large copies: %.0f MiB/s up, %.0f MiB/s down\n", mib / upload_s, mib / download_s);
+
+    free(host);
+    destroy_buffer(buffer);
+}
+
+#define BENCH_DISPATCHES 50
+
+/// Small kernels launched one by one, then recorded into a single command stream
+static void bench_dispatches(Device* device, Program* program, void** kernel_args) {
+    uint64_t start = get_time_nano();
+    for (size_t i = 0; i < BENCH_DISPATCHES; i++)
+        wait_completion(launch_kernel(program, device, "main", 1, 1, 1, 2, kernel_args));
+    double launch_us = (double) (get_time_nano() - start) / 1000.0 / BENCH_DISPATCHES;
+
+    start = get_time_nano();
+    CommandStream* stream = begin_command_stream(device);
+    for (size_t i = 0; i < BENCH_DISPATCHES; i++)
+        command_stream_dispatch(stream, program, "main", 1, 1, 1, 2, kernel_args);
+    Command* command = submit_command_stream(stream);
+    if (command)
+        wait_completion(command);
+    double stream_us = (double) (get_time_nano() - start) / 1000.0 / BENCH_DISPATCHES;
+    info_print("%d dispatches: %.1f us each when launched one by one, %.1f us each in a command stream\n", BENCH_DISPATCHES, launch_us, stream_us);
+}
+
 int main(int argc, char* argv[]) {
     set_log_level(INFO);
     Args args = {
@@ -90,6 +155,9 @@ int main(int argc, char* argv[]) {
         program = new_program_from_module(runtime, &args.driver_config.config, module);
     }
 
+    // compile in the background while we set up the arguments
+    ProgramFuture* future = prepare_program(program, device, 1, (const char*[]) { "main" });
+
     int32_t stuff[] = { 42, 42, 42, 42 };
     Buffer* buffer = allocate_buffer_device(device, sizeof(stuff));
     copy_to_buffer(buffer, 0, stuff, sizeof(stuff));
@@ -97,10 +165,18 @@ int main(int argc, char* argv[]) {
 
     int32_t a0 = 42;
     uint64_t a1 = get_buffer_device_pointer(buffer);
+    if (!wait_program_future(future))
+        return -1;
     wait_completion(launch_kernel(program, device, "main", 1, 1, 1, 2, (void*[]) { &a0, &a1 }));
 
+    if (args.bench_dispatches)
+        bench_dispatches(device, program, (void*[]) { &a0, &a1 });
+
     destroy_buffer(buffer);
 
+    if (args.bench_copies)
+        bench_copies(device);
+
     shutdown_runtime(runtime);
     if (arena)
         destroy_ir_arena(arena);
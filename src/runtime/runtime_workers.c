@@ -0,0 +1,71 @@
+#include "runtime_private.h"
+
+#include "log.h"
+#include "list.h"
+#include "portability.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+static void* worker_main(Runtime* runtime) {
+    lock_mutex(&runtime->workers.lock);
+    while (true) {
+        while (entries_count_list(runtime->workers.queue) == 0 && !runtime->workers.shutting_down)
+            wait_cond_var(&runtime->workers.wakeup, &runtime->workers.lock);
+        if (entries_count_list(runtime->workers.queue) == 0)
+            break;
+        RuntimeJob job = read_list(RuntimeJob, runtime->workers.queue)[0];
+        remove_list_impl(runtime->workers.queue, 0);
+        unlock_mutex(&runtime->workers.lock);
+        job.fn(job.payload);
+        lock_mutex(&runtime->workers.lock);
+    }
+    unlock_mutex(&runtime->workers.lock);
+    return NULL;
+}
+
+bool start_runtime_workers(Runtime* runtime) {
+    size_t count = runtime->config.compiler_threads;
+    if (count == 0) {
+        // leave a processor to the thread doing the launches
+        count = get_processors_count();
+        count = count > 1 ? count - 1 : 1;
+    }
+
+    init_mutex(&runtime->workers.lock);
+    init_cond_var(&runtime->workers.wakeup);
+    runtime->workers.queue = new_list(RuntimeJob);
+    runtime->workers.threads = calloc(count, sizeof(Thread));
+    runtime->workers.shutting_down = false;
+    for (size_t i = 0; i < count; i++) {
+        if (!spawn_thread(&runtime->workers.threads[i], (void*(*)(void*)) worker_main, runtime)) {
+            error_print("Failed to start compiler thread %zu\n", i);
+            break;
+        }
+        runtime->workers.threads_count++;
+    }
+    debug_print("Started %zu compiler threads\n", runtime->workers.threads_count);
+    return runtime->workers.threads_count > 0;
+}
+
+void stop_runtime_workers(Runtime* runtime) {
+    lock_mutex(&runtime->workers.lock);
+    runtime->workers.shutting_down = true;
+    broadcast_cond_var(&runtime->workers.wakeup);
+    unlock_mutex(&runtime->workers.lock);
+    for (size_t i = 0; i < runtime->workers.threads_count; i++)
+        join_thread(runtime->workers.threads[i]);
+    assert(entries_count_list(runtime->workers.queue) == 0);
+    free(runtime->workers.threads);
+    destroy_list(runtime->workers.queue);
+    destroy_cond_var(&runtime->workers.wakeup);
+    destroy_mutex(&runtime->workers.lock);
+}
+
+void submit_runtime_job(Runtime* runtime, RuntimeJob job) {
+    lock_mutex(&runtime->workers.lock);
+    assert(!runtime->workers.shutting_down);
+    append_list(RuntimeJob, runtime->workers.queue, job);
+    signal_cond_var(&runtime->workers.wakeup);
+    unlock_mutex(&runtime->workers.lock);
+}
@@ -4,37 +4,6 @@
 
 #include <string.h>
 
-typedef enum {
-    AllocDeviceLocal,
-    AllocHostVisible
-} AllocHeap;
-
-static uint32_t find_suitable_memory_type(VkrDevice* device, uint32_t memory_type_bits, AllocHeap heap) {
-    VkPhysicalDeviceMemoryProperties device_memory_properties;
-    vkGetPhysicalDeviceMemoryProperties(device->caps.physical_device, &device_memory_properties);
-    for (size_t bit = 0; bit < 32; bit++) {
-        VkMemoryType memory_type = device_memory_properties.memoryTypes[bit];
-
-        bool is_host_visible = (memory_type.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
-        bool is_host_coherent = (memory_type.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
-        bool is_device_local = (memory_type.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
-
-        if ((memory_type_bits & (1 << bit)) != 0) {
-            switch (heap) {
-                case AllocDeviceLocal:
-                    if (is_device_local)
-                        return bit;
-                    break;
-                case AllocHostVisible:
-                    if (is_host_visible && is_host_coherent)
-                        return bit;
-                    break;
-            }
-        }
-    }
-    assert(false && "Unable to find a suitable memory type");
-}
-
 static Buffer make_base_buffer(VkrDevice*);
 
 VkrBuffer* vkr_allocate_buffer_device_(VkrDevice* device, size_t size, AllocHeap heap) {
@@ -46,60 +15,15 @@ VkrBuffer* vkr_allocate_buffer_device_(VkrDevice* device, size_t size, AllocHeap
     VkrBuffer* buffer = calloc(sizeof(VkrBuffer), 1);
     buffer->base = make_base_buffer(device);
     buffer->device = device;
-    buffer->imported = true;
-    buffer->offset = 0;
-    buffer->host_ptr = NULL;
+    buffer->imported = false;
     buffer->size = size;
 
-    VkBufferCreateInfo buffer_create_info = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .pNext = NULL,
-        .size = size,
-        .flags = 0,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 0,
-        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_EXT
-    };
-    CHECK_VK(vkCreateBuffer(device->device, &buffer_create_info, NULL, &buffer->buffer), goto err_post_obj_create);
-
-    VkBufferMemoryRequirementsInfo2 buf_mem_requirements = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
-        .pNext = NULL,
-        .buffer = buffer->buffer
-    };
-    VkMemoryRequirements2 mem_requirements = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
-        .pNext = NULL,
-    };
-    vkGetBufferMemoryRequirements2(device->device, &buf_mem_requirements, &mem_requirements);
-
-    VkMemoryAllocateInfo allocation_info = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .pNext = NULL,
-        .allocationSize = mem_requirements.memoryRequirements.size,
-        .memoryTypeIndex = find_suitable_memory_type(device, mem_requirements.memoryRequirements.memoryTypeBits, heap),
-    };
-    VkMemoryAllocateFlagsInfo allocate_flags =  {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
-        .pNext = NULL,
-        .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR,
-        .deviceMask = 0
-    };
-    append_pnext((VkBaseOutStructure*) &allocation_info, &allocate_flags);
-
-    CHECK_VK(vkAllocateMemory(device->device, &allocation_info, NULL, &buffer->memory), goto err_post_buffer_create);
-
-    CHECK_VK(vkBindBufferMemory(device->device, buffer->buffer, buffer->memory, 0), goto err_post_mem_alloc);
-
+    if (!vkr_allocate_memory(device, heap, size, buffer)) {
+        error_print("Failed to allocate a %zu bytes device buffer\n", size);
+        free(buffer);
+        return NULL;
+    }
     return buffer;
-
-err_post_mem_alloc:
-    vkFreeMemory(buffer->device->device, buffer->memory, NULL);
-err_post_buffer_create:
-    vkDestroyBuffer(buffer->device->device, buffer->buffer, NULL);
-err_post_obj_create:
-    free(buffer);
-    return NULL;
 }
 
 VkrBuffer* vkr_allocate_buffer_device(VkrDevice* device, size_t size) {
@@ -153,7 +77,7 @@ VkrBuffer* vkr_import_buffer_host(VkrDevice* device, void* ptr, size_t size) {
     debug_print("aligned start %zu end %zu\n", aligned_addr, aligned_end);
 
     buffer->host_ptr = (void*) aligned_addr;
-    buffer->size = aligned_size;
+    buffer->size = aligned_size - buffer->offset;
 
     VkBufferCreateInfo buffer_create_info = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -178,9 +102,9 @@ VkrBuffer* vkr_import_buffer_host(VkrDevice* device, void* ptr, size_t size) {
     };
     CHECK_VK(device->extensions.EXT_external_memory_host.vkGetMemoryHostPointerPropertiesEXT(device->device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, ptr, &host_ptr_properties), goto err_post_buffer_create);
     uint32_t memory_type_index = find_suitable_memory_type(device, host_ptr_properties.memoryTypeBits, AllocHostVisible);
-    VkPhysicalDeviceMemoryProperties device_memory_properties;
-    vkGetPhysicalDeviceMemoryProperties(device->caps.physical_device, &device_memory_properties);
-    debug_print("memory type index: %d heap: %d\n", memory_type_index, device_memory_properties.memoryTypes[memory_type_index].heapIndex);
+    if (memory_type_index == UINT32_MAX)
+        goto err_post_buffer_create;
+    debug_print("memory type index: %d heap: %d\n", memory_type_index, device->caps.memory_properties.memoryTypes[memory_type_index].heapIndex);
 
     VkMemoryAllocateInfo allocation_info = {
         .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
@@ -219,11 +143,18 @@ err_post_obj_create:
 }
 
 static void vkr_destroy_buffer(VkrBuffer* buffer) {
-    vkDestroyBuffer(buffer->device->device, buffer->buffer, NULL);
-    vkFreeMemory(buffer->device->device, buffer->memory, NULL);
+    if (buffer->block) {
+        vkr_free_memory(buffer->device, buffer);
+    } else {
+        vkDestroyBuffer(buffer->device->device, buffer->buffer, NULL);
+        vkFreeMemory(buffer->device->device, buffer->memory, NULL);
+    }
+    free(buffer);
 }
 
 static VkDeviceAddress vkr_get_buffer_device_pointer(VkrBuffer* buf) {
+    if (buf->block)
+        return buf->block->device_address + buf->offset;
     return vkGetBufferDeviceAddress(buf->device->device, &(VkBufferDeviceAddressInfo) {
         .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
         .pNext = NULL,
@@ -232,106 +163,23 @@ static VkDeviceAddress vkr_get_buffer_device_pointer(VkrBuffer* buf) {
 }
 
 static void* vkr_get_buffer_host_pointer(VkrBuffer* buf) {
-    return ((char*) buf->host_ptr) + buf->offset;
-}
-
-static VkrCommand* submit_buffer_copy(VkrDevice* device, VkBuffer src, size_t src_offset, VkBuffer dst, size_t dst_offset, size_t size) {
-    VkrCommand* commands = vkr_begin_command(device);
-    if (!commands)
+    if (!buf->host_ptr)
         return NULL;
-
-    vkCmdCopyBuffer(commands->cmd_buf, src, dst, 1, (VkBufferCopy[]) { { .srcOffset = src_offset, .dstOffset = dst_offset, .size = size } });
-
-    if (!vkr_submit_command(commands))
-        goto err_post_commands_create;
-
-    return commands;
-
-err_post_commands_create:
-    vkr_destroy_command(commands);
-    return NULL;
-}
-
-static bool vkr_copy_to_buffer_fallback(VkrBuffer* dst, size_t buffer_offset, void* src, size_t size) {
-    VkrDevice* device = dst->device;
-
-    VkrBuffer* src_buf = vkr_allocate_buffer_device_(device, size, AllocHostVisible);
-    if (!src_buf)
-        return false;
-
-    void* mapped;
-    CHECK_VK(vkMapMemory(device->device, src_buf->memory, src_buf->offset, src_buf->size, 0, &mapped), goto err_post_buffer_create);
-    memcpy(mapped, src, size);
-
-    if (!wait_completion(submit_buffer_copy(device, src_buf->buffer, src_buf->offset, dst->buffer, dst->offset + buffer_offset, size)))
-        goto err_post_buffer_create;
-
-    vkUnmapMemory(device->device, src_buf->memory);
-    vkr_destroy_buffer(src_buf);
-    return true;
-
-    err_post_buffer_create:
-    vkr_destroy_buffer(src_buf);
-    return false;
+    return ((char*) buf->host_ptr) + buf->offset;
 }
 
-static bool vkr_copy_from_buffer_fallback(VkrBuffer* src, size_t buffer_offset, void* dst, size_t size) {
-    VkrDevice* device = src->device;
-
-    VkrBuffer* dst_buf = vkr_allocate_buffer_device_(device, size, AllocHostVisible);
-    if (!dst_buf)
+static bool vkr_copy_to_buffer(VkrBuffer* dst, size_t buffer_offset, void* src, size_t size) {
+    VkrTransfer* transfer = vkr_copy_to_buffer_async(dst, buffer_offset, src, size);
+    if (!transfer)
         return false;
-
-    void* mapped;
-    CHECK_VK(vkMapMemory(device->device, dst_buf->memory, dst_buf->offset, dst_buf->size, 0, &mapped), goto err_post_buffer_create);
-
-    if (!wait_completion(submit_buffer_copy(device, src->buffer, src->offset + buffer_offset, dst_buf->buffer, dst_buf->offset, size)))
-        goto err_post_buffer_create;
-
-    memcpy(dst, mapped, size);
-    vkUnmapMemory(device->device, dst_buf->memory);
-    vkr_destroy_buffer(dst_buf);
-    return true;
-
-    err_post_buffer_create:
-    vkr_destroy_buffer(dst_buf);
-    return false;
+    return vkr_wait_transfer(transfer);
 }
 
-static bool vkr_copy_to_buffer_importing(VkrBuffer* dst, size_t buffer_offset, void* src, size_t size) {
-    VkrDevice* device = dst->device;
-
-    VkrBuffer* src_buf = vkr_import_buffer_host(device, src, size);
-    if (!src_buf)
+static bool vkr_copy_from_buffer(VkrBuffer* src, size_t buffer_offset, void* dst, size_t size) {
+    VkrTransfer* transfer = vkr_copy_from_buffer_async(src, buffer_offset, dst, size);
+    if (!transfer)
         return false;
-
-    if (!wait_completion(submit_buffer_copy(device, src_buf->buffer, src_buf->offset, dst->buffer, dst->offset + buffer_offset, size)))
-        goto err_post_buffer_import;
-
-    vkr_destroy_buffer(src_buf);
-    return true;
-
-err_post_buffer_import:
-    vkr_destroy_buffer(src_buf);
-    return false;
-}
-
-static bool vkr_copy_from_buffer_importing(VkrBuffer* src, size_t buffer_offset, void* dst, size_t size) {
-    VkrDevice* device = src->device;
-
-    VkrBuffer* dst_buf = vkr_import_buffer_host(device, dst, size);
-    if (!dst_buf)
-        return false;
-
-    if (!wait_completion(submit_buffer_copy(device, src->buffer, src->offset + buffer_offset, dst_buf->buffer, dst_buf->offset, size)))
-        goto err_post_buffer_import;
-
-    vkr_destroy_buffer(dst_buf);
-    return true;
-
-err_post_buffer_import:
-    vkr_destroy_buffer(dst_buf);
-    return false;
+    return vkr_wait_transfer(transfer);
 }
 
 static Buffer make_base_buffer(VkrDevice* device) {
@@ -339,12 +187,10 @@ static Buffer make_base_buffer(VkrDevice* device) {
         .destroy = (void(*)(Buffer*)) vkr_destroy_buffer,
         .get_device_ptr = (uint64_t(*)(Buffer*)) vkr_get_buffer_device_pointer,
         .get_host_ptr = (void*(*)(Buffer*)) vkr_get_buffer_host_pointer,
-        .copy_into = (bool(*)(Buffer*, size_t, void*, size_t)) vkr_copy_to_buffer_fallback,
-        .copy_from = (bool(*)(Buffer*, size_t, void*, size_t)) vkr_copy_from_buffer_fallback,
+        .copy_into = (bool(*)(Buffer*, size_t, void*, size_t)) vkr_copy_to_buffer,
+        .copy_from = (bool(*)(Buffer*, size_t, void*, size_t)) vkr_copy_from_buffer,
+        .copy_into_async = (Command*(*)(Buffer*, size_t, void*, size_t)) vkr_copy_to_buffer_async,
+        .copy_from_async = (Command*(*)(Buffer*, size_t, void*, size_t)) vkr_copy_from_buffer_async,
     };
-    if (vkr_can_import_host_memory(device)) {
-        buffer.copy_from = (bool(*)(Buffer*, size_t, void*, size_t)) vkr_copy_from_buffer_importing;
-        buffer.copy_into = (bool(*)(Buffer*, size_t, void*, size_t)) vkr_copy_to_buffer_importing;
-    }
     return buffer;
 }
@@ -101,6 +101,7 @@ static bool fill_device_properties(VkrDeviceCaps* caps) {
     }
 
     vkGetPhysicalDeviceProperties2(caps->physical_device, &caps->properties.base);
+    vkGetPhysicalDeviceMemoryProperties(caps->physical_device, &caps->memory_properties);
 
     if (caps->supported_extensions[ShadySupportsEXT_subgroup_size_control] || caps->properties.base.properties.apiVersion >= VK_MAKE_VERSION(1, 3, 0)) {
         caps->subgroup_size.max = caps->properties.subgroup_size_control.maxSubgroupSize;
@@ -154,6 +155,11 @@ static bool fill_device_features(VkrDeviceCaps* caps) {
         append_pnext((VkBaseOutStructure*) &caps->features.base, &caps->features.storage16);
     }
 
+    if (caps->properties.base.properties.apiVersion >= VK_MAKE_VERSION(1, 2, 0)) {
+        caps->features.timeline_semaphore.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        append_pnext((VkBaseOutStructure*) &caps->features.base, &caps->features.timeline_semaphore);
+    }
+
     vkGetPhysicalDeviceFeatures2(caps->physical_device, &caps->features.base);
 
     if (!caps->features.subgroup_size_control.computeFullSubgroups) {
@@ -209,11 +215,11 @@ static bool get_physical_device_caps(SHADY_UNUSED VkrBackend* runtime, VkPhysica
 }
 
 KeyHash hash_spec_program_key(SpecProgramKey* ptr) {
-    return hash_murmur(ptr, sizeof(SpecProgramKey));
+    return hash_murmur(&ptr->base, sizeof(Program*)) ^ hash_murmur(ptr->entry_point, strlen(ptr->entry_point));
 }
 
 bool cmp_spec_program_keys(SpecProgramKey* a, SpecProgramKey* b) {
-    return memcmp(a, b, sizeof(SpecProgramKey)) == 0;
+    return a->base == b->base && strcmp(a->entry_point, b->entry_point) == 0;
 }
 
 static void obtain_device_pointers(VkrDevice* device) {
@@ -264,10 +270,16 @@ static VkrDevice* create_vkr_device(SHADY_UNUSED VkrBackend* runtime, VkPhysical
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .pNext = NULL,
         .queueFamilyIndex = device->caps.compute_queue_family,
-        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
     }, NULL, &device->cmd_pool), goto delete_device);
 
+    CHECK(init_vkr_commands(device), goto delete_cmd_pool);
+    CHECK(init_vkr_memory(device), goto shutdown_commands);
+    init_vkr_transfers(device);
+
     device->specialized_programs = new_dict(SpecProgramKey, VkrSpecProgram*, (HashFn) hash_spec_program_key, (CmpFn) cmp_spec_program_keys);
+    init_mutex(&device->specialized_programs_lock);
+    init_cond_var(&device->specialized_program_done);
 
     vkGetDeviceQueue(device->device, device->caps.compute_queue_family, 0, &device->compute_queue);
 
@@ -275,6 +287,10 @@ static VkrDevice* create_vkr_device(SHADY_UNUSED VkrBackend* runtime, VkPhysical
 
     return device;
 
+    shutdown_commands:
+    shutdown_vkr_commands(device);
+    delete_cmd_pool:
+    vkDestroyCommandPool(device->device, device->cmd_pool, NULL);
     delete_device:
     vkDestroyDevice(device->device, NULL);
 
@@ -283,6 +299,8 @@ static VkrDevice* create_vkr_device(SHADY_UNUSED VkrBackend* runtime, VkPhysical
 }
 
 static void shutdown_vkr_device(VkrDevice* device) {
+    shutdown_vkr_transfers(device);
+    shutdown_vkr_commands(device);
     size_t i = 0;
     SpecProgramKey k;
     VkrSpecProgram* sp;
@@ -290,6 +308,9 @@ static void shutdown_vkr_device(VkrDevice* device) {
         destroy_specialized_program(sp);
     }
     destroy_dict(device->specialized_programs);
+    destroy_cond_var(&device->specialized_program_done);
+    destroy_mutex(&device->specialized_programs_lock);
+    shutdown_vkr_memory(device);
     vkDestroyCommandPool(device->device, device->cmd_pool, NULL);
     vkDestroyDevice(device->device, NULL);
     free(device);
@@ -314,13 +335,24 @@ bool probe_vkr_devices(VkrBackend* runtime) {
         VkrDeviceCaps dummy;
         if (get_physical_device_caps(runtime, physical_device, &dummy)) {
             VkrDevice* device = create_vkr_device(runtime, physical_device);
+            // kernels run with the largest subgroup size each device has, see create_vk_pipeline
+            uint32_t subgroup_size = device->caps.subgroup_size.max;
+            if (runtime->subgroup_sizes.max == 0 || subgroup_size < runtime->subgroup_sizes.min)
+                runtime->subgroup_sizes.min = subgroup_size;
+            if (subgroup_size > runtime->subgroup_sizes.max)
+                runtime->subgroup_sizes.max = subgroup_size;
             device->base = (Device) {
                 .cleanup = (void(*)(Device*)) shutdown_vkr_device,
                 .get_name = (String(*)(Device*)) get_vkr_device_name,
                 .allocate_buffer = (Buffer*(*)(Device*, size_t)) vkr_allocate_buffer_device,
                 .import_host_memory_as_buffer = (Buffer*(*)(Device*, void*, size_t)) vkr_import_buffer_host,
                 .launch_kernel = (Command*(*)(Device*, Program*, String, int, int, int, int, void**)) vkr_launch_kernel,
+                .begin_command_stream = (CommandStream*(*)(Device*)) vkr_begin_command_stream,
+                .prepare_program = (bool(*)(Device*, Program*, String)) vkr_prepare_program,
+                .is_program_ready = (bool(*)(Device*, Program*, String)) vkr_is_program_ready,
+                .wait_program_ready = (bool(*)(Device*, Program*, String)) vkr_wait_program_ready,
                 .can_import_host_memory = (bool(*)(Device*)) vkr_can_import_host_memory,
+                .get_memory_stats = (DeviceMemoryStats(*)(Device*)) vkr_get_memory_stats,
             };
             append_list(Device*, runtime->base.runtime->devices, device);
         }
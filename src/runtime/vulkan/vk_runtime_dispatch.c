@@ -1,6 +1,7 @@
 #include "vk_runtime_private.h"
 
 #include "log.h"
+#include "list.h"
 #include "portability.h"
 
 #include <assert.h>
@@ -10,64 +11,17 @@
 static void bind_program_resources(VkrCommand* cmd, VkrSpecProgram* prog) {
     if (prog->resources.num_resources == 0)
         return;
-
-    LARRAY(VkWriteDescriptorSet, write_descriptor_sets, prog->resources.num_resources);
-    LARRAY(VkDescriptorBufferInfo, descriptor_buffer_info, prog->resources.num_resources);
-    size_t write_descriptor_sets_count = 0;
-
-    LARRAY(VkDescriptorSet, bind_sets, prog->resources.num_resources);
-    size_t bind_sets_count = 0;
-
-    for (size_t i = 0; i < prog->resources.num_resources; i++) {
-        ProgramResourceInfo* resource = prog->resources.resources[i];
-        if (resource->is_bound) {
-            descriptor_buffer_info[write_descriptor_sets_count] = (VkDescriptorBufferInfo) {
-                .buffer = resource->buffer->buffer,
-                .offset = resource->buffer->offset,
-                .range = resource->buffer->size - resource->buffer->offset,
-            };
-
-            write_descriptor_sets[write_descriptor_sets_count] = (VkWriteDescriptorSet) {
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .pNext = NULL,
-                .descriptorType = as_to_descriptor_type(resource->as),
-                .descriptorCount = 1,
-                .dstSet = prog->sets[resource->set],
-                .dstBinding = resource->binding,
-                .pBufferInfo = &descriptor_buffer_info[write_descriptor_sets_count],
-            };
-
-            write_descriptor_sets_count++;
-        }
-    }
-
-    vkUpdateDescriptorSets(prog->device->device, write_descriptor_sets_count, write_descriptor_sets, 0, NULL);
-
-    for (size_t set = 0; set < MAX_DESCRIPTOR_SETS; set++) {
-        bind_sets[set] = prog->sets[set];
-    }
-    bind_sets_count = MAX_DESCRIPTOR_SETS;
-
-    vkCmdBindDescriptorSets(cmd->cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, prog->layout, 0, bind_sets_count, bind_sets, 0, NULL);
+    vkCmdBindDescriptorSets(cmd->cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, prog->layout, 0, MAX_DESCRIPTOR_SETS, prog->sets, 0, NULL);
 }
 
 static Command make_command_base() {
     return (Command) {
             .wait_for_completion = (bool(*)(Command*)) vkr_wait_completion,
+            .is_complete = (bool(*)(Command*)) vkr_is_command_complete,
     };
 }
 
-VkrCommand* vkr_launch_kernel(VkrDevice* device, Program* program, String entry_point, int dimx, int dimy, int dimz, int args_count, void** args) {
-    assert(program && device);
-
-    VkrSpecProgram* prog = get_specialized_program(program, entry_point, device);
-
-    debug_print("Dispatching kernel on %s\n", device->caps.properties.base.properties.deviceName);
-
-    VkrCommand* cmd = vkr_begin_command(device);
-    if (!cmd)
-        return NULL;
-
+void vkr_record_dispatch(VkrCommand* cmd, VkrSpecProgram* prog, int dimx, int dimy, int dimz, int args_count, void** args) {
     ProgramParamsInfo entrypoint_info = prog->parameters;
     if (entrypoint_info.args_size) {
         assert(args_count == entrypoint_info.num_args && "number of arguments must match number of entrypoint arguments");
@@ -83,18 +37,54 @@ VkrCommand* vkr_launch_kernel(VkrDevice* device, Program* program, String entry_
     vkCmdBindPipeline(cmd->cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, prog->pipeline);
     bind_program_resources(cmd, prog);
     vkCmdDispatch(cmd->cmd_buf, dimx, dimy, dimz);
+}
 
-    if (!vkr_submit_command(cmd))
-        goto err_post_commands_create;
+VkrCommand* vkr_launch_kernel(VkrDevice* device, Program* program, String entry_point, int dimx, int dimy, int dimz, int args_count, void** args) {
+    assert(program && device);
 
-    return cmd;
+    VkrCommandStream* stream = vkr_begin_command_stream(device);
+    if (!stream)
+        return NULL;
+    vkr_stream_dispatch(stream, program, entry_point, dimx, dimy, dimz, args_count, args);
+    return vkr_submit_command_stream(stream);
+}
 
-err_post_commands_create:
-    vkr_destroy_command(cmd);
-    return NULL;
+bool init_vkr_commands(VkrDevice* device) {
+    init_mutex(&device->commands.lock);
+    device->commands.free = new_list(VkrCommand*);
+    device->commands.last_submitted = 0;
+    if (device->caps.features.timeline_semaphore.timelineSemaphore) {
+        VkSemaphoreTypeCreateInfo semaphore_type = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .pNext = NULL,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+        };
+        CHECK_VK(vkCreateSemaphore(device->device, &(VkSemaphoreCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &semaphore_type,
+            .flags = 0,
+        }, NULL, &device->commands.timeline), return false);
+    }
+    return true;
 }
 
-VkrCommand* vkr_begin_command(VkrDevice* device) {
+void shutdown_vkr_commands(VkrDevice* device) {
+    vkQueueWaitIdle(device->compute_queue);
+    for (size_t i = 0; i < entries_count_list(device->commands.free); i++) {
+        VkrCommand* cmd = read_list(VkrCommand*, device->commands.free)[i];
+        vkFreeCommandBuffers(device->device, device->cmd_pool, 1, &cmd->cmd_buf);
+        if (cmd->done_fence)
+            vkDestroyFence(device->device, cmd->done_fence, NULL);
+        free(cmd);
+    }
+    destroy_list(device->commands.free);
+    if (device->commands.timeline)
+        vkDestroySemaphore(device->device, device->commands.timeline, NULL);
+    destroy_mutex(&device->commands.lock);
+}
+
+static VkrCommand* new_command(VkrDevice* device) {
     VkrCommand* cmd = calloc(1, sizeof(VkrCommand));
     cmd->base = make_command_base();
     cmd->device = device;
@@ -107,59 +97,134 @@ VkrCommand* vkr_begin_command(VkrDevice* device) {
         .commandBufferCount = 1
     }, &cmd->cmd_buf), goto err_post_commands_create);
 
+    if (!device->commands.timeline) {
+        CHECK_VK(vkCreateFence(device->device, &(VkFenceCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0
+        }, NULL, &cmd->done_fence), goto err_post_cmd_buf_create);
+    }
+
+    return cmd;
+
+err_post_cmd_buf_create:
+    vkFreeCommandBuffers(device->device, device->cmd_pool, 1, &cmd->cmd_buf);
+err_post_commands_create:
+    free(cmd);
+    return NULL;
+}
+
+VkrCommand* vkr_begin_command(VkrDevice* device) {
+    lock_mutex(&device->commands.lock);
+    VkrCommand* cmd;
+    if (entries_count_list(device->commands.free) > 0) {
+        cmd = pop_last_list(VkrCommand*, device->commands.free);
+    } else {
+        cmd = new_command(device);
+    }
+    unlock_mutex(&device->commands.lock);
+    if (!cmd)
+        return NULL;
+    cmd->submitted = false;
+    cmd->timeline_value = 0;
+
+    // beginning a recycled command buffer resets it
     CHECK_VK(vkBeginCommandBuffer(cmd->cmd_buf, &(VkCommandBufferBeginInfo) {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
         .pNext = NULL,
         .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
         .pInheritanceInfo = NULL
-    }), goto err_post_cmd_buf_create);
+    }), goto err_post_cmd_acquire);
 
     return cmd;
 
-err_post_cmd_buf_create:
-    vkFreeCommandBuffers(device->device, device->cmd_pool, 1, &cmd->cmd_buf);
-err_post_commands_create:
-    free(cmd);
+err_post_cmd_acquire:
+    vkr_destroy_command(cmd);
     return NULL;
 }
 
 bool vkr_submit_command(VkrCommand* cmd) {
+    VkrDevice* device = cmd->device;
     CHECK_VK(vkEndCommandBuffer(cmd->cmd_buf), return false);
 
-    CHECK_VK(vkCreateFence(cmd->device->device, &(VkFenceCreateInfo) {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0
-    }, NULL, &cmd->done_fence), return false);
-
-    CHECK_VK(vkQueueSubmit(cmd->device->compute_queue, 1, &(VkSubmitInfo) {
+    // the timeline values have to be handed out in submission order
+    lock_mutex(&device->commands.lock);
+    uint64_t value = device->commands.last_submitted + 1;
+    VkSubmitInfo submit_info = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
         .pNext = NULL,
         .waitSemaphoreCount = 0,
         .commandBufferCount = 1,
-        .pCommandBuffers = (VkCommandBuffer[]) { cmd->cmd_buf },
+        .pCommandBuffers = &cmd->cmd_buf,
         .signalSemaphoreCount = 0
-    }, cmd->done_fence), goto err_post_fence_create);
+    };
+    VkTimelineSemaphoreSubmitInfo timeline_info = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .pNext = NULL,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &value,
+    };
+    if (device->commands.timeline) {
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &device->commands.timeline;
+        append_pnext((VkBaseOutStructure*) &submit_info, &timeline_info);
+    }
+    VkResult result = vkQueueSubmit(device->compute_queue, 1, &submit_info, cmd->done_fence);
+    if (result == VK_SUCCESS)
+        device->commands.last_submitted = value;
+    unlock_mutex(&device->commands.lock);
+    CHECK_VK(result, return false);
 
+    cmd->timeline_value = value;
     cmd->submitted = true;
-
     return true;
+}
 
-err_post_fence_create:
-    vkDestroyFence(cmd->device->device, cmd->done_fence, NULL);
-    return false;
+bool vkr_is_command_complete(VkrCommand* cmd) {
+    assert(cmd->submitted && "Command must be submitted before they can be polled");
+    VkrDevice* device = cmd->device;
+    if (device->commands.timeline) {
+        uint64_t value;
+        CHECK_VK(vkGetSemaphoreCounterValue(device->device, device->commands.timeline, &value), return false);
+        return value >= cmd->timeline_value;
+    }
+    return vkGetFenceStatus(device->device, cmd->done_fence) == VK_SUCCESS;
 }
 
-bool vkr_wait_completion(VkrCommand* cmd) {
+bool vkr_wait_command(VkrCommand* cmd) {
     assert(cmd->submitted && "Command must be submitted before they can be waited on");
-    CHECK_VK(vkWaitForFences(cmd->device->device, 1, (VkFence[]) { cmd->done_fence }, true, UINT32_MAX), return false);
+    VkrDevice* device = cmd->device;
+    if (device->commands.timeline) {
+        CHECK_VK(vkWaitSemaphores(device->device, &(VkSemaphoreWaitInfo) {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .semaphoreCount = 1,
+            .pSemaphores = &device->commands.timeline,
+            .pValues = &cmd->timeline_value,
+        }, UINT64_MAX), return false);
+    } else {
+        CHECK_VK(vkWaitForFences(device->device, 1, &cmd->done_fence, true, UINT64_MAX), return false);
+    }
+    return true;
+}
+
+bool vkr_wait_completion(VkrCommand* cmd) {
+    if (!vkr_wait_command(cmd))
+        return false;
     vkr_destroy_command(cmd);
     return true;
 }
 
 void vkr_destroy_command(VkrCommand* cmd) {
-    if (cmd->submitted)
-        vkDestroyFence(cmd->device->device, cmd->done_fence, NULL);
-    vkFreeCommandBuffers(cmd->device->device, cmd->device->cmd_pool, 1, &cmd->cmd_buf);
-    free(cmd);
+    VkrDevice* device = cmd->device;
+    if (cmd->submitted && cmd->done_fence)
+        vkResetFences(device->device, 1, &cmd->done_fence);
+    // it might have been abandoned while recording, it can't be begun again in that state
+    if (!cmd->submitted)
+        CHECK_VK(vkResetCommandBuffer(cmd->cmd_buf, 0), return);
+    cmd->submitted = false;
+    lock_mutex(&device->commands.lock);
+    append_list(VkrCommand*, device->commands.free, cmd);
+    unlock_mutex(&device->commands.lock);
 }
@@ -0,0 +1,288 @@
+#include "vk_runtime_private.h"
+
+#include "log.h"
+#include "list.h"
+#include "tlsf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#define MiB * 1024 * 1024
+
+/// Drivers cap how many allocations we can have (maxMemoryAllocationCount, often 4096) and each one is slow, so buffers come from large blocks
+#define default_block_size (64 MiB)
+/// Buffers larger than that get a block of their own, rather than making a mess of the shared ones
+#define dedicated_threshold(block_size) ((block_size) / 2)
+/// Whatever the limits say, pointers into buffers should be good for any type
+#define min_buffer_alignment 64
+
+static const VkBufferUsageFlags block_buffer_usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_EXT;
+
+static bool is_suitable_memory_type(VkMemoryType memory_type, AllocHeap heap) {
+    bool is_host_visible = (memory_type.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+    bool is_host_coherent = (memory_type.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    bool is_device_local = (memory_type.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0;
+    switch (heap) {
+        case AllocDeviceLocal: return is_device_local;
+        case AllocHostVisible: return is_host_visible && is_host_coherent;
+        default: assert(false);
+    }
+    return false;
+}
+
+uint32_t find_suitable_memory_type(VkrDevice* device, uint32_t memory_type_bits, AllocHeap heap) {
+    const VkPhysicalDeviceMemoryProperties* properties = &device->caps.memory_properties;
+    for (uint32_t bit = 0; bit < properties->memoryTypeCount; bit++) {
+        if ((memory_type_bits & (1u << bit)) != 0 && is_suitable_memory_type(properties->memoryTypes[bit], heap))
+            return bit;
+    }
+    error_print("Unable to find a suitable memory type\n");
+    return UINT32_MAX;
+}
+
+static size_t get_block_size(VkrDevice* device, uint32_t memory_type) {
+    const VkPhysicalDeviceMemoryProperties* properties = &device->caps.memory_properties;
+    size_t heap_size = properties->memoryHeaps[properties->memoryTypes[memory_type].heapIndex].size;
+    // small heaps (integrated GPUs, BAR memory) should not be taken up by a single block
+    size_t block_size = default_block_size;
+    while (block_size > 1 MiB && block_size > heap_size / 8)
+        block_size /= 2;
+    return block_size;
+}
+
+static size_t get_buffer_alignment(VkrDevice* device) {
+    const VkPhysicalDeviceLimits* limits = &device->caps.properties.base.properties.limits;
+    size_t alignment = min_buffer_alignment;
+    if (limits->minStorageBufferOffsetAlignment > alignment)
+        alignment = limits->minStorageBufferOffsetAlignment;
+    if (limits->minUniformBufferOffsetAlignment > alignment)
+        alignment = limits->minUniformBufferOffsetAlignment;
+    return alignment;
+}
+
+static void destroy_memory_block(VkrDevice* device, VkrMemoryBlock* block) {
+    if (block->mapped)
+        vkUnmapMemory(device->device, block->memory);
+    vkDestroyBuffer(device->device, block->buffer, NULL);
+    vkFreeMemory(device->device, block->memory, NULL);
+    if (block->allocator)
+        destroy_tlsf(block->allocator);
+    free(block);
+}
+
+static VkrMemoryBlock* create_memory_block(VkrDevice* device, AllocHeap heap, size_t size, bool dedicated) {
+    VkrMemoryPool* pool = &device->memory.pools[heap];
+    VkrMemoryBlock* block = calloc(1, sizeof(VkrMemoryBlock));
+    block->heap = heap;
+    block->size = size;
+
+    CHECK_VK(vkCreateBuffer(device->device, &(VkBufferCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .size = size,
+        .flags = 0,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .usage = block_buffer_usage,
+    }, NULL, &block->buffer), goto err_post_obj_create);
+
+    VkMemoryRequirements2 mem_requirements = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+        .pNext = NULL,
+    };
+    vkGetBufferMemoryRequirements2(device->device, &(VkBufferMemoryRequirementsInfo2) {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+        .pNext = NULL,
+        .buffer = block->buffer
+    }, &mem_requirements);
+    assert((mem_requirements.memoryRequirements.memoryTypeBits & (1u << pool->memory_type)) != 0);
+
+    VkMemoryAllocateInfo allocation_info = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = NULL,
+        .allocationSize = mem_requirements.memoryRequirements.size,
+        .memoryTypeIndex = pool->memory_type,
+    };
+    VkMemoryAllocateFlagsInfo allocate_flags =  {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+        .pNext = NULL,
+        .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR,
+        .deviceMask = 0
+    };
+    append_pnext((VkBaseOutStructure*) &allocation_info, &allocate_flags);
+    CHECK_VK(vkAllocateMemory(device->device, &allocation_info, NULL, &block->memory), goto err_post_buffer_create);
+    CHECK_VK(vkBindBufferMemory(device->device, block->buffer, block->memory, 0), goto err_post_mem_alloc);
+
+    if (heap == AllocHostVisible)
+        CHECK_VK(vkMapMemory(device->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped), goto err_post_mem_alloc);
+
+    block->device_address = vkGetBufferDeviceAddress(device->device, &(VkBufferDeviceAddressInfo) {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .pNext = NULL,
+        .buffer = block->buffer
+    });
+
+    if (!dedicated)
+        block->allocator = new_tlsf(size);
+    debug_print("Allocated a %zu KiB %s memory block\n", size / 1024, dedicated ? "dedicated" : "shared");
+    return block;
+
+err_post_mem_alloc:
+    vkFreeMemory(device->device, block->memory, NULL);
+err_post_buffer_create:
+    vkDestroyBuffer(device->device, block->buffer, NULL);
+err_post_obj_create:
+    free(block);
+    return NULL;
+}
+
+/// Buffers created with the same usage can live in the same memory types, so a throwaway buffer tells us which ones we can use for all of them
+bool init_vkr_memory(VkrDevice* device) {
+    VkBuffer probe;
+    CHECK_VK(vkCreateBuffer(device->device, &(VkBufferCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext = NULL,
+        .size = 1,
+        .flags = 0,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .usage = block_buffer_usage,
+    }, NULL, &probe), return false);
+    VkMemoryRequirements mem_requirements;
+    vkGetBufferMemoryRequirements(device->device, probe, &mem_requirements);
+    vkDestroyBuffer(device->device, probe, NULL);
+
+    init_mutex(&device->memory.lock);
+    for (AllocHeap heap = 0; heap < AllocHeapsCount; heap++) {
+        VkrMemoryPool* pool = &device->memory.pools[heap];
+        pool->memory_type = find_suitable_memory_type(device, mem_requirements.memoryTypeBits, heap);
+        pool->block_size = pool->memory_type != UINT32_MAX ? get_block_size(device, pool->memory_type) : 0;
+        pool->blocks = new_list(VkrMemoryBlock*);
+    }
+    return true;
+}
+
+void shutdown_vkr_memory(VkrDevice* device) {
+    for (size_t i = 0; i < AllocHeapsCount; i++) {
+        VkrMemoryPool* pool = &device->memory.pools[i];
+        for (size_t j = 0; j < entries_count_list(pool->blocks); j++) {
+            VkrMemoryBlock* block = read_list(VkrMemoryBlock*, pool->blocks)[j];
+            if (!block->allocator || !tlsf_is_empty(block->allocator))
+                warn_print("Device memory block still has live buffers at shutdown\n");
+            destroy_memory_block(device, block);
+        }
+        destroy_list(pool->blocks);
+    }
+    destroy_mutex(&device->memory.lock);
+}
+
+static bool allocate_from_pool(VkrDevice* device, AllocHeap heap, size_t size, VkrBuffer* buffer) {
+    VkrMemoryPool* pool = &device->memory.pools[heap];
+    if (pool->memory_type == UINT32_MAX)
+        return false;
+
+    if (size > dedicated_threshold(pool->block_size)) {
+        VkrMemoryBlock* block = create_memory_block(device, heap, size, true);
+        if (!block)
+            return false;
+        append_list(VkrMemoryBlock*, pool->blocks, block);
+        buffer->block = block;
+        buffer->range = NULL;
+        buffer->offset = 0;
+        return true;
+    }
+
+    size_t alignment = get_buffer_alignment(device);
+    // the most recent blocks are the likeliest to have room
+    for (size_t i = entries_count_list(pool->blocks); i > 0; i--) {
+        VkrMemoryBlock* block = read_list(VkrMemoryBlock*, pool->blocks)[i - 1];
+        if (!block->allocator)
+            continue;
+        buffer->range = tlsf_alloc(block->allocator, size, alignment, &buffer->offset);
+        if (buffer->range) {
+            buffer->block = block;
+            return true;
+        }
+    }
+
+    VkrMemoryBlock* block = create_memory_block(device, heap, pool->block_size, false);
+    if (!block)
+        return false;
+    append_list(VkrMemoryBlock*, pool->blocks, block);
+    buffer->range = tlsf_alloc(block->allocator, size, alignment, &buffer->offset);
+    assert(buffer->range);
+    buffer->block = block;
+    return true;
+}
+
+bool vkr_allocate_memory(VkrDevice* device, AllocHeap heap, size_t size, VkrBuffer* buffer) {
+    lock_mutex(&device->memory.lock);
+    bool ok = allocate_from_pool(device, heap, size, buffer);
+    unlock_mutex(&device->memory.lock);
+    if (!ok)
+        return false;
+
+    VkrMemoryBlock* block = buffer->block;
+    buffer->buffer = block->buffer;
+    buffer->memory = block->memory;
+    buffer->host_ptr = block->mapped;
+    return true;
+}
+
+void vkr_free_memory(VkrDevice* device, VkrBuffer* buffer) {
+    VkrMemoryBlock* block = buffer->block;
+    VkrMemoryPool* pool = &device->memory.pools[block->heap];
+    lock_mutex(&device->memory.lock);
+    if (block->allocator)
+        tlsf_free(block->allocator, buffer->range);
+
+    if (!block->allocator || tlsf_is_empty(block->allocator)) {
+        size_t index = SIZE_MAX;
+        size_t empty_blocks = 0;
+        for (size_t i = 0; i < entries_count_list(pool->blocks); i++) {
+            VkrMemoryBlock* other = read_list(VkrMemoryBlock*, pool->blocks)[i];
+            if (other == block)
+                index = i;
+            else if (other->allocator && tlsf_is_empty(other->allocator))
+                empty_blocks++;
+        }
+        assert(index != SIZE_MAX);
+        // one empty shared block is kept around, so that allocating and freeing a single buffer in a loop doesn't hit the driver every time
+        if (!block->allocator || empty_blocks > 0) {
+            remove_list_impl(pool->blocks, index);
+            destroy_memory_block(device, block);
+        }
+    }
+    unlock_mutex(&device->memory.lock);
+    buffer->block = NULL;
+    buffer->range = NULL;
+}
+
+DeviceMemoryStats vkr_get_memory_stats(VkrDevice* device) {
+    DeviceMemoryStats stats = { 0 };
+    size_t free_bytes = 0;
+    // free space can't be shared across blocks anyways, so only holes inside of a block count as fragmentation
+    size_t largest_free_ranges = 0;
+    lock_mutex(&device->memory.lock);
+    for (size_t i = 0; i < AllocHeapsCount; i++) {
+        VkrMemoryPool* pool = &device->memory.pools[i];
+        for (size_t j = 0; j < entries_count_list(pool->blocks); j++) {
+            VkrMemoryBlock* block = read_list(VkrMemoryBlock*, pool->blocks)[j];
+            stats.blocks_count++;
+            stats.reserved_bytes += block->size;
+            if (!block->allocator) {
+                stats.live_bytes += block->size;
+                continue;
+            }
+            TlsfStats block_stats = get_tlsf_stats(block->allocator);
+            stats.live_bytes += block_stats.used;
+            free_bytes += block_stats.size - block_stats.used;
+            largest_free_ranges += block_stats.largest_free_range;
+        }
+    }
+    unlock_mutex(&device->memory.lock);
+    stats.fragmentation = free_bytes > 0 ? 1.0 - (double) largest_free_ranges / (double) free_bytes : 0.0;
+    return stats;
+}
@@ -6,6 +6,7 @@
 
 #include "portability.h"
 #include "arena.h"
+#include "tlsf.h"
 
 #include "vulkan/vulkan.h"
 
@@ -89,6 +90,11 @@ typedef struct VkrBackend_ {
     } instance_exts;
 
     VkDebugUtilsMessengerEXT debug_messenger;
+
+    /// The subgroup sizes the devices run kernels with, programs are compiled for all of them so the devices can share the SPIR-V
+    struct {
+        uint32_t min, max;
+    } subgroup_sizes;
 } VkrBackend;
 
 typedef struct {
@@ -113,6 +119,7 @@ typedef struct {
         VkPhysicalDeviceShaderFloat16Int8Features float_16_int8;
         VkPhysicalDevice8BitStorageFeatures storage8;
         VkPhysicalDevice16BitStorageFeatures storage16;
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore;
     } features;
     struct {
         VkPhysicalDeviceProperties2 base;
@@ -121,6 +128,8 @@ typedef struct {
         VkPhysicalDeviceExternalMemoryHostPropertiesEXT external_memory_host;
         VkPhysicalDeviceDriverPropertiesKHR driver_properties;
     } properties;
+    /// Queried once, picking memory types needs it all the time
+    VkPhysicalDeviceMemoryProperties memory_properties;
     struct {
         bool is_moltenvk;
     } implementation;
@@ -128,11 +137,81 @@ typedef struct {
 
 typedef struct {
     Program* base;
+    /// Compared by contents, the key owns its own copy
     String entry_point;
 } SpecProgramKey;
 
 typedef struct VkrDevice_ VkrDevice;
 
+typedef enum {
+    AllocDeviceLocal,
+    AllocHostVisible,
+    AllocHeapsCount
+} AllocHeap;
+
+typedef struct {
+    AllocHeap heap;
+    VkDeviceMemory memory;
+    /// Spans the whole block, buffers allocated in there are ranges of it
+    VkBuffer buffer;
+    VkDeviceAddress device_address;
+    /// Host visible blocks stay mapped for as long as they live
+    void* mapped;
+    size_t size;
+    /// NULL for dedicated blocks, which hold a single buffer
+    Tlsf* allocator;
+} VkrMemoryBlock;
+
+typedef struct {
+    /// UINT32_MAX if the device has no memory of that kind
+    uint32_t memory_type;
+    size_t block_size;
+    /// VkrMemoryBlock*
+    struct List* blocks;
+} VkrMemoryPool;
+
+typedef struct VkrBuffer_ VkrBuffer;
+typedef struct VkrCommand_ VkrCommand;
+
+/// Persistently mapped buffer the host side of transfers goes through, recycled in submission order
+typedef struct {
+    VkrBuffer* buffer;
+    char* mapped;
+    size_t size;
+    /// Only ever grow, offsets in the buffer are these modulo 'size'
+    uint64_t head, tail;
+} VkrStagingRing;
+
+typedef struct {
+    void* dst;
+    size_t staging_offset;
+    size_t size;
+} VkrReadback;
+
+typedef struct {
+    VkBuffer buffer;
+    size_t start, end;
+} VkrWrittenRange;
+
+/// What was written since the last barrier of a command buffer, so that later commands only wait when they have to
+typedef struct {
+    /// VkrWrittenRange
+    struct List* written;
+    /// Kernels can write anywhere through device pointers
+    bool dispatched;
+} VkrHazards;
+
+/// Transfers recorded together and submitted in one go
+typedef struct {
+    uint64_t serial;
+    VkrCommand* command;
+    /// Where the tail of the staging ring goes once this batch is done
+    uint64_t staging_end;
+    /// VkrReadback, copied out of the staging ring once the batch is done
+    struct List* readbacks;
+    VkrHazards hazards;
+} VkrTransferBatch;
+
 struct VkrDevice_ {
     Device base;
     VkrBackend* runtime;
@@ -141,6 +220,16 @@ struct VkrDevice_ {
     VkCommandPool cmd_pool;
     VkQueue compute_queue;
 
+    /// Command buffers are recycled rather than allocated for every submission, guarded by the lock along with the queue
+    struct {
+        Mutex lock;
+        /// VkrCommand*, ready to be recorded again
+        struct List* free;
+        /// Reaches the value of each submission as it completes, VK_NULL_HANDLE when the device has no timeline semaphores
+        VkSemaphore timeline;
+        uint64_t last_submitted;
+    } commands;
+
     struct {
     #define Y(fn_name) PFN_##fn_name fn_name;
     #define X(_, name, fns) \
@@ -153,41 +242,129 @@ struct VkrDevice_ {
     #undef X
     } extensions;
 
+    /// Looked up by launches and filled in by the runtime workers, guarded by specialized_programs_lock
     struct Dict* specialized_programs;
+    Mutex specialized_programs_lock;
+    /// Broadcast whenever a specialized program is done compiling, successfully or not
+    CondVar specialized_program_done;
+
+    /// Device buffers are carved out of large blocks, one pool of those per kind of memory
+    struct {
+        Mutex lock;
+        VkrMemoryPool pools[AllocHeapsCount];
+    } memory;
+
+    /// Copies are recorded in a shared batch, which gets submitted when something needs their results
+    struct {
+        Mutex lock;
+        /// Created by the first transfer
+        VkrStagingRing staging;
+        VkrTransferBatch* open;
+        /// VkrTransferBatch*, in submission order
+        struct List* in_flight;
+        uint64_t next_serial;
+        uint64_t completed_serial;
+    } transfers;
 };
 
 bool probe_vkr_devices(VkrBackend*);
 
-typedef struct VkrBuffer_ {
+struct VkrBuffer_ {
     Buffer base;
     VkrDevice* device;
     bool imported;
     VkBuffer buffer;
     VkDeviceMemory memory;
+    /// Where the contents start in 'buffer' (and 'host_ptr')
     size_t offset;
+    /// Usable bytes past 'offset'
     size_t size;
     void* host_ptr;
-} VkrBuffer;
+    /// Where the buffer was sub-allocated from, NULL for imported buffers
+    VkrMemoryBlock* block;
+    TlsfRange* range;
+};
+
+bool init_vkr_memory(VkrDevice* device);
+void shutdown_vkr_memory(VkrDevice* device);
+/// Returns UINT32_MAX if there are none
+uint32_t find_suitable_memory_type(VkrDevice* device, uint32_t memory_type_bits, AllocHeap heap);
+/// Fills in the buffer, memory, offset and host pointer of 'buffer'
+bool vkr_allocate_memory(VkrDevice* device, AllocHeap heap, size_t size, VkrBuffer* buffer);
+void vkr_free_memory(VkrDevice* device, VkrBuffer* buffer);
+DeviceMemoryStats vkr_get_memory_stats(VkrDevice* device);
 
+VkrBuffer* vkr_allocate_buffer_device_(VkrDevice* device, size_t size, AllocHeap heap);
 VkrBuffer* vkr_allocate_buffer_device(VkrDevice* device, size_t size);
 VkrBuffer* vkr_import_buffer_host(VkrDevice* device, void* ptr, size_t size);
 bool vkr_can_import_host_memory(VkrDevice* device);
 
-typedef struct VkrCommand_ VkrCommand;
-
 struct VkrCommand_ {
     Command base;
     VkrDevice* device;
     VkCommandBuffer cmd_buf;
+    /// Only signaled when the device has no timeline semaphores
     VkFence done_fence;
+    /// What the device's timeline reaches once this is done
+    uint64_t timeline_value;
     bool submitted;
 };
 
+bool init_vkr_commands(VkrDevice* device);
+/// Waits for everything in flight
+void shutdown_vkr_commands(VkrDevice* device);
 VkrCommand* vkr_begin_command(VkrDevice* device);
 bool vkr_submit_command(VkrCommand* commands);
+/// Recycles the command, it must not be in flight: submitted commands have to be successfully waited on first
 void vkr_destroy_command(VkrCommand* commands);
+bool vkr_is_command_complete(VkrCommand* cmd);
+/// Does not recycle the command, unlike vkr_wait_completion
+bool vkr_wait_command(VkrCommand* cmd);
 bool vkr_wait_completion(VkrCommand* cmd);
 
+void init_vkr_hazards(VkrHazards* hazards);
+void destroy_vkr_hazards(VkrHazards* hazards);
+/// Puts a barrier in front of a transfer if it touches what's been written since the last one
+void vkr_order_transfer(VkrCommand* cmd, VkrHazards* hazards, VkBuffer buffer, size_t start, size_t end, bool writes);
+/// Kernels could touch anything, so they are ordered after every write
+void vkr_order_dispatch(VkrCommand* cmd, VkrHazards* hazards);
+void vkr_record_barrier(VkrCommand* cmd, VkrHazards* hazards);
+
+typedef struct {
+    CommandStream base;
+    VkrDevice* device;
+    VkrCommand* command;
+    VkrHazards hazards;
+    /// Something could not be recorded, submitting only cleans up
+    bool failed;
+} VkrCommandStream;
+
+VkrCommandStream* vkr_begin_command_stream(VkrDevice* device);
+bool vkr_stream_dispatch(VkrCommandStream* stream, Program* program, String entry_point, int dimx, int dimy, int dimz, int args_count, void** args);
+VkrCommand* vkr_submit_command_stream(VkrCommandStream* stream);
+
+void init_vkr_transfers(VkrDevice* device);
+/// Waits for every transfer in flight
+void shutdown_vkr_transfers(VkrDevice* device);
+/// Submits the transfers recorded so far, commands submitted afterwards see their results
+bool vkr_flush_transfers(VkrDevice* device);
+/// Recorded in the current batch, without a command to wait on
+bool vkr_upload(VkrBuffer* dst, size_t buffer_offset, const void* src, size_t size);
+bool vkr_clear_buffer(VkrBuffer* dst, size_t buffer_offset, size_t size);
+
+typedef struct {
+    Command base;
+    VkrDevice* device;
+    /// Done once the batch with that serial is
+    uint64_t serial;
+} VkrTransfer;
+
+VkrTransfer* vkr_copy_to_buffer_async(VkrBuffer* dst, size_t buffer_offset, void* src, size_t size);
+VkrTransfer* vkr_copy_from_buffer_async(VkrBuffer* src, size_t buffer_offset, void* dst, size_t size);
+bool vkr_wait_transfer(VkrTransfer* transfer);
+bool vkr_is_transfer_complete(VkrTransfer* transfer);
+
+void vkr_record_dispatch(VkrCommand* cmd, VkrSpecProgram* prog, int dimx, int dimy, int dimz, int args_count, void** args);
 VkrCommand* vkr_launch_kernel(VkrDevice* device, Program* program, String entry_point, int dimx, int dimy, int dimz, int args_count, void** args);
 
 typedef struct {
@@ -226,15 +403,28 @@ typedef struct {
 
 VkDescriptorType as_to_descriptor_type(AddressSpace as);
 
+typedef enum {
+    /// Sitting in the runtime's job queue, whoever needs it first compiles it
+    VkrSpecProgramQueued,
+    VkrSpecProgramCompiling,
+    VkrSpecProgramReady,
+    VkrSpecProgramFailed,
+} VkrSpecProgramState;
+
 struct VkrSpecProgram_ {
     SpecProgramKey key;
     VkrDevice* device;
     Arena* arena;
 
-    Module* specialized_module;
+    /// Guarded by the device's specialized_programs_lock
+    VkrSpecProgramState state;
+    /// Resources are only set up by the first launch, because that needs the queue
+    bool resources_ready;
 
-    size_t spirv_size;
-    char* spirv_bytes;
+    /// Owned by the program, devices compiling the entry point the same way share it
+    CompiledEntryPoint* compiled;
+    /// The compiled module, only read with the CompiledEntryPoint's lock held
+    Module* specialized_module;
 
     ProgramParamsInfo parameters;
     ProgramResourcesInfo resources;
@@ -251,9 +441,14 @@ struct VkrSpecProgram_ {
     VkDescriptorSet sets[MAX_DESCRIPTOR_SETS];
 };
 
+/// Waits for the program to be compiled, or compiles it on the spot if nobody started yet. Returns NULL if compilation failed.
 VkrSpecProgram* get_specialized_program(Program*, String ep, VkrDevice*);
 void destroy_specialized_program(VkrSpecProgram*);
 
+bool vkr_prepare_program(VkrDevice* device, Program* program, String entry_point);
+bool vkr_is_program_ready(VkrDevice* device, Program* program, String entry_point);
+bool vkr_wait_program_ready(VkrDevice* device, Program* program, String entry_point);
+
 static inline void append_pnext(VkBaseOutStructure* s, void* n) {
     while (s->pNext != NULL)
         s = s->pNext;
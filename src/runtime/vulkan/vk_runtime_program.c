@@ -15,15 +15,13 @@
 #include <string.h>
 
 static bool extract_parameters_info(VkrSpecProgram* program) {
-    Nodes decls = get_module_declarations(program->specialized_module);
-
     const Node* args_struct_annotation;
     const Node* args_struct_type = NULL;
     const Node* entry_point_function = NULL;
 
-    for (int i = 0; i < decls.count; ++i) {
-        const Node* node = decls.nodes[i];
-
+    size_t i = 0;
+    const Node* node;
+    while (module_decls_iter(program->specialized_module, &i, &node)) {
         switch (node->tag) {
             case GlobalVariable_TAG: {
                 const Node* entry_point_args_annotation = lookup_annotation(node, "EntryPointArgs");
@@ -150,9 +148,9 @@ static bool extract_resources_layout(VkrSpecProgram* program, VkDescriptorSetLay
     Growy* bindings_lists[MAX_DESCRIPTOR_SETS] = { 0 };
     Growy* resources = new_growy();
 
-    Nodes decls = get_module_declarations(program->specialized_module);
-    for (size_t i = 0; i < decls.count; i++) {
-        const Node* decl = decls.nodes[i];
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(program->specialized_module, &i, &decl)) {
         if (decl->tag != GlobalVariable_TAG) continue;
 
         if (lookup_annotation(decl, "Constants")) {
@@ -260,10 +258,28 @@ static bool create_vk_pipeline(VkrSpecProgram* program) {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
-        .codeSize = program->spirv_size,
-        .pCode = (uint32_t*) program->spirv_bytes
+        .codeSize = program->compiled->spirv_size,
+        .pCode = (uint32_t*) program->compiled->spirv_bytes
     }, NULL, &program->shader_module), return false);
 
+    // the module leaves the subgroup and workgroup sizes to these, see ShdSpecId
+    ArenaConfig arena_config = get_arena_config(get_module_arena(program->specialized_module));
+    uint32_t spec_data[] = {
+        [ShdSpecIdWorkgroupSizeX] = arena_config.specializations.workgroup_size[0],
+        [ShdSpecIdWorkgroupSizeY] = arena_config.specializations.workgroup_size[1],
+        [ShdSpecIdWorkgroupSizeZ] = arena_config.specializations.workgroup_size[2],
+        [ShdSpecIdSubgroupSize] = program->device->caps.subgroup_size.max,
+    };
+    VkSpecializationMapEntry spec_entries[sizeof(spec_data) / sizeof(spec_data[0])];
+    for (uint32_t i = 0; i < sizeof(spec_data) / sizeof(spec_data[0]); i++)
+        spec_entries[i] = (VkSpecializationMapEntry) { .constantID = i, .offset = i * sizeof(uint32_t), .size = sizeof(uint32_t) };
+    VkSpecializationInfo spec_info = {
+        .mapEntryCount = sizeof(spec_entries) / sizeof(spec_entries[0]),
+        .pMapEntries = spec_entries,
+        .dataSize = sizeof(spec_data),
+        .pData = spec_data,
+    };
+
     VkPipelineShaderStageCreateInfo stage_create_info = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
         .pNext = NULL,
@@ -271,7 +287,7 @@ static bool create_vk_pipeline(VkrSpecProgram* program) {
         .module = program->shader_module,
         .stage = VK_SHADER_STAGE_COMPUTE_BIT,
         .pName = program->key.entry_point,
-        .pSpecializationInfo = NULL
+        .pSpecializationInfo = &spec_info
     };
 
     VkPipelineShaderStageRequiredSubgroupSizeCreateInfoEXT pipeline_shader_stage_required_subgroup_size_create_info_ext = {
@@ -299,8 +315,11 @@ static bool create_vk_pipeline(VkrSpecProgram* program) {
 static CompilerConfig get_compiler_config_for_device(VkrDevice* device, const CompilerConfig* base_config) {
     CompilerConfig config = *base_config;
 
-    assert(device->caps.subgroup_size.max > 0);
-    config.specialization.subgroup_size = device->caps.subgroup_size.max;
+    // not this device's subgroup size but the range of all of them, create_vk_pipeline passes in the actual one
+    assert(device->runtime->subgroup_sizes.max > 0);
+    config.specialization.subgroup_size = device->runtime->subgroup_sizes.max;
+    config.specialization.min_subgroup_size = device->runtime->subgroup_sizes.min;
+    config.specialization.spec_constants = true;
     // config.per_thread_stack_size = ...
 
     config.target_spirv_version.major = device->caps.spirv_version.major;
@@ -329,19 +348,9 @@ static bool compile_specialized_program(VkrSpecProgram* spec) {
     CompilerConfig config = get_compiler_config_for_device(spec->device, spec->key.base->base_config);
     config.specialization.entry_point = spec->key.entry_point;
 
-    CHECK(run_compiler_passes(&config, &spec->specialized_module) == CompilationNoError, return false);
-
-    Module* new_mod;
-    emit_spirv(&config, spec->specialized_module, &spec->spirv_size, &spec->spirv_bytes, &new_mod);
-    spec->specialized_module = new_mod;
-
-    if (spec->key.base->runtime->config.dump_spv) {
-        String module_name = get_module_name(spec->specialized_module);
-        String file_name = format_string_new("%s.spv", module_name);
-        write_file(file_name, spec->spirv_size, (const char*) spec->spirv_bytes);
-        free((void*) file_name);
-    }
-
+    spec->compiled = get_compiled_entry_point(spec->key.base, &config);
+    CHECK(spec->compiled, return false);
+    spec->specialized_module = spec->compiled->module;
     return true;
 }
 
@@ -374,12 +383,49 @@ static void flush_staged_data(VkrSpecProgram* program) {
     for (size_t i = 0; i < program->resources.num_resources; i++) {
         ProgramResourceInfo* resource = program->resources.resources[i];
         if (resource->staging) {
-            copy_to_buffer(resource->buffer, 0, resource->buffer, resource->size);
+            vkr_upload(resource->buffer, 0, resource->staging, resource->size);
             free(resource->staging);
+            resource->staging = NULL;
         }
     }
 }
 
+/// The buffers never change once allocated, so the sets only need writing once rather than on every launch
+static void write_descriptor_sets(VkrSpecProgram* program) {
+    if (program->resources.num_resources == 0)
+        return;
+
+    LARRAY(VkWriteDescriptorSet, write_descriptor_sets, program->resources.num_resources);
+    LARRAY(VkDescriptorBufferInfo, descriptor_buffer_info, program->resources.num_resources);
+    size_t write_descriptor_sets_count = 0;
+
+    for (size_t i = 0; i < program->resources.num_resources; i++) {
+        ProgramResourceInfo* resource = program->resources.resources[i];
+        if (resource->is_bound) {
+            descriptor_buffer_info[write_descriptor_sets_count] = (VkDescriptorBufferInfo) {
+                .buffer = resource->buffer->buffer,
+                .offset = resource->buffer->offset,
+                .range = resource->buffer->size,
+            };
+
+            write_descriptor_sets[write_descriptor_sets_count] = (VkWriteDescriptorSet) {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .pNext = NULL,
+                .descriptorType = as_to_descriptor_type(resource->as),
+                .descriptorCount = 1,
+                .dstSet = program->sets[resource->set],
+                .dstBinding = resource->binding,
+                .pBufferInfo = &descriptor_buffer_info[write_descriptor_sets_count],
+            };
+
+            write_descriptor_sets_count++;
+        }
+    }
+
+    if (write_descriptor_sets_count > 0)
+        vkUpdateDescriptorSets(program->device->device, write_descriptor_sets_count, write_descriptor_sets, 0, NULL);
+}
+
 static bool prepare_resources(VkrSpecProgram* program) {
     for (size_t i = 0; i < program->resources.num_resources; i++) {
         ProgramResourceInfo* resource = program->resources.resources[i];
@@ -387,17 +433,18 @@ static bool prepare_resources(VkrSpecProgram* program) {
         if (resource->host_backed_allocation) {
             assert(vkr_can_import_host_memory(program->device));
             resource->host_ptr = alloc_aligned(resource->size, program->device->caps.properties.external_memory_host.minImportedHostPointerAlignment);
-            resource->buffer = import_buffer_host(program->device, resource->host_ptr, resource->size);
+            resource->buffer = vkr_import_buffer_host(program->device, resource->host_ptr, resource->size);
+            CHECK(resource->buffer, return false);
+            // TODO: initial data!
+            memset(resource->host_ptr, 0, resource->size);
         } else {
-            resource->buffer = allocate_buffer_device(program->device, resource->size);
+            resource->buffer = vkr_allocate_buffer_device(program->device, resource->size);
+            CHECK(resource->buffer, return false);
+            // staged resources are uploaded whole by flush_staged_data
+            if (!resource->staging)
+                CHECK(vkr_clear_buffer(resource->buffer, 0, resource->size), return false);
         }
 
-        // TODO: initial data!
-        // if (!resource->host_owned)
-        char* zeroes = calloc(1, resource->size);
-        copy_to_buffer(resource->buffer, 0, zeroes, resource->size);
-        free(zeroes);
-
         if (resource->parent) {
             char* dst = resource->parent->host_ptr;
             if (!dst) {
@@ -409,36 +456,117 @@ static bool prepare_resources(VkrSpecProgram* program) {
     }
 
     flush_staged_data(program);
+    write_descriptor_sets(program);
 
     return true;
 }
 
-static VkrSpecProgram* create_specialized_program(SpecProgramKey key, VkrDevice* device) {
-    VkrSpecProgram* spec_program = calloc(1, sizeof(VkrSpecProgram));
-    if (!spec_program)
-        return NULL;
+static bool build_specialized_program(VkrSpecProgram* spec_program) {
+    CHECK(compile_specialized_program(spec_program), return false);
+    // the other devices might be reading the module too
+    lock_mutex(&spec_program->compiled->lock);
+    bool extracted = extract_layout(spec_program);
+    unlock_mutex(&spec_program->compiled->lock);
+    CHECK(extracted,                                 return false);
+    CHECK(create_vk_pipeline(spec_program),          return false);
+    CHECK(allocate_sets(spec_program),               return false);
+    return true;
+}
 
-    spec_program->key = key;
-    spec_program->device = device;
-    spec_program->specialized_module = key.base->module;
-    spec_program->arena = new_arena();
-
-    CHECK(compile_specialized_program(spec_program), return NULL);
-    CHECK(extract_layout(spec_program),              return NULL);
-    CHECK(create_vk_pipeline(spec_program),          return NULL);
-    CHECK(allocate_sets(spec_program),               return NULL);
-    CHECK(prepare_resources(spec_program),           return NULL);
-    return spec_program;
+/// The caller must have moved the program to VkrSpecProgramCompiling
+static void compile_claimed_specialized_program(VkrSpecProgram* spec) {
+    VkrDevice* device = spec->device;
+    bool ok = build_specialized_program(spec);
+    lock_mutex(&device->specialized_programs_lock);
+    spec->state = ok ? VkrSpecProgramReady : VkrSpecProgramFailed;
+    broadcast_cond_var(&device->specialized_program_done);
+    unlock_mutex(&device->specialized_programs_lock);
 }
 
-VkrSpecProgram* get_specialized_program(Program* program, String entry_point, VkrDevice* device) {
+/// Must be called with the device's specialized_programs_lock held
+static bool claim_specialized_program(VkrSpecProgram* spec) {
+    if (spec->state != VkrSpecProgramQueued)
+        return false;
+    spec->state = VkrSpecProgramCompiling;
+    return true;
+}
+
+/// Runs on the runtime workers, unless a launch needed the program first and compiled it already
+static void compile_queued_specialized_program(VkrSpecProgram* spec) {
+    lock_mutex(&spec->device->specialized_programs_lock);
+    bool claimed = claim_specialized_program(spec);
+    unlock_mutex(&spec->device->specialized_programs_lock);
+    if (claimed)
+        compile_claimed_specialized_program(spec);
+}
+
+/// Must be called with the device's specialized_programs_lock held. New programs start out queued.
+static VkrSpecProgram* find_or_add_specialized_program(Program* program, String entry_point, VkrDevice* device, bool* added) {
     SpecProgramKey key = { .base = program, .entry_point = entry_point };
     VkrSpecProgram** found = find_value_dict(SpecProgramKey, VkrSpecProgram*, device->specialized_programs, key);
+    *added = !found;
     if (found)
         return *found;
-    VkrSpecProgram* spec = create_specialized_program(key, device);
-    assert(spec);
-    insert_dict(SpecProgramKey, VkrSpecProgram*, device->specialized_programs, key, spec);
+
+    VkrSpecProgram* spec = calloc(1, sizeof(VkrSpecProgram));
+    spec->key = (SpecProgramKey) { .base = program, .entry_point = format_string_new("%s", entry_point) };
+    spec->device = device;
+    spec->arena = new_arena();
+    spec->state = VkrSpecProgramQueued;
+    insert_dict(SpecProgramKey, VkrSpecProgram*, device->specialized_programs, spec->key, spec);
+    return spec;
+}
+
+bool vkr_prepare_program(VkrDevice* device, Program* program, String entry_point) {
+    bool added;
+    lock_mutex(&device->specialized_programs_lock);
+    VkrSpecProgram* spec = find_or_add_specialized_program(program, entry_point, device, &added);
+    unlock_mutex(&device->specialized_programs_lock);
+    if (added)
+        submit_runtime_job(program->runtime, (RuntimeJob) { .fn = (void(*)(void*)) compile_queued_specialized_program, .payload = spec });
+    return true;
+}
+
+bool vkr_is_program_ready(VkrDevice* device, Program* program, String entry_point) {
+    SpecProgramKey key = { .base = program, .entry_point = entry_point };
+    lock_mutex(&device->specialized_programs_lock);
+    VkrSpecProgram** found = find_value_dict(SpecProgramKey, VkrSpecProgram*, device->specialized_programs, key);
+    bool ready = found && (*found)->state == VkrSpecProgramReady;
+    unlock_mutex(&device->specialized_programs_lock);
+    return ready;
+}
+
+static VkrSpecProgram* wait_for_specialized_program(Program* program, String entry_point, VkrDevice* device) {
+    bool added;
+    lock_mutex(&device->specialized_programs_lock);
+    VkrSpecProgram* spec = find_or_add_specialized_program(program, entry_point, device, &added);
+    // still in the queue: there is no point waiting for a worker to get to it
+    bool claimed = claim_specialized_program(spec);
+    unlock_mutex(&device->specialized_programs_lock);
+
+    if (claimed)
+        compile_claimed_specialized_program(spec);
+
+    lock_mutex(&device->specialized_programs_lock);
+    while (spec->state == VkrSpecProgramCompiling)
+        wait_cond_var(&device->specialized_program_done, &device->specialized_programs_lock);
+    VkrSpecProgramState state = spec->state;
+    unlock_mutex(&device->specialized_programs_lock);
+    return state == VkrSpecProgramReady ? spec : NULL;
+}
+
+bool vkr_wait_program_ready(VkrDevice* device, Program* program, String entry_point) {
+    return wait_for_specialized_program(program, entry_point, device) != NULL;
+}
+
+VkrSpecProgram* get_specialized_program(Program* program, String entry_point, VkrDevice* device) {
+    VkrSpecProgram* spec = wait_for_specialized_program(program, entry_point, device);
+    if (!spec)
+        return NULL;
+    if (!spec->resources_ready) {
+        CHECK(prepare_resources(spec), return NULL);
+        spec->resources_ready = true;
+    }
     return spec;
 }
 
@@ -449,9 +577,6 @@ void destroy_specialized_program(VkrSpecProgram* spec) {
     vkDestroyPipelineLayout(spec->device->device, spec->layout, NULL);
     vkDestroyShaderModule(spec->device->device, spec->shader_module, NULL);
     free(spec->parameters.arg_offset);
-    free(spec->spirv_bytes);
-    if (get_module_arena(spec->specialized_module) != get_module_arena(spec->key.base->module))
-        destroy_ir_arena(get_module_arena(spec->specialized_module));
     for (size_t i = 0; i < spec->resources.num_resources; i++) {
         ProgramResourceInfo* resource = spec->resources.resources[i];
         if (resource->buffer)
@@ -462,5 +587,6 @@ void destroy_specialized_program(VkrSpecProgram* spec) {
     free(spec->resources.resources);
     vkDestroyDescriptorPool(spec->device->device, spec->descriptor_pool, NULL);
     destroy_arena(spec->arena);
+    free((void*) spec->key.entry_point);
     free(spec);
 }
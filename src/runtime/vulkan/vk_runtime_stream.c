@@ -0,0 +1,168 @@
+#include "vk_runtime_private.h"
+
+#include "log.h"
+#include "list.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+static const VkPipelineStageFlags work_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+static const VkAccessFlags work_writes = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+static const VkAccessFlags work_accesses = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+void init_vkr_hazards(VkrHazards* hazards) {
+    hazards->written = new_list(VkrWrittenRange);
+    hazards->dispatched = false;
+}
+
+void destroy_vkr_hazards(VkrHazards* hazards) {
+    destroy_list(hazards->written);
+}
+
+void vkr_record_barrier(VkrCommand* cmd, VkrHazards* hazards) {
+    vkCmdPipelineBarrier(cmd->cmd_buf, work_stages, work_stages, 0, 1, (VkMemoryBarrier[]) { {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = work_writes,
+        .dstAccessMask = work_accesses,
+    } }, 0, NULL, 0, NULL);
+    clear_list(hazards->written);
+    hazards->dispatched = false;
+}
+
+void vkr_order_transfer(VkrCommand* cmd, VkrHazards* hazards, VkBuffer buffer, size_t start, size_t end, bool writes) {
+    bool conflicts = hazards->dispatched;
+    for (size_t i = 0; i < entries_count_list(hazards->written) && !conflicts; i++) {
+        VkrWrittenRange range = read_list(VkrWrittenRange, hazards->written)[i];
+        conflicts = range.buffer == buffer && range.start < end && start < range.end;
+    }
+    if (conflicts)
+        vkr_record_barrier(cmd, hazards);
+    if (writes)
+        append_list(VkrWrittenRange, hazards->written, ((VkrWrittenRange) { .buffer = buffer, .start = start, .end = end }));
+}
+
+void vkr_order_dispatch(VkrCommand* cmd, VkrHazards* hazards) {
+    if (hazards->dispatched || entries_count_list(hazards->written) > 0)
+        vkr_record_barrier(cmd, hazards);
+    hazards->dispatched = true;
+}
+
+bool vkr_stream_dispatch(VkrCommandStream* stream, Program* program, String entry_point, int dimx, int dimy, int dimz, int args_count, void** args) {
+    if (stream->failed)
+        return false;
+
+    VkrSpecProgram* prog = get_specialized_program(program, entry_point, stream->device);
+    if (!prog) {
+        error_print("Failed to compile entry point '%s'\n", entry_point);
+        stream->failed = true;
+        return false;
+    }
+
+    debug_print("Dispatching kernel on %s\n", stream->device->caps.properties.base.properties.deviceName);
+    vkr_order_dispatch(stream->command, &stream->hazards);
+    vkr_record_dispatch(stream->command, prog, dimx, dimy, dimz, args_count, args);
+    return true;
+}
+
+static bool vkr_stream_copy(VkrCommandStream* stream, VkrBuffer* src, size_t src_offset, VkrBuffer* dst, size_t dst_offset, size_t size) {
+    if (stream->failed)
+        return false;
+    if (src->device != stream->device || dst->device != stream->device) {
+        error_print("Buffers copied in a command stream must belong to its device\n");
+        stream->failed = true;
+        return false;
+    }
+
+    size_t src_start = src->offset + src_offset;
+    size_t dst_start = dst->offset + dst_offset;
+    if (src->buffer == dst->buffer && src_start < dst_start + size && dst_start < src_start + size) {
+        error_print("The source and destination of a copy can't overlap\n");
+        stream->failed = true;
+        return false;
+    }
+
+    vkr_order_transfer(stream->command, &stream->hazards, src->buffer, src_start, src_start + size, false);
+    vkr_order_transfer(stream->command, &stream->hazards, dst->buffer, dst_start, dst_start + size, true);
+    vkCmdCopyBuffer(stream->command->cmd_buf, src->buffer, dst->buffer, 1, (VkBufferCopy[]) { {
+        .srcOffset = src_start,
+        .dstOffset = dst_start,
+        .size = size
+    } });
+    return true;
+}
+
+static bool vkr_stream_fill(VkrCommandStream* stream, VkrBuffer* dst, size_t offset, size_t size, uint32_t value) {
+    if (stream->failed)
+        return false;
+    if (dst->device != stream->device) {
+        error_print("Buffers filled in a command stream must belong to its device\n");
+        stream->failed = true;
+        return false;
+    }
+
+    size_t start = dst->offset + offset;
+    if (start % 4 != 0 || size % 4 != 0) {
+        error_print("Fills have to start and end on multiples of 4 bytes\n");
+        stream->failed = true;
+        return false;
+    }
+
+    vkr_order_transfer(stream->command, &stream->hazards, dst->buffer, start, start + size, true);
+    vkCmdFillBuffer(stream->command->cmd_buf, dst->buffer, start, size, value);
+    return true;
+}
+
+static void vkr_stream_barrier(VkrCommandStream* stream) {
+    if (!stream->failed)
+        vkr_record_barrier(stream->command, &stream->hazards);
+}
+
+VkrCommand* vkr_submit_command_stream(VkrCommandStream* stream) {
+    VkrDevice* device = stream->device;
+    VkrCommand* cmd = stream->command;
+    bool ok = !stream->failed;
+    destroy_vkr_hazards(&stream->hazards);
+    free(stream);
+
+    if (ok) {
+        // whatever comes next might depend on this, including the host reading the results
+        vkCmdPipelineBarrier(cmd->cmd_buf, work_stages, work_stages | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, (VkMemoryBarrier[]) { {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .pNext = NULL,
+            .srcAccessMask = work_writes,
+            .dstAccessMask = work_accesses | VK_ACCESS_HOST_READ_BIT,
+        } }, 0, NULL, 0, NULL);
+        // the kernels might read what's been copied so far
+        ok = vkr_flush_transfers(device) && vkr_submit_command(cmd);
+    }
+
+    if (!ok) {
+        vkr_destroy_command(cmd);
+        return NULL;
+    }
+    return cmd;
+}
+
+static CommandStream make_command_stream_base(void) {
+    return (CommandStream) {
+        .dispatch = (bool(*)(CommandStream*, Program*, const char*, int, int, int, int, void**)) vkr_stream_dispatch,
+        .copy = (bool(*)(CommandStream*, Buffer*, size_t, Buffer*, size_t, size_t)) vkr_stream_copy,
+        .fill = (bool(*)(CommandStream*, Buffer*, size_t, size_t, uint32_t)) vkr_stream_fill,
+        .barrier = (void(*)(CommandStream*)) vkr_stream_barrier,
+        .submit = (Command*(*)(CommandStream*)) vkr_submit_command_stream,
+    };
+}
+
+VkrCommandStream* vkr_begin_command_stream(VkrDevice* device) {
+    VkrCommand* cmd = vkr_begin_command(device);
+    if (!cmd)
+        return NULL;
+
+    VkrCommandStream* stream = calloc(1, sizeof(VkrCommandStream));
+    stream->base = make_command_stream_base();
+    stream->device = device;
+    stream->command = cmd;
+    init_vkr_hazards(&stream->hazards);
+    return stream;
+}
@@ -0,0 +1,322 @@
+#include "vk_runtime_private.h"
+
+#include "log.h"
+#include "list.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define MiB * 1024 * 1024
+
+#define staging_ring_size (8 MiB)
+/// Large copies are cut in pieces, so that the first ones can be in flight while the next ones get staged
+#define staging_chunk_size (staging_ring_size / 4)
+#define staging_alignment 16
+
+static Command make_transfer_base(void) {
+    return (Command) {
+        .wait_for_completion = (bool(*)(Command*)) vkr_wait_transfer,
+        .is_complete = (bool(*)(Command*)) vkr_is_transfer_complete,
+    };
+}
+
+void init_vkr_transfers(VkrDevice* device) {
+    init_mutex(&device->transfers.lock);
+    device->transfers.in_flight = new_list(VkrTransferBatch*);
+    device->transfers.next_serial = 1;
+}
+
+static void record_barrier(VkrCommand* cmd, VkPipelineStageFlags src_stages, VkAccessFlags src_access, VkPipelineStageFlags dst_stages, VkAccessFlags dst_access) {
+    vkCmdPipelineBarrier(cmd->cmd_buf, src_stages, dst_stages, 0, 1, (VkMemoryBarrier[]) { {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = src_access,
+        .dstAccessMask = dst_access,
+    } }, 0, NULL, 0, NULL);
+}
+
+static bool create_staging_ring(VkrDevice* device) {
+    VkrStagingRing* ring = &device->transfers.staging;
+    ring->buffer = vkr_allocate_buffer_device_(device, staging_ring_size, AllocHostVisible);
+    if (!ring->buffer)
+        return false;
+    ring->mapped = (char*) ring->buffer->host_ptr + ring->buffer->offset;
+    ring->size = staging_ring_size;
+    return true;
+}
+
+static VkrTransferBatch* get_open_batch(VkrDevice* device) {
+    if (device->transfers.open)
+        return device->transfers.open;
+
+    VkrCommand* cmd = vkr_begin_command(device);
+    if (!cmd)
+        return NULL;
+    // whatever ran before might have written what we are about to copy, or be reading what we are about to overwrite
+    record_barrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    VkrTransferBatch* batch = calloc(1, sizeof(VkrTransferBatch));
+    batch->serial = device->transfers.next_serial++;
+    batch->command = cmd;
+    batch->readbacks = new_list(VkrReadback);
+    init_vkr_hazards(&batch->hazards);
+    device->transfers.open = batch;
+    return batch;
+}
+
+static void destroy_batch(VkrTransferBatch* batch) {
+    destroy_list(batch->readbacks);
+    destroy_vkr_hazards(&batch->hazards);
+    free(batch);
+}
+
+static bool submit_open_batch(VkrDevice* device) {
+    VkrTransferBatch* batch = device->transfers.open;
+    if (!batch)
+        return true;
+    device->transfers.open = NULL;
+
+    record_barrier(batch->command, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+    if (!vkr_submit_command(batch->command)) {
+        vkr_destroy_command(batch->command);
+        destroy_batch(batch);
+        return false;
+    }
+    batch->staging_end = device->transfers.staging.head;
+    append_list(VkrTransferBatch*, device->transfers.in_flight, batch);
+    return true;
+}
+
+/// Waits on the oldest batch in flight and hands its staging space back, returns false if there is none
+static bool retire_oldest_batch(VkrDevice* device) {
+    if (entries_count_list(device->transfers.in_flight) == 0)
+        return false;
+    VkrTransferBatch* batch = read_list(VkrTransferBatch*, device->transfers.in_flight)[0];
+    remove_list_impl(device->transfers.in_flight, 0);
+
+    // a command we failed to wait on might still be pending, it's left to the destruction of the pool
+    if (!vkr_wait_command(batch->command)) {
+        destroy_batch(batch);
+        return false;
+    }
+    vkr_destroy_command(batch->command);
+
+    VkrStagingRing* ring = &device->transfers.staging;
+    for (size_t i = 0; i < entries_count_list(batch->readbacks); i++) {
+        VkrReadback readback = read_list(VkrReadback, batch->readbacks)[i];
+        memcpy(readback.dst, ring->mapped + readback.staging_offset, readback.size);
+    }
+    ring->tail = batch->staging_end;
+    assert(batch->serial > device->transfers.completed_serial);
+    device->transfers.completed_serial = batch->serial;
+    destroy_batch(batch);
+    return true;
+}
+
+/// Finds 'size' contiguous bytes in the staging ring, waiting on older transfers if it's full
+static bool reserve_staging(VkrDevice* device, size_t size, size_t* offset) {
+    VkrStagingRing* ring = &device->transfers.staging;
+    if (!ring->buffer && !create_staging_ring(device))
+        return false;
+    size = (size + staging_alignment - 1) / staging_alignment * staging_alignment;
+    assert(size <= ring->size);
+
+    while (true) {
+        uint64_t start = ring->head;
+        size_t position = start % ring->size;
+        // allocations don't wrap around, the end of the ring gets skipped instead
+        if (position + size > ring->size)
+            start += ring->size - position;
+        if (ring->tail == ring->head)
+            ring->tail = start;
+        if (start + size - ring->tail <= ring->size) {
+            ring->head = start + size;
+            *offset = start % ring->size;
+            return true;
+        }
+        if (!retire_oldest_batch(device)) {
+            // nothing is in flight, so the space we need is held by the batch we are recording, if anything
+            if (!device->transfers.open)
+                ring->tail = ring->head;
+            else if (!submit_open_batch(device))
+                return false;
+        }
+    }
+}
+
+static bool record_upload(VkrBuffer* dst, size_t buffer_offset, const void* src, size_t size) {
+    VkrDevice* device = dst->device;
+    while (size > 0) {
+        size_t chunk = size < staging_chunk_size ? size : staging_chunk_size;
+        size_t staging_offset;
+        if (!reserve_staging(device, chunk, &staging_offset))
+            return false;
+        memcpy(device->transfers.staging.mapped + staging_offset, src, chunk);
+
+        VkrTransferBatch* batch = get_open_batch(device);
+        if (!batch)
+            return false;
+        size_t dst_offset = dst->offset + buffer_offset;
+        vkr_order_transfer(batch->command, &batch->hazards, dst->buffer, dst_offset, dst_offset + chunk, true);
+        vkCmdCopyBuffer(batch->command->cmd_buf, device->transfers.staging.buffer->buffer, dst->buffer, 1, (VkBufferCopy[]) { {
+            .srcOffset = device->transfers.staging.buffer->offset + staging_offset,
+            .dstOffset = dst_offset,
+            .size = chunk
+        } });
+
+        src = (const char*) src + chunk;
+        buffer_offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+static bool record_readback(VkrBuffer* src, size_t buffer_offset, void* dst, size_t size) {
+    VkrDevice* device = src->device;
+    while (size > 0) {
+        size_t chunk = size < staging_chunk_size ? size : staging_chunk_size;
+        size_t staging_offset;
+        if (!reserve_staging(device, chunk, &staging_offset))
+            return false;
+
+        VkrTransferBatch* batch = get_open_batch(device);
+        if (!batch)
+            return false;
+        size_t src_offset = src->offset + buffer_offset;
+        vkr_order_transfer(batch->command, &batch->hazards, src->buffer, src_offset, src_offset + chunk, false);
+        vkCmdCopyBuffer(batch->command->cmd_buf, src->buffer, device->transfers.staging.buffer->buffer, 1, (VkBufferCopy[]) { {
+            .srcOffset = src_offset,
+            .dstOffset = device->transfers.staging.buffer->offset + staging_offset,
+            .size = chunk
+        } });
+        append_list(VkrReadback, batch->readbacks, ((VkrReadback) { .dst = dst, .staging_offset = staging_offset, .size = chunk }));
+
+        dst = (char*) dst + chunk;
+        buffer_offset += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+/// vkCmdFillBuffer works on whole words, the odd bytes at either end are uploaded instead
+static bool record_clear(VkrBuffer* dst, size_t buffer_offset, size_t size) {
+    static const char zeroes[8] = { 0 };
+    size_t start = dst->offset + buffer_offset;
+    size_t end = start + size;
+    size_t aligned_start = (start + 3) / 4 * 4;
+    size_t aligned_end = end / 4 * 4;
+    if (aligned_start >= aligned_end)
+        return record_upload(dst, buffer_offset, zeroes, size);
+
+    if (aligned_start > start && !record_upload(dst, buffer_offset, zeroes, aligned_start - start))
+        return false;
+    if (end > aligned_end && !record_upload(dst, aligned_end - dst->offset, zeroes, end - aligned_end))
+        return false;
+
+    VkrTransferBatch* batch = get_open_batch(dst->device);
+    if (!batch)
+        return false;
+    vkr_order_transfer(batch->command, &batch->hazards, dst->buffer, aligned_start, aligned_end, true);
+    vkCmdFillBuffer(batch->command->cmd_buf, dst->buffer, aligned_start, aligned_end - aligned_start, 0);
+    return true;
+}
+
+bool vkr_upload(VkrBuffer* dst, size_t buffer_offset, const void* src, size_t size) {
+    lock_mutex(&dst->device->transfers.lock);
+    bool ok = record_upload(dst, buffer_offset, src, size);
+    unlock_mutex(&dst->device->transfers.lock);
+    return ok;
+}
+
+bool vkr_clear_buffer(VkrBuffer* dst, size_t buffer_offset, size_t size) {
+    lock_mutex(&dst->device->transfers.lock);
+    bool ok = record_clear(dst, buffer_offset, size);
+    unlock_mutex(&dst->device->transfers.lock);
+    return ok;
+}
+
+/// Has to be called right after recording, while the batch that holds the transfer is still open
+static VkrTransfer* make_transfer(VkrDevice* device) {
+    assert(device->transfers.open);
+    VkrTransfer* transfer = calloc(1, sizeof(VkrTransfer));
+    transfer->base = make_transfer_base();
+    transfer->device = device;
+    transfer->serial = device->transfers.open->serial;
+    return transfer;
+}
+
+VkrTransfer* vkr_copy_to_buffer_async(VkrBuffer* dst, size_t buffer_offset, void* src, size_t size) {
+    VkrDevice* device = dst->device;
+    lock_mutex(&device->transfers.lock);
+    VkrTransfer* transfer = NULL;
+    if (record_upload(dst, buffer_offset, src, size) && get_open_batch(device))
+        transfer = make_transfer(device);
+    unlock_mutex(&device->transfers.lock);
+    return transfer;
+}
+
+VkrTransfer* vkr_copy_from_buffer_async(VkrBuffer* src, size_t buffer_offset, void* dst, size_t size) {
+    VkrDevice* device = src->device;
+    lock_mutex(&device->transfers.lock);
+    VkrTransfer* transfer = NULL;
+    if (record_readback(src, buffer_offset, dst, size) && get_open_batch(device))
+        transfer = make_transfer(device);
+    unlock_mutex(&device->transfers.lock);
+    return transfer;
+}
+
+bool vkr_wait_transfer(VkrTransfer* transfer) {
+    VkrDevice* device = transfer->device;
+    bool ok = true;
+    lock_mutex(&device->transfers.lock);
+    if (device->transfers.open && device->transfers.open->serial == transfer->serial)
+        ok = submit_open_batch(device);
+    while (ok && device->transfers.completed_serial < transfer->serial)
+        ok = retire_oldest_batch(device);
+    unlock_mutex(&device->transfers.lock);
+    free(transfer);
+    return ok;
+}
+
+bool vkr_is_transfer_complete(VkrTransfer* transfer) {
+    VkrDevice* device = transfer->device;
+    bool ok = true;
+    lock_mutex(&device->transfers.lock);
+    // nobody would ever submit it otherwise
+    if (device->transfers.open && device->transfers.open->serial == transfer->serial)
+        ok = submit_open_batch(device);
+    while (ok && device->transfers.completed_serial < transfer->serial) {
+        // the batch holding it failed to be submitted or waited on
+        if (entries_count_list(device->transfers.in_flight) == 0) {
+            error_print("This transfer failed, it will never complete\n");
+            ok = false;
+            break;
+        }
+        VkrTransferBatch* oldest = read_list(VkrTransferBatch*, device->transfers.in_flight)[0];
+        if (!vkr_is_command_complete(oldest->command))
+            break;
+        ok = retire_oldest_batch(device);
+    }
+    bool complete = ok && device->transfers.completed_serial >= transfer->serial;
+    unlock_mutex(&device->transfers.lock);
+    return complete;
+}
+
+bool vkr_flush_transfers(VkrDevice* device) {
+    lock_mutex(&device->transfers.lock);
+    bool ok = submit_open_batch(device);
+    unlock_mutex(&device->transfers.lock);
+    return ok;
+}
+
+void shutdown_vkr_transfers(VkrDevice* device) {
+    submit_open_batch(device);
+    while (retire_oldest_batch(device));
+    destroy_list(device->transfers.in_flight);
+    if (device->transfers.staging.buffer)
+        destroy_buffer((Buffer*) device->transfers.staging.buffer);
+    destroy_mutex(&device->transfers.lock);
+}
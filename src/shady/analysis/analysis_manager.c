@@ -0,0 +1,295 @@
+#include "analysis_manager.h"
+#include "looptree.h"
+
+#include "../ir_private.h"
+
+#include "list.h"
+#include "dict.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+KeyHash hash_node(const Node**);
+bool compare_node(const Node**, const Node**);
+
+static KeyHash hash_ptr(void** p) {
+    return hash_murmur(p, sizeof(void*));
+}
+
+static bool compare_ptr(void** a, void** b) {
+    return *a == *b;
+}
+
+typedef struct {
+    /// What the abstraction's body was when these were computed
+    const Node* body;
+    Scope* scope;
+    Scope* flipped_scope;
+    LoopTree* loop_tree;
+    const UsesMap* uses;
+    NodeClass uses_exclude;
+} CachedAnalyses;
+
+typedef struct {
+    IrArena* arena;
+    /// abstraction -> CachedAnalyses
+    struct Dict* abstractions;
+    /// Module* -> CallGraph*
+    struct Dict* callgraphs;
+    /// Analyses of abstractions that got a new body, they might still be in use so they live until the arena goes away
+    struct List* stale;
+} ArenaAnalyses;
+
+struct AnalysisManager_ {
+    /// ArenaAnalyses*, there are rarely more than two arenas alive at once
+    struct List* arenas;
+    /// Everything handed out by 'acquire' that the manager is responsible for
+    struct Dict* owned;
+    AnalysisStats stats;
+};
+
+static String kind_names[] = { "scopes", "loop trees", "uses maps", "call graphs" };
+
+AnalysisManager* new_analysis_manager() {
+    AnalysisManager* am = calloc(1, sizeof(AnalysisManager));
+    am->arenas = new_list(ArenaAnalyses*);
+    am->owned = new_set(void*, (HashFn) hash_ptr, (CmpFn) compare_ptr);
+    return am;
+}
+
+static void destroy_cached_analyses(AnalysisManager* am, CachedAnalyses* c) {
+    // the loop tree refers to the scope
+    if (c->loop_tree) {
+        remove_dict(void*, am->owned, c->loop_tree);
+        destroy_loop_tree(c->loop_tree);
+    }
+    if (c->scope) {
+        remove_dict(void*, am->owned, c->scope);
+        destroy_scope(c->scope);
+    }
+    if (c->flipped_scope) {
+        remove_dict(void*, am->owned, c->flipped_scope);
+        destroy_scope(c->flipped_scope);
+    }
+    if (c->uses) {
+        remove_dict(void*, am->owned, c->uses);
+        destroy_uses_map(c->uses);
+    }
+}
+
+static void destroy_arena_analyses(AnalysisManager* am, ArenaAnalyses* aa) {
+    size_t i = 0;
+    const Node* abs;
+    CachedAnalyses c;
+    while (dict_iter(aa->abstractions, &i, &abs, &c))
+        destroy_cached_analyses(am, &c);
+    for (size_t j = 0; j < entries_count_list(aa->stale); j++)
+        destroy_cached_analyses(am, &read_list(CachedAnalyses, aa->stale)[j]);
+
+    i = 0;
+    Module* mod;
+    CallGraph* graph;
+    while (dict_iter(aa->callgraphs, &i, &mod, &graph)) {
+        remove_dict(void*, am->owned, graph);
+        destroy_callgraph(graph);
+    }
+
+    destroy_dict(aa->abstractions);
+    destroy_dict(aa->callgraphs);
+    destroy_list(aa->stale);
+    free(aa);
+}
+
+void destroy_analysis_manager(AnalysisManager* am) {
+    for (size_t i = 0; i < entries_count_list(am->arenas); i++)
+        destroy_arena_analyses(am, read_list(ArenaAnalyses*, am->arenas)[i]);
+    assert(entries_count_dict(am->owned) == 0);
+    destroy_list(am->arenas);
+    destroy_dict(am->owned);
+    free(am);
+}
+
+AnalysisStats get_analysis_stats(const AnalysisManager* am) {
+    return am->stats;
+}
+
+void log_analysis_stats(LogLevel level, const AnalysisManager* am) {
+    for (AnalysisKind k = 0; k < AnalysisKindsCount; k++)
+        log_string(level, "Analysis cache: %s were reused %zu times and built %zu times\n", kind_names[k], am->stats.kinds[k].hits, am->stats.kinds[k].misses);
+}
+
+void forget_arena_analyses(AnalysisManager* am, IrArena* arena) {
+    if (!am)
+        return;
+    for (size_t i = 0; i < entries_count_list(am->arenas); i++) {
+        ArenaAnalyses* aa = read_list(ArenaAnalyses*, am->arenas)[i];
+        if (aa->arena == arena) {
+            destroy_arena_analyses(am, aa);
+            remove_list_impl(am->arenas, i);
+            return;
+        }
+    }
+}
+
+static ArenaAnalyses* get_arena_analyses(AnalysisManager* am, IrArena* arena) {
+    for (size_t i = 0; i < entries_count_list(am->arenas); i++) {
+        ArenaAnalyses* aa = read_list(ArenaAnalyses*, am->arenas)[i];
+        if (aa->arena == arena)
+            return aa;
+    }
+    ArenaAnalyses* aa = calloc(1, sizeof(ArenaAnalyses));
+    *aa = (ArenaAnalyses) {
+        .arena = arena,
+        .abstractions = new_dict(const Node*, CachedAnalyses, (HashFn) hash_node, (CmpFn) compare_node),
+        .callgraphs = new_dict(Module*, CallGraph*, (HashFn) hash_ptr, (CmpFn) compare_ptr),
+        .stale = new_list(CachedAnalyses),
+    };
+    append_list(ArenaAnalyses*, am->arenas, aa);
+    return aa;
+}
+
+/// Cases don't belong to any module, we can't tell if they're done being built
+static const Module* get_owning_module(const Node* node) {
+    switch (node->tag) {
+        case Function_TAG: return node->payload.fun.module;
+        case BasicBlock_TAG: return node->payload.basic_block.fn->payload.fun.module;
+        default: return NULL;
+    }
+}
+
+/// Returns NULL if the analyses of 'abs' can't be cached, the result is only good until the next lookup
+static CachedAnalyses* lookup_cached(AnalysisManager* am, const Node* abs) {
+    if (!am)
+        return NULL;
+    const Module* owner = get_owning_module(abs);
+    if (!owner || !owner->sealed)
+        return NULL;
+
+    ArenaAnalyses* aa = get_arena_analyses(am, abs->arena);
+    const Node* body = get_abstraction_body(abs);
+    CachedAnalyses* c = find_value_dict(const Node*, CachedAnalyses, aa->abstractions, abs);
+    if (c && c->body != body) {
+        append_list(CachedAnalyses, aa->stale, *c);
+        *c = (CachedAnalyses) { .body = body };
+    }
+    if (!c) {
+        CachedAnalyses fresh = { .body = body };
+        insert_dict(const Node*, CachedAnalyses, aa->abstractions, abs, fresh);
+        c = find_value_dict(const Node*, CachedAnalyses, aa->abstractions, abs);
+    }
+    return c;
+}
+
+static void count(AnalysisManager* am, AnalysisKind kind, bool hit) {
+    if (!am)
+        return;
+    if (hit)
+        am->stats.kinds[kind].hits++;
+    else
+        am->stats.kinds[kind].misses++;
+}
+
+static void take_ownership(AnalysisManager* am, void* analysis) {
+    insert_set_get_result(void*, am->owned, analysis);
+}
+
+static bool is_owned(AnalysisManager* am, const void* analysis) {
+    return am && find_key_dict(const void*, am->owned, analysis);
+}
+
+static Scope* acquire_scope_impl(AnalysisManager* am, const Node* entry, bool flipped) {
+    CachedAnalyses* c = lookup_cached(am, entry);
+    Scope** cached = c ? (flipped ? &c->flipped_scope : &c->scope) : NULL;
+    count(am, AnalysisScope, cached && *cached);
+    if (cached && *cached)
+        return *cached;
+
+    Scope* scope = new_scope_impl(entry, NULL, flipped);
+    if (cached) {
+        *cached = scope;
+        take_ownership(am, scope);
+    }
+    return scope;
+}
+
+Scope* acquire_scope(AnalysisManager* am, const Node* entry) {
+    return acquire_scope_impl(am, entry, false);
+}
+
+Scope* acquire_scope_flipped(AnalysisManager* am, const Node* entry) {
+    return acquire_scope_impl(am, entry, true);
+}
+
+void release_scope(AnalysisManager* am, Scope* scope) {
+    if (!is_owned(am, scope))
+        destroy_scope(scope);
+}
+
+LoopTree* acquire_loop_tree(AnalysisManager* am, Scope* scope) {
+    // flipped scopes, or forward scopes for an older body, don't get their loop tree cached
+    CachedAnalyses* c = is_owned(am, scope) && !scope->flipped ? lookup_cached(am, scope->entry->node) : NULL;
+    if (c && c->scope != scope)
+        c = NULL;
+    count(am, AnalysisLoopTree, c && c->loop_tree);
+    if (c && c->loop_tree)
+        return c->loop_tree;
+
+    LoopTree* lt = build_loop_tree(scope);
+    if (c) {
+        c->loop_tree = lt;
+        take_ownership(am, lt);
+    }
+    return lt;
+}
+
+void release_loop_tree(AnalysisManager* am, LoopTree* lt) {
+    if (!is_owned(am, lt))
+        destroy_loop_tree(lt);
+}
+
+const UsesMap* acquire_uses_map(AnalysisManager* am, const Node* root, NodeClass exclude) {
+    CachedAnalyses* c = lookup_cached(am, root);
+    // we only keep one uses map around per abstraction
+    if (c && c->uses && c->uses_exclude != exclude)
+        c = NULL;
+    count(am, AnalysisUsesMap, c && c->uses);
+    if (c && c->uses)
+        return c->uses;
+
+    const UsesMap* uses = create_uses_map(root, exclude);
+    if (c) {
+        c->uses = uses;
+        c->uses_exclude = exclude;
+        take_ownership(am, (void*) uses);
+    }
+    return uses;
+}
+
+void release_uses_map(AnalysisManager* am, const UsesMap* uses) {
+    if (!is_owned(am, uses))
+        destroy_uses_map(uses);
+}
+
+CallGraph* acquire_callgraph(AnalysisManager* am, Module* mod) {
+    // declarations can't be added to sealed modules, the graph stays valid for as long as the arena lives
+    if (!am || !mod->sealed) {
+        count(am, AnalysisCallGraph, false);
+        return new_callgraph(mod);
+    }
+
+    ArenaAnalyses* aa = get_arena_analyses(am, get_module_arena(mod));
+    CallGraph** cached = find_value_dict(Module*, CallGraph*, aa->callgraphs, mod);
+    count(am, AnalysisCallGraph, cached);
+    if (cached)
+        return *cached;
+
+    CallGraph* graph = new_callgraph(mod);
+    insert_dict(Module*, CallGraph*, aa->callgraphs, mod, graph);
+    take_ownership(am, graph);
+    return graph;
+}
+
+void release_callgraph(AnalysisManager* am, CallGraph* graph) {
+    if (!is_owned(am, graph))
+        destroy_callgraph(graph);
+}
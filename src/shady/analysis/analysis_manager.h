@@ -0,0 +1,56 @@
+#ifndef SHADY_ANALYSIS_MANAGER_H
+#define SHADY_ANALYSIS_MANAGER_H
+
+#include "shady/ir.h"
+#include "log.h"
+
+#include "scope.h"
+#include "uses.h"
+#include "callgraph.h"
+
+/// Keeps the analyses of sealed modules around, so consecutive passes (and verification) don't rebuild them.
+/// Analyses are keyed on the abstraction (or module) they are about, and remember the body they were built from:
+/// if a function gets a new body, only its own analyses are thrown out.
+/// Nodes in unsealed modules can still change, so they are never cached and 'acquire' simply builds a fresh analysis.
+///
+/// All of these accept a NULL manager, in which case 'acquire' builds a new analysis and 'release' destroys it.
+
+typedef enum {
+    AnalysisScope,
+    AnalysisLoopTree,
+    AnalysisUsesMap,
+    AnalysisCallGraph,
+    AnalysisKindsCount
+} AnalysisKind;
+
+typedef struct {
+    struct {
+        size_t hits;
+        size_t misses;
+    } kinds[AnalysisKindsCount];
+} AnalysisStats;
+
+AnalysisManager* new_analysis_manager();
+void destroy_analysis_manager(AnalysisManager*);
+
+AnalysisStats get_analysis_stats(const AnalysisManager*);
+void log_analysis_stats(LogLevel, const AnalysisManager*);
+
+/// Drops all the analyses about nodes in that arena, this needs to happen before the arena is destroyed
+void forget_arena_analyses(AnalysisManager*, IrArena*);
+
+Scope* acquire_scope(AnalysisManager*, const Node* entry);
+Scope* acquire_scope_flipped(AnalysisManager*, const Node* entry);
+void release_scope(AnalysisManager*, Scope*);
+
+/// Only loop trees built from a cached scope can be cached themselves
+LoopTree* acquire_loop_tree(AnalysisManager*, Scope*);
+void release_loop_tree(AnalysisManager*, LoopTree*);
+
+const UsesMap* acquire_uses_map(AnalysisManager*, const Node* root, NodeClass exclude);
+void release_uses_map(AnalysisManager*, const UsesMap*);
+
+CallGraph* acquire_callgraph(AnalysisManager*, Module*);
+void release_callgraph(AnalysisManager*, CallGraph*);
+
+#endif
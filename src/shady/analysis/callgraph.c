@@ -214,10 +214,11 @@ CallGraph* new_callgraph(Module* mod) {
         .fn2cgn = new_dict(const Node*, CGNode*, (HashFn) hash_node, (CmpFn) compare_node)
     };
 
-    Nodes decls = get_module_declarations(mod);
-    for (size_t i = 0; i < decls.count; i++) {
-        if (decls.nodes[i]->tag == Function_TAG) {
-            analyze_fn(graph, decls.nodes[i]);
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(mod, &i, &decl)) {
+        if (decl->tag == Function_TAG) {
+            analyze_fn(graph, decl);
         }
     }
 
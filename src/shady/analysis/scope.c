@@ -15,9 +15,9 @@
 struct List* build_scopes(Module* mod) {
     struct List* scopes = new_list(Scope*);
 
-    Nodes decls = get_module_declarations(mod);
-    for (size_t i = 0; i < decls.count; i++) {
-        const Node* decl = decls.nodes[i];
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(mod, &i, &decl)) {
         if (decl->tag != Function_TAG) continue;
         Scope* scope = new_scope(decl);
         append_list(Scope*, scopes, scope);
@@ -36,6 +36,8 @@ typedef struct {
     struct Dict* nodes;
     struct List* queue;
     struct List* contents;
+    /// Every edge of the scope, they only get sorted by node once the graph is complete
+    struct List* edges;
 
     struct Dict* join_point_values;
 } ScopeBuildContext;
@@ -50,22 +52,23 @@ CFNode* scope_lookup(Scope* scope, const Node* block) {
     return NULL;
 }
 
+static CFNode* new_cfnode(Arena* arena, const Node* abs) {
+    CFNode* new = arena_alloc(arena, sizeof(CFNode));
+    *new = (CFNode) {
+        .node = abs,
+        .rpo_index = SIZE_MAX,
+        .idom = NULL,
+    };
+    return new;
+}
+
 static CFNode* get_or_enqueue(ScopeBuildContext* ctx, const Node* abs) {
     assert(is_abstraction(abs));
     assert(!is_function(abs) || abs == ctx->entry);
     CFNode** found = find_value_dict(const Node*, CFNode*, ctx->nodes, abs);
     if (found) return *found;
 
-    CFNode* new = arena_alloc(ctx->arena, sizeof(CFNode));
-    *new = (CFNode) {
-        .node = abs,
-        .succ_edges = new_list(CFEdge),
-        .pred_edges = new_list(CFEdge),
-        .rpo_index = SIZE_MAX,
-        .idom = NULL,
-        .dominates = NULL,
-        .structurally_dominates = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
-    };
+    CFNode* new = new_cfnode(ctx->arena, abs);
     assert(abs && new->node);
     insert_dict(const Node*, CFNode*, ctx->nodes, abs, new);
     append_list(Node*, ctx->queue, new);
@@ -111,13 +114,11 @@ static void add_edge(ScopeBuildContext* ctx, const Node* src, const Node* dst, C
         .src = src_node,
         .dst = dst_node,
     };
-    append_list(CFEdge, src_node->succ_edges, edge);
-    append_list(CFEdge, dst_node->pred_edges, edge);
+    append_list(CFEdge, ctx->edges, edge);
 }
 
 static void add_structural_dominance_edge(ScopeBuildContext* ctx, CFNode* parent, const Node* dst, CFEdgeType type) {
     add_edge(ctx, parent->node, dst, type);
-    insert_set_get_result(const Node*, parent->structurally_dominates, dst);
 }
 
 static void add_jump_edge(ScopeBuildContext* ctx, const Node* src, const Node* j) {
@@ -208,74 +209,86 @@ static void process_cf_node(ScopeBuildContext* ctx, CFNode* node) {
     }
 }
 
-/**
- * Invert all edges in this scope. Used to compute a post dominance tree.
- */
-static void flip_scope(Scope* scope) {
-    scope->entry = NULL;
+/// Sorts the edges by node with a counting sort, so each node gets its successors and predecessors as contiguous slices.
+/// Edges keep the order they were added in.
+static void pack_edges(Scope* scope, struct List* edges) {
+    size_t edges_count = entries_count_list(edges);
+    CFEdge* all_edges = read_list(CFEdge, edges);
+    CFNode** nodes = read_list(CFNode*, scope->contents);
 
     for (size_t i = 0; i < scope->size; i++) {
-        CFNode * cur = read_list(CFNode*, scope->contents)[i];
-
-        struct List* tmp = cur->succ_edges;
-        cur->succ_edges = cur->pred_edges;
-        cur->pred_edges = tmp;
+        nodes[i]->succ_edges.count = 0;
+        nodes[i]->pred_edges.count = 0;
+    }
+    for (size_t i = 0; i < edges_count; i++) {
+        all_edges[i].src->succ_edges.count++;
+        all_edges[i].dst->pred_edges.count++;
+    }
 
-        for (size_t j = 0; j < entries_count_list(cur->succ_edges); j++) {
-            CFEdge* edge = &read_list(CFEdge, cur->succ_edges)[j];
+    CFEdge* storage = arena_alloc_uninitialized(scope->arena, sizeof(CFEdge) * edges_count * 2);
+    for (size_t i = 0; i < scope->size; i++) {
+        nodes[i]->succ_edges.edges = storage;
+        storage += nodes[i]->succ_edges.count;
+        nodes[i]->succ_edges.count = 0;
+        nodes[i]->pred_edges.edges = storage;
+        storage += nodes[i]->pred_edges.count;
+        nodes[i]->pred_edges.count = 0;
+    }
+    for (size_t i = 0; i < edges_count; i++) {
+        CFEdge edge = all_edges[i];
+        edge.src->succ_edges.edges[edge.src->succ_edges.count++] = edge;
+        edge.dst->pred_edges.edges[edge.dst->pred_edges.count++] = edge;
+    }
+}
 
-            CFNode* tmp = edge->dst;
-            edge->dst = edge->src;
-            edge->src = tmp;
-        }
+/**
+ * Invert all edges in this scope. Used to compute a post dominance tree.
+ */
+static void flip_scope(Scope* scope, struct List* edges) {
+    CFEdge* all_edges = read_list(CFEdge, edges);
+    for (size_t i = 0; i < entries_count_list(edges); i++) {
+        CFNode* tmp = all_edges[i].dst;
+        all_edges[i].dst = all_edges[i].src;
+        all_edges[i].src = tmp;
+    }
+    pack_edges(scope, edges);
 
-        for (size_t j = 0; j < entries_count_list(cur->pred_edges); j++) {
-            CFEdge* edge = &read_list(CFEdge, cur->pred_edges)[j];
+    // the exits become entries, when there are several of them we need to join them in a virtual one
+    scope->entry = NULL;
+    size_t original_size = scope->size;
+    for (size_t i = 0; i < original_size; i++) {
+        CFNode* cur = read_list(CFNode*, scope->contents)[i];
+        if (cur->pred_edges.count > 0)
+            continue;
 
-            CFNode* tmp = edge->dst;
-            edge->dst = edge->src;
-            edge->src = tmp;
+        if (scope->entry == NULL) {
+            scope->entry = cur;
+            continue;
         }
 
-        if (entries_count_list(cur->pred_edges) == 0) {
-            if (scope->entry != NULL) {
-                if (scope->entry->node) {
-                    CFNode* new_entry = arena_alloc(scope->arena, sizeof(CFNode));
-                    *new_entry = (CFNode) {
-                        .node = NULL,
-                        .succ_edges = new_list(CFEdge),
-                        .pred_edges = new_list(CFEdge),
-                        .rpo_index = SIZE_MAX,
-                        .idom = NULL,
-                        .dominates = NULL,
-                    };
-
-                    CFEdge prev_entry_edge = {
-                        .type = JumpEdge,
-                        .src = new_entry,
-                        .dst = scope->entry
-                    };
-                    append_list(CFEdge, new_entry->succ_edges, prev_entry_edge);
-                    append_list(CFEdge, scope->entry->pred_edges, prev_entry_edge);
-                    scope->entry = new_entry;
-                }
-
-                CFEdge new_edge = {
-                    .type = JumpEdge,
-                    .src = scope->entry,
-                    .dst = cur
-                };
-                append_list(CFEdge, scope->entry->succ_edges, new_edge);
-                append_list(CFEdge, cur->pred_edges, new_edge);
-            } else {
-                scope->entry = cur;
-            }
+        if (scope->entry->node) {
+            CFNode* new_entry = new_cfnode(scope->arena, NULL);
+            CFEdge prev_entry_edge = {
+                .type = JumpEdge,
+                .src = new_entry,
+                .dst = scope->entry
+            };
+            append_list(CFEdge, edges, prev_entry_edge);
+            scope->entry = new_entry;
         }
+
+        CFEdge new_edge = {
+            .type = JumpEdge,
+            .src = scope->entry,
+            .dst = cur
+        };
+        append_list(CFEdge, edges, new_edge);
     }
 
     if (!scope->entry->node) {
         scope->size += 1;
         append_list(Node*, scope->contents, scope->entry);
+        pack_edges(scope, edges);
     }
 }
 
@@ -284,8 +297,8 @@ static void validate_scope(Scope* scope) {
         CFNode* node = read_list(CFNode*, scope->contents)[i];
         if (is_case(node->node)) {
             size_t structured_body_uses = 0;
-            for (size_t j = 0; j < entries_count_list(node->pred_edges); j++) {
-                CFEdge edge = read_list(CFEdge, node->pred_edges)[j];
+            for (size_t j = 0; j < node->pred_edges.count; j++) {
+                CFEdge edge = node->pred_edges.edges[j];
                 switch (edge.type) {
                     case JumpEdge:
                         error_print("Error: cases cannot be jumped to directly.");
@@ -322,6 +335,7 @@ Scope* new_scope_impl(const Node* entry, LoopTree* lt, bool flipped) {
         .join_point_values = new_dict(const Node*, CFNode*, (HashFn) hash_node, (CmpFn) compare_node),
         .queue = new_list(CFNode*),
         .contents = new_list(CFNode*),
+        .edges = new_list(CFEdge),
     };
 
     CFNode* entry_node = get_or_enqueue(&context, entry);
@@ -342,13 +356,16 @@ Scope* new_scope_impl(const Node* entry, LoopTree* lt, bool flipped) {
         .flipped = flipped,
         .contents = context.contents,
         .map = context.nodes,
-        .rpo = NULL
+        .rpo = NULL,
+        .dom_frontiers = NULL,
     };
 
+    pack_edges(scope, context.edges);
     validate_scope(scope);
 
     if (flipped)
-        flip_scope(scope);
+        flip_scope(scope, context.edges);
+    destroy_list(context.edges);
 
     compute_rpo(scope);
     compute_domtree(scope);
@@ -357,54 +374,49 @@ Scope* new_scope_impl(const Node* entry, LoopTree* lt, bool flipped) {
 }
 
 void destroy_scope(Scope* scope) {
-    bool entry_destroyed = false;
-    for (size_t i = 0; i < scope->size; i++) {
-        CFNode* node = read_list(CFNode*, scope->contents)[i];
-        entry_destroyed |= node == scope->entry;
-        destroy_list(node->pred_edges);
-        destroy_list(node->succ_edges);
-        if (node->dominates)
-            destroy_list(node->dominates);
-        if (node->structurally_dominates)
-            destroy_dict(node->structurally_dominates);
-    }
-    if (!entry_destroyed) {
-        destroy_list(scope->entry->pred_edges);
-        destroy_list(scope->entry->succ_edges);
-        if (scope->entry->dominates)
-            destroy_list(scope->entry->dominates);
-    }
     destroy_dict(scope->map);
     destroy_arena(scope->arena);
-    free(scope->rpo);
     destroy_list(scope->contents);
     free(scope);
 }
 
-static size_t post_order_visit(Scope* scope, CFNode* n, size_t i) {
-    n->rpo_index = -2;
-
-    for (size_t j = 0; j < entries_count_list(n->succ_edges); j++) {
-        CFEdge edge = read_list(CFEdge, n->succ_edges)[j];
-        if (edge.dst->rpo_index == SIZE_MAX)
-            i = post_order_visit(scope, edge.dst, i);
-    }
-
-    n->rpo_index = i - 1;
-    scope->rpo[n->rpo_index] = n;
-    return n->rpo_index;
-}
+typedef struct {
+    CFNode* node;
+    size_t next_succ;
+} DfsFrame;
 
+/// Depth-first search with an explicit stack, scopes can have more blocks than we have stack frames to recurse into
 void compute_rpo(Scope* scope) {
-    scope->rpo = malloc(sizeof(const CFNode*) * scope->size);
-    size_t index = post_order_visit(scope,  scope->entry, scope->size);
+    scope->rpo = arena_alloc(scope->arena, sizeof(CFNode*) * scope->size);
+    // rpo_index doubles as the visited flag
+    const size_t unvisited = SIZE_MAX, visiting = SIZE_MAX - 1;
+    for (size_t i = 0; i < scope->size; i++)
+        read_list(CFNode*, scope->contents)[i]->rpo_index = unvisited;
+
+    // every node is pushed at most once
+    DfsFrame* stack = malloc(sizeof(DfsFrame) * scope->size);
+    size_t stack_size = 0;
+    size_t index = scope->size;
+
+    stack[stack_size++] = (DfsFrame) { .node = scope->entry, .next_succ = 0 };
+    scope->entry->rpo_index = visiting;
+    while (stack_size > 0) {
+        DfsFrame* top = &stack[stack_size - 1];
+        if (top->next_succ < top->node->succ_edges.count) {
+            CFNode* succ = top->node->succ_edges.edges[top->next_succ++].dst;
+            if (succ->rpo_index == unvisited) {
+                succ->rpo_index = visiting;
+                stack[stack_size++] = (DfsFrame) { .node = succ, .next_succ = 0 };
+            }
+            continue;
+        }
+        // all successors are done: number this node in post order, counting down from the end
+        top->node->rpo_index = --index;
+        scope->rpo[index] = top->node;
+        stack_size--;
+    }
+    free(stack);
     assert(index == 0);
-
-    // debug_print("RPO: ");
-    // for (size_t i = 0; i < scope->size; i++) {
-    //     debug_print("%s, ", scope->rpo[i]->node->payload.lam.name);
-    // }
-    // debug_print("\n");
 }
 
 CFNode* least_common_ancestor(CFNode* i, CFNode* j) {
@@ -416,97 +428,147 @@ CFNode* least_common_ancestor(CFNode* i, CFNode* j) {
     return i;
 }
 
-void compute_domtree(Scope* scope) {
-    for (size_t i = 0; i < scope->size; i++) {
-        CFNode* n = read_list(CFNode*, scope->contents)[i];
-        if (n == scope->entry)
-            continue;
-        for (size_t j = 0; j < entries_count_list(n->pred_edges); j++) {
-            CFEdge e = read_list(CFEdge, n->pred_edges)[j];
-            CFNode* p = e.src;
-            if (p->rpo_index < n->rpo_index) {
-                n->idom = p;
-                goto outer_loop;
-            }
-        }
-        error("no idom found");
-        outer_loop:;
+static size_t intersect_idoms(const size_t* idoms, size_t a, size_t b) {
+    while (a != b) {
+        while (a > b) a = idoms[a];
+        while (b > a) b = idoms[b];
     }
+    return a;
+}
+
+/// "A Simple, Fast Dominance Algorithm" (Cooper, Harvey & Kennedy) on rpo indices.
+/// Going in RPO means reducible graphs converge after a single iteration plus one to confirm it.
+void compute_domtree(Scope* scope) {
+    size_t size = scope->size;
+    const size_t undefined = SIZE_MAX;
+    size_t* idoms = malloc(sizeof(size_t) * size);
+    for (size_t i = 0; i < size; i++)
+        idoms[i] = undefined;
+    // the entry is its own idom for the purpose of the algorithm
+    idoms[0] = 0;
 
     bool todo = true;
     while (todo) {
         todo = false;
-        for (size_t i = 0; i < scope->size; i++) {
-            CFNode* n = read_list(CFNode*, scope->contents)[i];
-            if (n == scope->entry)
-                continue;
-            CFNode* new_idom = NULL;
-            for (size_t j = 0; j < entries_count_list(n->pred_edges); j++) {
-                CFEdge e = read_list(CFEdge, n->pred_edges)[j];
-                CFNode* p = e.src;
-                new_idom = new_idom ? least_common_ancestor(new_idom, p) : p;
+        for (size_t i = 1; i < size; i++) {
+            CFNode* n = scope->rpo[i];
+            size_t new_idom = undefined;
+            for (size_t j = 0; j < n->pred_edges.count; j++) {
+                size_t p = n->pred_edges.edges[j].src->rpo_index;
+                // ignore predecessors we know nothing about yet
+                if (idoms[p] == undefined)
+                    continue;
+                new_idom = new_idom == undefined ? p : intersect_idoms(idoms, p, new_idom);
             }
-            assert(new_idom);
-            if (n->idom != new_idom) {
-                n->idom = new_idom;
+            // the parent in the DFS tree always comes before in RPO
+            assert(new_idom != undefined);
+            if (idoms[i] != new_idom) {
+                idoms[i] = new_idom;
                 todo = true;
             }
         }
     }
 
-    for (size_t i = 0; i < scope->size; i++) {
-        CFNode* n = read_list(CFNode*, scope->contents)[i];
-        n->dominates = new_list(CFNode*);
+    CFNode** nodes = read_list(CFNode*, scope->contents);
+    for (size_t i = 0; i < size; i++) {
+        CFNode* n = scope->rpo[i];
+        n->idom = i == 0 ? NULL : scope->rpo[idoms[i]];
+        n->dominates.count = 0;
     }
-    for (size_t i = 0; i < scope->size; i++) {
-        CFNode* n = read_list(CFNode*, scope->contents)[i];
-        if (n == scope->entry)
-            continue;
-        append_list(CFNode*, n->idom->dominates, n);
+    free(idoms);
+
+    // children lists are slices of one array, in the order the scope discovered the nodes
+    for (size_t i = 0; i < size; i++)
+        if (nodes[i]->idom)
+            nodes[i]->idom->dominates.count++;
+    CFNode** storage = arena_alloc_uninitialized(scope->arena, sizeof(CFNode*) * size);
+    for (size_t i = 0; i < size; i++) {
+        nodes[i]->dominates.nodes = storage;
+        storage += nodes[i]->dominates.count;
+        nodes[i]->dominates.count = 0;
+    }
+    for (size_t i = 0; i < size; i++) {
+        CFNode* idom = nodes[i]->idom;
+        if (idom)
+            idom->dominates.nodes[idom->dominates.count++] = nodes[i];
     }
 }
 
-/**
- * @param node: Start node.
- * @param target: List to extend. @ref List of @ref CFNode*
- */
-static void get_undominated_children(const CFNode* node, struct List* target) {
-    for (size_t i = 0; i < entries_count_list(node->succ_edges); i++) {
-        CFEdge edge = read_list(CFEdge, node->succ_edges)[i];
-
-        bool contained = false;
-        for (size_t j = 0; j < entries_count_list(node->dominates); j++) {
-            CFNode* dominated = read_list(CFNode*, node->dominates)[j];
-            if (edge.dst == dominated) {
-                contained = true;
-                break;
-            }
+bool cfnode_structurally_dominates(const CFNode* parent, const CFNode* child) {
+    for (size_t i = 0; i < child->pred_edges.count; i++) {
+        CFEdge edge = child->pred_edges.edges[i];
+        if (edge.src != parent)
+            continue;
+        switch (edge.type) {
+            case LetTailEdge:
+            case StructuredEnterBodyEdge:
+            case StructuredPseudoExitEdge: return true;
+            case JumpEdge:
+            case StructuredLeaveBodyEdge: break;
         }
-        if (!contained)
-            append_list(CFNode*, target, edge.dst);
     }
+    return false;
 }
 
-//TODO: this function can produce duplicates.
-struct List* scope_get_dom_frontier(Scope* scope, const CFNode* node) {
-    struct List* dom_frontier = new_list(CFNode*);
+/// A node is in the frontier of all the nodes from its predecessors up to (excluding) its idom (Cooper, Harvey & Kennedy).
+/// Every node is looked at once, so it can only be a duplicate of the last entry of a frontier.
+/// The first round only counts, so the frontiers can be slices of a single array.
+static void compute_dom_frontiers(Scope* scope) {
+    size_t size = scope->size;
+    CFNodes* frontiers = arena_alloc(scope->arena, sizeof(CFNodes) * size);
+    size_t* last_added = malloc(sizeof(size_t) * size);
+    CFNode** storage = NULL;
+
+    for (int round = 0; round < 2; round++) {
+        for (size_t i = 0; i < size; i++)
+            last_added[i] = SIZE_MAX;
+        for (size_t i = 0; i < size; i++) {
+            CFNode* n = scope->rpo[i];
+            for (size_t j = 0; j < n->pred_edges.count; j++) {
+                for (CFNode* runner = n->pred_edges.edges[j].src; runner != n->idom; runner = runner->idom) {
+                    size_t r = runner->rpo_index;
+                    if (last_added[r] == i)
+                        continue;
+                    last_added[r] = i;
+                    if (round == 0)
+                        frontiers[r].count++;
+                    else
+                        frontiers[r].nodes[frontiers[r].count++] = n;
+                }
+            }
+        }
 
-    get_undominated_children(node, dom_frontier);
-    for (size_t i = 0; i < entries_count_list(node->dominates); i++) {
-        CFNode* dom = read_list(CFNode*, node->dominates)[i];
-        get_undominated_children(dom, dom_frontier);
+        if (round == 0) {
+            size_t total = 0;
+            for (size_t i = 0; i < size; i++)
+                total += frontiers[i].count;
+            storage = arena_alloc_uninitialized(scope->arena, sizeof(CFNode*) * total);
+            for (size_t i = 0; i < size; i++) {
+                frontiers[i].nodes = storage;
+                storage += frontiers[i].count;
+                frontiers[i].count = 0;
+            }
+        }
     }
 
-    return dom_frontier;
+    free(last_added);
+    scope->dom_frontiers = frontiers;
+}
+
+CFNodes scope_get_dom_frontier(Scope* scope, const CFNode* node) {
+    if (!scope->dom_frontiers)
+        compute_dom_frontiers(scope);
+    assert(node->rpo_index < scope->size);
+    return scope->dom_frontiers[node->rpo_index];
 }
 
 static int extra_uniqueness = 0;
 
 static CFNode* get_let_pred(const CFNode* n) {
-    if (entries_count_list(n->pred_edges) == 1) {
-        CFEdge pred = read_list(CFEdge, n->pred_edges)[0];
+    if (n->pred_edges.count == 1) {
+        CFEdge pred = n->pred_edges.edges[0];
         assert(pred.dst == n);
-        if (pred.type == LetTailEdge && entries_count_list(pred.src->succ_edges) == 1) {
+        if (pred.type == LetTailEdge && pred.src->succ_edges.count == 1) {
             assert(is_case(n->node));
             return pred.src;
         }
@@ -539,10 +601,10 @@ static void dump_cf_node(FILE* output, const CFNode* n) {
         else
             label = format_string_arena(bb->arena->arena, "%slet ... = %s (...)\n", label, node_tags[instr->tag]);
 
-        if (entries_count_list(let_chain_end->succ_edges) != 1 || read_list(CFEdge, let_chain_end->succ_edges)[0].type != LetTailEdge)
+        if (let_chain_end->succ_edges.count != 1 || let_chain_end->succ_edges.edges[0].type != LetTailEdge)
             break;
 
-        let_chain_end = read_list(CFEdge, let_chain_end->succ_edges)[0].dst;
+        let_chain_end = let_chain_end->succ_edges.edges[0].dst;
         const Node* abs = body->payload.let.tail;
         assert(let_chain_end->node == abs);
         assert(is_case(abs));
@@ -557,9 +619,9 @@ static void dump_cf_node(FILE* output, const CFNode* n) {
 
     fprintf(output, "bb_%zu [label=\"%s\", color=\"%s\", shape=box];\n", (size_t) n, label, color);
 
-    for (size_t i = 0; i < entries_count_list(n->dominates); i++) {
-        CFNode* d = read_list(CFNode*, n->dominates)[i];
-        if (!find_key_dict(const Node*, n->structurally_dominates, d->node))
+    for (size_t i = 0; i < n->dominates.count; i++) {
+        CFNode* d = n->dominates.nodes[i];
+        if (!cfnode_structurally_dominates(n, d))
             dump_cf_node(output, d);
     }
 }
@@ -585,8 +647,8 @@ static void dump_cfg_scope(FILE* output, Scope* scope) {
                 break;
         }
 
-        for (size_t j = 0; j < entries_count_list(bb_node->succ_edges); j++) {
-            CFEdge edge = read_list(CFEdge, bb_node->succ_edges)[j];
+        for (size_t j = 0; j < bb_node->succ_edges.count; j++) {
+            CFEdge edge = bb_node->succ_edges.edges[j];
             const CFNode* target_node = edge.dst;
 
             if (edge.type == LetTailEdge && get_let_pred(target_node) == bb_node)
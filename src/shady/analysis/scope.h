@@ -22,20 +22,25 @@ typedef struct {
     CFNode* dst;
 } CFEdge;
 
+typedef struct {
+    size_t count;
+    CFEdge* edges;
+} CFEdges;
+
+typedef struct {
+    size_t count;
+    CFNode** nodes;
+} CFNodes;
+
+/// The edge and dominator arrays are slices of a couple of big allocations in the scope's arena, they are only valid as long as the scope is.
 struct CFNode_ {
     const Node* node;
 
-    /** @brief Edges where this node is the source
-     *
-     * @ref List of @ref CFEdge
-     */
-    struct List* succ_edges;
+    /// Edges where this node is the source
+    CFEdges succ_edges;
 
-    /** @brief Edges where this node is the destination
-     *
-     * @ref List of @ref CFEdge
-     */
-    struct List* pred_edges;
+    /// Edges where this node is the destination
+    CFEdges pred_edges;
 
     // set by compute_rpo
     size_t rpo_index;
@@ -43,12 +48,8 @@ struct CFNode_ {
     // set by compute_domtree
     CFNode* idom;
 
-    /** @brief All Nodes directly dominated by this CFNode.
-     *
-     * @ref List of @ref CFNode*
-     */
-    struct List* dominates;
-    struct Dict* structurally_dominates;
+    /// All the nodes directly dominated by this one, in the order they were discovered in
+    CFNodes dominates;
 };
 
 typedef struct Arena_ Arena;
@@ -70,6 +71,9 @@ typedef struct Scope_ {
     CFNode* entry;
     // set by compute_rpo
     CFNode** rpo;
+
+    /// Indexed by rpo_index, see scope_get_dom_frontier
+    CFNodes* dom_frontiers;
 } Scope;
 
 /**
@@ -107,10 +111,12 @@ CFNode* least_common_ancestor(CFNode* i, CFNode* j);
 
 void destroy_scope(Scope*);
 
-/**
- * @returns @ref List of @ref CFNode*
- */
-struct List* scope_get_dom_frontier(Scope*, const CFNode* node);
+/// Whether 'parent' enters 'child' as part of a structured construct (let tails, bodies of ifs, loops...), as opposed to jumping there.
+/// Such children are always dominated by their structural parent.
+bool cfnode_structurally_dominates(const CFNode* parent, const CFNode* child);
+
+/// Exact, duplicate-free dominance frontier of 'node'. The frontiers of the whole scope are computed on the first call.
+CFNodes scope_get_dom_frontier(Scope*, const CFNode* node);
 
 #define SHADY_SCOPE_H
 
@@ -11,57 +11,128 @@
 KeyHash hash_node(Node**);
 bool compare_node(Node**, Node**);
 
+typedef struct {
+    Use* first;
+    Use* last;
+} UseChain;
+
 struct UsesMap_ {
-    struct Dict* map;
+    UsesMapLayout layout;
     Arena* a;
+
+    /// UsesMapLinked: node -> UseChain
+    struct Dict* chains;
+
+    /// UsesMapCompact: node -> dense index, the uses of node i are uses[offsets[i]] to uses[offsets[i + 1]]
+    struct Dict* indices;
+    size_t* offsets;
+    Use* uses;
 };
 
+/// A use found while walking the graph, before it gets packed
+typedef struct {
+    size_t index;
+    Use use;
+} RecordedUse;
+
 typedef struct {
     Visitor v;
     UsesMap* map;
     NodeClass exclude;
     struct Dict* seen;
     const Node* user;
+    /// UsesMapCompact only
+    struct List* recorded;
 } UsesMapVisitor;
 
-static Use* get_last_use(UsesMap* map, const Node* n) {
-    Use* use = (Use*) get_first_use(map, n);
-    if (!use)
-        return NULL;
-    while (use->next_use)
-        use = (Use*) use->next_use;
-    assert(use);
-    return use;
+static void record_use_linked(UsesMapVisitor* v, const Node* op, Use use) {
+    Use* alloc = arena_alloc_uninitialized(v->map->a, sizeof(Use));
+    *alloc = use;
+    UseChain* chain = find_value_dict(const Node*, UseChain, v->map->chains, op);
+    if (chain) {
+        chain->last->next_use = alloc;
+        chain->last = alloc;
+    } else {
+        UseChain new_chain = { .first = alloc, .last = alloc };
+        insert_dict(const Node*, UseChain, v->map->chains, op, new_chain);
+    }
+}
+
+/// Dense index of that node in the compact layout, assigning one the first time we see it
+static size_t get_node_index(UsesMapVisitor* v, const Node* node, bool* fresh) {
+    size_t* found = find_value_dict(const Node*, size_t, v->map->indices, node);
+    *fresh = !found;
+    if (found)
+        return *found;
+    size_t index = entries_count_dict(v->map->indices);
+    insert_dict(const Node*, size_t, v->map->indices, node, index);
+    return index;
 }
 
 static void uses_visit_op(UsesMapVisitor* v, NodeClass class, String op_name, const Node* op) {
-    Use* use = arena_alloc(v->map->a, sizeof(Use));
-    memset(use, 0, sizeof(Use));
-    *use = (Use) {
+    Use use = {
         .user = v->user,
         .operand_class = class,
         .operand_name = op_name,
         .next_use = NULL
     };
 
-    Use* last_use = get_last_use(v->map, op);
-    if (last_use)
-        last_use->next_use = use;
-    else
-        insert_dict(const Node*, const Use*, v->map->map, op, use);
+    bool fresh;
+    switch (v->map->layout) {
+        case UsesMapCompact: {
+            RecordedUse recorded = { .index = get_node_index(v, op, &fresh), .use = use };
+            append_list(RecordedUse, v->recorded, recorded);
+            break;
+        }
+        case UsesMapLinked: {
+            record_use_linked(v, op, use);
+            fresh = insert_set_get_result(const Node*, v->seen, op);
+            break;
+        }
+    }
 
-    if (!find_key_dict(const Node*, v->seen, op)) {
-        insert_set_get_result(const Node*, v->seen, op);
+    if (fresh) {
         UsesMapVisitor nv = *v;
         nv.user = op;
         visit_node_operands(&nv.v, v->exclude, op);
     }
 }
 
+/// Counting sort of the recorded uses by node index, keeping them in discovery order for each node
+static void pack_uses(UsesMap* map, struct List* recorded) {
+    size_t nodes_count = entries_count_dict(map->indices);
+    size_t uses_count = entries_count_list(recorded);
+    RecordedUse* recorded_uses = read_list(RecordedUse, recorded);
+
+    map->offsets = arena_alloc(map->a, sizeof(size_t) * (nodes_count + 1));
+    for (size_t i = 0; i < uses_count; i++)
+        map->offsets[recorded_uses[i].index + 1]++;
+    for (size_t i = 0; i < nodes_count; i++)
+        map->offsets[i + 1] += map->offsets[i];
+    assert(map->offsets[nodes_count] == uses_count);
+
+    map->uses = arena_alloc_uninitialized(map->a, sizeof(Use) * uses_count);
+    size_t* cursors = malloc(sizeof(size_t) * nodes_count);
+    memcpy(cursors, map->offsets, sizeof(size_t) * nodes_count);
+    for (size_t i = 0; i < uses_count; i++)
+        map->uses[cursors[recorded_uses[i].index]++] = recorded_uses[i].use;
+    free(cursors);
+
+    // chain them too, so get_first_use/next_use keep working
+    for (size_t i = 0; i < nodes_count; i++) {
+        for (size_t j = map->offsets[i]; j < map->offsets[i + 1]; j++)
+            map->uses[j].next_use = j + 1 < map->offsets[i + 1] ? &map->uses[j + 1] : NULL;
+    }
+}
+
 const UsesMap* create_uses_map(const Node* root, NodeClass exclude) {
+    return create_uses_map_with_layout(root, exclude, UsesMapCompact);
+}
+
+const UsesMap* create_uses_map_with_layout(const Node* root, NodeClass exclude, UsesMapLayout layout) {
     UsesMap* uses = calloc(sizeof(UsesMap), 1);
     *uses = (UsesMap) {
-        .map = new_dict(const Node*, Use*, (HashFn) hash_node, (CmpFn) compare_node),
+        .layout = layout,
         .a = new_arena(),
     };
 
@@ -69,24 +140,62 @@ const UsesMap* create_uses_map(const Node* root, NodeClass exclude) {
         .v = { .visit_op_fn = (VisitOpFn) uses_visit_op },
         .map = uses,
         .exclude = exclude,
-        .seen = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
         .user = root,
     };
-    insert_set_get_result(const Node*, v.seen, root);
-    visit_node_operands(&v.v, exclude, root);
-    destroy_dict(v.seen);
+
+    switch (layout) {
+        case UsesMapCompact: {
+            uses->indices = new_dict(const Node*, size_t, (HashFn) hash_node, (CmpFn) compare_node);
+            v.recorded = new_list(RecordedUse);
+            bool fresh;
+            get_node_index(&v, root, &fresh);
+            visit_node_operands(&v.v, exclude, root);
+            pack_uses(uses, v.recorded);
+            destroy_list(v.recorded);
+            break;
+        }
+        case UsesMapLinked: {
+            uses->chains = new_dict(const Node*, UseChain, (HashFn) hash_node, (CmpFn) compare_node);
+            v.seen = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node);
+            insert_set_get_result(const Node*, v.seen, root);
+            visit_node_operands(&v.v, exclude, root);
+            destroy_dict(v.seen);
+            break;
+        }
+    }
     return uses;
 }
 
 void destroy_uses_map(const UsesMap* map) {
     destroy_arena(map->a);
-    destroy_dict(map->map);
+    if (map->chains)
+        destroy_dict(map->chains);
+    if (map->indices)
+        destroy_dict(map->indices);
     free((void*) map);
 }
 
+const Use* get_uses(const UsesMap* map, const Node* n, size_t* count) {
+    assert(map->layout == UsesMapCompact);
+    size_t* found = find_value_dict(const Node*, size_t, map->indices, n);
+    if (!found) {
+        *count = 0;
+        return NULL;
+    }
+    *count = map->offsets[*found + 1] - map->offsets[*found];
+    return *count > 0 ? &map->uses[map->offsets[*found]] : NULL;
+}
+
 const Use* get_first_use(const UsesMap* map, const Node* n) {
-    const Use** found = find_value_dict(const Node*, const Use*, map->map, n);
-    if (found)
-        return *found;
-    return NULL;
+    switch (map->layout) {
+        case UsesMapCompact: {
+            size_t count;
+            return get_uses(map, n, &count);
+        }
+        case UsesMapLinked: {
+            UseChain* found = find_value_dict(const Node*, UseChain, map->chains, n);
+            return found ? found->first : NULL;
+        }
+    }
+    SHADY_UNREACHABLE;
 }
\ No newline at end of file
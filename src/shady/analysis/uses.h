@@ -9,7 +9,15 @@
 
 typedef struct UsesMap_ UsesMap;
 
+typedef enum {
+    /// Uses are recorded in one pass over the graph, then packed contiguously per node (CSR layout)
+    UsesMapCompact,
+    /// Uses are linked together as they are found, appending in O(1) thanks to a tail pointer
+    UsesMapLinked,
+} UsesMapLayout;
+
 const UsesMap* create_uses_map(const Node* root, NodeClass exclude);
+const UsesMap* create_uses_map_with_layout(const Node* root, NodeClass exclude, UsesMapLayout);
 void destroy_uses_map(const UsesMap*);
 
 typedef struct Use_ Use;
@@ -20,6 +28,9 @@ struct Use_ {
     const Use* next_use;
 };
 
+/// Works with both layouts, walk the rest with next_use
 const Use* get_first_use(const UsesMap*, const Node*);
+/// Compact layout only: all the uses of a node, packed together
+const Use* get_uses(const UsesMap*, const Node*, size_t* count);
 
 #endif
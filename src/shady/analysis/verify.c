@@ -1,6 +1,7 @@
 #include "verify.h"
 #include "free_variables.h"
 #include "scope.h"
+#include "analysis_manager.h"
 #include "log.h"
 
 #include "../visit.h"
@@ -42,10 +43,12 @@ static void verify_same_arena(Module* mod) {
     destroy_dict(visitor.once);
 }
 
-static void verify_scoping(Module* mod) {
-    struct List* scopes = build_scopes(mod);
-    for (size_t i = 0; i < entries_count_list(scopes); i++) {
-        Scope* scope = read_list(Scope*, scopes)[i];
+static void verify_scoping(AnalysisManager* am, Module* mod) {
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(mod, &i, &decl)) {
+        if (decl->tag != Function_TAG) continue;
+        Scope* scope = acquire_scope(am, decl);
         struct List* leaking = compute_free_variables(scope, scope->entry->node);
         for (size_t j = 0; j < entries_count_list(leaking); j++) {
             log_node(ERROR, read_list(const Node*, leaking)[j]);
@@ -53,9 +56,8 @@ static void verify_scoping(Module* mod) {
         }
         assert(entries_count_list(leaking) == 0);
         destroy_list(leaking);
-        destroy_scope(scope);
+        release_scope(am, scope);
     }
-    destroy_list(scopes);
 }
 
 static void verify_nominal_node(const Node* fn, const Node* n) {
@@ -92,10 +94,12 @@ static void verify_nominal_node(const Node* fn, const Node* n) {
     }
 }
 
-static void verify_bodies(Module* mod) {
-    struct List* scopes = build_scopes(mod);
-    for (size_t i = 0; i < entries_count_list(scopes); i++) {
-        Scope* scope = read_list(Scope*, scopes)[i];
+static void verify_bodies(AnalysisManager* am, Module* mod) {
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(mod, &i, &decl)) {
+        if (decl->tag != Function_TAG) continue;
+        Scope* scope = acquire_scope(am, decl);
 
         for (size_t j = 0; j < scope->size; j++) {
             CFNode* n = scope->rpo[j];
@@ -104,23 +108,20 @@ static void verify_bodies(Module* mod) {
             }
         }
 
-        destroy_scope(scope);
+        release_scope(am, scope);
     }
-    destroy_list(scopes);
 
-    Nodes decls = get_module_declarations(mod);
-    for (size_t i = 0; i < decls.count; i++) {
-        const Node* decl = decls.nodes[i];
+    i = 0;
+    while (module_decls_iter(mod, &i, &decl))
         verify_nominal_node(NULL, decl);
-    }
 }
 
-void verify_module(Module* mod) {
+void verify_module(const CompilerConfig* config, Module* mod) {
     verify_same_arena(mod);
     // before we normalize the IR, scopes are broken because decls appear where they should not
     // TODO add a normalized flag to the IR and check grammar is adhered to strictly
     if (get_module_arena(mod)->config.check_types) {
-        verify_scoping(mod);
-        verify_bodies(mod);
+        verify_scoping(config->analyses.manager, mod);
+        verify_bodies(config->analyses.manager, mod);
     }
 }
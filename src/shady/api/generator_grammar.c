@@ -109,6 +109,8 @@ static void generate_node_type(Growy* g, json_object* nodes) {
     growy_append_formatted(g, "\tIrArena* arena;\n");
     growy_append_formatted(g, "\tconst Type* type;\n");
     growy_append_formatted(g, "\tNodeTag tag;\n");
+    growy_append_formatted(g, "\t/// Computed once at construction time: structural hash of the payload, or address-based for nominal nodes\n");
+    growy_append_formatted(g, "\tuint32_t hash;\n");
     growy_append_formatted(g, "\tunion NodesUnion {\n");
 
     for (size_t i = 0; i < json_object_array_length(nodes); i++) {
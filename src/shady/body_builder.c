@@ -34,32 +34,27 @@ static Nodes create_output_variables(IrArena* a, const Node* value, size_t outpu
             // Check that the types we got are subtypes of what we care about
             for (size_t i = 0; i < types.count; i++)
                 assert(is_subtype(output_types[i], types.nodes[i]));
-            types = nodes(a, outputs_count, output_types);
+            types = (Nodes) { .count = types.count, .nodes = output_types };
         }
         outputs_count = types.count;
     } else {
         assert(outputs_count != SIZE_MAX);
-        if (output_types) {
-            types = nodes(a, outputs_count, output_types);
-        } else {
-            LARRAY(const Type*, nulls, outputs_count);
-            for (size_t i = 0; i < outputs_count; i++)
-                nulls[i] = NULL;
-            types = nodes(a, outputs_count, nulls);
-        }
+        // the types only serve to create the variables below, they don't need interning
+        types = (Nodes) { .count = outputs_count, .nodes = output_types };
     }
 
-    LARRAY(Node*, vars, types.count);
+    NodesBuilder vars = begin_nodes(a);
+    reserve_nodes(&vars, types.count);
     for (size_t i = 0; i < types.count; i++) {
         String var_name = output_names ? output_names[i] : NULL;
-        vars[i] = (Node*) var(a, types.nodes[i], var_name);
+        push_node(&vars, var(a, types.nodes ? types.nodes[i] : NULL, var_name));
     }
 
     // for (size_t i = 0; i < outputs_count; i++) {
     //     vars[i]->payload.var.instruction = value;
     //     vars[i]->payload.var.output = i;
     // }
-    return nodes(a, outputs_count, (const Node**) vars);
+    return finish_nodes(&vars);
 }
 
 static Nodes bind_internal(BodyBuilder* bb, const Node* instruction, bool mut, size_t outputs_count, const Node** provided_types, String const output_names[]) {
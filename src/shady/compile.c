@@ -9,6 +9,7 @@
 #include "util.h"
 
 #include <stdbool.h>
+#include <string.h>
 
 #define KiB * 1024
 #define MiB * 1024 KiB
@@ -33,11 +34,16 @@ CompilerConfig default_compiler_config() {
             .cleanup = {
                 .after_every_pass = true,
                 .delete_unused_instructions = true,
-            }
+            },
+            .spirv = {
+                // opt-in until the compactor has seen more real-world modules
+                .compact = false,
+            },
         },
 
         .specialization = {
             .subgroup_size = 8,
+            .min_subgroup_size = 1,
             .entry_point = NULL
         }
     };
@@ -61,17 +67,41 @@ ArenaConfig default_arena_config() {
     };
 }
 
-CompilationResult run_compiler_passes(CompilerConfig* config, Module** pmod) {
+void log_node_memory(LogLevel level, String pass_name, Module* mod) {
+    IrArena* arena = get_module_arena(mod);
+    size_t full_size = arena->stats.nodes * sizeof(Node);
+    log_string(level, "After %s pass: %zu nodes take %zu bytes (%zu bytes saved over full-size nodes)\n", pass_name, arena->stats.nodes, arena->stats.node_bytes, full_size - arena->stats.node_bytes);
+    ArenaStats stats = get_arena_stats(arena->arena);
+    log_string(level, "After %s pass: arena uses %zu bytes out of %zu reserved in %zu blocks, %zu wasted\n", pass_name, stats.used, stats.reserved, stats.blocks, stats.wasted);
+}
+
+static bool begin_analyses(CompilerConfig* config) {
+    if (config->analyses.manager)
+        return false;
+    config->analyses.manager = new_analysis_manager();
+    return true;
+}
+
+static void end_analyses(CompilerConfig* config, bool own_analyses) {
+    if (own_analyses) {
+        log_analysis_stats(DEBUG, config->analyses.manager);
+        destroy_analysis_manager(config->analyses.manager);
+        config->analyses.manager = NULL;
+    }
+}
+
+CompilationResult run_generic_compiler_passes(CompilerConfig* config, Module** pmod) {
     if (config->dynamic_scheduling) {
         debugv_print("Parsing builtin scheduler code");
         ParserConfig pconfig = {
             .front_end = true,
         };
-        parse_shady_ir(pconfig, shady_scheduler_src, *pmod);
+        parse_shady_ir(pconfig, strlen(shady_scheduler_src), shady_scheduler_src, *pmod);
     }
 
     IrArena* initial_arena = (*pmod)->arena;
     Module* old_mod = NULL;
+    bool own_analyses = begin_analyses(config);
 
     generate_dummy_constants(config, *pmod);
 
@@ -98,6 +128,18 @@ CompilationResult run_compiler_passes(CompilerConfig* config, Module** pmod) {
 
     RUN_PASS(lift_indirect_targets)
 
+    end_analyses(config, own_analyses);
+    return CompilationNoError;
+}
+
+CompilationResult run_specialized_compiler_passes(CompilerConfig* config, Module** pmod) {
+    IrArena* initial_arena = (*pmod)->arena;
+    Module* old_mod = NULL;
+    bool own_analyses = begin_analyses(config);
+
+    if (config->specialization.entry_point)
+        RUN_PASS(prune_entry_points)
+
     if (config->specialization.execution_model != EmNone)
         RUN_PASS(specialize_execution_model)
 
@@ -132,7 +174,25 @@ CompilationResult run_compiler_passes(CompilerConfig* config, Module** pmod) {
         RUN_PASS(specialize_entry_point)
     RUN_PASS(lower_fill)
 
+    end_analyses(config, own_analyses);
     return CompilationNoError;
 }
 
+CompilationResult run_compiler_passes(CompilerConfig* config, Module** pmod) {
+    IrArena* initial_arena = get_module_arena(*pmod);
+    bool own_analyses = begin_analyses(config);
+    CompilationResult result = run_generic_compiler_passes(config, pmod);
+    if (result == CompilationNoError) {
+        // nobody else gets to see the output of the generic stage, the specialized one keeps it around as its input
+        IrArena* generic_arena = get_module_arena(*pmod);
+        result = run_specialized_compiler_passes(config, pmod);
+        if (generic_arena != initial_arena && generic_arena != get_module_arena(*pmod)) {
+            forget_arena_analyses(config->analyses.manager, generic_arena);
+            destroy_ir_arena(generic_arena);
+        }
+    }
+    end_analyses(config, own_analyses);
+    return result;
+}
+
 #undef mod
@@ -5,6 +5,8 @@
 #include "passes/passes.h"
 #include "log.h"
 #include "analysis/verify.h"
+#include "profiler.h"
+#include "analysis/analysis_manager.h"
 
 #ifdef NDEBUG
 #define SHADY_RUN_VERIFY 0
@@ -12,23 +14,42 @@
 #define SHADY_RUN_VERIFY 1
 #endif
 
+/// Logs how much memory the nodes of the module's arena take, and how much was saved by sizing them per tag
+void log_node_memory(LogLevel level, String pass_name, Module* mod);
+
+/// Runs 'stmt' as one phase of the current pass, on behalf of the profiler (if any)
+#define PROFILE_PHASE(phase, src, stmt) {               \
+Module* phase_src = src;                                \
+profiler_begin_phase(config->profiling.profiler, phase, phase_src); \
+stmt;                                                   \
+profiler_end_phase(config->profiling.profiler, phase, phase_src, *pmod); \
+}
+
 #define RUN_PASS(pass_name) {                           \
+profiler_begin_pass(config->profiling.profiler, #pass_name); \
 old_mod = *pmod;                                        \
-*pmod = pass_name(config, *pmod);                       \
+PROFILE_PHASE(ProfiledPass, old_mod, *pmod = pass_name(config, *pmod)) \
 (*pmod)->sealed = true;                                 \
+log_node_memory(DEBUGV, #pass_name, *pmod);             \
 debugvv_print("After "#pass_name" pass: \n");           \
 log_module(DEBUGVV, config, *pmod);                     \
 if (SHADY_RUN_VERIFY)                                   \
-  verify_module(*pmod);                                 \
-if (get_module_arena(old_mod) != get_module_arena(*pmod) && get_module_arena(old_mod) != initial_arena) \
+  PROFILE_PHASE(ProfiledVerify, *pmod, verify_module(config, *pmod)) \
+if (get_module_arena(old_mod) != get_module_arena(*pmod) && get_module_arena(old_mod) != initial_arena) { \
+  forget_arena_analyses(config->analyses.manager, get_module_arena(old_mod)); \
   destroy_ir_arena(get_module_arena(old_mod));          \
+}                                                       \
 old_mod = *pmod;                                        \
 if (config->optimisations.cleanup.after_every_pass)     \
-  *pmod = cleanup(config, *pmod);                       \
+  PROFILE_PHASE(ProfiledCleanup, old_mod, *pmod = cleanup(config, *pmod)) \
+(*pmod)->sealed = true;                                 \
 if (SHADY_RUN_VERIFY)                                   \
-  verify_module(*pmod);                                 \
-if (get_module_arena(old_mod) != get_module_arena(*pmod) && get_module_arena(old_mod) != initial_arena) \
+  PROFILE_PHASE(ProfiledVerify, *pmod, verify_module(config, *pmod)) \
+if (get_module_arena(old_mod) != get_module_arena(*pmod) && get_module_arena(old_mod) != initial_arena) { \
+  forget_arena_analyses(config->analyses.manager, get_module_arena(old_mod)); \
   destroy_ir_arena(get_module_arena(old_mod));          \
+}                                                       \
+profiler_end_pass(config->profiling.profiler, *pmod);   \
 if (config->hooks.after_pass.fn)                        \
   config->hooks.after_pass.fn(config->hooks.after_pass.uptr, #pass_name, *pmod);                        \
 } \
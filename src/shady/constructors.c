@@ -13,6 +13,9 @@
 Strings import_strings(IrArena*, Strings);
 bool compare_nodes(Nodes* a, Nodes* b);
 
+KeyHash compute_structural_node_hash(const Node*);
+KeyHash hash_node_address(const Node*);
+
 typedef struct { Visitor visitor; const Node* parent; } VisitorPCV;
 
 static void post_construction_validation_visit_op(VisitorPCV* v, NodeClass class, SHADY_UNUSED String op_name, const Node* node) {
@@ -39,12 +42,15 @@ static Node* create_node_helper(IrArena* arena, Node node, bool* pfresh) {
         *pfresh = false;
 
     Node* ptr = &node;
-    Node** found = find_key_dict(Node*, arena->node_set, ptr);
-    // sanity check nominal nodes to be unique, check for duplicates in structural nodes
-    if (is_nominal(&node))
-        assert(!found);
-    else if (found)
-        return *found;
+    // nominal nodes are unique by definition, check for duplicates in structural nodes
+    bool nominal = is_nominal(&node);
+    if (!nominal) {
+        node.hash = compute_structural_node_hash(&node);
+        arena->stats.structural_hashes++;
+        Node** found = find_key_dict(Node*, arena->node_set, ptr);
+        if (found)
+            return *found;
+    }
 
     if (pfresh)
         *pfresh = true;
@@ -63,8 +69,14 @@ static Node* create_node_helper(IrArena* arena, Node node, bool* pfresh) {
         assert(is_type(node.type));
 
     // place the node in the arena and return it
-    Node* alloc = (Node*) arena_alloc(arena->arena, sizeof(Node));
-    *alloc = node;
+    // only the payload for that tag is allocated: never access the other union members through alloc !
+    size_t size = node_type_sizes[node.tag];
+    Node* alloc = (Node*) arena_alloc_uninitialized(arena->arena, size);
+    memcpy(alloc, &node, size);
+    arena->stats.nodes++;
+    arena->stats.node_bytes += size;
+    if (nominal)
+        alloc->hash = hash_node_address(alloc);
     insert_set_get_result(const Node*, arena->node_set, alloc);
 
     post_construction_validation(arena, alloc);
@@ -159,7 +171,7 @@ Node* function(Module* mod, Nodes params, const char* name, Nodes annotations, N
         .module = mod,
         .params = params,
         .body = NULL,
-        .name = name,
+        .name = string(arena, name),
         .annotations = annotations,
         .return_types = return_types,
     };
@@ -710,9 +710,10 @@ void emit_c(CompilerConfig compiler_config, CEmitterConfig config, Module* mod,
         .emitted_types = new_dict(Node*, String, (HashFn) hash_node, (CmpFn) compare_node),
     };
 
-    Nodes decls = get_module_declarations(mod);
-    for (size_t i = 0; i < decls.count; i++)
-        emit_decl(&emitter, decls.nodes[i]);
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(mod, &i, &decl))
+        emit_decl(&emitter, decl);
 
     destroy_printer(emitter.type_decls);
     destroy_printer(emitter.fn_decls);
@@ -12,6 +12,7 @@
 #include "../../compile.h"
 
 #include "emit_spv.h"
+#include "spirv_opt.h"
 
 #include <string.h>
 #include <stdint.h>
@@ -129,6 +130,15 @@ SpvId emit_value(Emitter* emitter, BBBuilder bb_builder, const Node* node) {
                         return r;
                     }
                     assert(init_value && "TODO: support some measure of constant expressions");
+                    const Node* spec_id = lookup_annotation(decl, "SpecId");
+                    if (spec_id) {
+                        assert(init_value->tag == IntLiteral_TAG && init_value->payload.int_literal.width != IntTy64);
+                        new = spvb_fresh_id(emitter->file_builder);
+                        spvb_spec_constant(emitter->file_builder, new, emit_type(emitter, init_value->type), 1, (uint32_t[]) { init_value->payload.int_literal.value });
+                        spvb_decorate(emitter->file_builder, new, SpvDecorationSpecId, 1, (uint32_t[]) { get_int_literal_value(*resolve_to_int_literal(get_annotation_value(spec_id)), false) });
+                        spvb_name(emitter->file_builder, new, get_decl_name(decl));
+                        break;
+                    }
                     new = emit_value(emitter, NULL, init_value);
                     break;
                 }
@@ -298,7 +308,7 @@ static void emit_function(Emitter* emitter, const Node* node) {
     }
 
     if (node->payload.fun.body) {
-        Scope* scope = new_scope(node);
+        Scope* scope = acquire_scope(emitter->configuration->analyses.manager, node);
         // reserve a bunch of identifiers for the basic blocks in the scope
         for (size_t i = 0; i < scope->size; i++) {
             CFNode* cfnode = read_list(CFNode*, scope->contents)[i];
@@ -333,7 +343,7 @@ static void emit_function(Emitter* emitter, const Node* node) {
             emit_basic_block(emitter, fn_builder, scope, cfnode);
         }
 
-        destroy_scope(scope);
+        release_scope(emitter->configuration->analyses.manager, scope);
 
         spvb_define_function(emitter->file_builder, fn_builder);
     } else {
@@ -443,6 +453,35 @@ static SpvExecutionModel emit_exec_model(ExecutionModel model) {
     }
 }
 
+static const Node* find_spec_constant(Nodes declarations, ShdSpecId id) {
+    for (size_t i = 0; i < declarations.count; i++) {
+        const Node* decl = declarations.nodes[i];
+        const Node* spec_id = decl->tag == Constant_TAG ? lookup_annotation(decl, "SpecId") : NULL;
+        if (spec_id && get_int_literal_value(*resolve_to_int_literal(get_annotation_value(spec_id)), false) == id)
+            return decl;
+    }
+    return NULL;
+}
+
+static void emit_workgroup_size_spec_constants(Emitter* emitter, Nodes declarations, uint32_t defaults[3]) {
+    SpvId u32_t = emit_type(emitter, uint32_type(emitter->arena));
+    SpvId components[3];
+    for (int dim = 0; dim < 3; dim++) {
+        // the code reads the workgroup size through these if specialize_entry_point made them, the SpecIds have to stay unique
+        const Node* decl = find_spec_constant(declarations, ShdSpecIdWorkgroupSizeX + dim);
+        if (decl) {
+            components[dim] = emit_value(emitter, NULL, ref_decl_helper(emitter->arena, decl));
+            continue;
+        }
+        components[dim] = spvb_fresh_id(emitter->file_builder);
+        spvb_spec_constant(emitter->file_builder, components[dim], u32_t, 1, &defaults[dim]);
+        spvb_decorate(emitter->file_builder, components[dim], SpvDecorationSpecId, 1, (uint32_t[]) { ShdSpecIdWorkgroupSizeX + dim });
+    }
+    SpvId v3u32_t = emit_type(emitter, pack_type(emitter->arena, (PackType) { .element_type = uint32_type(emitter->arena), .width = 3 }));
+    SpvId workgroup_size = spvb_spec_constant_composite(emitter->file_builder, v3u32_t, 3, components);
+    spvb_decorate(emitter->file_builder, workgroup_size, SpvDecorationBuiltIn, 1, (uint32_t[]) { SpvBuiltInWorkgroupSize });
+}
+
 static void emit_entry_points(Emitter* emitter, Nodes declarations) {
     // First, collect all the global variables, they're needed for the interface section of OpEntryPoint
     // it can be a superset of the ones actually used, so the easiest option is to just grab _all_ global variables and shove them in there
@@ -488,6 +527,11 @@ static void emit_entry_points(Emitter* emitter, Nodes declarations) {
                 uint32_t wg_z_dim = (uint32_t) get_int_literal_value(*resolve_to_int_literal(values.nodes[2]), false);
 
                 spvb_execution_mode(emitter->file_builder, fn_id, SpvExecutionModeLocalSize, 3, (uint32_t[3]) { wg_x_dim, wg_y_dim, wg_z_dim });
+
+                // a WorkgroupSize built-in overrides LocalSize, making it a specialization constant lets the runtime pick the shape
+                // there can only be one of those so this needs a module with a single entry point
+                if (emitter->configuration->specialization.spec_constants && emitter->configuration->specialization.entry_point)
+                    emit_workgroup_size_spec_constants(emitter, declarations, (uint32_t[3]) { wg_x_dim, wg_y_dim, wg_z_dim });
             }
 
             if (execution_model == EmFragment) {
@@ -535,6 +579,9 @@ static Module* run_backend_specific_passes(CompilerConfig* config, Module* initi
 
 void emit_spirv(CompilerConfig* config, Module* mod, size_t* output_size, char** output, Module** new_mod) {
     IrArena* initial_arena = get_module_arena(mod);
+    bool own_analyses = !config->analyses.manager;
+    if (own_analyses)
+        config->analyses.manager = new_analysis_manager();
     mod = run_backend_specific_passes(config, mod);
     IrArena* arena = get_module_arena(mod);
 
@@ -568,14 +615,28 @@ void emit_spirv(CompilerConfig* config, Module* mod, size_t* output_size, char**
     spvb_capability(file_builder, SpvCapabilityShader);
 
     *output_size = spvb_finish(file_builder, output);
+    if (config->optimisations.spirv.compact) {
+        SpvoConfig spvo_config = {
+            .strip_debug_info = config->optimisations.spirv.strip_debug_info,
+        };
+        *output_size = spvo_compact_module(spvo_config, get_module_name(mod), *output_size, (uint32_t*) *output);
+    }
 
     // cleanup the emitter
     destroy_dict(emitter.node_ids);
     destroy_dict(emitter.bb_builders);
     destroy_dict(emitter.extended_instruction_sets);
 
+    if (own_analyses) {
+        log_analysis_stats(DEBUG, config->analyses.manager);
+        destroy_analysis_manager(config->analyses.manager);
+        config->analyses.manager = NULL;
+    }
+
     if (new_mod)
         *new_mod = mod;
-    else if (initial_arena != arena)
+    else if (initial_arena != arena) {
+        forget_arena_analyses(config->analyses.manager, arena);
         destroy_ir_arena(arena);
+    }
 }
@@ -173,7 +173,11 @@ SpvId emit_type(Emitter* emitter, const Type* type) {
         case ArrType_TAG: {
             SpvId element_type = emit_type(emitter, type->payload.arr_type.element_type);
             if (type->payload.arr_type.size) {
-                new = spvb_array_type(emitter->file_builder, element_type, emit_value(emitter, NULL, type->payload.arr_type.size));
+                const Node* size = type->payload.arr_type.size;
+                // arrays sized by a specialization constant get the default value, which is the upper bound
+                if (size->tag == RefDecl_TAG && size->payload.ref_decl.decl->tag == Constant_TAG && lookup_annotation(size->payload.ref_decl.decl, "SpecId"))
+                    size = get_quoted_value(size->payload.ref_decl.decl->payload.constant.instruction);
+                new = spvb_array_type(emitter->file_builder, element_type, emit_value(emitter, NULL, size));
             } else {
                 new = spvb_runtime_array_type(emitter->file_builder, element_type);
             }
@@ -0,0 +1,203 @@
+#include "generator.h"
+
+/// Operand kinds that only ever take one word, or that are handled specially by the optimizer
+static String classify_simple_kind(String kind) {
+    if (strcmp(kind, "IdResultType") == 0)
+        return "SpvoOperandResultType";
+    if (strcmp(kind, "IdResult") == 0)
+        return "SpvoOperandResult";
+    if (strcmp(kind, "IdRef") == 0 || strcmp(kind, "IdScope") == 0 || strcmp(kind, "IdMemorySemantics") == 0)
+        return "SpvoOperandId";
+    if (strcmp(kind, "LiteralInteger") == 0 || strcmp(kind, "LiteralExtInstInteger") == 0 || strcmp(kind, "LiteralFloat") == 0)
+        return "SpvoOperandLiteral";
+    if (strcmp(kind, "LiteralString") == 0)
+        return "SpvoOperandString";
+    if (strcmp(kind, "LiteralContextDependentNumber") == 0)
+        return "SpvoOperandLiteralRest";
+    if (strcmp(kind, "LiteralSpecConstantOpInteger") == 0)
+        return "SpvoOperandSpecConstantOpcode";
+    return NULL;
+}
+
+static json_object* find_operand_kind(json_object* kinds, String name) {
+    for (size_t i = 0; kinds && i < json_object_array_length(kinds); i++) {
+        json_object* kind = json_object_array_get_idx(kinds, i);
+        if (strcmp(json_object_get_string(json_object_object_get(kind, "kind")), name) == 0)
+            return kind;
+    }
+    return NULL;
+}
+
+static bool enum_has_parameters(json_object* kind) {
+    json_object* enumerants = json_object_object_get(kind, "enumerants");
+    for (size_t i = 0; enumerants && i < json_object_array_length(enumerants); i++) {
+        if (json_object_object_get(json_object_array_get_idx(enumerants, i), "parameters"))
+            return true;
+    }
+    return false;
+}
+
+/// Only enums that have parameters need their own tables, the others are plain literals
+static int get_enum_index(json_object* kinds, String name) {
+    int index = 0;
+    for (size_t i = 0; kinds && i < json_object_array_length(kinds); i++) {
+        json_object* kind = json_object_array_get_idx(kinds, i);
+        if (!enum_has_parameters(kind))
+            continue;
+        if (strcmp(json_object_get_string(json_object_object_get(kind, "kind")), name) == 0)
+            return index;
+        index++;
+    }
+    return -1;
+}
+
+static void generate_operand(Growy* g, json_object* kinds, String kind_name, String quantifier, int group) {
+    String q = "SpvoOne";
+    if (quantifier && strcmp(quantifier, "?") == 0)
+        q = "SpvoOptional";
+    else if (quantifier && strcmp(quantifier, "*") == 0)
+        q = "SpvoVariadic";
+
+    String class = classify_simple_kind(kind_name);
+    int enum_index = 0;
+    json_object* kind = find_operand_kind(kinds, kind_name);
+    String category = kind ? json_object_get_string(json_object_object_get(kind, "category")) : NULL;
+    if (!class && category && strcmp(category, "ValueEnum") == 0) {
+        enum_index = get_enum_index(kinds, kind_name);
+        class = enum_index >= 0 ? "SpvoOperandValueEnum" : "SpvoOperandLiteral";
+    } else if (!class && category && strcmp(category, "BitEnum") == 0) {
+        enum_index = get_enum_index(kinds, kind_name);
+        class = enum_index >= 0 ? "SpvoOperandBitEnum" : "SpvoOperandLiteral";
+    } else if (!class && category && strcmp(category, "Composite") == 0) {
+        json_object* bases = json_object_object_get(kind, "bases");
+        size_t bases_count = json_object_array_length(bases);
+        for (size_t i = 0; i < bases_count; i++) {
+            String base = json_object_get_string(json_object_array_get_idx(bases, i));
+            // the case literals in OpSwitch are as wide as the selector
+            if (strcmp(kind_name, "PairLiteralIntegerIdRef") == 0 && i == 0)
+                growy_append_formatted(g, "{ SpvoOperandSwitchLiteral, %s, %zu, 0 }, ", q, bases_count);
+            else
+                generate_operand(g, kinds, base, i == 0 ? quantifier : NULL, i == 0 ? (int) bases_count : 0);
+        }
+        return;
+    }
+    if (enum_index < 0)
+        enum_index = 0;
+    if (!class)
+        class = "SpvoOperandUnknown";
+    growy_append_formatted(g, "{ %s, %s, %d, %d }, ", class, q, group, enum_index);
+}
+
+static String classify_instruction(json_object* instruction) {
+    String class = json_object_get_string(json_object_object_get(instruction, "class"));
+    if (!class)
+        return "SpvoClassOther";
+    if (strcmp(class, "Type-Declaration") == 0)
+        return "SpvoClassType";
+    if (strcmp(class, "Constant-Creation") == 0)
+        return "SpvoClassConstant";
+    if (strcmp(class, "Annotation") == 0)
+        return "SpvoClassAnnotation";
+    if (strcmp(class, "Debug") == 0)
+        return "SpvoClassDebug";
+    return "SpvoClassOther";
+}
+
+static void generate_instruction_descs(Growy* g, json_object* instructions, json_object* kinds) {
+    growy_append_formatted(g, "const SpvoInstructionDesc* spvo_get_instruction_desc(uint32_t opcode) {\n");
+    growy_append_formatted(g, "\tswitch (opcode) {\n");
+    // several instructions can share an opcode when they were promoted from an extension, the first one wins
+    for (size_t i = 0; instructions && i < json_object_array_length(instructions); i++) {
+        json_object* instruction = json_object_array_get_idx(instructions, i);
+        String name = json_object_get_string(json_object_object_get(instruction, "opname"));
+        int opcode = json_object_get_int(json_object_object_get(instruction, "opcode"));
+        bool seen = false;
+        for (size_t j = 0; j < i; j++)
+            seen |= json_object_get_int(json_object_object_get(json_object_array_get_idx(instructions, j), "opcode")) == opcode;
+        if (seen)
+            continue;
+
+        json_object* operands = json_object_object_get(instruction, "operands");
+        size_t operands_count = operands ? json_object_array_length(operands) : 0;
+        growy_append_formatted(g, "\t\tcase %d: {\n", (int) opcode);
+        if (operands_count > 0) {
+            growy_append_formatted(g, "\t\t\tstatic const SpvoOperand operands[] = { ");
+            for (size_t j = 0; j < operands_count; j++) {
+                json_object* operand = json_object_array_get_idx(operands, j);
+                String kind = json_object_get_string(json_object_object_get(operand, "kind"));
+                String quantifier = json_object_get_string(json_object_object_get(operand, "quantifier"));
+                generate_operand(g, kinds, kind, quantifier, 1);
+            }
+            growy_append_formatted(g, "};\n");
+            growy_append_formatted(g, "\t\t\tstatic const SpvoInstructionDesc desc = { \"%s\", %s, sizeof(operands) / sizeof(operands[0]), operands };\n", name, classify_instruction(instruction));
+        } else
+            growy_append_formatted(g, "\t\t\tstatic const SpvoInstructionDesc desc = { \"%s\", %s, 0, NULL };\n", name, classify_instruction(instruction));
+        growy_append_formatted(g, "\t\t\treturn &desc;\n");
+        growy_append_formatted(g, "\t\t}\n");
+    }
+    growy_append_formatted(g, "\t\tdefault: return NULL;\n");
+    growy_append_formatted(g, "\t}\n");
+    growy_append_formatted(g, "}\n\n");
+}
+
+static uint32_t get_enumerant_value(json_object* enumerant) {
+    json_object* value = json_object_object_get(enumerant, "value");
+    if (json_object_get_type(value) == json_type_string)
+        return (uint32_t) strtoul(json_object_get_string(value), NULL, 0);
+    return (uint32_t) json_object_get_int(value);
+}
+
+static void generate_enum_parameters(Growy* g, json_object* kinds) {
+    growy_append_formatted(g, "const SpvoOperand* spvo_get_enum_parameters(uint32_t enum_index, uint32_t value, size_t* count) {\n");
+    growy_append_formatted(g, "\tswitch (enum_index) {\n");
+    int index = 0;
+    for (size_t i = 0; kinds && i < json_object_array_length(kinds); i++) {
+        json_object* kind = json_object_array_get_idx(kinds, i);
+        if (!enum_has_parameters(kind))
+            continue;
+        growy_append_formatted(g, "\t\tcase %d: switch (value) { // %s\n", index++, json_object_get_string(json_object_object_get(kind, "kind")));
+        json_object* enumerants = json_object_object_get(kind, "enumerants");
+        for (size_t j = 0; j < json_object_array_length(enumerants); j++) {
+            json_object* enumerant = json_object_array_get_idx(enumerants, j);
+            json_object* parameters = json_object_object_get(enumerant, "parameters");
+            if (!parameters)
+                continue;
+            // aliases share their value with the original enumerant
+            uint32_t value = get_enumerant_value(enumerant);
+            bool seen = false;
+            for (size_t k = 0; k < j; k++) {
+                json_object* other = json_object_array_get_idx(enumerants, k);
+                seen |= json_object_object_get(other, "parameters") && get_enumerant_value(other) == value;
+            }
+            if (seen)
+                continue;
+            growy_append_formatted(g, "\t\t\tcase 0x%xu: {\n", value);
+            growy_append_formatted(g, "\t\t\t\tstatic const SpvoOperand parameters[] = { ");
+            for (size_t k = 0; k < json_object_array_length(parameters); k++) {
+                json_object* parameter = json_object_array_get_idx(parameters, k);
+                generate_operand(g, kinds, json_object_get_string(json_object_object_get(parameter, "kind")), json_object_get_string(json_object_object_get(parameter, "quantifier")), 1);
+            }
+            growy_append_formatted(g, "};\n");
+            growy_append_formatted(g, "\t\t\t\t*count = sizeof(parameters) / sizeof(parameters[0]);\n");
+            growy_append_formatted(g, "\t\t\t\treturn parameters;\n");
+            growy_append_formatted(g, "\t\t\t}\n");
+        }
+        growy_append_formatted(g, "\t\t\tdefault: break;\n");
+        growy_append_formatted(g, "\t\t} break;\n");
+    }
+    growy_append_formatted(g, "\t\tdefault: break;\n");
+    growy_append_formatted(g, "\t}\n");
+    growy_append_formatted(g, "\t*count = 0;\n");
+    growy_append_formatted(g, "\treturn NULL;\n");
+    growy_append_formatted(g, "}\n");
+}
+
+void generate(Growy* g, Data data) {
+    generate_header(g, data);
+    growy_append_formatted(g, "#include \"spirv_opt.h\"\n\n");
+
+    json_object* instructions = json_object_object_get(data.spv, "instructions");
+    json_object* kinds = json_object_object_get(data.spv, "operand_kinds");
+    generate_instruction_descs(g, instructions, kinds);
+    generate_enum_parameters(g, kinds);
+}
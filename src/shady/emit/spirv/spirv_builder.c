@@ -446,6 +446,24 @@ SpvId spvb_constant_composite(SpvbFileBuilder* file_builder, SpvId type, size_t
     return id;
 }
 
+void spvb_spec_constant(SpvbFileBuilder* file_builder, SpvId result, SpvId type, size_t bit_pattern_size, uint32_t bit_pattern[]) {
+    op(SpvOpSpecConstant, 3 + bit_pattern_size);
+    ref_id(type);
+    ref_id(result);
+    for (size_t i = 0; i < bit_pattern_size; i++)
+        literal_int(bit_pattern[i]);
+}
+
+SpvId spvb_spec_constant_composite(SpvbFileBuilder* file_builder, SpvId type, size_t ops_count, SpvId ops[]) {
+    op(SpvOpSpecConstantComposite, 3 + ops_count);
+    SpvId id = spvb_fresh_id(file_builder);
+    ref_id(type);
+    ref_id(id);
+    for (size_t i = 0; i < ops_count; i++)
+        ref_id(ops[i]);
+    return id;
+}
+
 SpvId spvb_constant_null(SpvbFileBuilder* file_builder, SpvId type) {
     op(SpvOpConstantNull, 3);
     SpvId id = spvb_fresh_id(file_builder);
@@ -0,0 +1,476 @@
+#include "spirv_opt.h"
+
+#include "list.h"
+#include "dict.h"
+#include "log.h"
+
+#include <spirv/unified1/spirv.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+typedef struct {
+    /// Where the instruction starts, in words
+    size_t offset;
+    uint32_t count;
+    uint32_t opcode;
+    const SpvoInstructionDesc* desc;
+    SpvId result;
+    /// Where the result id sits relative to the start of the instruction, 0 if there is none
+    uint32_t result_index;
+    /// Offsets of all the words that reference ids (result type included), in SpvoModule.id_operands
+    size_t ids_begin, ids_count;
+    bool global;
+    bool keep;
+} SpvoInstruction;
+
+typedef struct {
+    uint32_t* words;
+    size_t words_count;
+    uint32_t bound;
+
+    struct List* instructions;
+    struct List* id_operands;
+
+    /// Indexed by id
+    uint32_t* types;
+    uint32_t* int_widths;
+    size_t* definitions;
+} SpvoModule;
+
+typedef struct {
+    size_t end;
+    size_t result_type;
+    size_t result;
+    size_t switch_literal_words;
+} SpvoDecoder;
+
+static bool decode_operands(SpvoModule* m, SpvoDecoder* d, const SpvoOperand* operands, size_t count, size_t* pos, bool nested);
+
+static bool decode_operand(SpvoModule* m, SpvoDecoder* d, SpvoOperand operand, size_t* pos, bool nested) {
+    const uint32_t* words = m->words;
+    // the result (type) of the opcode in OpSpecConstantOp are those of the OpSpecConstantOp itself
+    if (nested && (operand.class == SpvoOperandResultType || operand.class == SpvoOperandResult))
+        return true;
+    if (*pos >= d->end)
+        return false;
+    switch (operand.class) {
+        case SpvoOperandUnknown: return false;
+        case SpvoOperandResultType:
+            d->result_type = *pos;
+            append_list(size_t, m->id_operands, *pos);
+            (*pos)++;
+            return true;
+        case SpvoOperandResult:
+            d->result = *pos;
+            (*pos)++;
+            return true;
+        case SpvoOperandId:
+            append_list(size_t, m->id_operands, *pos);
+            (*pos)++;
+            return true;
+        case SpvoOperandLiteral:
+            (*pos)++;
+            return true;
+        case SpvoOperandString:
+            // strings are nul-terminated and padded to a whole word
+            while (*pos < d->end) {
+                uint32_t word = words[(*pos)++];
+                if ((word & 0xFF) == 0 || (word & 0xFF00) == 0 || (word & 0xFF0000) == 0 || (word & 0xFF000000) == 0)
+                    return true;
+            }
+            return false;
+        case SpvoOperandLiteralRest:
+            *pos = d->end;
+            return true;
+        case SpvoOperandSwitchLiteral:
+            *pos += d->switch_literal_words;
+            return *pos <= d->end;
+        case SpvoOperandSpecConstantOpcode: {
+            const SpvoInstructionDesc* desc = spvo_get_instruction_desc(words[(*pos)++]);
+            if (!desc)
+                return false;
+            return decode_operands(m, d, desc->operands, desc->operands_count, pos, true);
+        }
+        case SpvoOperandValueEnum: {
+            size_t count;
+            const SpvoOperand* parameters = spvo_get_enum_parameters(operand.enum_index, words[(*pos)++], &count);
+            return decode_operands(m, d, parameters, count, pos, nested);
+        }
+        case SpvoOperandBitEnum: {
+            // parameters come in the order of the bits that need them, lowest first
+            uint32_t mask = words[(*pos)++];
+            for (uint32_t bit = 0; bit < 32; bit++) {
+                if (!(mask & (1u << bit)))
+                    continue;
+                size_t count;
+                const SpvoOperand* parameters = spvo_get_enum_parameters(operand.enum_index, 1u << bit, &count);
+                if (!decode_operands(m, d, parameters, count, pos, nested))
+                    return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool decode_operands(SpvoModule* m, SpvoDecoder* d, const SpvoOperand* operands, size_t count, size_t* pos, bool nested) {
+    for (size_t i = 0; i < count;) {
+        size_t group = operands[i].group ? operands[i].group : 1;
+        assert(i + group <= count);
+        switch (operands[i].quantifier) {
+            case SpvoOne:
+                for (size_t j = 0; j < group; j++)
+                    if (!decode_operand(m, d, operands[i + j], pos, nested))
+                        return false;
+                break;
+            case SpvoOptional:
+                if (*pos < d->end)
+                    for (size_t j = 0; j < group; j++)
+                        if (!decode_operand(m, d, operands[i + j], pos, nested))
+                            return false;
+                break;
+            case SpvoVariadic:
+                while (*pos < d->end)
+                    for (size_t j = 0; j < group; j++)
+                        if (!decode_operand(m, d, operands[i + j], pos, nested))
+                            return false;
+                break;
+        }
+        i += group;
+    }
+    return true;
+}
+
+static bool parse_module(SpvoModule* m) {
+    const uint32_t* words = m->words;
+    bool in_function = false;
+    size_t pos = 5;
+    while (pos < m->words_count) {
+        uint32_t opcode = words[pos] & 0xFFFFu;
+        uint32_t count = words[pos] >> 16;
+        if (count == 0 || pos + count > m->words_count)
+            return false;
+        const SpvoInstructionDesc* desc = spvo_get_instruction_desc(opcode);
+        if (!desc) {
+            debug_print("SPIR-V compaction: unknown opcode %d\n", opcode);
+            return false;
+        }
+        // we don't try to keep track of decoration groups
+        if (opcode == SpvOpDecorationGroup || opcode == SpvOpGroupDecorate || opcode == SpvOpGroupMemberDecorate)
+            return false;
+
+        if (opcode == SpvOpFunction)
+            in_function = true;
+        SpvoInstruction instruction = {
+            .offset = pos,
+            .count = count,
+            .opcode = opcode,
+            .desc = desc,
+            .ids_begin = entries_count_list(m->id_operands),
+            .global = !in_function,
+            .keep = true,
+        };
+        if (opcode == SpvOpFunctionEnd)
+            in_function = false;
+
+        SpvoDecoder d = { .end = pos + count, .switch_literal_words = 1 };
+        if (opcode == SpvOpSwitch && count > 1 && words[pos + 1] < m->bound && m->int_widths[m->types[words[pos + 1]]] > 32)
+            d.switch_literal_words = 2;
+        size_t operands_pos = pos + 1;
+        if (!decode_operands(m, &d, desc->operands, desc->operands_count, &operands_pos, false) || operands_pos != d.end) {
+            debug_print("SPIR-V compaction: could not decode %s\n", desc->name);
+            return false;
+        }
+        instruction.ids_count = entries_count_list(m->id_operands) - instruction.ids_begin;
+        for (size_t i = 0; i < instruction.ids_count; i++) {
+            if (words[read_list(size_t, m->id_operands)[instruction.ids_begin + i]] >= m->bound)
+                return false;
+        }
+
+        if (d.result) {
+            SpvId id = words[d.result];
+            if (id == 0 || id >= m->bound)
+                return false;
+            instruction.result = id;
+            instruction.result_index = (uint32_t) (d.result - pos);
+            m->definitions[id] = entries_count_list(m->instructions);
+            if (d.result_type)
+                m->types[id] = words[d.result_type];
+            if (opcode == SpvOpTypeInt)
+                m->int_widths[id] = words[pos + 2];
+        }
+        append_list(SpvoInstruction, m->instructions, instruction);
+        pos += count;
+    }
+    return true;
+}
+
+static bool is_spec_constant(uint32_t opcode) {
+    switch (opcode) {
+        case SpvOpSpecConstantTrue:
+        case SpvOpSpecConstantFalse:
+        case SpvOpSpecConstant:
+        case SpvOpSpecConstantComposite:
+        case SpvOpSpecConstantOp: return true;
+        default: return false;
+    }
+}
+
+/// Global definitions that can go if nothing uses them
+static bool is_removable(SpvoInstruction* instruction) {
+    if (!instruction->global || !instruction->result)
+        return false;
+    switch (instruction->desc->class) {
+        case SpvoClassType: return instruction->opcode != SpvOpTypeForwardPointer;
+        case SpvoClassConstant: return !is_spec_constant(instruction->opcode);
+        default: break;
+    }
+    return instruction->opcode == SpvOpVariable || instruction->opcode == SpvOpString || instruction->opcode == SpvOpUndef;
+}
+
+/// Names and decorations live as long as what they are attached to
+static bool is_attached(uint32_t opcode) {
+    switch (opcode) {
+        case SpvOpName:
+        case SpvOpMemberName:
+        case SpvOpDecorate:
+        case SpvOpDecorateId:
+        case SpvOpDecorateString:
+        case SpvOpMemberDecorate:
+        case SpvOpMemberDecorateString: return true;
+        default: return false;
+    }
+}
+
+static bool is_debug_info(uint32_t opcode) {
+    switch (opcode) {
+        case SpvOpName:
+        case SpvOpMemberName:
+        case SpvOpLine:
+        case SpvOpNoLine:
+        case SpvOpSource:
+        case SpvOpSourceContinued:
+        case SpvOpSourceExtension:
+        case SpvOpModuleProcessed: return true;
+        default: return false;
+    }
+}
+
+typedef struct {
+    const uint32_t* words;
+    uint32_t count;
+    /// The result id is not part of the key
+    uint32_t result_index;
+} SpvoDefinitionKey;
+
+static KeyHash hash_definition_key(SpvoDefinitionKey* key) {
+    uint64_t hash = key->count;
+    for (uint32_t i = 0; i < key->count; i++) {
+        if (i != key->result_index)
+            hash = hash_combine_word(hash, key->words[i]);
+    }
+    return (KeyHash) hash;
+}
+
+static bool compare_definition_key(SpvoDefinitionKey* a, SpvoDefinitionKey* b) {
+    if (a->count != b->count || a->result_index != b->result_index)
+        return false;
+    for (uint32_t i = 0; i < a->count; i++) {
+        if (i != a->result_index && a->words[i] != b->words[i])
+            return false;
+    }
+    return true;
+}
+
+static void remap_ids(SpvoModule* m, SpvoInstruction* instruction, const uint32_t* map) {
+    const size_t* id_operands = read_list(size_t, m->id_operands);
+    for (size_t i = 0; i < instruction->ids_count; i++) {
+        uint32_t* word = &m->words[id_operands[instruction->ids_begin + i]];
+        *word = map[*word];
+    }
+}
+
+static void fold_duplicates(SpvoModule* m, uint32_t* canonical) {
+    size_t instructions_count = entries_count_list(m->instructions);
+    SpvoInstruction* instructions = read_list(SpvoInstruction, m->instructions);
+
+    bool* pinned = calloc(m->bound, sizeof(bool));
+    for (size_t i = 0; i < instructions_count; i++) {
+        // decorations make otherwise identical types or constants different
+        if (instructions[i].desc->class == SpvoClassAnnotation || instructions[i].opcode == SpvOpTypeForwardPointer)
+            pinned[m->words[instructions[i].offset + 1]] = true;
+    }
+
+    struct Dict* definitions = new_dict(SpvoDefinitionKey, SpvId, (HashFn) hash_definition_key, (CmpFn) compare_definition_key);
+    for (size_t i = 0; i < instructions_count; i++) {
+        SpvoInstruction* instruction = &instructions[i];
+        // definitions only refer to earlier ones, so those are already canonical
+        remap_ids(m, instruction, canonical);
+        if (!is_removable(instruction) || instruction->desc->class == SpvoClassOther || pinned[instruction->result])
+            continue;
+        SpvoDefinitionKey key = {
+            .words = &m->words[instruction->offset],
+            .count = instruction->count,
+            .result_index = instruction->result_index,
+        };
+        SpvId* existing = find_value_dict(SpvoDefinitionKey, SpvId, definitions, key);
+        if (existing) {
+            canonical[instruction->result] = *existing;
+            instruction->keep = false;
+        } else
+            insert_dict(SpvoDefinitionKey, SpvId, definitions, key, instruction->result);
+    }
+    destroy_dict(definitions);
+    free(pinned);
+
+    // forward references (names, function calls, phis...) and the names of what got folded away
+    for (size_t i = 0; i < instructions_count; i++) {
+        SpvoInstruction* instruction = &instructions[i];
+        if ((instruction->opcode == SpvOpName || instruction->opcode == SpvOpMemberName) && canonical[m->words[instruction->offset + 1]] != m->words[instruction->offset + 1])
+            instruction->keep = false;
+        remap_ids(m, instruction, canonical);
+    }
+}
+
+static void mark_live(SpvoModule* m, bool* live, struct List* worklist, SpvId id) {
+    if (live[id])
+        return;
+    live[id] = true;
+    append_list(SpvId, worklist, id);
+}
+
+static void mark_operands_live(SpvoModule* m, bool* live, struct List* worklist, SpvoInstruction* instruction) {
+    const size_t* id_operands = read_list(size_t, m->id_operands);
+    for (size_t i = 0; i < instruction->ids_count; i++)
+        mark_live(m, live, worklist, m->words[id_operands[instruction->ids_begin + i]]);
+}
+
+static void remove_dead_definitions(SpvoModule* m, bool strip_debug_info) {
+    size_t instructions_count = entries_count_list(m->instructions);
+    SpvoInstruction* instructions = read_list(SpvoInstruction, m->instructions);
+    bool* live = calloc(m->bound, sizeof(bool));
+    struct List* worklist = new_list(SpvId);
+
+    for (size_t i = 0; i < instructions_count; i++) {
+        SpvoInstruction* instruction = &instructions[i];
+        if (strip_debug_info && is_debug_info(instruction->opcode))
+            instruction->keep = false;
+        if (!instruction->keep || is_removable(instruction) || is_attached(instruction->opcode))
+            continue;
+        if (instruction->result)
+            mark_live(m, live, worklist, instruction->result);
+        mark_operands_live(m, live, worklist, instruction);
+    }
+
+    bool changed = true;
+    while (changed) {
+        while (entries_count_list(worklist) > 0) {
+            SpvId id = pop_last_list(SpvId, worklist);
+            SpvoInstruction* definition = &instructions[m->definitions[id]];
+            if (definition->result == id && is_removable(definition))
+                mark_operands_live(m, live, worklist, definition);
+        }
+        // OpDecorateId can keep more things alive
+        changed = false;
+        for (size_t i = 0; i < instructions_count; i++) {
+            SpvoInstruction* instruction = &instructions[i];
+            if (!instruction->keep || !is_attached(instruction->opcode) || !live[m->words[instruction->offset + 1]])
+                continue;
+            size_t before = entries_count_list(worklist);
+            mark_operands_live(m, live, worklist, instruction);
+            changed |= entries_count_list(worklist) != before;
+        }
+    }
+
+    for (size_t i = 0; i < instructions_count; i++) {
+        SpvoInstruction* instruction = &instructions[i];
+        if (is_removable(instruction))
+            instruction->keep &= live[instruction->result];
+        else if (is_attached(instruction->opcode))
+            instruction->keep &= live[m->words[instruction->offset + 1]];
+    }
+
+    destroy_list(worklist);
+    free(live);
+}
+
+/// Hands out ids in the order they are defined, then writes the surviving instructions back to back
+static size_t renumber_and_compact(SpvoModule* m, uint32_t* new_ids) {
+    size_t instructions_count = entries_count_list(m->instructions);
+    SpvoInstruction* instructions = read_list(SpvoInstruction, m->instructions);
+    const size_t* id_operands = read_list(size_t, m->id_operands);
+
+    uint32_t next_id = 1;
+    for (size_t i = 0; i < instructions_count; i++) {
+        if (instructions[i].keep && instructions[i].result && !new_ids[instructions[i].result])
+            new_ids[instructions[i].result] = next_id++;
+    }
+    // ids that are used but never defined should not happen, but they need a number all the same
+    for (size_t i = 0; i < instructions_count; i++) {
+        for (size_t j = 0; instructions[i].keep && j < instructions[i].ids_count; j++) {
+            SpvId id = m->words[id_operands[instructions[i].ids_begin + j]];
+            if (!new_ids[id])
+                new_ids[id] = next_id++;
+        }
+    }
+
+    size_t out = 5;
+    for (size_t i = 0; i < instructions_count; i++) {
+        SpvoInstruction* instruction = &instructions[i];
+        if (!instruction->keep)
+            continue;
+        remap_ids(m, instruction, new_ids);
+        if (instruction->result)
+            m->words[instruction->offset + instruction->result_index] = new_ids[instruction->result];
+        memmove(&m->words[out], &m->words[instruction->offset], instruction->count * sizeof(uint32_t));
+        out += instruction->count;
+    }
+    m->words[3] = next_id;
+    return out;
+}
+
+size_t spvo_compact_module(SpvoConfig config, const char* name, size_t size, uint32_t* words) {
+    if (size % sizeof(uint32_t) != 0 || size < 5 * sizeof(uint32_t) || words[0] != SpvMagicNumber) {
+        warn_print("SPIR-V compaction: '%s' does not look like a SPIR-V module\n", name);
+        return size;
+    }
+
+    SpvoModule m = {
+        .words = words,
+        .words_count = size / sizeof(uint32_t),
+        .bound = words[3],
+        .instructions = new_list(SpvoInstruction),
+        .id_operands = new_list(size_t),
+    };
+    m.types = calloc(m.bound, sizeof(uint32_t));
+    m.int_widths = calloc(m.bound, sizeof(uint32_t));
+    m.definitions = calloc(m.bound, sizeof(size_t));
+    uint32_t* canonical = malloc(m.bound * sizeof(uint32_t));
+    uint32_t* new_ids = calloc(m.bound, sizeof(uint32_t));
+    for (uint32_t id = 0; id < m.bound; id++)
+        canonical[id] = id;
+
+    size_t new_size = size;
+    uint32_t old_bound = m.bound;
+    if (!parse_module(&m)) {
+        warn_print("SPIR-V compaction: '%s' uses instructions we can't decode, leaving it as-is\n", name);
+        goto cleanup;
+    }
+
+    fold_duplicates(&m, canonical);
+    remove_dead_definitions(&m, config.strip_debug_info);
+    new_size = renumber_and_compact(&m, new_ids) * sizeof(uint32_t);
+    debug_print("SPIR-V compaction: '%s' went from %zu to %zu bytes (-%.1f%%), id bound went from %u to %u\n", name, size, new_size, 100.0 * (double) (size - new_size) / (double) size, old_bound, words[3]);
+
+    cleanup:
+    free(new_ids);
+    free(canonical);
+    free(m.definitions);
+    free(m.int_widths);
+    free(m.types);
+    destroy_list(m.id_operands);
+    destroy_list(m.instructions);
+    return new_size;
+}
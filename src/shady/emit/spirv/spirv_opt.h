@@ -0,0 +1,70 @@
+#ifndef SHADY_SPIRV_OPT_H
+#define SHADY_SPIRV_OPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    /// Anything the grammar has that we don't know how to step over, modules that use it are left alone
+    SpvoOperandUnknown,
+    SpvoOperandResultType,
+    SpvoOperandResult,
+    SpvoOperandId,
+    SpvoOperandLiteral,
+    SpvoOperandString,
+    /// Takes up all the remaining words (the value in OpConstant)
+    SpvoOperandLiteralRest,
+    /// Case values in OpSwitch, they are as wide as the selector
+    SpvoOperandSwitchLiteral,
+    /// The opcode in OpSpecConstantOp, the operands for that opcode follow
+    SpvoOperandSpecConstantOpcode,
+    /// Enums where some values are followed by extra operands
+    SpvoOperandValueEnum,
+    SpvoOperandBitEnum,
+} SpvoOperandClass;
+
+typedef enum {
+    SpvoOne,
+    SpvoOptional,
+    SpvoVariadic,
+} SpvoQuantifier;
+
+typedef struct {
+    SpvoOperandClass class;
+    SpvoQuantifier quantifier;
+    /// How many operands get repeated together (pairs), 0 for the operands that follow the first one in such a group
+    uint8_t group;
+    /// Which table spvo_get_enum_parameters should look in
+    uint16_t enum_index;
+} SpvoOperand;
+
+typedef enum {
+    SpvoClassOther,
+    SpvoClassType,
+    SpvoClassConstant,
+    SpvoClassAnnotation,
+    SpvoClassDebug,
+} SpvoInstructionClass;
+
+typedef struct {
+    const char* name;
+    SpvoInstructionClass class;
+    size_t operands_count;
+    const SpvoOperand* operands;
+} SpvoInstructionDesc;
+
+/// Generated from the SPIR-V grammar
+const SpvoInstructionDesc* spvo_get_instruction_desc(uint32_t opcode);
+const SpvoOperand* spvo_get_enum_parameters(uint32_t enum_index, uint32_t value, size_t* count);
+
+typedef struct {
+    /// Removes OpName, OpLine and other instructions that only matter to debuggers
+    bool strip_debug_info;
+} SpvoConfig;
+
+/// Folds duplicate types and constants, removes unused types, constants and global variables and renumbers the ids densely.
+/// This works in place and returns the new size in bytes, modules we don't understand are left as they are.
+size_t spvo_compact_module(SpvoConfig config, const char* name, size_t size, uint32_t* words);
+
+#endif
@@ -32,9 +32,65 @@ static void generate_node_has_payload_array(Growy* g, json_object* nodes) {
     growy_append_formatted(g, "};\n\n");
 }
 
+/// Nodes are allocated with just enough room for their own payload, not the whole union.
+/// The sizes are rounded up to the alignment of Node: the arena aligns allocations based on their size.
+static void generate_node_sizes_array(Growy* g, json_object* nodes) {
+    growy_append_formatted(g, "#define NODE_SIZE(payload_size) ((offsetof(Node, payload) + (payload_size) + alignof(Node) - 1) / alignof(Node) * alignof(Node))\n");
+    growy_append_formatted(g, "const size_t node_type_sizes[] = {\n");
+    growy_append_formatted(g, "\tNODE_SIZE(0),\n");
+    for (size_t i = 0; i < json_object_array_length(nodes); i++) {
+        json_object* node = json_object_array_get_idx(nodes, i);
+        String name = json_object_get_string(json_object_object_get(node, "name"));
+        json_object* ops = json_object_object_get(node, "ops");
+        if (ops)
+            growy_append_formatted(g, "\tNODE_SIZE(sizeof(%s)),\n", name);
+        else
+            growy_append_formatted(g, "\tNODE_SIZE(0),\n");
+    }
+    growy_append_formatted(g, "};\n");
+    growy_append_formatted(g, "#undef NODE_SIZE\n\n");
+}
+
+typedef enum {
+    /// Scalars and enums, hashed as their raw value
+    FieldWord,
+    /// Nodes, strings and other (interned) pointers, the address identifies them
+    FieldPointer,
+    /// Nodes/Strings handle: those are interned, so the array pointer and the count identify them
+    FieldList,
+    /// Anything else, we fall back to hashing/comparing the bytes
+    FieldOpaque,
+} FieldKind;
+
+static FieldKind classify_operand(json_object* op) {
+    String class = json_object_get_string(json_object_object_get(op, "class"));
+    if (class)
+        return json_object_get_boolean(json_object_object_get(op, "list")) ? FieldList : FieldPointer;
+    String type = json_object_get_string(json_object_object_get(op, "type"));
+    assert(type);
+    if (type[strlen(type) - 1] == '*' || strcmp(type, "String") == 0)
+        return FieldPointer;
+    String word_types[] = { "bool", "int", "unsigned", "uint32_t", "uint64_t", "VarId", "Op", "IntSizes", "FloatSizes", "AddressSpace", "RecordSpecialFlag" };
+    for (size_t i = 0; i < sizeof(word_types) / sizeof(word_types[0]); i++) {
+        if (strcmp(type, word_types[i]) == 0)
+            return FieldWord;
+    }
+    if (strcmp(type, "Nodes") == 0 || strcmp(type, "Strings") == 0)
+        return FieldList;
+    return FieldOpaque;
+}
+
+/// Name of the array member in the Nodes/Strings handle
+static String list_array_member(json_object* op) {
+    String class = json_object_get_string(json_object_object_get(op, "class"));
+    String type = json_object_get_string(json_object_object_get(op, "type"));
+    if ((class && strcmp(class, "string") == 0) || (type && strcmp(type, "Strings") == 0))
+        return "strings";
+    return "nodes";
+}
+
 static void generate_node_payload_hash_fn(Growy* g, Data data, json_object* nodes) {
-    growy_append_formatted(g, "KeyHash hash_node_payload(const Node* node) {\n");
-    growy_append_formatted(g, "\tKeyHash hash = 0;\n");
+    growy_append_formatted(g, "uint64_t hash_node_payload(uint64_t hash, const Node* node) {\n");
     growy_append_formatted(g, "\tswitch (node->tag) { \n");
     assert(json_object_get_type(nodes) == json_type_array);
     for (size_t i = 0; i < json_object_array_length(nodes); i++) {
@@ -49,13 +105,26 @@ static void generate_node_payload_hash_fn(Growy* g, Data data, json_object* node
         if (ops) {
             assert(json_object_get_type(ops) == json_type_array);
             growy_append_formatted(g, "\tcase %s_TAG: {\n", name);
-            growy_append_formatted(g, "\t\t%s payload = node->payload.%s;\n", name, snake_name);
+            growy_append_formatted(g, "\t\tconst %s* payload = &node->payload.%s;\n", name, snake_name);
             for (size_t j = 0; j < json_object_array_length(ops); j++) {
                 json_object* op = json_object_array_get_idx(ops, j);
                 String op_name = json_object_get_string(json_object_object_get(op, "name"));
                 bool ignore = json_object_get_boolean(json_object_object_get(op, "ignore"));
-                if (!ignore) {
-                    growy_append_formatted(g, "\t\thash = hash ^ hash_murmur(&payload.%s, sizeof(payload.%s));\n", op_name, op_name);
+                if (ignore)
+                    continue;
+                switch (classify_operand(op)) {
+                    case FieldWord:
+                        growy_append_formatted(g, "\t\thash = hash_combine_word(hash, (uint64_t) payload->%s);\n", op_name);
+                        break;
+                    case FieldPointer:
+                        growy_append_formatted(g, "\t\thash = hash_combine_word(hash, (uint64_t) (size_t) payload->%s);\n", op_name);
+                        break;
+                    case FieldList:
+                        growy_append_formatted(g, "\t\thash = hash_combine_word(hash, (uint64_t) (size_t) payload->%s.%s);\n", op_name, list_array_member(op));
+                        break;
+                    case FieldOpaque:
+                        growy_append_formatted(g, "\t\thash = hash_combine_word(hash, hash_murmur(&payload->%s, sizeof(payload->%s)));\n", op_name, op_name);
+                        break;
                 }
             }
             growy_append_formatted(g, "\t\tbreak;\n");
@@ -72,7 +141,6 @@ static void generate_node_payload_hash_fn(Growy* g, Data data, json_object* node
 
 static void generate_node_payload_cmp_fn(Growy* g, Data data, json_object* nodes) {
     growy_append_formatted(g, "bool compare_node_payload(const Node* a, const Node* b) {\n");
-    growy_append_formatted(g, "\tbool eq = true;\n");
     growy_append_formatted(g, "\tswitch (a->tag) { \n");
     assert(json_object_get_type(nodes) == json_type_array);
     for (size_t i = 0; i < json_object_array_length(nodes); i++) {
@@ -87,17 +155,29 @@ static void generate_node_payload_cmp_fn(Growy* g, Data data, json_object* nodes
         if (ops) {
             assert(json_object_get_type(ops) == json_type_array);
             growy_append_formatted(g, "\tcase %s_TAG: {\n", name);
-            growy_append_formatted(g, "\t\t%s payload_a = a->payload.%s;\n", name, snake_name);
-            growy_append_formatted(g, "\t\t%s payload_b = b->payload.%s;\n", name, snake_name);
+            growy_append_formatted(g, "\t\tconst %s* payload_a = &a->payload.%s;\n", name, snake_name);
+            growy_append_formatted(g, "\t\tconst %s* payload_b = &b->payload.%s;\n", name, snake_name);
+            growy_append_formatted(g, "\t\treturn true");
             for (size_t j = 0; j < json_object_array_length(ops); j++) {
                 json_object* op = json_object_array_get_idx(ops, j);
                 String op_name = json_object_get_string(json_object_object_get(op, "name"));
                 bool ignore = json_object_get_boolean(json_object_object_get(op, "ignore"));
-                if (!ignore) {
-                    growy_append_formatted(g, "\t\teq &= memcmp(&payload_a.%s, &payload_b.%s, sizeof(payload_a.%s)) == 0;\n", op_name, op_name, op_name);
+                if (ignore)
+                    continue;
+                switch (classify_operand(op)) {
+                    case FieldWord:
+                    case FieldPointer:
+                        growy_append_formatted(g, "\n\t\t\t&& payload_a->%s == payload_b->%s", op_name, op_name);
+                        break;
+                    case FieldList:
+                        growy_append_formatted(g, "\n\t\t\t&& payload_a->%s.count == payload_b->%s.count && payload_a->%s.%s == payload_b->%s.%s", op_name, op_name, op_name, list_array_member(op), op_name, list_array_member(op));
+                        break;
+                    case FieldOpaque:
+                        growy_append_formatted(g, "\n\t\t\t&& memcmp(&payload_a->%s, &payload_b->%s, sizeof(payload_a->%s)) == 0", op_name, op_name, op_name);
+                        break;
                 }
             }
-            growy_append_formatted(g, "\t\tbreak;\n");
+            growy_append_formatted(g, ";\n");
             growy_append_formatted(g, "\t}\n", name);
         }
         if (alloc)
@@ -105,7 +185,7 @@ static void generate_node_payload_cmp_fn(Growy* g, Data data, json_object* nodes
     }
     growy_append_formatted(g, "\t\tdefault: assert(false);\n");
     growy_append_formatted(g, "\t}\n");
-    growy_append_formatted(g, "\treturn eq;\n");
+    growy_append_formatted(g, "\treturn false;\n");
     growy_append_formatted(g, "}\n");
 }
 
@@ -145,6 +225,7 @@ void generate(Growy* g, Data data) {
     generate_address_space_name_fn(g, json_object_object_get(data.shd, "address-spaces"));
     generate_node_names_string_array(g, nodes);
     generate_node_has_payload_array(g, nodes);
+    generate_node_sizes_array(g, nodes);
     generate_node_payload_hash_fn(g, data, nodes);
     generate_node_payload_cmp_fn(g, data, nodes);
     generate_bit_enum_classifier(g, "get_node_class_from_tag", "NodeClass", "Nc", "NodeTag", "", "_TAG", nodes);
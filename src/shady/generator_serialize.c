@@ -0,0 +1,199 @@
+#include "generator.h"
+
+typedef enum {
+    /// Scalars and enums, stored in one word
+    FieldWord,
+    /// 64-bit scalars, stored in two words
+    FieldDoubleWord,
+    /// Indexes into the string table
+    FieldString,
+    FieldStrings,
+    /// Indexes into the node table
+    FieldNode,
+    /// Indexes into the list table
+    FieldNodes,
+} FieldKind;
+
+static FieldKind classify_operand(String node_name, json_object* op) {
+    String class = json_object_get_string(json_object_object_get(op, "class"));
+    bool list = json_object_get_boolean(json_object_object_get(op, "list"));
+    if (class && strcmp(class, "string") == 0)
+        return list ? FieldStrings : FieldString;
+    if (class)
+        return list ? FieldNodes : FieldNode;
+    String type = json_object_get_string(json_object_object_get(op, "type"));
+    assert(type && !list);
+    if (strcmp(type, "String") == 0)
+        return FieldString;
+    if (strcmp(type, "uint64_t") == 0)
+        return FieldDoubleWord;
+    String word_types[] = { "bool", "int", "unsigned", "uint32_t", "Op", "IntSizes", "FloatSizes", "AddressSpace", "RecordSpecialFlag" };
+    for (size_t i = 0; i < sizeof(word_types) / sizeof(word_types[0]); i++) {
+        if (strcmp(type, word_types[i]) == 0)
+            return FieldWord;
+    }
+    error("%s.%s has type '%s', which the binary format does not know how to store", node_name, json_object_get_string(json_object_object_get(op, "name")), type);
+}
+
+/// Anything that changes node tags, payload layouts or primop numbering changes the serialized form of the grammar,
+/// modules written against another grammar are rejected instead of being misinterpreted.
+static void generate_grammar_hash(Growy* g, Data data) {
+    String grammar = json_object_to_json_string_ext(data.shd, JSON_C_TO_STRING_PLAIN);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; grammar[i]; i++) {
+        hash ^= (uint8_t) grammar[i];
+        hash *= 16777619u;
+    }
+    growy_append_formatted(g, "#define SERIALIZED_GRAMMAR_HASH 0x%08xu\n\n", hash);
+}
+
+static void generate_operands_emitter(Growy* g, json_object* nodes) {
+    growy_append_formatted(g, "static void emit_operands_generated(Serializer* s, const Node* node) {\n");
+    growy_append_formatted(g, "\tswitch (node->tag) { \n");
+    assert(json_object_get_type(nodes) == json_type_array);
+    for (size_t i = 0; i < json_object_array_length(nodes); i++) {
+        json_object* node = json_object_array_get_idx(nodes, i);
+        json_object* ops = json_object_object_get(node, "ops");
+        if (has_custom_ctor(node) || !ops)
+            continue;
+
+        String name = json_object_get_string(json_object_object_get(node, "name"));
+        // nodes without node operands (literals, types made of scalars...) have nothing to emit first
+        bool has_node_operands = false;
+        for (size_t j = 0; j < json_object_array_length(ops); j++) {
+            json_object* op = json_object_array_get_idx(ops, j);
+            if (json_object_get_boolean(json_object_object_get(op, "ignore")))
+                continue;
+            FieldKind kind = classify_operand(name, op);
+            has_node_operands |= kind == FieldNode || kind == FieldNodes;
+        }
+        if (!has_node_operands)
+            continue;
+
+        String snake_name = json_object_get_string(json_object_object_get(node, "snake_name"));
+        void* alloc = NULL;
+        if (!snake_name) {
+            alloc = snake_name = to_snake_case(name);
+        }
+        growy_append_formatted(g, "\t\tcase %s_TAG: {\n", name);
+        growy_append_formatted(g, "\t\t\tconst %s* payload = &node->payload.%s;\n", name, snake_name);
+        for (size_t j = 0; j < json_object_array_length(ops); j++) {
+            json_object* op = json_object_array_get_idx(ops, j);
+            String op_name = json_object_get_string(json_object_object_get(op, "name"));
+            if (json_object_get_boolean(json_object_object_get(op, "ignore")))
+                continue;
+            switch (classify_operand(name, op)) {
+                case FieldNode: growy_append_formatted(g, "\t\t\temit_node(s, payload->%s);\n", op_name); break;
+                case FieldNodes: growy_append_formatted(g, "\t\t\temit_nodes(s, payload->%s);\n", op_name); break;
+                default: break;
+            }
+        }
+        growy_append_formatted(g, "\t\t\tbreak;\n");
+        growy_append_formatted(g, "\t\t}\n");
+        if (alloc)
+            free(alloc);
+    }
+    growy_append_formatted(g, "\t\tdefault: break;\n");
+    growy_append_formatted(g, "\t}\n");
+    growy_append_formatted(g, "}\n\n");
+}
+
+static void generate_payload_writer(Growy* g, json_object* nodes) {
+    growy_append_formatted(g, "static void write_payload_generated(Serializer* s, const Node* node) {\n");
+    growy_append_formatted(g, "\tswitch (node->tag) { \n");
+    assert(json_object_get_type(nodes) == json_type_array);
+    for (size_t i = 0; i < json_object_array_length(nodes); i++) {
+        json_object* node = json_object_array_get_idx(nodes, i);
+        if (has_custom_ctor(node))
+            continue;
+
+        String name = json_object_get_string(json_object_object_get(node, "name"));
+        String snake_name = json_object_get_string(json_object_object_get(node, "snake_name"));
+        void* alloc = NULL;
+        if (!snake_name) {
+            alloc = snake_name = to_snake_case(name);
+        }
+        growy_append_formatted(g, "\t\tcase %s_TAG: {\n", name);
+        json_object* ops = json_object_object_get(node, "ops");
+        if (ops) {
+            assert(json_object_get_type(ops) == json_type_array);
+            growy_append_formatted(g, "\t\t\tconst %s* payload = &node->payload.%s;\n", name, snake_name);
+            for (size_t j = 0; j < json_object_array_length(ops); j++) {
+                json_object* op = json_object_array_get_idx(ops, j);
+                String op_name = json_object_get_string(json_object_object_get(op, "name"));
+                if (json_object_get_boolean(json_object_object_get(op, "ignore")))
+                    continue;
+                switch (classify_operand(name, op)) {
+                    case FieldWord: growy_append_formatted(g, "\t\t\twrite_word(s, (uint32_t) payload->%s);\n", op_name); break;
+                    case FieldDoubleWord: growy_append_formatted(g, "\t\t\twrite_double_word(s, payload->%s);\n", op_name); break;
+                    case FieldString: growy_append_formatted(g, "\t\t\twrite_string(s, payload->%s);\n", op_name); break;
+                    case FieldStrings: growy_append_formatted(g, "\t\t\twrite_strings(s, payload->%s);\n", op_name); break;
+                    case FieldNode: growy_append_formatted(g, "\t\t\twrite_node(s, payload->%s);\n", op_name); break;
+                    case FieldNodes: growy_append_formatted(g, "\t\t\twrite_nodes(s, payload->%s);\n", op_name); break;
+                }
+            }
+        }
+        growy_append_formatted(g, "\t\t\tbreak;\n");
+        growy_append_formatted(g, "\t\t}\n");
+        if (alloc)
+            free(alloc);
+    }
+    growy_append_formatted(g, "\t\tdefault: assert(false);\n");
+    growy_append_formatted(g, "\t}\n");
+    growy_append_formatted(g, "}\n\n");
+}
+
+static void generate_payload_reader(Growy* g, json_object* nodes) {
+    growy_append_formatted(g, "static const Node* read_payload_generated(Deserializer* d, NodeTag tag) {\n");
+    growy_append_formatted(g, "\tswitch (tag) { \n");
+    for (size_t i = 0; i < json_object_array_length(nodes); i++) {
+        json_object* node = json_object_array_get_idx(nodes, i);
+        if (has_custom_ctor(node))
+            continue;
+
+        String name = json_object_get_string(json_object_object_get(node, "name"));
+        String snake_name = json_object_get_string(json_object_object_get(node, "snake_name"));
+        void* alloc = NULL;
+        if (!snake_name) {
+            alloc = snake_name = to_snake_case(name);
+        }
+        growy_append_formatted(g, "\t\tcase %s_TAG: {\n", name);
+        json_object* ops = json_object_object_get(node, "ops");
+        if (ops) {
+            growy_append_formatted(g, "\t\t\t%s payload = { 0 };\n", name);
+            for (size_t j = 0; j < json_object_array_length(ops); j++) {
+                json_object* op = json_object_array_get_idx(ops, j);
+                String op_name = json_object_get_string(json_object_object_get(op, "name"));
+                if (json_object_get_boolean(json_object_object_get(op, "ignore")))
+                    continue;
+                String type = json_object_get_string(json_object_object_get(op, "type"));
+                switch (classify_operand(name, op)) {
+                    case FieldWord: growy_append_formatted(g, "\t\t\tpayload.%s = (%s) read_word(d);\n", op_name, type); break;
+                    case FieldDoubleWord: growy_append_formatted(g, "\t\t\tpayload.%s = read_double_word(d);\n", op_name); break;
+                    case FieldString: growy_append_formatted(g, "\t\t\tpayload.%s = read_string(d);\n", op_name); break;
+                    case FieldStrings: growy_append_formatted(g, "\t\t\tpayload.%s = read_strings(d);\n", op_name); break;
+                    case FieldNode: growy_append_formatted(g, "\t\t\tpayload.%s = read_node(d);\n", op_name); break;
+                    case FieldNodes: growy_append_formatted(g, "\t\t\tpayload.%s = read_nodes(d);\n", op_name); break;
+                }
+            }
+            growy_append_formatted(g, "\t\t\treturn %s(d->arena, payload);\n", snake_name);
+        } else
+            growy_append_formatted(g, "\t\t\treturn %s(d->arena);\n", snake_name);
+        growy_append_formatted(g, "\t\t}\n");
+        if (alloc)
+            free(alloc);
+    }
+    growy_append_formatted(g, "\t\tdefault: return NULL;\n");
+    growy_append_formatted(g, "\t}\n");
+    growy_append_formatted(g, "}\n\n");
+}
+
+void generate(Growy* g, Data data) {
+    generate_header(g, data);
+
+    json_object* nodes = json_object_object_get(data.shd, "nodes");
+    generate_grammar_hash(g, data);
+    generate_operands_emitter(g, nodes);
+    generate_payload_writer(g, nodes);
+    generate_payload_reader(g, nodes);
+}
@@ -63,6 +63,12 @@ VarId fresh_id(IrArena* arena) {
     return arena->next_free_id++;
 }
 
+void reserve_ir_arena(IrArena* arena, size_t nodes, size_t lists, size_t strings) {
+    reserve_dict(arena->node_set, entries_count_dict(arena->node_set) + nodes);
+    reserve_dict(arena->nodes_set, entries_count_dict(arena->nodes_set) + lists);
+    reserve_dict(arena->string_set, entries_count_dict(arena->string_set) + strings);
+}
+
 Nodes nodes(IrArena* arena, size_t count, const Node* in_nodes[]) {
     Nodes tmp = {
         .count = count,
@@ -74,7 +80,7 @@ Nodes nodes(IrArena* arena, size_t count, const Node* in_nodes[]) {
 
     Nodes nodes;
     nodes.count = count;
-    nodes.nodes = arena_alloc(arena->arena, sizeof(Node*) * count);
+    nodes.nodes = arena_alloc_uninitialized(arena->arena, sizeof(Node*) * count);
     for (size_t i = 0; i < count; i++)
         nodes.nodes[i] = in_nodes[i];
 
@@ -93,7 +99,7 @@ Strings strings(IrArena* arena, size_t count, const char* in_strs[])  {
 
     Strings strings;
     strings.count = count;
-    strings.strings = arena_alloc(arena->arena, sizeof(const char*) * count);
+    strings.strings = arena_alloc_uninitialized(arena->arena, sizeof(const char*) * count);
     for (size_t i = 0; i < count; i++)
         strings.strings[i] = in_strs[i];
 
@@ -146,11 +152,72 @@ Nodes concat_nodes(IrArena* arena, Nodes a, Nodes b) {
 Nodes change_node_at_index(IrArena* arena, Nodes old, size_t i, const Node* n) {
     LARRAY(const Node*, tmp, old.count);
     for (size_t j = 0; j < old.count; j++)
-        tmp[j] = old.nodes[i];
+        tmp[j] = old.nodes[j];
     tmp[i] = n;
     return nodes(arena, old.count, tmp);
 }
 
+NodesBuilder begin_nodes(IrArena* arena) {
+    return (NodesBuilder) {
+        .arena = arena,
+        .count = 0,
+        .capacity = NODES_BUILDER_INLINE_CAPACITY,
+        .heap = NULL,
+    };
+}
+
+static const Node** nodes_builder_storage(NodesBuilder* builder) {
+    return builder->heap ? builder->heap : builder->inline_storage;
+}
+
+void reserve_nodes(NodesBuilder* builder, size_t additional) {
+    size_t needed = builder->count + additional;
+    if (needed <= builder->capacity)
+        return;
+    size_t new_capacity = builder->capacity * 2;
+    while (new_capacity < needed)
+        new_capacity *= 2;
+    if (builder->heap) {
+        builder->heap = realloc(builder->heap, sizeof(const Node*) * new_capacity);
+    } else {
+        builder->heap = malloc(sizeof(const Node*) * new_capacity);
+        memcpy(builder->heap, builder->inline_storage, sizeof(const Node*) * builder->count);
+    }
+    builder->capacity = new_capacity;
+}
+
+void push_node(NodesBuilder* builder, const Node* node) {
+    reserve_nodes(builder, 1);
+    nodes_builder_storage(builder)[builder->count++] = node;
+}
+
+void extend_nodes(NodesBuilder* builder, Nodes nodes) {
+    reserve_nodes(builder, nodes.count);
+    const Node** storage = nodes_builder_storage(builder);
+    for (size_t i = 0; i < nodes.count; i++)
+        storage[builder->count++] = nodes.nodes[i];
+}
+
+Nodes peek_nodes(const NodesBuilder* builder) {
+    return (Nodes) {
+        .count = builder->count,
+        .nodes = builder->heap ? builder->heap : (const Node**) builder->inline_storage,
+    };
+}
+
+Nodes finish_nodes(NodesBuilder* builder) {
+    Nodes result = nodes(builder->arena, builder->count, nodes_builder_storage(builder));
+    discard_nodes(builder);
+    return result;
+}
+
+void discard_nodes(NodesBuilder* builder) {
+    free(builder->heap);
+    builder->heap = NULL;
+    builder->count = 0;
+    builder->capacity = NODES_BUILDER_INLINE_CAPACITY;
+}
+
 /// takes care of structural sharing
 static const char* string_impl(IrArena* arena, size_t size, const char* zero_terminated) {
     if (!zero_terminated)
@@ -160,11 +227,12 @@ static const char* string_impl(IrArena* arena, size_t size, const char* zero_ter
     if (found)
         return *found;
 
-    char* new_str = (char*) arena_alloc(arena->arena, strlen(zero_terminated) + 1);
-    strncpy(new_str, zero_terminated, size);
+    char* new_str = (char*) arena_alloc_uninitialized(arena->arena, size + 1);
+    memcpy(new_str, zero_terminated, size);
     new_str[size] = '\0';
 
     insert_set_get_result(const char*, arena->string_set, new_str);
+    arena->stats.strings++;
     return new_str;
 }
 
@@ -174,7 +242,7 @@ const char* string_sized(IrArena* arena, size_t size, const char* str) {
     strncpy(new_str, str, size);
     new_str[size] = '\0';
     assert(strlen(new_str) == size);
-    return string_impl(arena, size, str);
+    return string_impl(arena, size, new_str);
 }
 
 const char* string(IrArena* arena, const char* str) {
@@ -20,12 +20,26 @@ typedef struct IrArena_ {
 
     struct Dict* nodes_set;
     struct Dict* strings_set;
+
+    struct {
+        /// Structural nodes get hashed once per constructor call, dict lookups and resizes reuse node->hash
+        size_t structural_hashes;
+        /// Nodes only take as many bytes as their tag needs, see node_type_sizes
+        size_t nodes;
+        size_t node_bytes;
+        size_t strings;
+    } stats;
 } IrArena_;
 
+/// Size of a node with the given tag, header included and rounded up to alignof(Node) (generated from grammar.json)
+extern const size_t node_type_sizes[];
+
 struct Module_ {
     IrArena* arena;
     String name;
     struct List* decls;
+    /// Interned name -> declaration
+    struct Dict* decls_by_name;
     bool sealed;
 };
 
@@ -38,6 +52,8 @@ struct BodyBuilder_ {
 };
 
 VarId fresh_id(IrArena*);
+/// Makes room for that many more nodes, lists of nodes and strings, for when a lot of them are about to be added at once
+void reserve_ir_arena(IrArena*, size_t nodes, size_t lists, size_t strings);
 
 struct List;
 Nodes list_to_nodes(IrArena*, struct List*);
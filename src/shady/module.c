@@ -1,16 +1,28 @@
 #include "ir_private.h"
 
 #include "list.h"
+#include "dict.h"
 #include "portability.h"
 
 #include <string.h>
 
+/// Declaration names are interned, the address is enough to identify them
+static KeyHash hash_interned_string(String* s) {
+    size_t ptr = (size_t) *s;
+    return (KeyHash) (ptr ^ (ptr >> 32));
+}
+
+static bool compare_interned_string(String* a, String* b) {
+    return *a == *b;
+}
+
 Module* new_module(IrArena* arena, String name) {
     Module* m = arena_alloc(arena->arena, sizeof(Module));
     *m = (Module) {
         .arena = arena,
         .name = string(arena, name),
         .decls = new_list(Node*),
+        .decls_by_name = new_dict(String, Node*, (HashFn) hash_interned_string, (CmpFn) compare_interned_string),
     };
     append_list(Module*, arena->modules, m);
     return m;
@@ -30,21 +42,32 @@ Nodes get_module_declarations(const Module* m) {
     return nodes(get_module_arena(m), count, start);
 }
 
+bool module_decls_iter(const Module* m, size_t* i, const Node** decl) {
+    if (*i >= entries_count_list(m->decls))
+        return false;
+    *decl = read_list(const Node*, m->decls)[(*i)++];
+    return true;
+}
+
 void register_decl_module(Module* m, Node* node) {
     assert(is_declaration(node));
-    assert(!get_declaration(m, get_decl_name(node)) && "duplicate declaration");
+    String name = get_decl_name(node);
+    assert(name == string(m->arena, name) && "declaration names must be interned in the module's arena");
+    SHADY_UNUSED bool fresh = insert_dict_and_get_result(String, Node*, m->decls_by_name, name, node);
+    assert(fresh && "duplicate declaration");
     append_list(Node*, m->decls, node);
 }
 
 const Node* get_declaration(const Module* m, String name) {
-    Nodes existing_decls = get_module_declarations(m);
-    for (size_t i = 0; i < existing_decls.count; i++) {
-        if (strcmp(get_decl_name(existing_decls.nodes[i]), name) == 0)
-            return existing_decls.nodes[i];
-    }
-    return NULL;
+    // a name that was never interned can't belong to a declaration, and we don't want to intern lookups
+    String* interned = find_key_dict(String, m->arena->string_set, name);
+    if (!interned)
+        return NULL;
+    Node** found = find_value_dict(String, Node*, m->decls_by_name, *interned);
+    return found ? *found : NULL;
 }
 
 void destroy_module(Module* m) {
     destroy_list(m->decls);
+    destroy_dict(m->decls_by_name);
 }
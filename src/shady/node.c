@@ -6,6 +6,8 @@
 #include "dict.h"
 
 #include <string.h>
+#include <stddef.h>
+#include <stdalign.h>
 #include <assert.h>
 
 String get_decl_name(const Node* node) {
@@ -299,35 +301,32 @@ const Node* get_let_tail(const Node* let) {
     }
 }
 
-KeyHash hash_node_payload(const Node* node);
+uint64_t hash_node_payload(uint64_t hash, const Node* node);
 
-KeyHash hash_node(Node** pnode) {
-    const Node* node = *pnode;
-    KeyHash combined;
-
-    if (is_nominal(node)) {
-        size_t ptr = (size_t) node;
-        uint32_t upper = ptr >> 32;
-        uint32_t lower = ptr;
-        combined = upper ^ lower;
-        goto end;
-    }
-
-    KeyHash tag_hash = hash_murmur(&node->tag, sizeof(NodeTag));
-    KeyHash payload_hash = 0;
+KeyHash hash_node_address(const Node* node) {
+    size_t ptr = (size_t) node;
+    uint32_t upper = ptr >> 32;
+    uint32_t lower = ptr;
+    return upper ^ lower;
+}
 
-    if (node_type_has_payload[node->tag]) {
-        payload_hash = hash_node_payload(node);
-    }
-    combined = tag_hash ^ payload_hash;
+/// Only meant to be called once per node, by the constructors. Everyone else should use the cached node->hash.
+KeyHash compute_structural_node_hash(const Node* node) {
+    assert(!is_nominal(node));
+    uint64_t hash = hash_combine_word(0, (uint64_t) node->tag);
+    if (node_type_has_payload[node->tag])
+        hash = hash_node_payload(hash, node);
+    return (KeyHash) (hash ^ (hash >> 32));
+}
 
-    end:
-    return combined;
+KeyHash hash_node(Node** pnode) {
+    return (*pnode)->hash;
 }
 
 bool compare_node_payload(const Node*, const Node*);
 
 bool compare_node(Node** pa, Node** pb) {
+    if ((*pa)->hash != (*pb)->hash) return false;
     if ((*pa)->tag != (*pb)->tag) return false;
     if (is_nominal((*pa)))
         return *pa == *pb;
@@ -335,9 +334,6 @@ bool compare_node(Node** pa, Node** pb) {
     const Node* a = *pa;
     const Node* b = *pb;
 
-    #undef field
-    #define field(w) eq &= memcmp(&a->payload.w, &b->payload.w, sizeof(a->payload.w)) == 0;
-
     if (node_type_has_payload[a->tag]) {
         return compare_node_payload(a, b);
     } else return true;
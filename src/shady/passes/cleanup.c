@@ -2,79 +2,238 @@
 
 #include "portability.h"
 #include "log.h"
+#include "dict.h"
+#include "list.h"
 
 #include "../rewrite.h"
-#include "../analysis/uses.h"
+#include "../visit.h"
+
+KeyHash hash_node(Node**);
+bool compare_node(Node**, Node**);
+
+/// Dead code elimination in a single rewrite: we count the uses of every node in a function, find the pure instructions
+/// whose results are unused, and propagate the removals through a worklist, so entire dead chains go away in one go.
+typedef struct {
+    /// node -> number of operand slots that refer to it, a user that refers to it twice counts twice
+    struct Dict* uses;
+    /// variable -> the let that binds it
+    struct Dict* binders;
+    /// the lets we're going to drop
+    struct Dict* dead_lets;
+    struct List* worklist;
+    struct List* lets;
+    size_t removed;
+} Liveness;
+
+typedef struct {
+    Visitor v;
+    Liveness* liveness;
+    /// we're either counting uses or taking them away when a node dies
+    bool counting;
+} LivenessVisitor;
+
+static void count_uses_visit_op(LivenessVisitor* v, NodeClass class, String op_name, const Node* op);
+
+static void visit_operands(LivenessVisitor* v, const Node* node) {
+    visit_node_operands(&v->v, NcType | NcDeclaration, node);
+}
+
+static size_t* get_uses_count(Liveness* l, const Node* node) {
+    return find_value_dict(const Node*, size_t, l->uses, node);
+}
+
+static bool is_pure_instruction(const Node* instruction) {
+    return instruction->tag == PrimOp_TAG && !has_primop_got_side_effects(instruction->payload.prim_op.op);
+}
+
+/// A let can go if its instruction is pure and nothing but its own tail refers to the variables it binds
+static bool is_let_dead(Liveness* l, const Node* let_node) {
+    if (!is_pure_instruction(let_node->payload.let.instruction))
+        return false;
+    Nodes params = get_abstraction_params(let_node->payload.let.tail);
+    for (size_t i = 0; i < params.count; i++) {
+        size_t* uses = get_uses_count(l, params.nodes[i]);
+        // the tail case's parameter list accounts for one use
+        if (uses && *uses > 1)
+            return false;
+    }
+    return true;
+}
+
+static void mark_let_dead(Liveness* l, const Node* let_node) {
+    if (insert_set_get_result(const Node*, l->dead_lets, let_node))
+        append_list(const Node*, l->worklist, let_node);
+}
+
+/// Removes a use of 'node', and if that was the last one, the uses it makes of its own operands
+static void release_use(LivenessVisitor* v, const Node* node) {
+    Liveness* l = v->liveness;
+    size_t* uses = get_uses_count(l, node);
+    assert(uses && *uses > 0);
+    (*uses)--;
+
+    if (node->tag == Variable_TAG) {
+        const Node** binder = find_value_dict(const Node*, const Node*, l->binders, node);
+        if (binder && is_let_dead(l, *binder))
+            mark_let_dead(l, *binder);
+        return;
+    }
+
+    // nominal nodes and abstractions don't die with their users
+    if (*uses == 0 && !is_nominal(node) && !is_abstraction(node))
+        visit_operands(v, node);
+}
+
+static void count_uses_visit_op(LivenessVisitor* v, SHADY_UNUSED NodeClass class, SHADY_UNUSED String op_name, const Node* op) {
+    Liveness* l = v->liveness;
+    if (!v->counting) {
+        release_use(v, op);
+        return;
+    }
+
+    size_t* uses = get_uses_count(l, op);
+    if (uses) {
+        (*uses)++;
+        return;
+    }
+    size_t one = 1;
+    insert_dict(const Node*, size_t, l->uses, op, one);
+
+    if (op->tag == Let_TAG) {
+        append_list(const Node*, l->lets, op);
+        Nodes params = get_abstraction_params(op->payload.let.tail);
+        for (size_t i = 0; i < params.count; i++)
+            insert_dict(const Node*, const Node*, l->binders, params.nodes[i], op);
+    }
+    visit_operands(v, op);
+}
+
+static void compute_liveness(Liveness* l, const Node* root) {
+    LivenessVisitor v = {
+        .v = { .visit_op_fn = (VisitOpFn) count_uses_visit_op },
+        .liveness = l,
+        .counting = true,
+    };
+    visit_operands(&v, root);
+
+    for (size_t i = 0; i < entries_count_list(l->lets); i++) {
+        const Node* let_node = read_list(const Node*, l->lets)[i];
+        if (is_let_dead(l, let_node))
+            mark_let_dead(l, let_node);
+    }
+
+    // dropping a let releases its instruction, which in turn can kill the lets that bind its operands
+    v.counting = false;
+    while (entries_count_list(l->worklist) > 0) {
+        const Node* let_node = pop_last_list(const Node*, l->worklist);
+        debug_print("Cleanup: found an unused instruction: ");
+        log_node(DEBUG, let_node->payload.let.instruction);
+        debug_print("\n");
+        l->removed++;
+        release_use(&v, let_node->payload.let.instruction);
+    }
+}
 
 typedef struct {
     Rewriter rewriter;
-    const UsesMap* map;
-    bool* todo;
+    Liveness* liveness;
+    size_t removed;
+    /// set when the arena folded something we kept in a way that can leave dead code the liveness analysis couldn't see
+    bool folded;
 } Context;
 
-const Node* process(Context* ctx, const Node* old) {
+/// Folding a primop into a quote can leave out some of the variables it used, the lets binding them might be dead now
+static bool fold_dropped_variables(Context* ctx, const Node* old, const Node* new) {
+    if (old->payload.prim_op.op == quote_op || new->tag != PrimOp_TAG || new->payload.prim_op.op != quote_op)
+        return false;
+    Nodes old_operands = old->payload.prim_op.operands;
+    Nodes kept = new->payload.prim_op.operands;
+    for (size_t i = 0; i < old_operands.count; i++) {
+        // variables bound to constants fold away with it, and nothing else can be a dead let's result
+        const Node* operand = rewrite_node(&ctx->rewriter, old_operands.nodes[i]);
+        if (operand->tag != Variable_TAG)
+            continue;
+        bool found = false;
+        for (size_t j = 0; j < kept.count && !found; j++)
+            found = kept.nodes[j] == operand;
+        if (!found)
+            return true;
+    }
+    return false;
+}
+
+/// Blocks get lifted into the enclosing let chain, and their yield substituted into its tail, which might not use everything
+static bool block_was_folded(const Node* old, const Node* new) {
+    return get_let_instruction(old)->tag == Block_TAG && (new->tag != Let_TAG || get_let_instruction(new)->tag != Block_TAG);
+}
+
+static const Node* process(Context* ctx, const Node* old) {
     if (old->tag == Function_TAG || old->tag == Constant_TAG) {
-        Context c = *ctx;
-        c.map = create_uses_map(old, NcType | NcDeclaration);
-        const Node* new = recreate_node_identity(&c.rewriter, old);
-        destroy_uses_map(c.map);
+        Liveness* outer = ctx->liveness;
+        Liveness l = {
+            .uses = new_dict(const Node*, size_t, (HashFn) hash_node, (CmpFn) compare_node),
+            .binders = new_dict(const Node*, const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+            .dead_lets = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+            .worklist = new_list(const Node*),
+            .lets = new_list(const Node*),
+        };
+        compute_liveness(&l, old);
+        ctx->liveness = &l;
+        const Node* new = recreate_node_identity(&ctx->rewriter, old);
+        ctx->liveness = outer;
+        ctx->removed += l.removed;
+        destroy_dict(l.uses);
+        destroy_dict(l.binders);
+        destroy_dict(l.dead_lets);
+        destroy_list(l.worklist);
+        destroy_list(l.lets);
         return new;
     }
 
-    switch (old->tag) {
-        case Let_TAG: {
-            Let payload = old->payload.let;
-            bool side_effects = true;
-            if (payload.instruction->tag == PrimOp_TAG)
-                side_effects = has_primop_got_side_effects(payload.instruction->payload.prim_op.op);
-            bool consumed = false;
-            const Node* tail_case = payload.tail;
-            Nodes tail_params = get_abstraction_params(tail_case);
-            for (size_t i = 0; i < tail_params.count; i++) {
-                const Use* use = get_first_use(ctx->map, tail_params.nodes[i]);
-                assert(use);
-                for (;use; use = use->next_use) {
-                    if (use->user == tail_case)
-                        continue;
-                    consumed = true;
-                    break;
-                }
-                if (consumed)
-                    break;
-            }
-            if (!consumed && !side_effects && ctx->rewriter.dst_arena) {
-                debug_print("Cleanup: found an unused instruction: ");
-                log_node(DEBUG, payload.instruction);
-                debug_print("\n");
-                *ctx->todo = true;
-                return rewrite_node(&ctx->rewriter, get_abstraction_body(tail_case));
-            }
-            break;
-        }
-        default: break;
+    if (old->tag == Let_TAG && ctx->liveness) {
+        if (find_key_dict(const Node*, ctx->liveness->dead_lets, old))
+            return rewrite_node(&ctx->rewriter, get_abstraction_body(old->payload.let.tail));
+        const Node* new = recreate_node_identity(&ctx->rewriter, old);
+        ctx->folded |= block_was_folded(old, new);
+        return new;
+    }
+
+    if (old->tag == PrimOp_TAG && ctx->liveness) {
+        const Node* new = recreate_node_identity(&ctx->rewriter, old);
+        ctx->folded |= fold_dropped_variables(ctx, old, new);
+        return new;
     }
 
-    return recreate_node_identity(&ctx->rewriter, old);;
+    return recreate_node_identity(&ctx->rewriter, old);
 }
 
 Module* cleanup(SHADY_UNUSED const CompilerConfig* config, Module* src) {
     ArenaConfig aconfig = get_arena_config(get_module_arena(src));
     if (!aconfig.check_types)
         return src;
+    uint64_t start = get_time_nano();
     IrArena* a = new_ir_arena(aconfig);
-    bool todo;
-    Context ctx = { .todo = &todo };
+    size_t removed = 0;
     size_t r = 0;
+    bool folded;
     Module* m;
+    // the worklist takes out whole dead chains in one rewrite, we only go again if the arena folded something on the way
     do {
         debug_print("Cleanup round %d\n", r);
-        todo = false;
         m = new_module(a, get_module_name(src));
-        ctx.rewriter = create_rewriter(src, m, (RewriteNodeFn) process),
+        Context ctx = {
+            .rewriter = create_rewriter(src, m, (RewriteNodeFn) process),
+            .liveness = NULL,
+            .removed = 0,
+            .folded = false,
+        };
         rewrite_module(&ctx.rewriter);
         destroy_rewriter(&ctx.rewriter);
+        removed += ctx.removed;
+        folded = ctx.folded;
         src = m;
         r++;
-    } while (todo);
+    } while (folded);
+    debugv_print("Cleanup: removed %zu unused instructions in %zu rounds, %.3f ms\n", removed, r, (double) (get_time_nano() - start) / 1000000.0);
     return m;
 }
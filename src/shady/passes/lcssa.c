@@ -6,6 +6,7 @@
 #include "../analysis/uses.h"
 #include "../analysis/leak.h"
 #include "../analysis/free_variables.h"
+#include "../analysis/analysis_manager.h"
 
 #include "portability.h"
 #include "log.h"
@@ -45,15 +46,15 @@ static String loop_name(const LTNode* n) {
     return "";
 }
 
-void find_liftable_loop_values(Context* ctx, const Node* old, Nodes* nparams, Nodes* lparams, Nodes* nargs) {
+/// 'lparams' gets the old variables the new parameters stand for, they are only needed while rewriting so they aren't interned
+void find_liftable_loop_values(Context* ctx, const Node* old, Nodes* nparams, NodesBuilder* lparams, Nodes* nargs) {
     IrArena* a = ctx->rewriter.dst_arena;
     assert(old->tag == BasicBlock_TAG);
 
     const LTNode* bb_loop = get_loop(looptree_lookup(ctx->loop_tree, old));
 
-    *nparams = empty(a);
-    *lparams = empty(a);
-    *nargs = empty(a);
+    NodesBuilder nparams_builder = begin_nodes(a);
+    NodesBuilder nargs_builder = begin_nodes(a);
 
     struct List* fvs = compute_free_variables(ctx->scope, old);
     for (size_t i = 0; i < entries_count_list(fvs); i++) {
@@ -67,12 +68,14 @@ void find_liftable_loop_values(Context* ctx, const Node* old, Nodes* nparams, No
             debug_print("lcssa: %s~%d is used outside of the loop that defines it %s %s\n", get_value_name_safe(fv), fv->payload.var.id, loop_name(defining_loop), loop_name(bb_loop));
             const Node* narg = rewrite_node(&ctx->rewriter, fv);
             const Node* nparam = var(a, narg->type, "lcssa_phi");
-            *nparams = append_nodes(a, *nparams, nparam);
-            *lparams = append_nodes(a, *lparams, fv);
-            *nargs = append_nodes(a, *nargs, narg);
+            push_node(&nparams_builder, nparam);
+            push_node(lparams, fv);
+            push_node(&nargs_builder, narg);
         }
     }
     destroy_list(fvs);
+    *nparams = finish_nodes(&nparams_builder);
+    *nargs = finish_nodes(&nargs_builder);
 
     if (nparams->count > 0)
         insert_dict(const Node*, Nodes, ctx->lifted_arguments, old, *nparams);
@@ -93,19 +96,20 @@ const Node* process_abstraction_body(Context* ctx, const Node* old, const Node*
     const CFNode* n = scope_lookup(ctx->scope, old);
 
     size_t children_count = 0;
-    LARRAY(const Node*, old_children, entries_count_list(n->dominates));
-    for (size_t i = 0; i < entries_count_list(n->dominates); i++) {
-        CFNode* c = read_list(CFNode*, n->dominates)[i];
+    LARRAY(const Node*, old_children, n->dominates.count);
+    for (size_t i = 0; i < n->dominates.count; i++) {
+        CFNode* c = n->dominates.nodes[i];
         if (is_case(c->node))
             continue;
         old_children[children_count++] = c->node;
     }
 
     LARRAY(Node*, new_children, children_count);
-    LARRAY(Nodes, lifted_params, children_count);
+    LARRAY(NodesBuilder, lifted_params, children_count);
     LARRAY(Nodes, new_params, children_count);
     for (size_t i = 0; i < children_count; i++) {
         Nodes nargs;
+        lifted_params[i] = begin_nodes(a);
         find_liftable_loop_values(ctx, old_children[i], &new_params[i], &lifted_params[i], &nargs);
         Nodes nparams = recreate_variables(&ctx->rewriter, get_abstraction_params(old_children[i]));
         new_children[i] = basic_block(a, nfn, concat_nodes(a, nparams, new_params[i]), get_abstraction_name(old_children[i]));
@@ -119,10 +123,12 @@ const Node* process_abstraction_body(Context* ctx, const Node* old, const Node*
     ctx->rewriter.map = clone_dict(ctx->rewriter.map);
 
     for (size_t i = 0; i < children_count; i++) {
-        for (size_t j = 0; j < lifted_params[i].count; j++) {
-            remove_dict(const Node*, ctx->rewriter.map, lifted_params[i].nodes[j]);
+        Nodes lifted = peek_nodes(&lifted_params[i]);
+        for (size_t j = 0; j < lifted.count; j++) {
+            remove_dict(const Node*, ctx->rewriter.map, lifted.nodes[j]);
         }
-        register_processed_list(&ctx->rewriter, lifted_params[i], new_params[i]);
+        register_processed_list(&ctx->rewriter, lifted, new_params[i]);
+        discard_nodes(&lifted_params[i]);
         new_children[i]->payload.basic_block.body = process_abstraction_body(ctx, old_children[i], get_abstraction_body(old_children[i]));
     }
 
@@ -148,16 +154,17 @@ const Node* process_node(Context* ctx, const Node* old) {
             ctx = &fn_ctx;
 
             ctx->current_fn = old;
-            ctx->scope = new_scope(old);
-            ctx->scope_uses = create_uses_map(old, (NcDeclaration | NcType));
-            ctx->loop_tree = build_loop_tree(ctx->scope);
+            AnalysisManager* am = ctx->config->analyses.manager;
+            ctx->scope = acquire_scope(am, old);
+            ctx->scope_uses = acquire_uses_map(am, old, (NcDeclaration | NcType));
+            ctx->loop_tree = acquire_loop_tree(am, ctx->scope);
 
             Node* new = recreate_decl_header_identity(&ctx->rewriter, old);
             new->payload.fun.body = process_abstraction_body(ctx, old, get_abstraction_body(old));
 
-            destroy_loop_tree(ctx->loop_tree);
-            destroy_uses_map(ctx->scope_uses);
-            destroy_scope(ctx->scope);
+            release_loop_tree(am, ctx->loop_tree);
+            release_uses_map(am, ctx->scope_uses);
+            release_scope(am, ctx->scope);
             return new;
         }
         case Jump_TAG: {
@@ -15,6 +15,7 @@
 #include "../analysis/free_variables.h"
 #include "../analysis/uses.h"
 #include "../analysis/leak.h"
+#include "../analysis/analysis_manager.h"
 
 #include <assert.h>
 #include <string.h>
@@ -78,10 +79,10 @@ static LiftedCont* lambda_lift(Context* ctx, const Node* cont, String given_name
     String name = is_basic_block(cont) ? format_string_arena(a->arena, "%s_%s", get_abstraction_name(cont->payload.basic_block.fn), get_abstraction_name(cont)) : unique_name(a, given_name);
 
     // Compute the live stuff we'll need
-    Scope* scope = new_scope(cont);
+    Scope* scope = acquire_scope(ctx->config->analyses.manager, cont);
     struct List* recover_context = compute_free_variables(scope, cont);
     size_t recover_context_size = entries_count_list(recover_context);
-    destroy_scope(scope);
+    release_scope(ctx->config->analyses.manager, scope);
 
     debugv_print("free (spilled) variables at '%s': ", name);
     for (size_t i = 0; i < recover_context_size; i++) {
@@ -148,12 +149,9 @@ static const Node* process_node(Context* ctx, const Node* node) {
 
     // TODO: share this code
     if (is_declaration(node)) {
-        String name = get_decl_name(node);
-        Nodes decls = get_module_declarations(ctx->rewriter.dst_module);
-        for (size_t i = 0; i < decls.count; i++) {
-            if (strcmp(get_decl_name(decls.nodes[i]), name) == 0)
-                return decls.nodes[i];
-        }
+        const Node* existing = get_declaration(ctx->rewriter.dst_module, get_decl_name(node));
+        if (existing)
+            return existing;
     }
 
     IrArena* a = ctx->rewriter.dst_arena;
@@ -164,15 +162,15 @@ static const Node* process_node(Context* ctx, const Node* node) {
     switch (node->tag) {
         case Function_TAG: {
             Context fn_ctx = *ctx;
-            fn_ctx.scope = new_scope(node);
-            fn_ctx.scope_uses = create_uses_map(node, (NcDeclaration | NcType));
+            fn_ctx.scope = acquire_scope(ctx->config->analyses.manager, node);
+            fn_ctx.scope_uses = acquire_uses_map(ctx->config->analyses.manager, node, (NcDeclaration | NcType));
             ctx = &fn_ctx;
 
             Node* new = recreate_decl_header_identity(&ctx->rewriter, node);
             recreate_decl_body_identity(&ctx->rewriter, node, new);
 
-            destroy_uses_map(ctx->scope_uses);
-            destroy_scope(ctx->scope);
+            release_uses_map(ctx->config->analyses.manager, ctx->scope_uses);
+            release_scope(ctx->config->analyses.manager, ctx->scope);
             return new;
         }
         case Let_TAG: {
@@ -7,11 +7,13 @@
 #include "../type.h"
 #include "../rewrite.h"
 #include "../analysis/scope.h"
+#include "../analysis/analysis_manager.h"
 
 #include <assert.h>
 
 typedef struct Context_ {
     Rewriter rewriter;
+    AnalysisManager* analyses;
     bool disable_lowering;
     Node* current_fn;
 
@@ -141,10 +143,10 @@ static const Node* process_node(Context* ctx, const Node* node) {
         Node* fun = recreate_decl_header_identity(&ctx->rewriter, node);
         sub_ctx.disable_lowering = lookup_annotation(fun, "Structured");
         sub_ctx.current_fn = fun;
-        sub_ctx.scope = new_scope(node);
+        sub_ctx.scope = acquire_scope(ctx->analyses, node);
         sub_ctx.abs = node;
         fun->payload.fun.body = rewrite_node(&sub_ctx.rewriter, node->payload.fun.body);
-        destroy_scope(sub_ctx.scope);
+        release_scope(ctx->analyses, sub_ctx.scope);
         return fun;
     }
 
@@ -263,12 +265,13 @@ static const Node* process_node(Context* ctx, const Node* node) {
 KeyHash hash_node(const Node**);
 bool compare_node(const Node**, const Node**);
 
-Module* lower_cf_instrs(SHADY_UNUSED const CompilerConfig* config, Module* src) {
+Module* lower_cf_instrs(const CompilerConfig* config, Module* src) {
     ArenaConfig aconfig = get_arena_config(get_module_arena(src));
     IrArena* a = new_ir_arena(aconfig);
     Module* dst = new_module(a, get_module_name(src));
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process_node),
+        .analyses = config->analyses.manager,
         .structured_join_tokens = new_dict(const Node*, Nodes, (HashFn) hash_node, (CmpFn) compare_node),
     };
     ctx.rewriter.config.fold_quote = false;
@@ -10,6 +10,8 @@
 
 typedef struct {
     Rewriter rewriter;
+    /// Scratch memory for the decision trees, rewound after each match
+    Arena* arena;
 
     const Node* inspectee;
     const Node* run_default_case;
@@ -148,10 +150,10 @@ static const Node* process(Context* ctx, const Node* node) {
             // TODO or maybe do that in fold()
             assert(cases.count > 0);
 
-            Arena* arena = new_arena();
+            ArenaMark mark = arena_mark(ctx->arena);
             TreeNode* root = NULL;
             for (size_t i = 0; i < literals.count; i++) {
-                TreeNode* t = arena_alloc(arena, sizeof(TreeNode));
+                TreeNode* t = arena_alloc(ctx->arena, sizeof(TreeNode));
                 t->key = get_int_literal_value(*resolve_to_int_literal(literals.nodes[i]), false);
                 t->lam = cases.nodes[i];
                 root = insert(root, t);
@@ -177,7 +179,7 @@ static const Node* process(Context* ctx, const Node* node) {
                 }))
             }));
 
-            destroy_arena(arena);
+            arena_rewind(ctx->arena, mark);
             return yield_values_and_wrap_in_block(bb, final_results);
         }
         default: break;
@@ -193,8 +195,10 @@ Module* lower_switch_btree(SHADY_UNUSED const CompilerConfig* config, Module* sr
 
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .arena = new_arena(),
     };
     rewrite_module(&ctx.rewriter);
     destroy_rewriter(&ctx.rewriter);
+    destroy_arena(ctx.arena);
     return dst;
 }
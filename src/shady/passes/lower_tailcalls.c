@@ -11,6 +11,7 @@
 #include "../analysis/scope.h"
 #include "../analysis/uses.h"
 #include "../analysis/leak.h"
+#include "../analysis/analysis_manager.h"
 #include "../transform/ir_gen_helpers.h"
 
 #include "list.h"
@@ -103,8 +104,8 @@ static const Node* process(Context* ctx, const Node* old) {
     switch (old->tag) {
         case Function_TAG: {
             Context ctx2 = *ctx;
-            ctx2.scope = new_scope(old);
-            ctx2.scope_uses = create_uses_map(old, (NcDeclaration | NcType));
+            ctx2.scope = acquire_scope(ctx->config->analyses.manager, old);
+            ctx2.scope_uses = acquire_uses_map(ctx->config->analyses.manager, old, (NcDeclaration | NcType));
             ctx = &ctx2;
 
             const Node* entry_point_annotation = lookup_annotation_list(old->payload.fun.annotations, "EntryPoint");
@@ -122,8 +123,8 @@ static const Node* process(Context* ctx, const Node* old) {
                     fun->payload.fun.body = nbody;
                 }
 
-                destroy_uses_map(ctx2.scope_uses);
-                destroy_scope(ctx2.scope);
+                release_uses_map(ctx->config->analyses.manager, ctx2.scope_uses);
+                release_scope(ctx->config->analyses.manager, ctx2.scope);
                 return fun;
             }
 
@@ -153,8 +154,8 @@ static const Node* process(Context* ctx, const Node* old) {
                 register_processed(&ctx->rewriter, old_param, popped);
             }
             fun->payload.fun.body = finish_body(bb, rewrite_node(&ctx2.rewriter, old->payload.fun.body));
-            destroy_uses_map(ctx2.scope_uses);
-            destroy_scope(ctx2.scope);
+            release_uses_map(ctx->config->analyses.manager, ctx2.scope_uses);
+            release_scope(ctx->config->analyses.manager, ctx2.scope);
             return fun;
         }
         case FnAddr_TAG: return lower_fn_addr(ctx, old->payload.fn_addr.fn);
@@ -345,9 +346,9 @@ void generate_top_level_dispatch_fn(Context* ctx) {
     append_list(const Node*, literals, zero_lit);
     append_list(const Node*, cases, zero_case_lam);
 
-    Nodes old_decls = get_module_declarations(ctx->rewriter.src_module);
-    for (size_t i = 0; i < old_decls.count; i++) {
-        const Node* decl = old_decls.nodes[i];
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(ctx->rewriter.src_module, &i, &decl)) {
         if (decl->tag == Function_TAG) {
             if (lookup_annotation(decl, "Leaf"))
                 continue;
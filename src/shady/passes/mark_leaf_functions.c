@@ -10,9 +10,11 @@
 #include "../analysis/scope.h"
 #include "../analysis/uses.h"
 #include "../analysis/leak.h"
+#include "../analysis/analysis_manager.h"
 
 typedef struct {
     Rewriter rewriter;
+    AnalysisManager* analyses;
     CallGraph* graph;
     struct Dict* fns;
 
@@ -86,8 +88,8 @@ static const Node* process(Context* ctx, const Node* node) {
             Context fn_ctx = *ctx;
             CGNode* fn_node = *find_value_dict(const Node*, CGNode*, ctx->graph->fn2cgn, node);
             fn_ctx.is_leaf = is_leaf_fn(ctx, fn_node);
-            fn_ctx.scope = new_scope(node);
-            fn_ctx.scope_uses = create_uses_map(node, (NcDeclaration | NcType));
+            fn_ctx.scope = acquire_scope(ctx->analyses, node);
+            fn_ctx.scope_uses = acquire_uses_map(ctx->analyses, node, (NcDeclaration | NcType));
             ctx = &fn_ctx;
 
             Nodes annotations = rewrite_nodes(&ctx->rewriter, node->payload.fun.annotations);
@@ -104,8 +106,8 @@ static const Node* process(Context* ctx, const Node* node) {
                 }));
             }
 
-            destroy_uses_map(fn_ctx.scope_uses);
-            destroy_scope(fn_ctx.scope);
+            release_uses_map(ctx->analyses, fn_ctx.scope_uses);
+            release_scope(ctx->analyses, fn_ctx.scope);
             return new;
         }
         case Control_TAG: {
@@ -147,18 +149,19 @@ static const Node* process(Context* ctx, const Node* node) {
 KeyHash hash_node(Node**);
 bool compare_node(Node**, Node**);
 
-Module* mark_leaf_functions(SHADY_UNUSED const CompilerConfig* config, Module* src) {
+Module* mark_leaf_functions(const CompilerConfig* config, Module* src) {
     ArenaConfig aconfig = get_arena_config(get_module_arena(src));
     IrArena* a = new_ir_arena(aconfig);
     Module* dst = new_module(a, get_module_name(src));
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .analyses = config->analyses.manager,
         .fns = new_dict(const Node*, FnInfo, (HashFn) hash_node, (CmpFn) compare_node),
-        .graph = new_callgraph(src)
+        .graph = acquire_callgraph(config->analyses.manager, src)
     };
     rewrite_module(&ctx.rewriter);
     destroy_dict(ctx.fns);
-    destroy_callgraph(ctx.graph);
+    release_callgraph(ctx.analyses, ctx.graph);
     destroy_rewriter(&ctx.rewriter);
     return dst;
 }
@@ -12,9 +12,11 @@
 
 #include "../analysis/scope.h"
 #include "../analysis/callgraph.h"
+#include "../analysis/analysis_manager.h"
 
 typedef struct {
     Rewriter rewriter;
+    AnalysisManager* analyses;
     Scope* scope;
     CallGraph* graph;
     const Node* old_fun;
@@ -88,12 +90,12 @@ static const Node* inline_call(Context* ctx, const Node* oabs, Nodes nargs, bool
     register_processed_list(&inline_context.rewriter, oparams, nargs);
 
     if (oabs->tag == Function_TAG)
-        inline_context.scope = new_scope(oabs);
+        inline_context.scope = acquire_scope(ctx->analyses, oabs);
 
     const Node* nbody = rewrite_node(&inline_context.rewriter, get_abstraction_body(oabs));
 
     if (oabs->tag == Function_TAG)
-        destroy_scope(inline_context.scope);
+        release_scope(ctx->analyses, inline_context.scope);
 
     if (separate_scope)
         destroy_dict(inline_context.rewriter.map);
@@ -128,14 +130,14 @@ static const Node* process(Context* ctx, const Node* node) {
             register_processed(&ctx->rewriter, node, new);
 
             Context fn_ctx = *ctx;
-            Scope* scope = new_scope(node);
+            Scope* scope = acquire_scope(ctx->analyses, node);
             fn_ctx.rewriter.map = clone_dict(fn_ctx.rewriter.map);
             fn_ctx.scope = scope;
             fn_ctx.old_fun = node;
             fn_ctx.fun = new;
             recreate_decl_body_identity(&fn_ctx.rewriter, node, new);
             destroy_dict(fn_ctx.rewriter.map);
-            destroy_scope(scope);
+            release_scope(ctx->analyses, scope);
             return new;
         }
         case Jump_TAG: {
@@ -144,7 +146,7 @@ static const Node* process(Context* ctx, const Node* node) {
             assert(otarget->payload.basic_block.fn == ctx->scope->entry->node);
             CFNode* cfnode = scope_lookup(ctx->scope, otarget);
             assert(cfnode);
-            size_t preds_count = entries_count_list(cfnode->pred_edges);
+            size_t preds_count = cfnode->pred_edges.count;
             assert(preds_count > 0 && "this CFG looks broken");
             if (preds_count == 1) {
                 debugv_print("Inlining jump to %s inside function %s\n", get_abstraction_name(otarget), get_abstraction_name(ctx->old_fun));
@@ -242,20 +244,21 @@ static const Node* process(Context* ctx, const Node* node) {
 KeyHash hash_node(const Node**);
 bool compare_node(const Node**, const Node**);
 
-void opt_simplify_cf(SHADY_UNUSED const CompilerConfig* config, Module* src, Module* dst, bool allow_fn_inlining) {
+void opt_simplify_cf(const CompilerConfig* config, Module* src, Module* dst, bool allow_fn_inlining) {
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .analyses = config->analyses.manager,
         .graph = NULL,
         .scope = NULL,
         .fun = NULL,
         .inlined_return_sites = new_dict(const Node*, CGNode*, (HashFn) hash_node, (CmpFn) compare_node),
     };
     if (allow_fn_inlining)
-        ctx.graph = new_callgraph(src);
+        ctx.graph = acquire_callgraph(ctx.analyses, src);
 
     rewrite_module(&ctx.rewriter);
     if (ctx.graph)
-        destroy_callgraph(ctx.graph);
+        release_callgraph(ctx.analyses, ctx.graph);
 
     destroy_rewriter(&ctx.rewriter);
     destroy_dict(ctx.inlined_return_sites);
@@ -8,6 +8,7 @@
 #include "../analysis/scope.h"
 #include "../analysis/uses.h"
 #include "../analysis/leak.h"
+#include "../analysis/analysis_manager.h"
 #include "../analysis/verify.h"
 
 #include "../transform/ir_gen_helpers.h"
@@ -44,6 +45,7 @@ struct KB {
 
 typedef struct {
     Rewriter rewriter;
+    AnalysisManager* analyses;
     Scope* scope;
     const UsesMap* scope_uses;
     struct Dict* abs_to_kb;
@@ -291,7 +293,8 @@ static KnowledgeBase* get_kb(Context* ctx, const Node* abs) {
     return *found;
 }
 
-static void visit_cfnode(Context* ctx, CFNode* node, CFNode* dominator) {
+static void visit_cfnode(Context* ctx, CFNode* node) {
+    CFNode* dominator = node->idom;
     const Node* oabs = node->node;
     KnowledgeBase* kb = arena_alloc(ctx->a, sizeof(KnowledgeBase));
     *kb = (KnowledgeBase) {
@@ -301,9 +304,9 @@ static void visit_cfnode(Context* ctx, CFNode* node, CFNode* dominator) {
         .potential_additional_params = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
         .dominator_kb = NULL,
     };
-    if (entries_count_list(node->pred_edges) == 1) {
+    if (node->pred_edges.count == 1) {
         assert(dominator);
-        CFEdge edge = read_list(CFEdge, node->pred_edges)[0];
+        CFEdge edge = node->pred_edges.edges[0];
         assert(edge.dst == node);
         assert(edge.src == dominator);
         const KnowledgeBase* parent_kb = get_kb(ctx, dominator->node);
@@ -314,11 +317,6 @@ static void visit_cfnode(Context* ctx, CFNode* node, CFNode* dominator) {
     insert_dict(const Node*, KnowledgeBase*, ctx->abs_to_kb, node->node, kb);
     assert(is_abstraction(oabs));
     visit_terminator(ctx, kb, get_abstraction_body(oabs));
-
-    for (size_t i = 0; i < entries_count_list(node->dominates); i++) {
-        CFNode* dominated = read_list(CFNode*, node->dominates)[i];
-        visit_cfnode(ctx, dominated, node);
-    }
 }
 
 static const Node* process(Context* ctx, const Node* old) {
@@ -326,20 +324,25 @@ static const Node* process(Context* ctx, const Node* old) {
     Context fn_ctx = *ctx;
     if (old->tag == Function_TAG && !lookup_annotation(old, "Internal")) {
         ctx = &fn_ctx;
-        fn_ctx.scope = new_scope(old);
-        fn_ctx.scope_uses = create_uses_map(old, (NcDeclaration | NcType));
+        // the knowledge bases don't outlive the function
+        ArenaMark mark = arena_mark(ctx->a);
+        fn_ctx.scope = acquire_scope(ctx->analyses, old);
+        fn_ctx.scope_uses = acquire_uses_map(ctx->analyses, old, (NcDeclaration | NcType));
         fn_ctx.abs_to_kb = new_dict(const Node*, KnowledgeBase**, (HashFn) hash_node, (CmpFn) compare_node);
-        visit_cfnode(&fn_ctx, fn_ctx.scope->entry, NULL);
+        // dominators come first in RPO, so their knowledge is always there when we need it
+        for (size_t i = 0; i < fn_ctx.scope->size; i++)
+            visit_cfnode(&fn_ctx, fn_ctx.scope->rpo[i]);
         fn_ctx.abs = old;
         const Node* new_fn = recreate_node_identity(&fn_ctx.rewriter, old);
-        destroy_scope(fn_ctx.scope);
-        destroy_uses_map(fn_ctx.scope_uses);
+        release_scope(ctx->analyses, fn_ctx.scope);
+        release_uses_map(ctx->analyses, fn_ctx.scope_uses);
         size_t i = 0;
         KnowledgeBase* kb;
         while (dict_iter(fn_ctx.abs_to_kb, &i, NULL, &kb)) {
             destroy_kb(kb);
         }
         destroy_dict(fn_ctx.abs_to_kb);
+        arena_rewind(ctx->a, mark);
         return new_fn;
     } else if (is_abstraction(old)) {
         fn_ctx.abs = old;
@@ -408,13 +411,15 @@ static const Node* process(Context* ctx, const Node* old) {
             const Node* ptr;
             Nodes params = recreate_variables(&ctx->rewriter, get_abstraction_params(old));
             register_processed_list(&ctx->rewriter, get_abstraction_params(old), params);
-            Nodes ptrs = empty(ctx->rewriter.src_arena);
+            NodesBuilder params_builder = begin_nodes(a);
+            extend_nodes(&params_builder, params);
+            NodesBuilder ptrs_builder = begin_nodes(ctx->rewriter.src_arena);
             while (dict_iter(kb->potential_additional_params, &i, &ptr, NULL)) {
                 PtrSourceKnowledge* source = NULL;
                 PtrKnowledge uk = { 0 };
                 // check if all the edges have a value for this!
-                for (size_t j = 0; j < entries_count_list(cfnode->pred_edges); j++) {
-                    CFEdge edge = read_list(CFEdge, cfnode->pred_edges)[j];
+                for (size_t j = 0; j < cfnode->pred_edges.count; j++) {
+                    CFEdge edge = cfnode->pred_edges.edges[j];
                     if (edge.type == StructuredPseudoExitEdge)
                         continue; // these are not real edges...
                     KnowledgeBase* kb_at_src = get_kb(ctx, edge.src->node);
@@ -452,8 +457,8 @@ static const Node* process(Context* ctx, const Node* old) {
                 debug_print(" has a known value in all predecessors! Turning it into a new parameter.\n");
 
                 const Node* param = var(a, rewrite_node(&ctx->rewriter, source->type), unique_name(a, "ssa_phi"));
-                params = append_nodes(a, params, param);
-                ptrs = append_nodes(ctx->rewriter.src_arena, ptrs, ptr);
+                push_node(&params_builder, param);
+                push_node(&ptrs_builder, ptr);
 
                 PtrKnowledge* k = arena_alloc(ctx->a, sizeof(PtrKnowledge));
                 *k = (PtrKnowledge) {
@@ -466,6 +471,8 @@ static const Node* process(Context* ctx, const Node* old) {
                 next_potential_param: continue;
             }
 
+            params = finish_nodes(&params_builder);
+            Nodes ptrs = finish_nodes(&ptrs_builder);
             if (ptrs.count > 0) {
                 insert_dict(const Node*, Nodes, ctx->bb_new_args, old, ptrs);
             }
@@ -492,6 +499,9 @@ static const Node* process(Context* ctx, const Node* old) {
                 Node* trampoline = basic_block(a, fn, tr_params, format_string_interned(a, "%s_trampoline", get_abstraction_name(new_bb)));
                 Nodes tr_args = args;
                 BodyBuilder* bb = begin_body(a);
+                NodesBuilder args_builder = begin_nodes(a);
+                reserve_nodes(&args_builder, args.count + additional_ssa_params->count);
+                extend_nodes(&args_builder, args);
 
                 for (size_t i = 0; i < additional_ssa_params->count; i++) {
                     const Node* ptr = additional_ssa_params->nodes[i];
@@ -508,8 +518,9 @@ static const Node* process(Context* ctx, const Node* old) {
                         value = first(gen_primop(bb, reinterpret_op, singleton(rewrite_node(&ctx->rewriter, alloca_type_t)), singleton(value)));
 
                     assert(value);
-                    args = append_nodes(a, args, value);
+                    push_node(&args_builder, value);
                 }
+                args = finish_nodes(&args_builder);
 
                 trampoline->payload.basic_block.body = finish_body(bb, jump_helper(a, new_bb, args));
 
@@ -535,6 +546,7 @@ Module* opt_mem2reg(const CompilerConfig* config, Module* src) {
 
         Context ctx = {
             .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+            .analyses = config->analyses.manager,
             .bb_new_args = new_dict(const Node*, Nodes, (HashFn) hash_node, (CmpFn) compare_node),
             .a = new_arena(),
         };
@@ -546,15 +558,18 @@ Module* opt_mem2reg(const CompilerConfig* config, Module* src) {
         destroy_dict(ctx.bb_new_args);
         destroy_arena(ctx.a);
 
-        verify_module(dst);
+        verify_module(config, dst);
 
-        if (get_module_arena(src) != initial_arena)
+        if (get_module_arena(src) != initial_arena) {
+            forget_arena_analyses(config->analyses.manager, get_module_arena(src));
             destroy_ir_arena(get_module_arena(src));
+        }
 
         dst = cleanup(config, dst);
         src = dst;
     }
 
+    forget_arena_analyses(config->analyses.manager, a);
     destroy_ir_arena(a);
 
     return dst;
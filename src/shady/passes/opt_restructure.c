@@ -341,12 +341,9 @@ static const Node* process(Context* ctx, const Node* node) {
     if (found) return found;
 
     if (is_declaration(node)) {
-        String name = get_decl_name(node);
-        Nodes decls = get_module_declarations(ctx->rewriter.dst_module);
-        for (size_t i = 0; i < decls.count; i++) {
-            if (strcmp(get_decl_name(decls.nodes[i]), name) == 0)
-                return decls.nodes[i];
-        }
+        const Node* existing = get_declaration(ctx->rewriter.dst_module, get_decl_name(node));
+        if (existing)
+            return existing;
     }
 
     if (node->tag == Function_TAG) {
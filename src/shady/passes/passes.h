@@ -124,6 +124,8 @@ RewritePass spirv_map_entrypoint_args;
 RewritePass spirv_lift_globals_ssbo;
 
 RewritePass specialize_entry_point;
+/// Keeps only the entry point we're specializing for and what it uses
+RewritePass prune_entry_points;
 RewritePass specialize_execution_model;
 
 /// @}
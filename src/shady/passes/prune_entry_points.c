@@ -0,0 +1,55 @@
+#include "passes.h"
+
+#include "portability.h"
+#include "dict.h"
+
+#include "../rewrite.h"
+#include "../visit.h"
+
+#include <string.h>
+
+KeyHash hash_node(Node**);
+bool compare_node(Node**, Node**);
+
+typedef struct {
+    Visitor v;
+    struct Dict* seen;
+} ReachabilityVisitor;
+
+static void visit_reachable(ReachabilityVisitor* v, const Node* node) {
+    if (insert_set_get_result(const Node*, v->seen, node))
+        visit_node_operands(&v->v, 0, node);
+}
+
+static bool is_entry_point(const Node* decl) {
+    return decl->tag == Function_TAG && lookup_annotation(decl, "EntryPoint");
+}
+
+/// Drops the other entry points and everything only they use, so the rest of the pipeline doesn't lower code we're going to throw away.
+/// Declarations no entry point uses are kept: the scheduler and the internal constants are only referenced later on, by lowering passes.
+Module* prune_entry_points(const CompilerConfig* config, Module* src) {
+    ArenaConfig aconfig = get_arena_config(get_module_arena(src));
+    IrArena* a = new_ir_arena(aconfig);
+    Module* dst = new_module(a, get_module_name(src));
+    Rewriter rewriter = create_rewriter(src, dst, (RewriteNodeFn) recreate_node_identity);
+
+    ReachabilityVisitor v = {
+        .v = { .visit_node_fn = (VisitNodeFn) visit_reachable },
+        .seen = new_set(const Node*, (HashFn) hash_node, (CmpFn) compare_node),
+    };
+    Nodes decls = get_module_declarations(src);
+    for (size_t i = 0; i < decls.count; i++) {
+        if (is_entry_point(decls.nodes[i]))
+            visit_reachable(&v, decls.nodes[i]);
+    }
+
+    for (size_t i = 0; i < decls.count; i++) {
+        const Node* decl = decls.nodes[i];
+        if (is_entry_point(decl) ? strcmp(get_decl_name(decl), config->specialization.entry_point) == 0 : !find_key_dict(const Node*, v.seen, decl))
+            rewrite_node(&rewriter, decl);
+    }
+
+    destroy_dict(v.seen);
+    destroy_rewriter(&rewriter);
+    return dst;
+}
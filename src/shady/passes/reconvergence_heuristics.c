@@ -13,11 +13,13 @@
 
 #include "../analysis/scope.h"
 #include "../analysis/looptree.h"
+#include "../analysis/analysis_manager.h"
 
 #include <assert.h>
 
 typedef struct Context_ {
     Rewriter rewriter;
+    AnalysisManager* analyses;
     const Node* current_fn;
     const Node* current_abstraction;
     Scope* fwd_scope;
@@ -51,8 +53,8 @@ static void gather_exiting_nodes(LoopTree* lt, const CFNode* entry, const CFNode
         return;
     }
 
-    for (size_t i = 0; i < entries_count_list(block->dominates); i++) {
-        const CFNode* target = read_list(CFNode*, block->dominates)[i];
+    for (size_t i = 0; i < block->dominates.count; i++) {
+        const CFNode* target = block->dominates.nodes[i];
         gather_exiting_nodes(lt, entry, target, exiting_nodes);
     }
 }
@@ -307,15 +309,15 @@ static const Node* process_node(Context* ctx, const Node* node) {
             Context new_context = *ctx;
             ctx = &new_context;
             ctx->current_fn = node;
-            ctx->fwd_scope = new_scope(ctx->current_fn);
-            ctx->back_scope = new_scope_flipped(ctx->current_fn);
-            ctx->current_looptree = build_loop_tree(ctx->fwd_scope);
+            ctx->fwd_scope = acquire_scope(ctx->analyses, ctx->current_fn);
+            ctx->back_scope = acquire_scope_flipped(ctx->analyses, ctx->current_fn);
+            ctx->current_looptree = acquire_loop_tree(ctx->analyses, ctx->fwd_scope);
 
             const Node* new = process_abstraction(ctx, node);;
 
-            destroy_scope(ctx->fwd_scope);
-            destroy_scope(ctx->back_scope);
-            destroy_loop_tree(ctx->current_looptree);
+            release_loop_tree(ctx->analyses, ctx->current_looptree);
+            release_scope(ctx->analyses, ctx->fwd_scope);
+            release_scope(ctx->analyses, ctx->back_scope);
             return new;
         }
         case Case_TAG:
@@ -337,8 +339,8 @@ static const Node* process_node(Context* ctx, const Node* node) {
             if (entries_count_list(current_loop->cf_nodes)) {
                 bool leaves_loop = false;
                 CFNode* current_node = scope_lookup(ctx->fwd_scope, ctx->current_abstraction);
-                for (size_t i = 0; i < entries_count_list(current_node->succ_edges); i++) {
-                    CFEdge edge = read_list(CFEdge, current_node->succ_edges)[i];
+                for (size_t i = 0; i < current_node->succ_edges.count; i++) {
+                    CFEdge edge = current_node->succ_edges.edges[i];
                     LTNode* lt_target = looptree_lookup(ctx->current_looptree, edge.dst->node);
 
                     if (lt_target->parent != current_loop) {
@@ -469,13 +471,14 @@ static const Node* process_node(Context* ctx, const Node* node) {
     return recreate_node_identity(rewriter, node);
 }
 
-Module* reconvergence_heuristics(SHADY_UNUSED const CompilerConfig* config, Module* src) {
+Module* reconvergence_heuristics(const CompilerConfig* config, Module* src) {
     ArenaConfig aconfig = get_arena_config(get_module_arena(src));
     IrArena* a = new_ir_arena(aconfig);
     Module* dst = new_module(a, get_module_name(src));
 
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process_node),
+        .analyses = config->analyses.manager,
         .current_fn = NULL,
         .fwd_scope = NULL,
         .back_scope = NULL,
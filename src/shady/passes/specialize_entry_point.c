@@ -11,10 +11,23 @@
 
 typedef struct {
     Rewriter rewriter;
+    const CompilerConfig* config;
     const Node* old_entry_point_decl;
     const Node* old_wg_size_annotation;
+    /// Stand-ins for the workgroup size in spec_constants mode, created the first time it's read
+    const Node* wg_size_constants[3];
 } Context;
 
+static const Node* get_workgroup_size_constant(Context* ctx, int dim) {
+    if (!ctx->wg_size_constants[dim]) {
+        IrArena* a = ctx->rewriter.dst_arena;
+        String names[] = { "WORKGROUP_SIZE_X", "WORKGROUP_SIZE_Y", "WORKGROUP_SIZE_Z" };
+        Node* cnst = constant(ctx->rewriter.dst_module, singleton(annotation_value_helper(a, "SpecId", uint32_literal(a, ShdSpecIdWorkgroupSizeX + dim))), uint32_type(a), names[dim]);
+        cnst->payload.constant.instruction = quote_helper(a, singleton(uint32_literal(a, a->config.specializations.workgroup_size[dim])));
+        ctx->wg_size_constants[dim] = cnst;
+    }
+    return ctx->wg_size_constants[dim];
+}
 
 static const Node* process(Context* ctx, const Node* node) {
     if (!node) return NULL;
@@ -28,11 +41,15 @@ static const Node* process(Context* ctx, const Node* node) {
             Builtin b;
             if (is_builtin_load_op(node, &b) && b == BuiltinWorkgroupSize) {
                 const Type* t = pack_type(a, (PackType) { .element_type = uint32_type(a), .width = 3 });
-                uint32_t wg_size[3];
-                wg_size[0] = a->config.specializations.workgroup_size[0];
-                wg_size[1] = a->config.specializations.workgroup_size[1];
-                wg_size[2] = a->config.specializations.workgroup_size[2];
-                return quote_helper(a, singleton(composite_helper(a, t, mk_nodes(a, uint32_literal(a, wg_size[0]), uint32_literal(a, wg_size[1]), uint32_literal(a, wg_size[2]) ))));
+                const Node* wg_size[3];
+                for (int dim = 0; dim < 3; dim++) {
+                    // the emitter makes those specialization constants, so the runtime can still pick another shape
+                    if (ctx->config->specialization.spec_constants)
+                        wg_size[dim] = ref_decl_helper(a, get_workgroup_size_constant(ctx, dim));
+                    else
+                        wg_size[dim] = uint32_literal(a, a->config.specializations.workgroup_size[dim]);
+                }
+                return quote_helper(a, singleton(composite_helper(a, t, nodes(a, 3, wg_size))));
             }
             break;
         }
@@ -53,6 +70,9 @@ static const Node* process(Context* ctx, const Node* node) {
             Node* ncnst = (Node*) recreate_node_identity(&ctx->rewriter, node);
             if (strcmp(get_decl_name(ncnst), "SUBGROUP_SIZE") == 0) {
                 ncnst->payload.constant.instruction = quote_helper(a, singleton(uint32_literal(a, a->config.specializations.subgroup_size)));
+                // the value is only the upper bound, the emitter turns this into a specialization constant
+                if (ctx->config->specialization.spec_constants)
+                    ncnst->payload.constant.annotations = append_nodes(a, ncnst->payload.constant.annotations, annotation_value_helper(a, "SpecId", uint32_literal(a, ShdSpecIdSubgroupSize)));
             } else if (strcmp(get_decl_name(ncnst), "SUBGROUPS_PER_WG") == 0) {
                 if (ctx->old_wg_size_annotation) {
                     // SUBGROUPS_PER_WG = (NUMBER OF INVOCATIONS IN SUBGROUP / SUBGROUP SIZE)
@@ -61,7 +81,11 @@ static const Node* process(Context* ctx, const Node* node) {
                     wg_size[0] = a->config.specializations.workgroup_size[0];
                     wg_size[1] = a->config.specializations.workgroup_size[1];
                     wg_size[2] = a->config.specializations.workgroup_size[2];
-                    uint32_t subgroups_per_wg = (wg_size[0] * wg_size[1] * wg_size[2]) / a->config.specializations.subgroup_size;
+                    // with specialization constants the arrays must be big enough for the smallest subgroup size
+                    uint32_t subgroup_size = a->config.specializations.subgroup_size;
+                    if (ctx->config->specialization.spec_constants && ctx->config->specialization.min_subgroup_size)
+                        subgroup_size = ctx->config->specialization.min_subgroup_size;
+                    uint32_t subgroups_per_wg = (wg_size[0] * wg_size[1] * wg_size[2]) / subgroup_size;
                     if (subgroups_per_wg == 0)
                         subgroups_per_wg = 1; // uh-oh
                     ncnst->payload.constant.instruction = quote_helper(a, singleton(uint32_literal(a, subgroups_per_wg)));
@@ -77,14 +101,7 @@ static const Node* process(Context* ctx, const Node* node) {
 static const Node* find_entry_point(Module* m, const CompilerConfig* config) {
     if (!config->specialization.entry_point)
         return NULL;
-    const Node* found = NULL;
-    Nodes old_decls = get_module_declarations(m);
-    for (size_t i = 0; i < old_decls.count; i++) {
-        if (strcmp(get_decl_name(old_decls.nodes[i]), config->specialization.entry_point) == 0) {
-            assert(!found);
-            found = old_decls.nodes[i];
-        }
-    }
+    const Node* found = get_declaration(m, config->specialization.entry_point);
     assert(found);
     return found;
 }
@@ -124,9 +141,12 @@ Module* specialize_entry_point(const CompilerConfig* config, Module* src) {
 
     Context ctx = {
         .rewriter = create_rewriter(src, dst, (RewriteNodeFn) process),
+        .config = config,
     };
 
     const Node* old_entry_point_decl = find_entry_point(src, config);
+    ctx.old_entry_point_decl = old_entry_point_decl;
+    ctx.old_wg_size_annotation = lookup_annotation(old_entry_point_decl, "WorkgroupSize");
     rewrite_node(&ctx.rewriter, old_entry_point_decl);
 
     destroy_rewriter(&ctx.rewriter);
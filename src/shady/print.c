@@ -153,10 +153,10 @@ static void print_basic_block(PrinterCtx* ctx, const Node* bb) {
 
 static void print_dominated_bbs(PrinterCtx* ctx, const CFNode* dominator) {
     assert(dominator);
-    for (size_t i = 0; i < dominator->dominates->elements_count; i++) {
-        const CFNode* cfnode = read_list(const CFNode*, dominator->dominates)[i];
+    for (size_t i = 0; i < dominator->dominates.count; i++) {
+        const CFNode* cfnode = dominator->dominates.nodes[i];
         // ignore cases that make up basic structural dominance
-        if (find_key_dict(const Node*, dominator->structurally_dominates, cfnode->node))
+        if (cfnode_structurally_dominates(dominator, cfnode))
             continue;
         assert(is_basic_block(cfnode->node));
         print_basic_block(ctx, cfnode->node);
@@ -931,11 +931,10 @@ static void print_node_impl(PrinterCtx* ctx, const Node* node) {
 }
 
 static void print_mod_impl(PrinterCtx* ctx, Module* mod) {
-    Nodes decls = get_module_declarations(mod);
-    for (size_t i = 0; i < decls.count; i++) {
-        const Node* decl = decls.nodes[i];
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(mod, &i, &decl))
         print_decl(ctx, decl);
-    }
 }
 
 #undef print_node
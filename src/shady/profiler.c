@@ -0,0 +1,231 @@
+#include "profiler.h"
+#include "ir_private.h"
+
+#include "list.h"
+#include "dict.h"
+#include "portability.h"
+
+#include <assert.h>
+
+typedef struct {
+    size_t runs;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    /// Created by this phase in the module it produced
+    size_t nodes;
+    size_t strings;
+    DictStats dicts;
+} PhaseRecord;
+
+typedef struct {
+    String name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    PhaseRecord phases[ProfiledPhasesCount];
+    /// Bytes allocated in the arena of the resulting module
+    size_t arena_bytes;
+    /// Largest amount of memory reserved by the source and destination arenas while the pass ran
+    size_t peak_arena_bytes;
+} PassRecord;
+
+/// Individual phases make up the nested slices of the trace, verification usually runs twice per pass
+typedef struct {
+    ProfiledPhase phase;
+    size_t pass;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} PhaseEvent;
+
+struct PassProfiler_ {
+    uint64_t epoch_ns;
+    struct List* passes;
+    struct List* events;
+    size_t peak_arena_bytes;
+
+    struct {
+        bool in_pass;
+        bool in_phase;
+        uint64_t wall_ns;
+        uint64_t cpu_ns;
+        IrArena* arena;
+        size_t nodes;
+        size_t strings;
+        DictStats dicts;
+    } current;
+};
+
+static String phase_names[] = { "pass", "cleanup", "verify" };
+
+PassProfiler* new_pass_profiler() {
+    PassProfiler* profiler = calloc(1, sizeof(PassProfiler));
+    profiler->epoch_ns = get_time_nano();
+    profiler->passes = new_list(PassRecord);
+    profiler->events = new_list(PhaseEvent);
+    return profiler;
+}
+
+void destroy_pass_profiler(PassProfiler* profiler) {
+    destroy_list(profiler->passes);
+    destroy_list(profiler->events);
+    free(profiler);
+}
+
+static PassRecord* current_pass(PassProfiler* profiler) {
+    assert(profiler->current.in_pass);
+    return &read_list(PassRecord, profiler->passes)[entries_count_list(profiler->passes) - 1];
+}
+
+static size_t reserved_bytes(IrArena* arena) {
+    return get_arena_stats(arena->arena).reserved;
+}
+
+void profiler_begin_pass(PassProfiler* profiler, String pass_name) {
+    if (!profiler)
+        return;
+    assert(!profiler->current.in_pass);
+    PassRecord record = {
+        .name = pass_name,
+        .start_ns = get_time_nano(),
+    };
+    append_list(PassRecord, profiler->passes, record);
+    profiler->current.in_pass = true;
+}
+
+void profiler_begin_phase(PassProfiler* profiler, ProfiledPhase phase, Module* src) {
+    if (!profiler)
+        return;
+    assert(profiler->current.in_pass && !profiler->current.in_phase && phase < ProfiledPhasesCount);
+    IrArena* arena = get_module_arena(src);
+    profiler->current.in_phase = true;
+    profiler->current.arena = arena;
+    profiler->current.nodes = arena->stats.nodes;
+    profiler->current.strings = arena->stats.strings;
+    profiler->current.dicts = get_dict_stats();
+    profiler->current.cpu_ns = get_cpu_time_nano();
+    profiler->current.wall_ns = get_time_nano();
+}
+
+void profiler_end_phase(PassProfiler* profiler, ProfiledPhase phase, Module* src, Module* dst) {
+    if (!profiler)
+        return;
+    uint64_t wall_end = get_time_nano();
+    uint64_t cpu_end = get_cpu_time_nano();
+    DictStats dicts = get_dict_stats();
+    assert(profiler->current.in_phase && profiler->current.arena == get_module_arena(src));
+    profiler->current.in_phase = false;
+
+    PassRecord* pass = current_pass(profiler);
+    PhaseRecord* record = &pass->phases[phase];
+    record->runs++;
+    record->wall_ns += wall_end - profiler->current.wall_ns;
+    record->cpu_ns += cpu_end - profiler->current.cpu_ns;
+    record->dicts.lookups += dicts.lookups - profiler->current.dicts.lookups;
+    record->dicts.probes += dicts.probes - profiler->current.dicts.probes;
+    record->dicts.resizes += dicts.resizes - profiler->current.dicts.resizes;
+
+    IrArena* src_arena = get_module_arena(src);
+    IrArena* dst_arena = get_module_arena(dst);
+    // most passes build a fresh arena, but some work in place
+    if (src_arena == dst_arena) {
+        record->nodes += dst_arena->stats.nodes - profiler->current.nodes;
+        record->strings += dst_arena->stats.strings - profiler->current.strings;
+    } else {
+        record->nodes += dst_arena->stats.nodes;
+        record->strings += dst_arena->stats.strings;
+    }
+
+    // both arenas are alive at this point, this is as big as it gets
+    size_t resident = reserved_bytes(src_arena);
+    if (dst_arena != src_arena)
+        resident += reserved_bytes(dst_arena);
+    if (resident > pass->peak_arena_bytes)
+        pass->peak_arena_bytes = resident;
+    if (resident > profiler->peak_arena_bytes)
+        profiler->peak_arena_bytes = resident;
+
+    PhaseEvent event = {
+        .phase = phase,
+        .pass = entries_count_list(profiler->passes) - 1,
+        .start_ns = profiler->current.wall_ns,
+        .end_ns = wall_end,
+    };
+    append_list(PhaseEvent, profiler->events, event);
+}
+
+void profiler_end_pass(PassProfiler* profiler, Module* result) {
+    if (!profiler)
+        return;
+    PassRecord* pass = current_pass(profiler);
+    pass->end_ns = get_time_nano();
+    pass->arena_bytes = get_arena_stats(get_module_arena(result)->arena).used;
+    profiler->current.in_pass = false;
+}
+
+static double to_ms(uint64_t ns) {
+    return (double) ns / 1000000.0;
+}
+
+static double to_trace_us(const PassProfiler* profiler, uint64_t ns) {
+    return (double) (ns - profiler->epoch_ns) / 1000.0;
+}
+
+static void dump_phase(FILE* output, const PhaseRecord* phase) {
+    fprintf(output, "{ \"runs\": %zu, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"nodes\": %zu, \"strings\": %zu, \"dict_lookups\": %zu, \"dict_probes\": %zu, \"dict_resizes\": %zu }",
+            phase->runs, to_ms(phase->wall_ns), to_ms(phase->cpu_ns), phase->nodes, phase->strings, phase->dicts.lookups, phase->dicts.probes, phase->dicts.resizes);
+}
+
+void dump_pass_profile(FILE* output, const PassProfiler* profiler) {
+    size_t passes_count = entries_count_list(profiler->passes);
+    const PassRecord* passes = read_list(const PassRecord, profiler->passes);
+    size_t events_count = entries_count_list(profiler->events);
+    const PhaseEvent* events = read_list(const PhaseEvent, profiler->events);
+
+    PhaseRecord totals[ProfiledPhasesCount] = { 0 };
+    uint64_t total_wall_ns = 0;
+
+    fprintf(output, "{\n  \"passes\": [\n");
+    for (size_t i = 0; i < passes_count; i++) {
+        const PassRecord* pass = &passes[i];
+        fprintf(output, "    { \"name\": \"%s\", \"wall_ms\": %.3f, \"arena_bytes\": %zu, \"peak_arena_bytes\": %zu", pass->name, to_ms(pass->end_ns - pass->start_ns), pass->arena_bytes, pass->peak_arena_bytes);
+        for (ProfiledPhase p = 0; p < ProfiledPhasesCount; p++) {
+            const PhaseRecord* phase = &pass->phases[p];
+            fprintf(output, ",\n      \"%s\": ", phase_names[p]);
+            dump_phase(output, phase);
+            totals[p].runs += phase->runs;
+            totals[p].wall_ns += phase->wall_ns;
+            totals[p].cpu_ns += phase->cpu_ns;
+            totals[p].nodes += phase->nodes;
+            totals[p].strings += phase->strings;
+            totals[p].dicts.lookups += phase->dicts.lookups;
+            totals[p].dicts.probes += phase->dicts.probes;
+            totals[p].dicts.resizes += phase->dicts.resizes;
+        }
+        total_wall_ns += pass->end_ns - pass->start_ns;
+        fprintf(output, " }%s\n", i + 1 < passes_count ? "," : "");
+    }
+    fprintf(output, "  ],\n");
+
+    fprintf(output, "  \"totals\": { \"passes\": %zu, \"wall_ms\": %.3f, \"peak_arena_bytes\": %zu", passes_count, to_ms(total_wall_ns), profiler->peak_arena_bytes);
+    for (ProfiledPhase p = 0; p < ProfiledPhasesCount; p++) {
+        fprintf(output, ",\n    \"%s\": ", phase_names[p]);
+        dump_phase(output, &totals[p]);
+    }
+    fprintf(output, " },\n");
+
+    // Trace Event Format: complete ("X") events with microsecond timestamps, phases nest inside their pass since they share a thread
+    fprintf(output, "  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [");
+    const char* separator = "\n";
+    for (size_t i = 0; i < passes_count; i++) {
+        const PassRecord* pass = &passes[i];
+        fprintf(output, "%s    { \"name\": \"%s\", \"cat\": \"pass\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, \"args\": { \"nodes\": %zu, \"arena_bytes\": %zu, \"peak_arena_bytes\": %zu } }",
+                separator, pass->name, to_trace_us(profiler, pass->start_ns), (double) (pass->end_ns - pass->start_ns) / 1000.0, pass->phases[ProfiledPass].nodes, pass->arena_bytes, pass->peak_arena_bytes);
+        separator = ",\n";
+    }
+    for (size_t i = 0; i < events_count; i++) {
+        const PhaseEvent* event = &events[i];
+        fprintf(output, "%s    { \"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f }",
+                separator, phase_names[event->phase], passes[event->pass].name, to_trace_us(profiler, event->start_ns), (double) (event->end_ns - event->start_ns) / 1000.0);
+        separator = ",\n";
+    }
+    fprintf(output, "\n  ]\n}\n");
+}
@@ -0,0 +1,22 @@
+#ifndef SHADY_PROFILER_H
+#define SHADY_PROFILER_H
+
+#include "shady/ir.h"
+
+/// What RUN_PASS spends its time on, the pass itself, the optional cleanup after it, and verification
+typedef enum {
+    ProfiledPass,
+    ProfiledCleanup,
+    ProfiledVerify,
+    ProfiledPhasesCount
+} ProfiledPhase;
+
+/// All of these accept a NULL profiler, in which case they do nothing
+
+void profiler_begin_pass(PassProfiler*, String pass_name);
+/// 'src' is the module the phase starts from, it is needed to tell apart nodes created by the phase from existing ones
+void profiler_begin_phase(PassProfiler*, ProfiledPhase, Module* src);
+void profiler_end_phase(PassProfiler*, ProfiledPhase, Module* src, Module* dst);
+void profiler_end_pass(PassProfiler*, Module* result);
+
+#endif
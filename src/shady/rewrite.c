@@ -70,10 +70,11 @@ const Node* rewrite_node_with_fn(Rewriter* rewriter, const Node* node, RewriteNo
 }
 
 Nodes rewrite_nodes_with_fn(Rewriter* rewriter, Nodes values, RewriteNodeFn fn) {
-    LARRAY(const Node*, arr, values.count);
+    NodesBuilder builder = begin_nodes(rewriter->dst_arena);
+    reserve_nodes(&builder, values.count);
     for (size_t i = 0; i < values.count; i++)
-        arr[i] = rewrite_node_with_fn(rewriter, values.nodes[i], fn);
-    return nodes(rewriter->dst_arena, values.count, arr);
+        push_node(&builder, rewrite_node_with_fn(rewriter, values.nodes[i], fn));
+    return finish_nodes(&builder);
 }
 
 const Node* rewrite_node(Rewriter* rewriter, const Node* node) {
@@ -190,10 +191,11 @@ bool compare_node(Node**, Node**);
 #include "rewrite_generated.c"
 
 void rewrite_module(Rewriter* rewriter) {
-    Nodes old_decls = get_module_declarations(rewriter->src_module);
-    for (size_t i = 0; i < old_decls.count; i++) {
-        if (old_decls.nodes[i]->tag == NominalType_TAG) continue;
-        rewrite_op_helper(rewriter, NcDeclaration, "decl", old_decls.nodes[i]);
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(rewriter->src_module, &i, &decl)) {
+        if (decl->tag == NominalType_TAG) continue;
+        rewrite_op_helper(rewriter, NcDeclaration, "decl", decl);
     }
 }
 
@@ -0,0 +1,624 @@
+#include "ir_private.h"
+
+#include "log.h"
+#include "list.h"
+#include "dict.h"
+#include "growy.h"
+#include "portability.h"
+
+#include <string.h>
+#include <assert.h>
+#include <setjmp.h>
+
+/// Layout of a serialized module, every section is made of 32-bit words (except for the string data) so the whole
+/// file can be used in place once it's mapped in memory:
+///
+/// - the header
+/// - the string table: one offset per string into the string data, then the NUL-terminated strings themselves
+/// - the records: each one starts with a node tag and has a layout specific to that tag. Records only ever refer to
+///   strings, and to nodes and lists created by earlier records, by their index, so they can be replayed in a single
+///   pass. Nominal nodes can't wait for their bodies (those are cyclic), they are created as soon as their header is
+///   complete and their body comes in a later record, flagged with SERIALIZED_BODY_RECORD.
+///   Lists of nodes are interned, each one is written once in a SERIALIZED_LIST_RECORD and then used by index.
+/// - the declarations, in module order
+///
+/// Records store what the constructors need and not more: types and hashes are recomputed when loading.
+#define SERIALIZED_MAGIC 0x42444853u
+/// Bump this whenever the layout of the records changes (the grammar itself is covered by SERIALIZED_GRAMMAR_HASH)
+#define SERIALIZED_VERSION 1
+#define SERIALIZED_NULL UINT32_MAX
+#define SERIALIZED_BODY_RECORD 0x80000000u
+#define SERIALIZED_LIST_RECORD 0x40000000u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t grammar;
+    uint32_t strings_count;
+    /// In bytes, padded to a whole number of words
+    uint32_t strings_size;
+    uint32_t nodes_count;
+    uint32_t lists_count;
+    /// In words
+    uint32_t records_size;
+    uint32_t decls_count;
+    uint32_t padding;
+    /// Of everything after the header
+    uint64_t checksum[2];
+} SerializedHeader;
+
+static_assert(sizeof(SerializedHeader) == 56, "the header should not have any implicit padding");
+
+typedef struct {
+    Growy* records;
+    uint32_t nodes_count;
+    /// const Node* -> uint32_t
+    struct Dict* node_ids;
+    uint32_t lists_count;
+    /// Nodes -> uint32_t
+    struct Dict* list_ids;
+    /// String -> uint32_t, not all strings in payloads are interned so those are compared by contents
+    struct Dict* string_ids;
+    Growy* string_offsets;
+    Growy* string_data;
+    uint32_t strings_count;
+    /// Nominal nodes whose body has yet to be written
+    struct List* pending;
+} Serializer;
+
+static KeyHash hash_ptr(void** p) {
+    return hash_murmur(p, sizeof(void*));
+}
+
+static bool compare_ptr(void** a, void** b) {
+    return *a == *b;
+}
+
+/// Lists are interned, the array is enough to identify them
+static KeyHash hash_list(Nodes* l) {
+    return hash_murmur(&l->nodes, sizeof(l->nodes)) ^ (KeyHash) l->count;
+}
+
+static bool compare_list(Nodes* a, Nodes* b) {
+    return a->nodes == b->nodes && a->count == b->count;
+}
+
+static KeyHash hash_string_contents(String* s) {
+    return hash_murmur(*s, strlen(*s));
+}
+
+static bool compare_string_contents(String* a, String* b) {
+    return strcmp(*a, *b) == 0;
+}
+
+static void write_word(Serializer* s, uint32_t word) {
+    growy_append_object(s->records, word);
+}
+
+static void write_double_word(Serializer* s, uint64_t dword) {
+    write_word(s, (uint32_t) dword);
+    write_word(s, (uint32_t) (dword >> 32));
+}
+
+static void write_string(Serializer* s, String str) {
+    if (!str) {
+        write_word(s, SERIALIZED_NULL);
+        return;
+    }
+    uint32_t* found = find_value_dict(String, uint32_t, s->string_ids, str);
+    if (found) {
+        write_word(s, *found);
+        return;
+    }
+    uint32_t id = s->strings_count++;
+    uint32_t offset = (uint32_t) growy_size(s->string_data);
+    growy_append_object(s->string_offsets, offset);
+    growy_append_bytes(s->string_data, strlen(str) + 1, str);
+    insert_dict(String, uint32_t, s->string_ids, str, id);
+    write_word(s, id);
+}
+
+static void write_strings(Serializer* s, Strings strs) {
+    write_word(s, (uint32_t) strs.count);
+    for (size_t i = 0; i < strs.count; i++)
+        write_string(s, strs.strings[i]);
+}
+
+static uint32_t get_node_id(Serializer* s, const Node* node) {
+    if (!node)
+        return SERIALIZED_NULL;
+    uint32_t* found = find_value_dict(const Node*, uint32_t, s->node_ids, node);
+    assert(found && *found != SERIALIZED_NULL && "operands are written before the nodes that use them");
+    return *found;
+}
+
+static void write_node(Serializer* s, const Node* node) {
+    write_word(s, get_node_id(s, node));
+}
+
+static void write_nodes(Serializer* s, Nodes nodes) {
+    uint32_t* found = find_value_dict(Nodes, uint32_t, s->list_ids, nodes);
+    assert(found && "lists are written before the nodes that use them");
+    write_word(s, *found);
+}
+
+typedef struct {
+    IrArena* arena;
+    Module* module;
+    const uint32_t* records;
+    size_t records_size;
+    size_t cursor;
+    String* strings;
+    uint32_t strings_count;
+    const Node** nodes;
+    uint32_t nodes_count;
+    uint32_t nodes_read;
+    Nodes* lists;
+    uint32_t lists_count;
+    uint32_t lists_read;
+    /// Malformed records abandon the whole load
+    jmp_buf bail;
+} Deserializer;
+
+#define corrupted(d, ...) { error_print("Serialized module: " __VA_ARGS__); error_print("\n"); longjmp((d)->bail, 1); }
+
+static uint32_t read_word(Deserializer* d) {
+    if (d->cursor >= d->records_size)
+        corrupted(d, "truncated record");
+    return d->records[d->cursor++];
+}
+
+static uint64_t read_double_word(Deserializer* d) {
+    uint64_t lo = read_word(d);
+    uint64_t hi = read_word(d);
+    return lo | (hi << 32);
+}
+
+static String read_string(Deserializer* d) {
+    uint32_t id = read_word(d);
+    if (id == SERIALIZED_NULL)
+        return NULL;
+    if (id >= d->strings_count)
+        corrupted(d, "string %u is out of bounds", id);
+    return d->strings[id];
+}
+
+static Strings read_strings(Deserializer* d) {
+    uint32_t count = read_word(d);
+    if (count > d->records_size - d->cursor)
+        corrupted(d, "truncated record");
+    LARRAY(String, strs, count);
+    for (size_t i = 0; i < count; i++)
+        strs[i] = read_string(d);
+    return strings(d->arena, count, strs);
+}
+
+static const Node* read_node(Deserializer* d) {
+    uint32_t id = read_word(d);
+    if (id == SERIALIZED_NULL)
+        return NULL;
+    if (id >= d->nodes_read)
+        corrupted(d, "node %u is used before being defined", id);
+    return d->nodes[id];
+}
+
+static Nodes read_nodes(Deserializer* d) {
+    uint32_t id = read_word(d);
+    if (id >= d->lists_read)
+        corrupted(d, "list %u is used before being defined", id);
+    return d->lists[id];
+}
+
+static void read_list_record(Deserializer* d) {
+    uint32_t count = read_word(d);
+    if (count > d->records_size - d->cursor)
+        corrupted(d, "truncated record");
+    LARRAY(const Node*, ns, count);
+    for (size_t i = 0; i < count; i++)
+        ns[i] = read_node(d);
+    if (d->lists_read >= d->lists_count)
+        corrupted(d, "more lists than announced");
+    d->lists[d->lists_read++] = nodes(d->arena, count, ns);
+}
+
+static void emit_node(Serializer* s, const Node* node);
+static void emit_nodes(Serializer* s, Nodes nodes);
+
+#include "serialize_generated.c"
+
+static void emit_nodes(Serializer* s, Nodes nodes) {
+    if (find_value_dict(Nodes, uint32_t, s->list_ids, nodes))
+        return;
+    for (size_t i = 0; i < nodes.count; i++)
+        emit_node(s, nodes.nodes[i]);
+    write_word(s, SERIALIZED_LIST_RECORD);
+    write_word(s, (uint32_t) nodes.count);
+    for (size_t i = 0; i < nodes.count; i++)
+        write_node(s, nodes.nodes[i]);
+    uint32_t id = s->lists_count++;
+    insert_dict(Nodes, uint32_t, s->list_ids, nodes, id);
+}
+
+static void emit_header_record(Serializer* s, const Node* node) {
+    write_word(s, node->tag);
+    switch (node->tag) {
+        case Function_TAG:
+            write_string(s, node->payload.fun.name);
+            write_nodes(s, node->payload.fun.annotations);
+            write_nodes(s, node->payload.fun.params);
+            write_nodes(s, node->payload.fun.return_types);
+            break;
+        case Constant_TAG:
+            write_string(s, node->payload.constant.name);
+            write_nodes(s, node->payload.constant.annotations);
+            write_node(s, node->payload.constant.type_hint);
+            break;
+        case GlobalVariable_TAG:
+            write_string(s, node->payload.global_variable.name);
+            write_nodes(s, node->payload.global_variable.annotations);
+            write_node(s, node->payload.global_variable.type);
+            write_word(s, node->payload.global_variable.address_space);
+            break;
+        case NominalType_TAG:
+            write_string(s, node->payload.nom_type.name);
+            write_nodes(s, node->payload.nom_type.annotations);
+            break;
+        case BasicBlock_TAG:
+            write_node(s, node->payload.basic_block.fn);
+            write_nodes(s, node->payload.basic_block.params);
+            write_string(s, node->payload.basic_block.name);
+            break;
+        default: SHADY_UNREACHABLE;
+    }
+}
+
+static const Node* get_nominal_body(const Node* node) {
+    switch (node->tag) {
+        case Function_TAG: return node->payload.fun.body;
+        case Constant_TAG: return node->payload.constant.instruction;
+        case GlobalVariable_TAG: return node->payload.global_variable.init;
+        case NominalType_TAG: return node->payload.nom_type.body;
+        case BasicBlock_TAG: return node->payload.basic_block.body;
+        default: SHADY_UNREACHABLE;
+    }
+}
+
+/// Gives the next index to the node whose record was just written
+static void define_node(Serializer* s, const Node* node) {
+    uint32_t id = s->nodes_count++;
+    uint32_t* found = find_value_dict(const Node*, uint32_t, s->node_ids, node);
+    if (found)
+        *found = id;
+    else
+        insert_dict(const Node*, uint32_t, s->node_ids, node, id);
+}
+
+static void emit_body_record(Serializer* s, const Node* node) {
+    const Node* body = get_nominal_body(node);
+    emit_node(s, body);
+    write_word(s, node->tag | SERIALIZED_BODY_RECORD);
+    write_node(s, node);
+    write_node(s, body);
+}
+
+static void emit_node(Serializer* s, const Node* node) {
+    if (!node)
+        return;
+    uint32_t* found = find_value_dict(const Node*, uint32_t, s->node_ids, node);
+    if (found) {
+        if (*found == SERIALIZED_NULL)
+            error("The headers of nominal nodes refer to each other, they can't be serialized");
+        return;
+    }
+
+    switch (node->tag) {
+        case Variable_TAG:
+            emit_node(s, node->payload.var.type);
+            write_word(s, node->tag);
+            write_node(s, node->payload.var.type);
+            write_string(s, node->payload.var.name);
+            break;
+        case Let_TAG:
+        case LetMut_TAG:
+            // let and let_mut have the same layout
+            emit_node(s, node->payload.let.instruction);
+            emit_node(s, node->payload.let.tail);
+            write_word(s, node->tag);
+            write_node(s, node->payload.let.instruction);
+            write_node(s, node->payload.let.tail);
+            break;
+        case Case_TAG:
+            emit_nodes(s, node->payload.case_.params);
+            emit_node(s, node->payload.case_.body);
+            write_word(s, node->tag);
+            write_nodes(s, node->payload.case_.params);
+            write_node(s, node->payload.case_.body);
+            break;
+        case Function_TAG:
+        case Constant_TAG:
+        case GlobalVariable_TAG:
+        case NominalType_TAG:
+        case BasicBlock_TAG: {
+            uint32_t in_progress = SERIALIZED_NULL;
+            insert_dict(const Node*, uint32_t, s->node_ids, node, in_progress);
+            switch (node->tag) {
+                case Function_TAG:
+                    emit_nodes(s, node->payload.fun.annotations);
+                    emit_nodes(s, node->payload.fun.params);
+                    emit_nodes(s, node->payload.fun.return_types);
+                    break;
+                case Constant_TAG:
+                    emit_nodes(s, node->payload.constant.annotations);
+                    emit_node(s, node->payload.constant.type_hint);
+                    break;
+                case GlobalVariable_TAG:
+                    emit_nodes(s, node->payload.global_variable.annotations);
+                    emit_node(s, node->payload.global_variable.type);
+                    break;
+                case NominalType_TAG:
+                    emit_nodes(s, node->payload.nom_type.annotations);
+                    break;
+                default:
+                    emit_node(s, node->payload.basic_block.fn);
+                    emit_nodes(s, node->payload.basic_block.params);
+                    break;
+            }
+            emit_header_record(s, node);
+            define_node(s, node);
+            // type checking looks through nominal types, and the values of constants and globals, so those need to be
+            // complete before anyone uses them. Only the bodies of functions and basic blocks can wait.
+            if (node->tag == Function_TAG || node->tag == BasicBlock_TAG)
+                append_list(const Node*, s->pending, node);
+            else
+                emit_body_record(s, node);
+            return;
+        }
+        default:
+            emit_operands_generated(s, node);
+            write_word(s, node->tag);
+            write_payload_generated(s, node);
+            break;
+    }
+    define_node(s, node);
+}
+
+/// Bodies can refer to more nominal nodes (basic blocks, other functions...), which get queued in turn
+static void emit_pending_bodies(Serializer* s) {
+    for (size_t i = 0; i < entries_count_list(s->pending); i++)
+        emit_body_record(s, read_list(const Node*, s->pending)[i]);
+}
+
+void serialize_module(Module* mod, size_t* size, char** output) {
+    Serializer s = {
+        .records = new_growy(),
+        .node_ids = new_dict(const Node*, uint32_t, (HashFn) hash_ptr, (CmpFn) compare_ptr),
+        .list_ids = new_dict(Nodes, uint32_t, (HashFn) hash_list, (CmpFn) compare_list),
+        .string_ids = new_dict(String, uint32_t, (HashFn) hash_string_contents, (CmpFn) compare_string_contents),
+        .string_offsets = new_growy(),
+        .string_data = new_growy(),
+        .pending = new_list(const Node*),
+    };
+
+    Nodes decls = get_module_declarations(mod);
+    for (size_t i = 0; i < decls.count; i++)
+        emit_node(&s, decls.nodes[i]);
+    emit_pending_bodies(&s);
+
+    while (growy_size(s.string_data) % sizeof(uint32_t) != 0)
+        growy_append_bytes(s.string_data, 1, (char[]) { 0 });
+
+    Growy* g = new_growy();
+    SerializedHeader header = {
+        .magic = SERIALIZED_MAGIC,
+        .version = SERIALIZED_VERSION,
+        .grammar = SERIALIZED_GRAMMAR_HASH,
+        .strings_count = s.strings_count,
+        .strings_size = (uint32_t) growy_size(s.string_data),
+        .nodes_count = s.nodes_count,
+        .lists_count = s.lists_count,
+        .records_size = (uint32_t) (growy_size(s.records) / sizeof(uint32_t)),
+        .decls_count = (uint32_t) decls.count,
+    };
+    growy_append_object(g, header);
+    growy_append_bytes(g, growy_size(s.string_offsets), growy_data(s.string_offsets));
+    growy_append_bytes(g, growy_size(s.string_data), growy_data(s.string_data));
+    growy_append_bytes(g, growy_size(s.records), growy_data(s.records));
+    for (size_t i = 0; i < decls.count; i++) {
+        uint32_t id = get_node_id(&s, decls.nodes[i]);
+        growy_append_object(g, id);
+    }
+
+    *size = growy_size(g);
+    *output = growy_deconstruct(g);
+    hash_murmur_128(*output + sizeof(SerializedHeader), *size - sizeof(SerializedHeader), ((SerializedHeader*) *output)->checksum);
+
+    destroy_growy(s.records);
+    destroy_dict(s.node_ids);
+    destroy_dict(s.list_ids);
+    destroy_dict(s.string_ids);
+    destroy_growy(s.string_offsets);
+    destroy_growy(s.string_data);
+    destroy_list(s.pending);
+}
+
+static const Node* read_record(Deserializer* d, NodeTag tag) {
+    switch (tag) {
+        case Variable_TAG: {
+            const Type* type = read_node(d);
+            String name = read_string(d);
+            return var(d->arena, type, name);
+        }
+        case Let_TAG:
+        case LetMut_TAG: {
+            const Node* instruction = read_node(d);
+            const Node* tail = read_node(d);
+            return tag == Let_TAG ? let(d->arena, instruction, tail) : let_mut(d->arena, instruction, tail);
+        }
+        case Case_TAG: {
+            Nodes params = read_nodes(d);
+            const Node* body = read_node(d);
+            return case_(d->arena, params, body);
+        }
+        case Function_TAG: {
+            String name = read_string(d);
+            Nodes annotations = read_nodes(d);
+            Nodes params = read_nodes(d);
+            Nodes return_types = read_nodes(d);
+            return function(d->module, params, name, annotations, return_types);
+        }
+        case Constant_TAG: {
+            String name = read_string(d);
+            Nodes annotations = read_nodes(d);
+            const Type* type_hint = read_node(d);
+            return constant(d->module, annotations, type_hint, name);
+        }
+        case GlobalVariable_TAG: {
+            String name = read_string(d);
+            Nodes annotations = read_nodes(d);
+            const Type* type = read_node(d);
+            AddressSpace as = (AddressSpace) read_word(d);
+            return global_var(d->module, annotations, type, name, as);
+        }
+        case NominalType_TAG: {
+            String name = read_string(d);
+            Nodes annotations = read_nodes(d);
+            return nominal_type(d->module, annotations, name);
+        }
+        case BasicBlock_TAG: {
+            const Node* fn = read_node(d);
+            Nodes params = read_nodes(d);
+            String name = read_string(d);
+            if (!fn || fn->tag != Function_TAG)
+                corrupted(d, "basic blocks belong to functions");
+            return basic_block(d->arena, (Node*) fn, params, name);
+        }
+        default: {
+            const Node* node = read_payload_generated(d, tag);
+            if (!node)
+                corrupted(d, "unknown node tag %u", (unsigned) tag);
+            return node;
+        }
+    }
+}
+
+static void read_body_record(Deserializer* d, NodeTag tag) {
+    Node* node = (Node*) read_node(d);
+    const Node* body = read_node(d);
+    if (!node || node->tag != tag)
+        corrupted(d, "body record for the wrong node");
+    switch (tag) {
+        case Function_TAG: node->payload.fun.body = body; break;
+        case Constant_TAG: node->payload.constant.instruction = body; break;
+        case GlobalVariable_TAG: node->payload.global_variable.init = body; break;
+        case NominalType_TAG: node->payload.nom_type.body = body; break;
+        case BasicBlock_TAG: node->payload.basic_block.body = body; break;
+        default: corrupted(d, "only nominal nodes have body records");
+    }
+}
+
+bool deserialize_module(Module* mod, size_t size, const char* data) {
+    SerializedHeader header;
+    if (size < sizeof(header)) {
+        error_print("Serialized module: file is too small\n");
+        return false;
+    }
+    // the header is the only part we copy out, in case the data isn't aligned on words
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != SERIALIZED_MAGIC) {
+        error_print("Serialized module: bad magic number\n");
+        return false;
+    }
+    if (header.version != SERIALIZED_VERSION || header.grammar != SERIALIZED_GRAMMAR_HASH) {
+        error_print("Serialized module: written by an incompatible version of shady\n");
+        return false;
+    }
+    uint64_t expected_size = sizeof(header) + (uint64_t) header.strings_count * 4 + header.strings_size + (uint64_t) header.records_size * 4 + (uint64_t) header.decls_count * 4;
+    if (size != expected_size || header.strings_size % 4 != 0) {
+        error_print("Serialized module: file size does not match the header\n");
+        return false;
+    }
+    uint64_t checksum[2];
+    hash_murmur_128(data + sizeof(header), size - sizeof(header), checksum);
+    if (checksum[0] != header.checksum[0] || checksum[1] != header.checksum[1]) {
+        error_print("Serialized module: checksum mismatch, the file is corrupted\n");
+        return false;
+    }
+    if ((size_t) data % sizeof(uint32_t) != 0) {
+        error_print("Serialized module: data needs to be aligned on 4 bytes\n");
+        return false;
+    }
+
+    const uint32_t* string_offsets = (const uint32_t*) (data + sizeof(header));
+    const char* string_data = (const char*) (string_offsets + header.strings_count);
+    const uint32_t* records = (const uint32_t*) (string_data + header.strings_size);
+    const uint32_t* decls = records + header.records_size;
+    if (header.strings_count > 0 && (header.strings_size == 0 || string_data[header.strings_size - 1] != '\0')) {
+        error_print("Serialized module: unterminated string table\n");
+        return false;
+    }
+
+    IrArena* arena = get_module_arena(mod);
+    Deserializer d = {
+        .arena = arena,
+        .module = mod,
+        .records = records,
+        .records_size = header.records_size,
+        .strings = malloc(sizeof(String) * header.strings_count),
+        .strings_count = header.strings_count,
+        .nodes = malloc(sizeof(const Node*) * header.nodes_count),
+        .nodes_count = header.nodes_count,
+        .lists = malloc(sizeof(Nodes) * header.lists_count),
+        .lists_count = header.lists_count,
+    };
+
+    size_t first_decl = entries_count_list(mod->decls);
+    if (setjmp(d.bail)) {
+        // the nodes read so far stay in the arena, but the module doesn't get any of its declarations
+        while (entries_count_list(mod->decls) > first_decl) {
+            Node* decl = pop_last_list(Node*, mod->decls);
+            String name = get_decl_name(decl);
+            remove_dict(String, mod->decls_by_name, name);
+        }
+        free(d.strings);
+        free(d.nodes);
+        free(d.lists);
+        return false;
+    }
+
+    reserve_ir_arena(arena, header.nodes_count, header.lists_count, header.strings_count);
+    for (size_t i = 0; i < header.strings_count; i++) {
+        if (string_offsets[i] >= header.strings_size)
+            corrupted(&d, "string %zu is out of bounds", i);
+        d.strings[i] = string(arena, string_data + string_offsets[i]);
+    }
+
+    while (d.cursor < d.records_size) {
+        uint32_t head = read_word(&d);
+        if (head & SERIALIZED_BODY_RECORD) {
+            read_body_record(&d, head & ~SERIALIZED_BODY_RECORD);
+            continue;
+        }
+        if (head == SERIALIZED_LIST_RECORD) {
+            read_list_record(&d);
+            continue;
+        }
+        if (d.nodes_read >= d.nodes_count)
+            corrupted(&d, "more nodes than announced");
+        d.nodes[d.nodes_read++] = read_record(&d, head);
+    }
+
+    // declarations get registered as their header is read, put them back in their original order
+    if (entries_count_list(mod->decls) - first_decl == header.decls_count) {
+        Node** module_decls = read_list(Node*, mod->decls) + first_decl;
+        for (size_t i = 0; i < header.decls_count; i++) {
+            if (decls[i] >= d.nodes_read || !is_declaration(d.nodes[decls[i]]))
+                corrupted(&d, "bad declaration table");
+            module_decls[i] = (Node*) d.nodes[decls[i]];
+        }
+    }
+
+    free(d.strings);
+    free(d.nodes);
+    free(d.lists);
+    return true;
+}
@@ -106,9 +106,9 @@ void gen_comment(BodyBuilder* bb, String str) {
 }
 
 const Node* get_builtin(Module* m, Builtin b, String n) {
-    Nodes decls = get_module_declarations(m);
-    for (size_t i = 0; i < decls.count; i++) {
-        const Node* decl = decls.nodes[i];
+    size_t i = 0;
+    const Node* decl;
+    while (module_decls_iter(m, &i, &decl)) {
         if (decl->tag != GlobalVariable_TAG)
             continue;
         const Node* a = lookup_annotation(decl, "Builtin");
@@ -122,8 +122,7 @@ const Node* get_builtin(Module* m, Builtin b, String n) {
 
     AddressSpace as = get_builtin_as(b);
     IrArena* a = get_module_arena(m);
-    Node* decl = global_var(m, singleton(annotation_value_helper(a, "Builtin", string_lit_helper(a, get_builtin_name(b)))), get_builtin_type(a, b), n ? n : format_string_arena(a->arena, "builtin_%s", get_builtin_name(b)), as);
-    return decl;
+    return global_var(m, singleton(annotation_value_helper(a, "Builtin", string_lit_helper(a, get_builtin_name(b)))), get_builtin_type(a, b), n ? n : format_string_arena(a->arena, "builtin_%s", get_builtin_name(b)), as);
 }
 
 const Node* gen_builtin_load(Module* m, BodyBuilder* bb, Builtin b) {
@@ -153,14 +152,9 @@ bool is_builtin_load_op(const Node* n, Builtin* out) {
 }
 
 const Node* find_or_process_decl(Rewriter* rewriter, const char* name) {
-    Nodes old_decls = get_module_declarations(rewriter->src_module);
-    for (size_t i = 0; i < old_decls.count; i++) {
-        const Node* decl = old_decls.nodes[i];
-        if (strcmp(get_decl_name(decl), name) == 0) {
-            return rewrite_node(rewriter, decl);
-        }
-    }
-    assert(false);
+    const Node* decl = get_declaration(rewriter->src_module, name);
+    assert(decl);
+    return rewrite_node(rewriter, decl);
 }
 
 const Node* access_decl(Rewriter* rewriter, const char* name) {
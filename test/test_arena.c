@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "log.h"
+#include "arena.h"
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+#define MiB (1024 * 1024)
+
+static void fill(unsigned char* p, size_t size, unsigned char value) {
+    memset(p, value, size);
+}
+
+static bool check_filled(unsigned char* p, size_t size, unsigned char value) {
+    for (size_t i = 0; i < size; i++)
+        if (p[i] != value)
+            return false;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    set_log_level(INFO);
+    Arena* a = new_arena();
+
+    // allocations are zeroed and aligned for whatever fits in them
+    for (size_t size = 1; size < 4096; size = size * 3 + 1) {
+        unsigned char* p = arena_alloc(a, size);
+        CHECK(check_filled(p, size, 0), exit(-1));
+        size_t alignment = size & (~size + 1);
+        CHECK((size_t) p % (alignment < _Alignof(max_align_t) ? alignment : _Alignof(max_align_t)) == 0, exit(-1));
+        fill(p, size, 0xFF);
+    }
+
+    // allocations way larger than a block used to trip an assertion
+    unsigned char* big = arena_alloc(a, 64 * MiB);
+    CHECK(big && check_filled(big, 64 * MiB, 0), exit(-1));
+    fill(big, 64 * MiB, 0xAB);
+    ArenaStats stats = get_arena_stats(a);
+    CHECK(stats.oversized_allocations == 1, exit(-1));
+    CHECK(stats.used >= 64 * MiB && stats.reserved >= stats.used, exit(-1));
+
+    // lots of small allocations need many blocks, which grow geometrically
+    unsigned char* first_small = arena_alloc(a, 24);
+    fill(first_small, 24, 0x42);
+    ArenaMark mark = arena_mark(a);
+    size_t before_blocks = get_arena_stats(a).blocks;
+    for (size_t i = 0; i < 100000; i++) {
+        uint64_t* p = arena_alloc_uninitialized(a, sizeof(uint64_t) * 4);
+        p[0] = i;
+    }
+    arena_alloc(a, 32 * MiB);
+    stats = get_arena_stats(a);
+    CHECK(stats.blocks > before_blocks && stats.blocks < before_blocks + 16, exit(-1));
+    CHECK(stats.oversized_allocations == 2, exit(-1));
+    info_print("used: %zu, reserved: %zu, wasted: %zu, blocks: %zu\n", stats.used, stats.reserved, stats.wasted, stats.blocks);
+
+    // rewinding releases all of it at once, but keeps what was allocated before the mark
+    arena_rewind(a, mark);
+    ArenaStats rewound = get_arena_stats(a);
+    CHECK(rewound.oversized_allocations == 1, exit(-1));
+    CHECK(rewound.used < stats.used - 32 * MiB, exit(-1));
+    CHECK(check_filled(first_small, 24, 0x42), exit(-1));
+    CHECK(check_filled(big, 64 * MiB, 0xAB), exit(-1));
+
+    // the spare blocks get reused, and handing out the same memory again zeroes it
+    for (size_t i = 0; i < 100000; i++) {
+        uint64_t* p = arena_alloc(a, sizeof(uint64_t) * 4);
+        CHECK(p[0] == 0, exit(-1));
+    }
+    CHECK(get_arena_stats(a).reserved == rewound.reserved, exit(-1));
+
+    CHECK(arena_alloc(a, 0) == NULL, exit(-1));
+    destroy_arena(a);
+    return 0;
+}
@@ -0,0 +1,9 @@
+# Compiles the same file twice with an empty cache directory: the second run has to produce the exact same output from the cache
+set(CACHE_DIR ${DST}/test_cache)
+file(REMOVE_RECURSE ${CACHE_DIR})
+execute_process(COMMAND ${COMPILER} ${SRC}/${T} ${TARGS} --cache-dir ${CACHE_DIR} -o ${DST}/test_cache_cold.spv COMMAND_ERROR_IS_FATAL ANY)
+execute_process(COMMAND ${COMPILER} ${SRC}/${T} ${TARGS} --cache-dir ${CACHE_DIR} -o ${DST}/test_cache_warm.spv COMMAND_ERROR_IS_FATAL ANY ERROR_VARIABLE WARM_LOG)
+if (NOT WARM_LOG MATCHES "1 hits, 0 misses")
+    message(FATAL_ERROR "The second compilation did not come from the cache: ${WARM_LOG}")
+endif ()
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${DST}/test_cache_cold.spv ${DST}/test_cache_warm.spv COMMAND_ERROR_IS_FATAL ANY)
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdalign.h>
+
+#include "shady/ir.h"
+#include "ir_private.h"
+
+#include "log.h"
+#include "dict.h"
+#include "util.h"
+#include "portability.h"
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+KeyHash hash_node(const Node**);
+bool compare_node(const Node** a, const Node** b);
+
+KeyHash hash_string(const char** string);
+bool compare_string(const char** a, const char** b);
+
+static KeyHash hash_nodes(Nodes* nodes) {
+    return hash_murmur(nodes->nodes, sizeof(const Node*) * nodes->count);
+}
+bool compare_nodes(Nodes* a, Nodes* b);
+
+static size_t hash_node_calls = 0;
+static KeyHash counting_hash_node(const Node** n) {
+    hash_node_calls++;
+    return hash_node(n);
+}
+
+static double elapsed_ms(clock_t start) {
+    return (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+#define ELEMENTS 200000
+#define LOOKUP_ROUNDS 8
+
+typedef struct {
+    const char* name;
+    size_t key_size;
+    void* keys;
+    HashFn hash;
+    CmpFn cmp;
+    struct Dict* dict;
+} KeyKind;
+
+/// Inserts all the keys, looks them up a few times, removes every other one and checks the dict is still coherent
+static void test_key_kind(KeyKind k) {
+    void* key;
+    clock_t start = clock();
+    for (size_t i = 0; i < ELEMENTS; i++) {
+        key = (void*) ((size_t) k.keys + i * k.key_size);
+        CHECK(insert_dict_and_get_result_impl(k.dict, key, &i), exit(-1));
+    }
+    double insert_time = elapsed_ms(start);
+    CHECK(entries_count_dict(k.dict) == ELEMENTS, exit(-1));
+
+    start = clock();
+    for (size_t round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (size_t i = 0; i < ELEMENTS; i++) {
+            key = (void*) ((size_t) k.keys + i * k.key_size);
+            size_t* value = find_value_dict_impl(k.dict, key);
+            CHECK(value && *value == i, exit(-1));
+        }
+    }
+    double lookup_time = elapsed_ms(start);
+
+    // re-inserting an existing key overwrites the value and doesn't add an entry
+    size_t new_value = 42;
+    CHECK(!insert_dict_and_get_result_impl(k.dict, k.keys, &new_value), exit(-1));
+    CHECK(*(size_t*) find_value_dict_impl(k.dict, k.keys) == 42, exit(-1));
+    CHECK(entries_count_dict(k.dict) == ELEMENTS, exit(-1));
+    new_value = 0;
+    insert_dict_and_get_result_impl(k.dict, k.keys, &new_value);
+
+    struct Dict* clone = clone_dict(k.dict);
+
+    start = clock();
+    for (size_t i = 0; i < ELEMENTS; i += 2) {
+        key = (void*) ((size_t) k.keys + i * k.key_size);
+        CHECK(remove_dict_impl(k.dict, key), exit(-1));
+    }
+    double remove_time = elapsed_ms(start);
+    CHECK(entries_count_dict(k.dict) == ELEMENTS / 2, exit(-1));
+    for (size_t i = 0; i < ELEMENTS; i++) {
+        key = (void*) ((size_t) k.keys + i * k.key_size);
+        size_t* value = find_value_dict_impl(k.dict, key);
+        if (i % 2 == 0) {
+            CHECK(!value, exit(-1));
+        } else {
+            CHECK(value && *value == i, exit(-1));
+        }
+        CHECK(find_value_dict_impl(clone, key), exit(-1));
+    }
+
+    size_t iterated = 0, iter = 0, value;
+    LARRAY(char, iterated_key, k.key_size);
+    while (dict_iter(k.dict, &iter, iterated_key, &value)) {
+        CHECK(value % 2 == 1, exit(-1));
+        iterated++;
+    }
+    CHECK(iterated == ELEMENTS / 2, exit(-1));
+
+    clear_dict(clone);
+    CHECK(entries_count_dict(clone) == 0 && !find_key_dict_impl(clone, k.keys), exit(-1));
+    destroy_dict(clone);
+
+    info_print("%-10s insert: %8.2f ms, lookup: %8.2f ms, remove: %8.2f ms\n", k.name, insert_time, lookup_time, remove_time);
+}
+
+int main(int argc, char** argv) {
+    set_log_level(INFO);
+    ArenaConfig aconfig = default_arena_config();
+    aconfig.check_types = false;
+    aconfig.allow_fold = false;
+    IrArena* a = new_ir_arena(aconfig);
+
+    const Node** node_keys = malloc(sizeof(const Node*) * ELEMENTS);
+    Nodes* nodes_keys = malloc(sizeof(Nodes) * ELEMENTS);
+    String* string_keys = malloc(sizeof(String) * ELEMENTS);
+    clock_t start = clock();
+    for (size_t i = 0; i < ELEMENTS; i++) {
+        node_keys[i] = uint32_literal(a, (uint32_t) i);
+        nodes_keys[i] = mk_nodes(a, node_keys[i], node_keys[i / 2]);
+        string_keys[i] = format_string_interned(a, "name_%zu", i);
+        prim_op_helper(a, add_op, empty(a), nodes_keys[i]);
+    }
+    double construction_time = elapsed_ms(start);
+
+    // re-creating existing nodes hashes them again, but only once per constructor call
+    start = clock();
+    for (size_t i = 0; i < ELEMENTS; i++) {
+        CHECK(uint32_literal(a, (uint32_t) i) == node_keys[i], exit(-1));
+        prim_op_helper(a, add_op, empty(a), nodes_keys[i]);
+    }
+    double interning_time = elapsed_ms(start);
+    info_print("node construction: %8.2f ms, re-interning: %8.2f ms\n", construction_time, interning_time);
+    size_t structural_hashes = a->stats.structural_hashes;
+    CHECK(structural_hashes == 4 * ELEMENTS, exit(-1));
+
+    KeyKind kinds[] = {
+        { "Node*",  sizeof(const Node*), node_keys,   (HashFn) counting_hash_node, (CmpFn) compare_node },
+        { "Nodes",  sizeof(Nodes),       nodes_keys,  (HashFn) hash_nodes,         (CmpFn) compare_nodes  },
+        { "String", sizeof(String),      string_keys, (HashFn) hash_string,        (CmpFn) compare_string },
+    };
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        kinds[i].dict = new_dict_impl(kinds[i].key_size, sizeof(size_t), alignof(void*), alignof(size_t), kinds[i].hash, kinds[i].cmp);
+        test_key_kind(kinds[i]);
+        destroy_dict(kinds[i].dict);
+    }
+
+    // Node hashes are memoized: all the lookups, removals and resizes above must not have hashed a single payload
+    CHECK(a->stats.structural_hashes == structural_hashes, exit(-1));
+    info_print("hash_node calls: %zu, structural hashes computed: %zu\n", hash_node_calls, structural_hashes);
+
+    free(node_keys);
+    free(nodes_keys);
+    free(string_keys);
+    destroy_ir_arena(a);
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "shady/ir.h"
+#include "shady/driver.h"
+
+#include "log.h"
+#include "growy.h"
+#include "util.h"
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+static double elapsed_ms(clock_t start) {
+    return (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+#define ENTRY_POINTS_COUNT 20
+
+/// step_N calls step_N-1, and entry_N starts the chain at step_N: each entry point reaches a different number of functions,
+/// and pruning the others away leaves a different module behind every time
+static const char* function_src =
+    "fn step_%d varying u32(varying u32 n) {\n"
+    "  var u32 acc = n;\n"
+    "  loop() {\n"
+    "    if (acc > u32 100) { break; }\n"
+    "    acc = acc * u32 3 + u32 %d;\n"
+    "    continue;\n"
+    "  }\n"
+    "  return (step_%d(acc %% u32 16));\n"
+    "}\n\n";
+
+static const char* entry_point_src =
+    "@EntryPoint(\"Compute\") @WorkgroupSize(%d, 1, 1) fn entry_%d() {\n"
+    "    val n = subgroup_local_id %% u32 16;\n"
+    "    debug_printf(\"step(%%d) = %%d\\n\", n, step_%d(n));\n"
+    "    return ();\n"
+    "}\n\n";
+
+static char* make_program(size_t* size) {
+    Growy* g = new_growy();
+    growy_append_string(g, "fn step_0 varying u32(varying u32 n) { return (n); }\n\n");
+    for (size_t i = 1; i < ENTRY_POINTS_COUNT; i++)
+        growy_append_formatted(g, function_src, (int) i, (int) i, (int) i - 1);
+    growy_append_string(g, "@Builtin(\"SubgroupLocalInvocationId\")\ninput u32 subgroup_local_id;\n\n");
+    for (size_t i = 0; i < ENTRY_POINTS_COUNT; i++)
+        growy_append_formatted(g, entry_point_src, i % 2 ? 64 : 32, (int) i, (int) i);
+    *size = growy_size(g);
+    return growy_deconstruct(g);
+}
+
+static Module* parse_program(const char* src, size_t size) {
+    IrArena* a = new_ir_arena(default_arena_config());
+    Module* m = new_module(a, "program");
+    CHECK(driver_load_source_file(SrcSlim, size, src, m) == NoError, exit(-1));
+    return m;
+}
+
+static void emit(CompilerConfig* config, Module* mod, size_t* size, char** spirv) {
+    Module* emitted;
+    emit_spirv(config, mod, size, spirv, &emitted);
+    if (get_module_arena(emitted) != get_module_arena(mod))
+        destroy_ir_arena(get_module_arena(emitted));
+    destroy_ir_arena(get_module_arena(mod));
+}
+
+int main(int argc, char** argv) {
+    set_log_level(INFO);
+    size_t src_size;
+    char* src = make_program(&src_size);
+
+    CompilerConfig base_config = default_compiler_config();
+    String entry_points[ENTRY_POINTS_COUNT];
+    size_t spirv_sizes[ENTRY_POINTS_COUNT];
+    char* spirv[ENTRY_POINTS_COUNT];
+
+    // the whole pipeline once per entry point
+    double full_time = 0;
+    for (size_t i = 0; i < ENTRY_POINTS_COUNT; i++) {
+        entry_points[i] = format_string_new("entry_%d", (int) i);
+        Module* initial = parse_program(src, src_size);
+        Module* m = initial;
+        CompilerConfig config = base_config;
+        config.specialization.entry_point = entry_points[i];
+        clock_t start = clock();
+        CHECK(run_compiler_passes(&config, &m) == CompilationNoError, exit(-1));
+        full_time += elapsed_ms(start);
+        emit(&config, m, &spirv_sizes[i], &spirv[i]);
+        destroy_ir_arena(get_module_arena(initial));
+    }
+
+    // the generic part once, then only the specialized tail
+    Module* initial = parse_program(src, src_size);
+    Module* generic = initial;
+    CompilerConfig generic_config = base_config;
+    clock_t start = clock();
+    CHECK(run_generic_compiler_passes(&generic_config, &generic) == CompilationNoError, exit(-1));
+    double generic_time = elapsed_ms(start);
+    CHECK(get_module_arena(generic) != get_module_arena(initial), exit(-1));
+
+    double specialized_time = 0;
+    for (size_t i = 0; i < ENTRY_POINTS_COUNT; i++) {
+        Module* m = generic;
+        CompilerConfig config = base_config;
+        config.specialization.entry_point = entry_points[i];
+        start = clock();
+        CHECK(run_specialized_compiler_passes(&config, &m) == CompilationNoError, exit(-1));
+        specialized_time += elapsed_ms(start);
+        CHECK(get_module_arena(m) != get_module_arena(generic), exit(-1));
+        // the other entry points are gone, and so is what only they use
+        for (size_t j = 0; j < ENTRY_POINTS_COUNT; j++)
+            CHECK((get_declaration(m, entry_points[j]) != NULL) == (i == j), exit(-1));
+        if (i + 1 < ENTRY_POINTS_COUNT) {
+            String next_step = format_string_new("step_%d", (int) i + 1);
+            CHECK(get_declaration(m, next_step) == NULL, exit(-1));
+            free((void*) next_step);
+        }
+
+        // specializing from the checkpoint has to give the same code as running the whole thing
+        size_t size;
+        char* data;
+        emit(&config, m, &size, &data);
+        CHECK(size == spirv_sizes[i] && memcmp(data, spirv[i], size) == 0, exit(-1));
+        free(data);
+        free(spirv[i]);
+        free((void*) entry_points[i]);
+    }
+
+    info_print("%d entry points: %.1f ms running the whole pipeline for each, %.1f ms for the generic stage once plus %.1f ms specializing them\n", ENTRY_POINTS_COUNT, full_time, generic_time, specialized_time);
+
+    destroy_ir_arena(get_module_arena(generic));
+    destroy_ir_arena(get_module_arena(initial));
+    free(src);
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "shady/ir.h"
+#include "analysis/scope.h"
+
+#include "log.h"
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+static double elapsed_ms(clock_t start) {
+    return (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+#define BLOCKS_COUNT 100000
+
+/// Even blocks either go to the next block or skip it, odd ones fall through and the last one loops back to the start:
+/// this gives a dominator tree made of the even blocks, 50k deep, which would be a problem for any recursive traversal.
+static const Node* make_long_function(IrArena* a, Module* m, Node** blocks) {
+    const Node* cond = var(a, bool_type(a), "cond");
+    Node* fn = function(m, singleton(cond), "long", empty(a), empty(a));
+    for (size_t i = 0; i <= BLOCKS_COUNT; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "bb_%zu", i);
+        blocks[i] = basic_block(a, fn, empty(a), name);
+    }
+
+    for (size_t i = 0; i < BLOCKS_COUNT; i++) {
+        if (i == BLOCKS_COUNT - 1) {
+            blocks[i]->payload.basic_block.body = branch(a, (Branch) {
+                .branch_condition = cond,
+                .true_jump = jump_helper(a, blocks[0], empty(a)),
+                .false_jump = jump_helper(a, blocks[BLOCKS_COUNT], empty(a)),
+            });
+        } else if (i % 2 == 0) {
+            blocks[i]->payload.basic_block.body = branch(a, (Branch) {
+                .branch_condition = cond,
+                .true_jump = jump_helper(a, blocks[i + 1], empty(a)),
+                .false_jump = jump_helper(a, blocks[i + 2], empty(a)),
+            });
+        } else {
+            blocks[i]->payload.basic_block.body = jump_helper(a, blocks[i + 1], empty(a));
+        }
+    }
+    blocks[BLOCKS_COUNT]->payload.basic_block.body = fn_ret(a, (Return) { .fn = fn, .args = empty(a) });
+    fn->payload.fun.body = jump_helper(a, blocks[0], empty(a));
+    return fn;
+}
+
+static bool frontier_is(Scope* scope, CFNode* n, size_t count, CFNode* a, CFNode* b) {
+    CFNodes df = scope_get_dom_frontier(scope, n);
+    if (df.count != count)
+        return false;
+    for (size_t i = 0; i < count; i++)
+        if (df.nodes[i] != a && df.nodes[i] != b)
+            return false;
+    return count < 2 || df.nodes[0] != df.nodes[1];
+}
+
+int main(int argc, char** argv) {
+    set_log_level(INFO);
+    ArenaConfig aconfig = default_arena_config();
+    aconfig.check_types = false;
+    aconfig.allow_fold = false;
+    IrArena* a = new_ir_arena(aconfig);
+    Module* m = new_module(a, "test_scope");
+    Node** blocks = malloc(sizeof(Node*) * (BLOCKS_COUNT + 1));
+    const Node* fn = make_long_function(a, m, blocks);
+
+    clock_t start = clock();
+    Scope* scope = new_scope(fn);
+    double build_time = elapsed_ms(start);
+    CHECK(scope->size == BLOCKS_COUNT + 2, exit(-1));
+    CHECK(scope->entry->node == fn && scope->rpo[0] == scope->entry, exit(-1));
+
+    CFNode* fn_node = scope->entry;
+    CFNode** n = malloc(sizeof(CFNode*) * (BLOCKS_COUNT + 1));
+    for (size_t i = 0; i <= BLOCKS_COUNT; i++)
+        n[i] = scope_lookup(scope, blocks[i]);
+
+    CHECK(n[0]->idom == fn_node, exit(-1));
+    for (size_t i = 0; i + 1 < BLOCKS_COUNT; i++) {
+        // the even block on top of each diamond dominates everything in it
+        size_t top = i % 2 == 0 ? i : i - 1;
+        CHECK(n[i + 1]->idom == n[top], exit(-1));
+        CHECK(n[i]->rpo_index < n[i + 1]->rpo_index, exit(-1));
+    }
+    CHECK(n[BLOCKS_COUNT]->idom == n[BLOCKS_COUNT - 2], exit(-1));
+    CHECK(fn_node->dominates.count == 1 && n[0]->dominates.count == 2, exit(-1));
+
+    start = clock();
+    CHECK(scope_get_dom_frontier(scope, fn_node).count == 0, exit(-1));
+    double frontiers_time = elapsed_ms(start);
+    for (size_t i = 0; i + 1 < BLOCKS_COUNT; i++) {
+        if (i % 2 == 0)
+            CHECK(frontier_is(scope, n[i], 1, n[0], NULL), exit(-1))
+        else
+            CHECK(frontier_is(scope, n[i], 1, n[i + 1], NULL), exit(-1))
+    }
+    // the last block closes the loop and also joins with the exit path of the last diamond
+    CHECK(frontier_is(scope, n[BLOCKS_COUNT - 1], 2, n[0], n[BLOCKS_COUNT]), exit(-1));
+    CHECK(frontier_is(scope, n[BLOCKS_COUNT], 0, NULL, NULL), exit(-1));
+
+    start = clock();
+    Scope* flipped = new_scope_flipped(fn);
+    double flipped_time = elapsed_ms(start);
+    // the function's only exit post-dominates everything, and both sides of each diamond meet on the next even block
+    CHECK(flipped->entry->node == blocks[BLOCKS_COUNT], exit(-1));
+    CHECK(scope_lookup(flipped, blocks[0])->idom->node == blocks[2], exit(-1));
+
+    info_print("scope with %d blocks: built in %.2f ms, frontiers in %.2f ms, post-dominance in %.2f ms\n", BLOCKS_COUNT, build_time, frontiers_time, flipped_time);
+
+    destroy_scope(flipped);
+    destroy_scope(scope);
+    free(n);
+    free(blocks);
+    destroy_ir_arena(a);
+    return 0;
+}
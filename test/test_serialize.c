@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "shady/ir.h"
+#include "shady/driver.h"
+
+#include "log.h"
+#include "dict.h"
+#include "growy.h"
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+static double elapsed_ms(clock_t start) {
+    return (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+#define FUNCTIONS_COUNT 2000
+/// The header ends with the checksum of everything after it, the declaration table comes last
+#define SERIALIZED_HEADER_SIZE 56
+
+/// Declarations of every kind, with annotations, so the format gets to store each sort of node and payload
+static const char* prelude_src =
+    "type Particle = struct {\n"
+    "    f32 x;\n"
+    "    f32 y;\n"
+    "    u32 id;\n"
+    "};\n\n"
+    "const u32 SCALE = u32 3;\n"
+    "const f32 HALF = f32 0.5;\n\n"
+    "subgroup u32 tally;\n\n"
+    "@Builtin(\"SubgroupLocalInvocationId\")\n"
+    "input u32 subgroup_local_id;\n\n";
+
+/// Arrays, records, control flow and memory operations. part_N calls part_N/2, which keeps the call graph shallow
+static const char* function_src =
+    "fn part_%d varying u32(varying u32 n, varying f32 w) {\n"
+    "    var [u32; 4] lanes = composite [u32; 4](n, u32 %d, SCALE, n * SCALE);\n"
+    "    var Particle p = composite Particle(w, w * HALF, n);\n"
+    "    if (n > u32 %d) { lanes#1 = n; } else { p#2 = u32 7; }\n"
+    "    val a = alloca[u32]();\n"
+    "    store(a, lanes#1 + p#2);\n"
+    "    loop() {\n"
+    "        if (load(a) > u32 100) { break; }\n"
+    "        store(a, load(a) * SCALE + u32 %d);\n"
+    "        continue;\n"
+    "    }\n"
+    "    debug_printf(\"part %%d: %%d\\n\", n, load(a));\n"
+    "    return (load(a) + part_%d(n - u32 1, p#1));\n"
+    "}\n\n";
+
+/// Calls the last function, so the lowered module still has a few of them
+static const char* entry_point_src =
+    "@EntryPoint(\"Compute\") @WorkgroupSize(32, 1, 1) fn main() {\n"
+    "    val n = subgroup_local_id %% u32 16;\n"
+    "    debug_printf(\"%%d\\n\", part_%d(n, f32 1.0));\n"
+    "    return ();\n"
+    "}\n";
+
+static char* make_program(size_t count) {
+    Growy* g = new_growy();
+    growy_append_string(g, prelude_src);
+    for (size_t i = 0; i < count; i++)
+        growy_append_formatted(g, function_src, (int) i, (int) i, (int) i % 8, (int) i, (int) i / 2);
+    growy_append_formatted(g, entry_point_src, (int) count - 1);
+    growy_append_bytes(g, 1, (char[]) { 0 });
+    return growy_deconstruct(g);
+}
+
+/// Loading a module and writing it out again should give back the exact same bytes
+static bool round_trips(ArenaConfig aconfig, Module* mod, size_t size, char* data) {
+    IrArena* a = new_ir_arena(aconfig);
+    Module* loaded = new_module(a, "loaded");
+    CHECK(deserialize_module(loaded, size, data), return false);
+    size_t size2;
+    char* data2;
+    serialize_module(loaded, &size2, &data2);
+    bool same = size == size2 && memcmp(data, data2, size) == 0;
+    free(data2);
+    destroy_ir_arena(a);
+    return same;
+}
+
+int main(int argc, char** argv) {
+    set_log_level(INFO);
+    char* src = make_program(FUNCTIONS_COUNT);
+    ArenaConfig aconfig = default_arena_config();
+
+    IrArena* a = new_ir_arena(aconfig);
+    Module* m = new_module(a, "parsed");
+    clock_t start = clock();
+    CHECK(driver_load_source_file(SrcSlim, strlen(src), src, m) == NoError, exit(-1));
+    double parse_time = elapsed_ms(start);
+
+    size_t size;
+    char* data;
+    serialize_module(m, &size, &data);
+
+    IrArena* a2 = new_ir_arena(aconfig);
+    Module* m2 = new_module(a2, "loaded");
+    start = clock();
+    CHECK(driver_load_source_file(SrcShadyBinary, size, data, m2) == NoError, exit(-1));
+    double load_time = elapsed_ms(start);
+    CHECK(get_module_declarations(m2).count == get_module_declarations(m).count, exit(-1));
+    CHECK(get_declaration(m2, "part_1234") != NULL, exit(-1));
+    CHECK(get_declaration(m2, "Particle") != NULL && get_declaration(m2, "SCALE") != NULL && get_declaration(m2, "tally") != NULL, exit(-1));
+    destroy_ir_arena(a2);
+
+    info_print("%d functions: parsed %zu bytes of text in %.2f ms, loaded %zu bytes of binary in %.2f ms\n", FUNCTIONS_COUNT, strlen(src), parse_time, size, load_time);
+    CHECK(round_trips(aconfig, m, size, data), exit(-1));
+
+    // a file with a valid checksum can still be malformed, that fails the load rather than the process
+    char* malformed = malloc(size);
+    memcpy(malformed, data, size);
+    uint32_t bad_decl = UINT32_MAX - 1;
+    memcpy(malformed + size - sizeof(bad_decl), &bad_decl, sizeof(bad_decl));
+    uint64_t checksum[2];
+    hash_murmur_128(malformed + SERIALIZED_HEADER_SIZE, size - SERIALIZED_HEADER_SIZE, checksum);
+    memcpy(malformed + SERIALIZED_HEADER_SIZE - sizeof(checksum), checksum, sizeof(checksum));
+    IrArena* a4 = new_ir_arena(aconfig);
+    Module* m4 = new_module(a4, "malformed");
+    CHECK(!deserialize_module(m4, size, malformed), exit(-1));
+    CHECK(get_module_declarations(m4).count == 0, exit(-1));
+    destroy_ir_arena(a4);
+    free(malformed);
+
+    // any corruption should be caught before we start building nodes
+    data[size / 2] ^= 0x10;
+    IrArena* a3 = new_ir_arena(aconfig);
+    CHECK(!deserialize_module(new_module(a3, "corrupted"), size, data), exit(-1));
+    destroy_ir_arena(a3);
+    free(data);
+
+    // typed, lowered modules are also fair game, to save the state of the pipeline half-way through
+    CompilerConfig config = default_compiler_config();
+    config.specialization.entry_point = "main";
+    CHECK(run_compiler_passes(&config, &m) == CompilationNoError, exit(-1));
+    serialize_module(m, &size, &data);
+    CHECK(round_trips(get_arena_config(get_module_arena(m)), m, size, data), exit(-1));
+    free(data);
+
+    destroy_ir_arena(get_module_arena(m));
+    destroy_ir_arena(a);
+    free(src);
+    return 0;
+}
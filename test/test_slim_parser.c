@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "shady/ir.h"
+#include "shady/driver.h"
+#include "frontends/slim/token.h"
+
+#include "log.h"
+#include "growy.h"
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+static double elapsed_ms(clock_t start) {
+    return (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+/// Copies the source into a buffer of the exact size, without a terminator, like a mapped file would be
+static char* copy_unterminated(const char* src, size_t size) {
+    char* copy = malloc(size);
+    memcpy(copy, src, size);
+    return copy;
+}
+
+static void check_tokens(const char* src, size_t count, TokenTag* expected) {
+    size_t size = strlen(src);
+    char* copy = copy_unterminated(src, size);
+    Tokenizer* tokenizer = new_tokenizer(copy, size);
+    for (size_t i = 0; i < count; i++) {
+        Token token = curr_token(tokenizer);
+        if (token.tag != expected[i]) {
+            error_print("token %zu in '%s': expected %s, got %s\n", i, src, token_tags[expected[i]], token_tags[token.tag]);
+            exit(-1);
+        }
+        next_token(tokenizer);
+    }
+    CHECK(curr_token(tokenizer).tag == EOF_tok, exit(-1));
+    destroy_tokenizer(tokenizer);
+    free(copy);
+}
+
+static void test_tokens() {
+    // keywords only match whole identifiers
+    check_tokens("fn fnord if iffy u32 u32x mask_t _val", 8, (TokenTag[]) { fn_tok, identifier_tok, if_tok, identifier_tok, u32_tok, identifier_tok, mask_t_tok, identifier_tok });
+    // symbols use the longest match
+    check_tokens(">>>>> >=><=<<", 6, (TokenTag[]) { infix_rshift_logical_tok, infix_rshift_arithm_tok, infix_geq_tok, infix_gt_tok, infix_leq_tok, infix_lshift_tok });
+    check_tokens("1.5e-3f 0x10 42 \"a b\"", 4, (TokenTag[]) { dec_lit_tok, hex_lit_tok, dec_lit_tok, string_lit_tok });
+    check_tokens("/**/a// comment\n\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\tb /* * / */c // no newline", 3, (TokenTag[]) { identifier_tok, identifier_tok, identifier_tok });
+    // comment markers inside strings are just characters
+    check_tokens("\"// /* no comment\" x", 2, (TokenTag[]) { string_lit_tok, identifier_tok });
+    // unterminated comments run to the end of the file, however short
+    check_tokens("a /*", 1, (TokenTag[]) { identifier_tok });
+    check_tokens("a /* b *", 1, (TokenTag[]) { identifier_tok });
+    check_tokens("   \n   ", 0, NULL);
+}
+
+#define FUNCTIONS_COUNT 10000
+
+/// Mostly there to keep the tokenizer busy: comments of every shape, keywords next to identifiers they prefix, every operator and every kind of literal
+static const char* function_src =
+    "/* block comments can hold * and / and \"quotes\",\n"
+    "   and span lines */\n"
+    "fn lexeme_soup_%d varying u32(varying u32 iffy, varying f32 fnord) { // keywords prefix these names\n"
+    "    val u32x = iffy >> u32 3;\n"
+    "    val masked = (u32x << u32 %d) | (iffy & u32 0x10) ^ u32 0x7;\n"
+    "    val scaled = fnord * f32 1.5e-3 + f32 2e+6 - f32 0.25f;\n"
+    "\t  \t  \n"
+    "    val logical = masked >>> u32 1;\n"
+    "    val different = iffy != u32x;\n"
+    "    if (iffy == u32 0) { return (u32 0); }\n"
+    "    if (masked >= u32 1) {\n"
+    "        debug_printf(\"a string with // and /* inside %%d\\n\", masked);\n"
+    "    }\n"
+    "    var u32 accumulator_with_a_rather_long_name = masked %% u32 7;\n"
+    "    loop() {\n"
+    "        if (accumulator_with_a_rather_long_name > u32 1000) { break; }\n"
+    "        accumulator_with_a_rather_long_name = accumulator_with_a_rather_long_name * u32 3 + u32 %d;\n"
+    "        continue;\n"
+    "    }\n"
+    "    return (accumulator_with_a_rather_long_name + iffy / u32 2);\n"
+    "}\n\n";
+
+static char* make_program(size_t count, size_t* size) {
+    Growy* g = new_growy();
+    for (size_t i = 0; i < count; i++)
+        growy_append_formatted(g, function_src, (int) i, (int) (i % 32), (int) i);
+    *size = growy_size(g);
+    return growy_deconstruct(g);
+}
+
+static double throughput(size_t size, double ms) {
+    return (double) size / (1024.0 * 1024.0) / (ms / 1000.0);
+}
+
+int main(int argc, char** argv) {
+    set_log_level(INFO);
+    test_tokens();
+
+    size_t size;
+    char* src = make_program(FUNCTIONS_COUNT, &size);
+
+    clock_t start = clock();
+    Tokenizer* tokenizer = new_tokenizer(src, size);
+    size_t tokens = 0;
+    while (curr_token(tokenizer).tag != EOF_tok) {
+        next_token(tokenizer);
+        tokens++;
+    }
+    destroy_tokenizer(tokenizer);
+    double lex_time = elapsed_ms(start);
+
+    IrArena* a = new_ir_arena(default_arena_config());
+    Module* m = new_module(a, "parsed");
+    start = clock();
+    CHECK(driver_load_source_file(SrcSlim, size, src, m) == NoError, exit(-1));
+    double parse_time = elapsed_ms(start);
+    CHECK(get_module_declarations(m).count == FUNCTIONS_COUNT, exit(-1));
+    destroy_ir_arena(a);
+
+    info_print("%.2f MiB of slim, %zu tokens: lexed at %.1f MiB/s, parsed at %.1f MiB/s\n", (double) size / (1024.0 * 1024.0), tokens, throughput(size, lex_time), throughput(size, parse_time));
+    free(src);
+    return 0;
+}
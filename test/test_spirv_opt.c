@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emit/spirv/spirv_opt.h"
+
+#include "log.h"
+
+#include <spirv/unified1/spirv.h>
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+typedef struct {
+    uint32_t words[512];
+    size_t count;
+    size_t start;
+} Assembler;
+
+static void begin_op(Assembler* a, SpvOp op) {
+    a->start = a->count;
+    a->words[a->count++] = op;
+}
+
+static void push_word(Assembler* a, uint32_t word) {
+    a->words[a->count++] = word;
+}
+
+/// Nul-terminated, padded to a whole word
+static void push_string(Assembler* a, const char* string) {
+    size_t len = strlen(string) + 1;
+    for (size_t i = 0; i < len; i += 4) {
+        uint32_t word = 0;
+        for (size_t j = 0; j < 4 && i + j < len; j++)
+            word |= (uint32_t) (unsigned char) string[i + j] << (8 * j);
+        push_word(a, word);
+    }
+}
+
+static void end_op(Assembler* a) {
+    a->words[a->start] |= (uint32_t) (a->count - a->start) << 16;
+}
+
+#define OP(a, op, ...) { begin_op(a, op); uint32_t operands[] = { __VA_ARGS__ }; for (size_t i = 0; i < sizeof(operands) / sizeof(operands[0]); i++) push_word(a, operands[i]); end_op(a); }
+#define OP0(a, op) { begin_op(a, op); end_op(a); }
+
+/// Sparse on purpose, so renumbering has something to do
+enum {
+    id_main = 10, id_entry = 20, id_case = 30, id_merge = 40,
+    id_void = 100, id_fn, id_int, id_int2, id_long, id_float,
+    id_node, id_node_ptr, id_plain_node, id_s1, id_pc_ptr, id_dead_block, id_s2, id_s3,
+    id_fn_plain_node, id_fn_s2, id_fn_s3, id_private_int,
+    id_seven = 200, id_seven2, id_ninety_nine, id_one, id_selector,
+    id_pc = 300, id_unused, id_plain, id_v2, id_v3, id_pc_value, id_sum,
+    ids_bound = 1000,
+};
+
+#define SELECTOR_LO 5
+#define SELECTOR_HI 1
+
+/// Has everything the compactor should clean up: duplicate types and constants, unused definitions, sparse ids.
+/// The duplicate OpTypeInt makes this invalid as far as spirv-val is concerned, only the output has to pass.
+static void assemble_module(Assembler* a) {
+    a->count = 0;
+    push_word(a, SpvMagicNumber);
+    push_word(a, 0x00010300);
+    push_word(a, 0);
+    push_word(a, ids_bound);
+    push_word(a, 0);
+
+    OP(a, SpvOpCapability, SpvCapabilityShader);
+    OP(a, SpvOpCapability, SpvCapabilityInt64);
+    OP(a, SpvOpCapability, SpvCapabilityPhysicalStorageBufferAddresses);
+    begin_op(a, SpvOpExtension);
+    push_string(a, "SPV_KHR_physical_storage_buffer");
+    end_op(a);
+    OP(a, SpvOpMemoryModel, SpvAddressingModelPhysicalStorageBuffer64, SpvMemoryModelGLSL450);
+    begin_op(a, SpvOpEntryPoint);
+    push_word(a, SpvExecutionModelGLCompute);
+    push_word(a, id_main);
+    push_string(a, "main");
+    end_op(a);
+    OP(a, SpvOpExecutionMode, id_main, SpvExecutionModeLocalSize, 1, 1, 1);
+
+    begin_op(a, SpvOpName);
+    push_word(a, id_main);
+    push_string(a, "main");
+    end_op(a);
+    begin_op(a, SpvOpName);
+    push_word(a, id_unused);
+    push_string(a, "unused");
+    end_op(a);
+    begin_op(a, SpvOpName);
+    push_word(a, id_s3);
+    push_string(a, "s3");
+    end_op(a);
+
+    OP(a, SpvOpDecorate, id_s1, SpvDecorationBlock);
+    OP(a, SpvOpMemberDecorate, id_s1, 0, SpvDecorationOffset, 0);
+    OP(a, SpvOpDecorate, id_dead_block, SpvDecorationBlock);
+    OP(a, SpvOpMemberDecorate, id_dead_block, 0, SpvDecorationOffset, 0);
+    OP(a, SpvOpMemberDecorate, id_node, 0, SpvDecorationOffset, 0);
+    OP(a, SpvOpMemberDecorate, id_node, 1, SpvDecorationOffset, 8);
+
+    OP(a, SpvOpTypeVoid, id_void);
+    OP(a, SpvOpTypeFunction, id_fn, id_void);
+    OP(a, SpvOpTypeInt, id_int, 32, 0);
+    OP(a, SpvOpTypeInt, id_int2, 32, 0);
+    OP(a, SpvOpTypeInt, id_long, 64, 0);
+    OP(a, SpvOpTypeFloat, id_float, 32);
+    OP(a, SpvOpTypeForwardPointer, id_node_ptr, SpvStorageClassPhysicalStorageBuffer);
+    OP(a, SpvOpTypeStruct, id_node, id_int, id_node_ptr);
+    OP(a, SpvOpTypePointer, id_node_ptr, SpvStorageClassPhysicalStorageBuffer, id_node);
+    // the same members as node, but no offsets: the two must not be folded
+    OP(a, SpvOpTypeStruct, id_plain_node, id_int, id_node_ptr);
+    OP(a, SpvOpTypeStruct, id_s1, id_node_ptr);
+    OP(a, SpvOpTypePointer, id_pc_ptr, SpvStorageClassPushConstant, id_s1);
+    // decorated like s1, but nothing uses it
+    OP(a, SpvOpTypeStruct, id_dead_block, id_int);
+    OP(a, SpvOpTypeStruct, id_s2, id_int, id_long);
+    OP(a, SpvOpTypeStruct, id_s3, id_int2, id_long);
+    OP(a, SpvOpTypePointer, id_fn_plain_node, SpvStorageClassFunction, id_plain_node);
+    OP(a, SpvOpTypePointer, id_fn_s2, SpvStorageClassFunction, id_s2);
+    OP(a, SpvOpTypePointer, id_fn_s3, SpvStorageClassFunction, id_s3);
+    OP(a, SpvOpTypePointer, id_private_int, SpvStorageClassPrivate, id_int);
+
+    OP(a, SpvOpConstant, id_int, id_seven, 7);
+    OP(a, SpvOpConstant, id_int2, id_seven2, 7);
+    OP(a, SpvOpConstant, id_int, id_ninety_nine, 99);
+    OP(a, SpvOpConstant, id_float, id_one, 0x3f800000);
+    OP(a, SpvOpConstant, id_long, id_selector, SELECTOR_LO, SELECTOR_HI);
+
+    OP(a, SpvOpVariable, id_pc_ptr, id_pc, SpvStorageClassPushConstant);
+    OP(a, SpvOpVariable, id_private_int, id_unused, SpvStorageClassPrivate);
+
+    OP(a, SpvOpFunction, id_void, id_main, SpvFunctionControlMaskNone, id_fn);
+    OP(a, SpvOpLabel, id_entry);
+    OP(a, SpvOpVariable, id_fn_plain_node, id_plain, SpvStorageClassFunction);
+    OP(a, SpvOpVariable, id_fn_s2, id_v2, SpvStorageClassFunction);
+    OP(a, SpvOpVariable, id_fn_s3, id_v3, SpvStorageClassFunction);
+    OP(a, SpvOpLoad, id_s1, id_pc_value, id_pc);
+    OP(a, SpvOpIAdd, id_int, id_sum, id_seven, id_seven2);
+    OP(a, SpvOpSelectionMerge, id_merge, SpvSelectionControlMaskNone);
+    // the case value takes two words, it only decodes right if the compactor knows how wide the selector is
+    OP(a, SpvOpSwitch, id_selector, id_merge, SELECTOR_LO, SELECTOR_HI, id_case);
+    OP(a, SpvOpLabel, id_case);
+    OP(a, SpvOpBranch, id_merge);
+    OP(a, SpvOpLabel, id_merge);
+    OP0(a, SpvOpReturn);
+    OP0(a, SpvOpFunctionEnd);
+}
+
+/// Returns the next instruction with that opcode, starting at *pos
+static const uint32_t* find_op(const uint32_t* words, size_t count, size_t* pos, SpvOp op) {
+    while (*pos < count) {
+        const uint32_t* instruction = &words[*pos];
+        *pos += instruction[0] >> 16;
+        if ((instruction[0] & 0xFFFFu) == op)
+            return instruction;
+    }
+    return NULL;
+}
+
+static size_t count_ops(const uint32_t* words, size_t count, SpvOp op) {
+    size_t found = 0;
+    for (size_t pos = 5; find_op(words, count, &pos, op);)
+        found++;
+    return found;
+}
+
+static const uint32_t* find_definition(const uint32_t* words, size_t count, SpvOp op, uint32_t id) {
+    const uint32_t* instruction;
+    for (size_t pos = 5; (instruction = find_op(words, count, &pos, op));) {
+        if (instruction[1] == id)
+            return instruction;
+    }
+    return NULL;
+}
+
+static uint32_t result_id(const uint32_t* instruction) {
+    switch (instruction[0] & 0xFFFFu) {
+        case SpvOpTypeVoid:
+        case SpvOpTypeFunction:
+        case SpvOpTypeInt:
+        case SpvOpTypeFloat:
+        case SpvOpTypeStruct:
+        case SpvOpTypePointer:
+        case SpvOpLabel: return instruction[1];
+        case SpvOpConstant:
+        case SpvOpVariable:
+        case SpvOpFunction:
+        case SpvOpLoad:
+        case SpvOpIAdd: return instruction[2];
+        default: return 0;
+    }
+}
+
+static void check_compacted(const uint32_t* words, size_t count) {
+    const uint32_t* instruction;
+
+    // the duplicate int type got folded, and the constants that were only different because of it
+    CHECK(count_ops(words, count, SpvOpTypeInt) == 2, exit(-1));
+    uint32_t int_id = 0;
+    for (size_t pos = 5; (instruction = find_op(words, count, &pos, SpvOpTypeInt));) {
+        if (instruction[2] == 32)
+            int_id = instruction[1];
+    }
+    CHECK(int_id != 0, exit(-1));
+    size_t sevens = 0;
+    for (size_t pos = 5; (instruction = find_op(words, count, &pos, SpvOpConstant));) {
+        CHECK(instruction[1] != int_id || instruction[3] != 99, exit(-1));
+        sevens += instruction[1] == int_id && instruction[3] == 7;
+    }
+    CHECK(sevens == 1, exit(-1));
+    size_t pos = 5;
+    instruction = find_op(words, count, &pos, SpvOpIAdd);
+    CHECK(instruction && instruction[3] == instruction[4], exit(-1));
+
+    // unused definitions are gone, along with their names and decorations
+    CHECK(count_ops(words, count, SpvOpTypeFloat) == 0, exit(-1));
+    CHECK(count_ops(words, count, SpvOpConstant) == 2, exit(-1));
+    for (size_t pos = 5; (instruction = find_op(words, count, &pos, SpvOpVariable));)
+        CHECK(instruction[3] != SpvStorageClassPrivate, exit(-1));
+    CHECK(count_ops(words, count, SpvOpName) == 1, exit(-1));
+    pos = 5;
+    instruction = find_op(words, count, &pos, SpvOpName);
+    CHECK(strcmp((const char*) &instruction[2], "main") == 0, exit(-1));
+    CHECK(count_ops(words, count, SpvOpDecorate) == 1, exit(-1));
+    CHECK(count_ops(words, count, SpvOpMemberDecorate) == 3, exit(-1));
+
+    // s3 folds into s2, the decorated structs stay as they are
+    CHECK(count_ops(words, count, SpvOpTypeStruct) == 4, exit(-1));
+    size_t function_pointers = 0;
+    for (size_t pos = 5; (instruction = find_op(words, count, &pos, SpvOpTypePointer));)
+        function_pointers += instruction[2] == SpvStorageClassFunction;
+    CHECK(function_pointers == 2, exit(-1));
+
+    // the forward declared pointer keeps its id, just renumbered
+    pos = 5;
+    instruction = find_op(words, count, &pos, SpvOpTypeForwardPointer);
+    CHECK(instruction, exit(-1));
+    const uint32_t* node_ptr = find_definition(words, count, SpvOpTypePointer, instruction[1]);
+    CHECK(node_ptr && node_ptr[2] == SpvStorageClassPhysicalStorageBuffer, exit(-1));
+    CHECK(find_definition(words, count, SpvOpTypeStruct, node_ptr[3]), exit(-1));
+
+    // the switch kept its 64-bit case value and its target
+    pos = 5;
+    instruction = find_op(words, count, &pos, SpvOpSwitch);
+    CHECK(instruction && (instruction[0] >> 16) == 6, exit(-1));
+    CHECK(instruction[3] == SELECTOR_LO && instruction[4] == SELECTOR_HI, exit(-1));
+    const uint32_t* case_label = &words[pos];
+    CHECK((case_label[0] & 0xFFFFu) == SpvOpLabel && case_label[1] == instruction[5], exit(-1));
+
+    // every id below the bound is defined exactly once
+    uint32_t bound = words[3];
+    CHECK(bound < ids_bound, exit(-1));
+    bool* defined = calloc(bound, sizeof(bool));
+    size_t defined_count = 0;
+    for (size_t pos = 5; pos < count; pos += words[pos] >> 16) {
+        uint32_t id = result_id(&words[pos]);
+        if (!id)
+            continue;
+        CHECK(id < bound && !defined[id], exit(-1));
+        defined[id] = true;
+        defined_count++;
+    }
+    CHECK(defined_count == bound - 1, exit(-1));
+    free(defined);
+}
+
+static void validate(const char* validator, const uint32_t* words, size_t size) {
+    const char* path = "test_spirv_opt.spv";
+    FILE* f = fopen(path, "wb");
+    CHECK(f, exit(-1));
+    CHECK(fwrite(words, 1, size, f) == size, exit(-1));
+    fclose(f);
+    char command[1024];
+    snprintf(command, sizeof(command), "\"%s\" --target-env vulkan1.3 %s", validator, path);
+    CHECK(system(command) == 0, exit(-1));
+}
+
+int main(int argc, char** argv) {
+    Assembler a;
+    assemble_module(&a);
+    size_t size = a.count * sizeof(uint32_t);
+    size_t new_size = spvo_compact_module((SpvoConfig) { 0 }, "test", size, a.words);
+    CHECK(new_size < size, exit(-1));
+    check_compacted(a.words, new_size / sizeof(uint32_t));
+
+    // there is nothing left to do the second time around
+    uint32_t bound = a.words[3];
+    CHECK(spvo_compact_module((SpvoConfig) { 0 }, "test", new_size, a.words) == new_size, exit(-1));
+    CHECK(a.words[3] == bound, exit(-1));
+
+    // optional path to spirv-val
+    if (argc > 1)
+        validate(argv[1], a.words, new_size);
+
+    size_t stripped_size = spvo_compact_module((SpvoConfig) { .strip_debug_info = true }, "test", new_size, a.words);
+    CHECK(stripped_size < new_size, exit(-1));
+    CHECK(count_ops(a.words, stripped_size / sizeof(uint32_t), SpvOpName) == 0, exit(-1));
+    return 0;
+}
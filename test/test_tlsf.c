@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "log.h"
+#include "tlsf.h"
+#include "portability.h"
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+#define MiB (1024 * 1024)
+#define POOL_SIZE (64 * MiB)
+#define SLOTS 4096
+#define ITERATIONS 1000000
+
+typedef struct {
+    TlsfRange* range;
+    size_t offset;
+    size_t size;
+} Allocation;
+
+/// Which allocation owns each granule of the pool, to catch overlaps
+static uint16_t* owners;
+
+static void claim(size_t offset, size_t size, uint16_t owner) {
+    for (size_t i = offset / TLSF_GRANULARITY; i < (offset + size + TLSF_GRANULARITY - 1) / TLSF_GRANULARITY; i++) {
+        CHECK(owners[i] == 0, exit(-1));
+        owners[i] = owner;
+    }
+}
+
+static void release(size_t offset, size_t size, uint16_t owner) {
+    for (size_t i = offset / TLSF_GRANULARITY; i < (offset + size + TLSF_GRANULARITY - 1) / TLSF_GRANULARITY; i++) {
+        CHECK(owners[i] == owner, exit(-1));
+        owners[i] = 0;
+    }
+}
+
+/// Mostly small buffers, some big ones, like the runtime sees
+static size_t random_size(void) {
+    switch (rand() % 8) {
+        case 0: return (size_t) (rand() % 1024) * 1024 + 1;
+        case 1: return (size_t) (rand() % 64) * 1024;
+        default: return (size_t) (rand() % 4096) + 1;
+    }
+}
+
+static void test_exhaustion(void) {
+    Tlsf* tlsf = new_tlsf(1 * MiB);
+    size_t offset;
+    TlsfRange* ranges[256];
+    for (size_t i = 0; i < 256; i++) {
+        ranges[i] = tlsf_alloc(tlsf, 4096, 4096, &offset);
+        CHECK(ranges[i] && offset == i * 4096, exit(-1));
+    }
+    CHECK(!tlsf_alloc(tlsf, 1, 1, &offset), exit(-1));
+    // freeing every other range leaves 4K holes: a 8K allocation can't fit until neighbours merge
+    for (size_t i = 0; i < 256; i += 2)
+        tlsf_free(tlsf, ranges[i]);
+    CHECK(!tlsf_alloc(tlsf, 8192, 16, &offset), exit(-1));
+    CHECK(get_tlsf_stats(tlsf).free_ranges == 128, exit(-1));
+    tlsf_free(tlsf, ranges[1]);
+    TlsfRange* merged = tlsf_alloc(tlsf, 3 * 4096, 16, &offset);
+    CHECK(merged && offset == 0, exit(-1));
+    tlsf_free(tlsf, merged);
+    for (size_t i = 3; i < 256; i += 2)
+        tlsf_free(tlsf, ranges[i]);
+    TlsfStats stats = get_tlsf_stats(tlsf);
+    CHECK(tlsf_is_empty(tlsf) && stats.free_ranges == 1 && stats.largest_free_range == 1 * MiB, exit(-1));
+    destroy_tlsf(tlsf);
+}
+
+int main(int argc, char** argv) {
+    set_log_level(INFO);
+    srand(42);
+    test_exhaustion();
+
+    owners = calloc(POOL_SIZE / TLSF_GRANULARITY, sizeof(uint16_t));
+    Allocation* slots = calloc(SLOTS, sizeof(Allocation));
+    Tlsf* tlsf = new_tlsf(POOL_SIZE);
+
+    size_t failures = 0;
+    // only the allocator is timed, not the overlap checks
+    uint64_t elapsed_ns = 0;
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        size_t slot = (size_t) rand() % SLOTS;
+        Allocation* a = &slots[slot];
+        if (a->range) {
+            release(a->offset, a->size, (uint16_t) (slot + 1));
+            uint64_t start = get_time_nano();
+            tlsf_free(tlsf, a->range);
+            elapsed_ns += get_time_nano() - start;
+            a->range = NULL;
+            continue;
+        }
+        a->size = random_size();
+        size_t alignment = (size_t) 1 << (rand() % 9);
+        uint64_t start = get_time_nano();
+        a->range = tlsf_alloc(tlsf, a->size, alignment, &a->offset);
+        elapsed_ns += get_time_nano() - start;
+        if (!a->range) {
+            failures++;
+            continue;
+        }
+        CHECK(a->offset % alignment == 0 && a->offset + a->size <= POOL_SIZE, exit(-1));
+        claim(a->offset, a->size, (uint16_t) (slot + 1));
+    }
+    double elapsed = (double) elapsed_ns / 1000000.0;
+
+    TlsfStats stats = get_tlsf_stats(tlsf);
+    size_t free_bytes = stats.size - stats.used;
+    info_print("%d random allocations and frees in %.1f ms (%zu did not fit), %zu live allocations using %zu KiB, %zu free ranges, %.1f%% fragmentation\n", ITERATIONS, elapsed, failures, stats.allocations, stats.used / 1024, stats.free_ranges, free_bytes ? 100.0 * (1.0 - (double) stats.largest_free_range / (double) free_bytes) : 0.0);
+
+    // once everything is freed, it all merges back into one range
+    for (size_t slot = 0; slot < SLOTS; slot++) {
+        if (slots[slot].range) {
+            release(slots[slot].offset, slots[slot].size, (uint16_t) (slot + 1));
+            tlsf_free(tlsf, slots[slot].range);
+        }
+    }
+    stats = get_tlsf_stats(tlsf);
+    CHECK(tlsf_is_empty(tlsf) && stats.used == 0 && stats.free_ranges == 1 && stats.largest_free_range == POOL_SIZE, exit(-1));
+
+    destroy_tlsf(tlsf);
+    free(slots);
+    free(owners);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "shady/ir.h"
+#include "analysis/uses.h"
+
+#include "log.h"
+
+#define CHECK(x, failure_handler) { if (!(x)) { error_print(#x " failed\n"); failure_handler; } }
+
+static double elapsed_ms(clock_t start) {
+    return (double) (clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+#define FAN_OUT 50000
+
+/// A function returning lots of values, every single one of which uses the same parameter
+static const Node* make_high_fan_out_function(IrArena* a, Module* m, const Node** shared) {
+    const Node* param = var(a, int32_type(a), "shared");
+    *shared = param;
+    NodesBuilder results = begin_nodes(a);
+    for (size_t i = 0; i < FAN_OUT; i++)
+        push_node(&results, prim_op_helper(a, add_op, empty(a), mk_nodes(a, param, int32_literal(a, (int32_t) i))));
+    Node* fn = function(m, singleton(param), "fan_out", empty(a), empty(a));
+    fn->payload.fun.body = fn_ret(a, (Return) { .args = finish_nodes(&results) });
+    return fn;
+}
+
+static size_t count_uses(const UsesMap* map, const Node* n) {
+    size_t count = 0;
+    for (const Use* use = get_first_use(map, n); use; use = use->next_use)
+        count++;
+    return count;
+}
+
+int main(int argc, char** argv) {
+    set_log_level(INFO);
+    ArenaConfig aconfig = default_arena_config();
+    aconfig.check_types = false;
+    aconfig.allow_fold = false;
+    IrArena* a = new_ir_arena(aconfig);
+    Module* m = new_module(a, "test_uses");
+    const Node* shared;
+    const Node* fn = make_high_fan_out_function(a, m, &shared);
+
+    clock_t start = clock();
+    const UsesMap* compact = create_uses_map(fn, NcType | NcDeclaration);
+    double compact_time = elapsed_ms(start);
+
+    start = clock();
+    const UsesMap* linked = create_uses_map_with_layout(fn, NcType | NcDeclaration, UsesMapLinked);
+    double linked_time = elapsed_ms(start);
+
+    // FAN_OUT prim ops, plus the function's params
+    CHECK(count_uses(compact, shared) == FAN_OUT + 1, exit(-1));
+    CHECK(count_uses(linked, shared) == FAN_OUT + 1, exit(-1));
+
+    size_t count;
+    const Use* uses = get_uses(compact, shared, &count);
+    CHECK(count == FAN_OUT + 1, exit(-1));
+    // both layouts find the uses in the same order
+    const Use* linked_use = get_first_use(linked, shared);
+    for (size_t i = 0; i < count; i++, linked_use = linked_use->next_use) {
+        CHECK(uses[i].user == linked_use->user, exit(-1));
+        CHECK(uses[i].operand_name == linked_use->operand_name, exit(-1));
+    }
+
+    CHECK(!get_first_use(compact, fn) && !get_first_use(linked, fn), exit(-1));
+    CHECK(!get_uses(compact, fn, &count) && count == 0, exit(-1));
+
+    info_print("uses map with %d uses of one value: compact %.2f ms, linked %.2f ms\n", FAN_OUT, compact_time, linked_time);
+
+    destroy_uses_map(compact);
+    destroy_uses_map(linked);
+    destroy_ir_arena(a);
+    return 0;
+}